@@ -0,0 +1,645 @@
+// Arbitrary-precision integers.
+//
+// A bignum's magnitude is an array of 64-bit limbs, least significant first,
+// and the arithmetic below works on those arrays, using unsigned __int128 for
+// the double-width products and quotients. Multiplication is schoolbook for
+// short operands and Karatsuba's for long ones. Division by one limb is a
+// single pass; longer divisors use Knuth's algorithm D. Printing divides by
+// 10^19, the largest power of ten that fits in a limb, with a precomputed
+// reciprocal instead of a hardware division.
+//
+// Integers are turned into bignums only when they don't fit in a long, and
+// back as soon as they do, so the arithmetic primitives only come here after
+// an overflow or for an argument that is already big.
+
+#include "bignum.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "talloc.h"
+
+typedef unsigned __int128 uint128;
+
+// Operands at least this many limbs long are multiplied with Karatsuba
+#define KARATSUBA_THRESHOLD 32
+
+// The largest power of ten that fits in a limb, and its number of zeros
+#define DECIMAL_CHUNK 10000000000000000000ull
+#define DECIMAL_CHUNK_DIGITS 19
+
+//==================
+// Limb arrays
+//==================
+
+uint64_t *allocateLimbs(int length) {
+    uint64_t *limbs = talloc(sizeof(uint64_t) * (length > 0 ? length : 1));
+    memset(limbs, 0, sizeof(uint64_t) * (length > 0 ? length : 1));
+    return limbs;
+}
+
+// Returns length, less the leading zero limbs.
+int trimLimbs(const uint64_t *a, int length) {
+    while (length > 0 && a[length - 1] == 0) {
+        length--;
+    }
+    return length;
+}
+
+// Compares two trimmed magnitudes.
+int compareLimbs(const uint64_t *a, int n, const uint64_t *b, int m) {
+    if (n != m) {
+        return n < m ? -1 : 1;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// r[0, n) = a + b, where n >= m. Returns the carry out. r may be a.
+uint64_t addLimbs(uint64_t *r, const uint64_t *a, int n, const uint64_t *b,
+                  int m) {
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++) {
+        uint128 sum = (uint128) a[i] + (i < m ? b[i] : 0) + carry;
+        r[i] = (uint64_t) sum;
+        carry = (uint64_t) (sum >> 64);
+    }
+    return carry;
+}
+
+// r[0, n) = a - b, where a >= b and n >= m. r may be a.
+void subtractLimbs(uint64_t *r, const uint64_t *a, int n, const uint64_t *b,
+                   int m) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t subtrahend = i < m ? b[i] : 0;
+        uint64_t difference = a[i] - subtrahend - borrow;
+        borrow = a[i] < subtrahend || a[i] - subtrahend < borrow;
+        r[i] = difference;
+    }
+}
+
+// r[0, n) += a[0, m), where m <= n and the sum fits.
+void addInto(uint64_t *r, int n, const uint64_t *a, int m) {
+    uint64_t carry = addLimbs(r, r, m, a, m);
+    for (int i = m; carry != 0 && i < n; i++) {
+        carry = ++r[i] == 0;
+    }
+}
+
+// r[0, n) -= a[0, m), where m <= n and the difference isn't negative.
+void subtractFrom(uint64_t *r, int n, const uint64_t *a, int m) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < n && (i < m || borrow != 0); i++) {
+        uint64_t subtrahend = i < m ? a[i] : 0;
+        uint64_t difference = r[i] - subtrahend - borrow;
+        borrow = r[i] < subtrahend || r[i] - subtrahend < borrow;
+        r[i] = difference;
+    }
+}
+
+// Multiplies a[0, n) in place by factor and adds addend. Returns the limb
+// carried out of the top.
+uint64_t multiplyAddSmall(uint64_t *a, int n, uint64_t factor,
+                          uint64_t addend) {
+    uint64_t carry = addend;
+    for (int i = 0; i < n; i++) {
+        uint128 product = (uint128) a[i] * factor + carry;
+        a[i] = (uint64_t) product;
+        carry = (uint64_t) (product >> 64);
+    }
+    return carry;
+}
+
+// q[0, n) = a / d, for one limb d. Returns the remainder. q may be a.
+uint64_t divideSmall(uint64_t *q, const uint64_t *a, int n, uint64_t d) {
+    uint64_t remainder = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        uint128 dividend = ((uint128) remainder << 64) | a[i];
+        q[i] = (uint64_t) (dividend / d);
+        remainder = (uint64_t) (dividend % d);
+    }
+    return remainder;
+}
+
+//==================
+// Multiplication
+//==================
+
+void schoolbookMultiply(uint64_t *r, const uint64_t *a, int n,
+                        const uint64_t *b, int m) {
+    memset(r, 0, sizeof(uint64_t) * (n + m));
+    for (int j = 0; j < m; j++) {
+        uint64_t carry = 0;
+        for (int i = 0; i < n; i++) {
+            uint128 product = (uint128) a[i] * b[j] + r[i + j] + carry;
+            r[i + j] = (uint64_t) product;
+            carry = (uint64_t) (product >> 64);
+        }
+        r[n + j] = carry;
+    }
+}
+
+// How much scratch space multiplyLimbs needs for operands of n and m limbs
+int multiplyScratchSize(int n, int m) {
+    return 4 * (n + m) + 512;
+}
+
+/* r[0, n + m) = a * b. r mustn't overlap either operand. scratch has room
+ * for multiplyScratchSize(n, m) limbs, or is NULL if both are shorter than
+ * KARATSUBA_THRESHOLD.
+ *
+ * Karatsuba splits each operand at h limbs, a = a1 B^h + a0 and likewise b,
+ * and gets by with three half-size products instead of four:
+ *     a b = a1 b1 B^2h + ((a0 + a1)(b0 + b1) - a0 b0 - a1 b1) B^h + a0 b0
+ * An operand at least twice as long as the other is multiplied a piece at a
+ * time instead, so the split always leaves both halves non-empty.
+ */
+void multiplyLimbs(uint64_t *r, const uint64_t *a, int n, const uint64_t *b,
+                   int m, uint64_t *scratch) {
+    if (n < m) {
+        const uint64_t *swap = a;
+        a = b;
+        b = swap;
+        int swapLength = n;
+        n = m;
+        m = swapLength;
+    }
+    if (m < KARATSUBA_THRESHOLD) {
+        schoolbookMultiply(r, a, n, b, m);
+        return;
+    }
+
+    if (n >= 2 * m) {
+        memset(r, 0, sizeof(uint64_t) * (n + m));
+        uint64_t *piece = scratch;
+        for (int start = 0; start < n; start += m) {
+            int size = n - start < m ? n - start : m;
+            multiplyLimbs(piece, a + start, size, b, m, scratch + 2 * m);
+            addInto(r + start, n + m - start, piece, size + m);
+        }
+        return;
+    }
+
+    int h = n / 2;
+    const uint64_t *a0 = a;
+    const uint64_t *a1 = a + h;
+    const uint64_t *b0 = b;
+    const uint64_t *b1 = b + h;
+    int a1Length = n - h;
+    int b1Length = m - h;
+
+    // a0 b0 and a1 b1 go straight into their places in r
+    multiplyLimbs(r, a0, h, b0, h, scratch);
+    multiplyLimbs(r + 2 * h, a1, a1Length, b1, b1Length, scratch);
+
+    // The sums are one limb longer than their longer half, for the carry
+    int aSumLength = a1Length + 1;
+    int bSumLength = (b1Length > h ? b1Length : h) + 1;
+    uint64_t *aSum = scratch;
+    uint64_t *bSum = aSum + aSumLength;
+    uint64_t *middle = bSum + bSumLength;
+    int middleLength = aSumLength + bSumLength;
+    aSum[aSumLength - 1] = addLimbs(aSum, a1, a1Length, a0, h);
+    if (b1Length >= h) {
+        bSum[bSumLength - 1] = addLimbs(bSum, b1, b1Length, b0, h);
+    } else {
+        bSum[bSumLength - 1] = addLimbs(bSum, b0, h, b1, b1Length);
+    }
+    multiplyLimbs(middle, aSum, aSumLength, bSum, bSumLength,
+                  middle + middleLength);
+    subtractFrom(middle, middleLength, r, 2 * h);
+    subtractFrom(middle, middleLength, r + 2 * h, n + m - 2 * h);
+    addInto(r + h, n + m - h, middle, trimLimbs(middle, middleLength));
+}
+
+//==================
+// Division
+//==================
+
+/* q[0, m - n] = u / v and r[0, n) = u % v, for a divisor of at least two
+ * limbs with a nonzero top limb, and m >= n.
+ *
+ * This is Knuth's algorithm D (TAOCP volume 2, 4.3.1). Both operands are
+ * shifted left until the divisor's top bit is set; then each quotient limb
+ * is estimated from the top two limbs of what is left of the dividend, and
+ * that estimate is never more than two too big, and rarely even one.
+ */
+void divideLimbs(uint64_t *q, uint64_t *r, const uint64_t *u, int m,
+                 const uint64_t *v, int n) {
+    int shift = __builtin_clzll(v[n - 1]);
+    uint64_t *vn = allocateLimbs(n);
+    uint64_t *un = allocateLimbs(m + 1);
+    for (int i = n - 1; i > 0; i--) {
+        vn[i] = (v[i] << shift) | (shift ? v[i - 1] >> (64 - shift) : 0);
+    }
+    vn[0] = v[0] << shift;
+    un[m] = shift ? u[m - 1] >> (64 - shift) : 0;
+    for (int i = m - 1; i > 0; i--) {
+        un[i] = (u[i] << shift) | (shift ? u[i - 1] >> (64 - shift) : 0);
+    }
+    un[0] = u[0] << shift;
+
+    for (int j = m - n; j >= 0; j--) {
+        uint128 top = ((uint128) un[j + n] << 64) | un[j + n - 1];
+        uint128 qhat = top / vn[n - 1];
+        uint128 rhat = top % vn[n - 1];
+        while ((qhat >> 64) != 0
+               || qhat * vn[n - 2] > ((rhat << 64) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if ((rhat >> 64) != 0) {
+                break;
+            }
+        }
+
+        // Subtract qhat times the divisor from this part of the dividend
+        uint64_t carry = 0;
+        uint64_t borrow = 0;
+        for (int i = 0; i < n; i++) {
+            uint128 product = (uint128) (uint64_t) qhat * vn[i] + carry;
+            carry = (uint64_t) (product >> 64);
+            uint64_t low = (uint64_t) product;
+            uint64_t difference = un[i + j] - low - borrow;
+            borrow = un[i + j] < low || un[i + j] - low < borrow;
+            un[i + j] = difference;
+        }
+        uint64_t top64 = un[j + n];
+        un[j + n] = top64 - carry - borrow;
+        bool negative = top64 < carry || top64 - carry < borrow;
+
+        q[j] = (uint64_t) qhat;
+        if (negative) {
+            // qhat was one too big: add the divisor back
+            q[j]--;
+            uint64_t addCarry = addLimbs(un + j, un + j, n, vn, n);
+            un[j + n] += addCarry;
+        }
+    }
+
+    for (int i = 0; i < n - 1; i++) {
+        r[i] = (un[i] >> shift) | (shift ? un[i + 1] << (64 - shift) : 0);
+    }
+    r[n - 1] = un[n - 1] >> shift;
+}
+
+/* Divides a[0, n) in place by 10^19 and returns the remainder.
+ *
+ * 10^19 has its top bit set, which lets this multiply by a reciprocal
+ * computed once, at compile time, instead of dividing (Moller and Granlund,
+ * "Improved division by invariant integers", 2011, algorithm 4).
+ */
+uint64_t divideByDecimalChunk(uint64_t *a, int n) {
+    const uint64_t d = DECIMAL_CHUNK;
+    const uint64_t reciprocal = (uint64_t) (~(uint128) 0 / DECIMAL_CHUNK);
+    uint64_t remainder = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        uint128 product = (uint128) reciprocal * remainder
+                          + (((uint128) remainder << 64) | a[i]);
+        uint64_t quotient = (uint64_t) (product >> 64) + 1;
+        uint64_t next = a[i] - quotient * d;
+        if (next > (uint64_t) product) {
+            quotient--;
+            next += d;
+        }
+        if (next >= d) {
+            quotient++;
+            next -= d;
+        }
+        a[i] = quotient;
+        remainder = next;
+    }
+    return remainder;
+}
+
+//==================
+// Values
+//==================
+
+bool isExactInteger(Value *value) {
+    return isInteger(value) || isBignum(value);
+}
+
+// Makes an integer from a magnitude, which it takes over, and a sign.
+Value *makeInteger(uint64_t *limbs, int length, bool negative) {
+    length = trimLimbs(limbs, length);
+    if (length == 0) {
+        return makeInt(0);
+    } else if (length == 1) {
+        if (!negative && limbs[0] <= LONG_MAX) {
+            return makeInt((long) limbs[0]);
+        } else if (negative && limbs[0] <= (uint64_t) LONG_MAX + 1) {
+            return makeInt((long) (0 - limbs[0]));
+        }
+    }
+    Value *result = makeValue(BIGNUM_TYPE);
+    result->big.limbs = limbs;
+    result->big.length = length;
+    result->big.negative = negative;
+    return result;
+}
+
+// An integer's magnitude and sign. An INT_TYPE Value's magnitude is stored
+// in the limb small, which must outlive the result.
+typedef struct Magnitude {
+    const uint64_t *limbs;
+    int length;
+    bool negative;
+} Magnitude;
+
+Magnitude magnitudeOf(Value *value, uint64_t *small) {
+    Magnitude magnitude;
+    if (isBignum(value)) {
+        magnitude.limbs = value->big.limbs;
+        magnitude.length = value->big.length;
+        magnitude.negative = value->big.negative;
+    } else {
+        // 0 - i is right for LONG_MIN too, in unsigned arithmetic
+        *small = value->i < 0 ? 0 - (uint64_t) value->i : (uint64_t) value->i;
+        magnitude.limbs = small;
+        magnitude.length = *small != 0;
+        magnitude.negative = value->i < 0;
+    }
+    return magnitude;
+}
+
+// Adds two signed magnitudes.
+Value *addMagnitudes(Magnitude a, Magnitude b) {
+    if (a.length < b.length) {
+        Magnitude swap = a;
+        a = b;
+        b = swap;
+    }
+    if (a.negative == b.negative) {
+        uint64_t *sum = allocateLimbs(a.length + 1);
+        sum[a.length] = addLimbs(sum, a.limbs, a.length, b.limbs, b.length);
+        return makeInteger(sum, a.length + 1, a.negative);
+    }
+
+    // Opposite signs: take the smaller magnitude from the bigger
+    int comparison = compareLimbs(a.limbs, a.length, b.limbs, b.length);
+    if (comparison < 0) {
+        Magnitude swap = a;
+        a = b;
+        b = swap;
+    }
+    uint64_t *difference = allocateLimbs(a.length);
+    subtractLimbs(difference, a.limbs, a.length, b.limbs, b.length);
+    return makeInteger(difference, a.length, a.negative);
+}
+
+Value *addIntegers(Value *a, Value *b) {
+    long sum;
+    if (isInteger(a) && isInteger(b)
+        && !__builtin_add_overflow(a->i, b->i, &sum)) {
+        return makeInt(sum);
+    } else if (isInteger(b) && b->i == 0) {
+        return a;
+    } else if (isInteger(a) && a->i == 0) {
+        // The primitives start their sums at 0
+        return b;
+    }
+    uint64_t aSmall, bSmall;
+    return addMagnitudes(magnitudeOf(a, &aSmall), magnitudeOf(b, &bSmall));
+}
+
+Value *subtractIntegers(Value *a, Value *b) {
+    long difference;
+    if (isInteger(a) && isInteger(b)
+        && !__builtin_sub_overflow(a->i, b->i, &difference)) {
+        return makeInt(difference);
+    } else if (isInteger(b) && b->i == 0) {
+        return a;
+    }
+    uint64_t aSmall, bSmall;
+    Magnitude negated = magnitudeOf(b, &bSmall);
+    negated.negative = !negated.negative;
+    return addMagnitudes(magnitudeOf(a, &aSmall), negated);
+}
+
+Value *multiplyIntegers(Value *a, Value *b) {
+    long product;
+    if (isInteger(a) && isInteger(b)
+        && !__builtin_mul_overflow(a->i, b->i, &product)) {
+        return makeInt(product);
+    } else if (isInteger(b) && b->i == 1) {
+        return a;
+    } else if (isInteger(a) && a->i == 1) {
+        // The primitives start their products at 1
+        return b;
+    }
+    uint64_t aSmall, bSmall;
+    Magnitude x = magnitudeOf(a, &aSmall);
+    Magnitude y = magnitudeOf(b, &bSmall);
+    if (x.length == 0 || y.length == 0) {
+        return makeInt(0);
+    }
+
+    int length = x.length + y.length;
+    uint64_t *result = allocateLimbs(length);
+    if (y.length == 1 || x.length == 1) {
+        // The usual case: a bignum times a fixnum, as in a factorial
+        const uint64_t *big = y.length == 1 ? x.limbs : y.limbs;
+        int bigLength = y.length == 1 ? x.length : y.length;
+        memcpy(result, big, sizeof(uint64_t) * bigLength);
+        uint64_t factor = y.length == 1 ? y.limbs[0] : x.limbs[0];
+        result[bigLength] = multiplyAddSmall(result, bigLength, factor, 0);
+    } else {
+        uint64_t *scratch = NULL;
+        if (x.length >= KARATSUBA_THRESHOLD && y.length >= KARATSUBA_THRESHOLD) {
+            scratch = allocateLimbs(multiplyScratchSize(x.length, y.length));
+        }
+        multiplyLimbs(result, x.limbs, x.length, y.limbs, y.length, scratch);
+    }
+    return makeInteger(result, length, x.negative != y.negative);
+}
+
+void divideIntegers(Value *a, Value *b, Value **quotient, Value **remainder) {
+    if (isInteger(a) && isInteger(b)) {
+        if (b->i == -1) {
+            // LONG_MIN / -1 overflows, and would trap
+            *quotient = subtractIntegers(makeInt(0), a);
+            *remainder = makeInt(0);
+        } else {
+            *quotient = makeInt(a->i / b->i);
+            *remainder = makeInt(a->i % b->i);
+        }
+        return;
+    }
+
+    uint64_t aSmall, bSmall;
+    Magnitude x = magnitudeOf(a, &aSmall);
+    Magnitude y = magnitudeOf(b, &bSmall);
+    if (compareLimbs(x.limbs, x.length, y.limbs, y.length) < 0) {
+        *quotient = makeInt(0);
+        *remainder = a;
+        return;
+    }
+
+    uint64_t *q = allocateLimbs(x.length - y.length + 1);
+    uint64_t *r = allocateLimbs(y.length);
+    if (y.length == 1) {
+        r[0] = divideSmall(q, x.limbs, x.length, y.limbs[0]);
+    } else {
+        divideLimbs(q, r, x.limbs, x.length, y.limbs, y.length);
+    }
+    *quotient = makeInteger(q, x.length - y.length + 1,
+                            x.negative != y.negative);
+    *remainder = makeInteger(r, y.length, x.negative);
+}
+
+// Returns the number of bits in an integer's magnitude.
+int bitLength(Value *value) {
+    uint64_t small;
+    Magnitude magnitude = magnitudeOf(value, &small);
+    if (magnitude.length == 0) {
+        return 0;
+    }
+    uint64_t top = magnitude.limbs[magnitude.length - 1];
+    return 64 * magnitude.length - __builtin_clzll(top);
+}
+
+Value *powerOfTwo(int exponent) {
+    uint64_t *limbs = allocateLimbs(exponent / 64 + 1);
+    limbs[exponent / 64] = (uint64_t) 1 << (exponent % 64);
+    return makeInteger(limbs, exponent / 64 + 1, false);
+}
+
+/* Scales a or b by a power of two so that the quotient has 56 or 57 bits,
+ * which fits in a long and is more than a double holds. A nonzero remainder
+ * is folded into its lowest bit, so converting it rounds the way the exact
+ * quotient would, and the scale is taken back out of the double.
+ */
+double divideIntegersToDouble(Value *a, Value *b) {
+    int shift = 56 + bitLength(b) - bitLength(a);
+    if (shift > 0) {
+        a = multiplyIntegers(a, powerOfTwo(shift));
+    } else if (shift < 0) {
+        b = multiplyIntegers(b, powerOfTwo(-shift));
+    }
+    Value *quotient;
+    Value *remainder;
+    divideIntegers(a, b, &quotient, &remainder);
+    long magnitude = labs(quotient->i);
+    if (!isInteger(remainder) || remainder->i != 0) {
+        magnitude |= 1;
+    }
+    double result = ldexp((double) magnitude, -shift);
+    return quotient->i < 0 ? -result : result;
+}
+
+int compareIntegers(Value *a, Value *b) {
+    if (isInteger(a) && isInteger(b)) {
+        return (a->i > b->i) - (a->i < b->i);
+    }
+    uint64_t aSmall, bSmall;
+    Magnitude x = magnitudeOf(a, &aSmall);
+    Magnitude y = magnitudeOf(b, &bSmall);
+    if (x.negative != y.negative) {
+        return x.negative ? -1 : 1;
+    }
+    int comparison = compareLimbs(x.limbs, x.length, y.limbs, y.length);
+    return x.negative ? -comparison : comparison;
+}
+
+double integerToDouble(Value *value) {
+    if (isInteger(value)) {
+        return value->i;
+    }
+    // The top three limbs hold far more bits than a double, so what rounding
+    // there is in adding them up doesn't show
+    int length = value->big.length;
+    int low = length > 3 ? length - 3 : 0;
+    double result = 0;
+    for (int i = length - 1; i >= low; i--) {
+        result = result * 18446744073709551616.0 + value->big.limbs[i];
+    }
+    result = ldexp(result, 64 * low);
+    return value->big.negative ? -result : result;
+}
+
+//==================
+// Decimal
+//==================
+
+Value *parseInteger(char *text) {
+    bool negative = *text == '-';
+    if (*text == '-' || *text == '+') {
+        text++;
+    }
+    int digits = strlen(text);
+
+    // Each chunk of 19 digits multiplies what's read so far by 10^19; the
+    // first chunk takes whatever is left over
+    uint64_t *limbs = allocateLimbs(digits / DECIMAL_CHUNK_DIGITS + 2);
+    int length = 0;
+    int chunkDigits = digits % DECIMAL_CHUNK_DIGITS;
+    if (chunkDigits == 0) {
+        chunkDigits = DECIMAL_CHUNK_DIGITS;
+    }
+    uint64_t scale = 1;
+    for (int i = 0; i < chunkDigits; i++) {
+        scale *= 10;
+    }
+    while (*text != '\0') {
+        uint64_t chunk = 0;
+        for (int i = 0; i < chunkDigits; i++) {
+            chunk = chunk * 10 + (*text++ - '0');
+        }
+        uint64_t carry = multiplyAddSmall(limbs, length, scale, chunk);
+        if (carry != 0) {
+            limbs[length++] = carry;
+        }
+        chunkDigits = DECIMAL_CHUNK_DIGITS;
+        scale = DECIMAL_CHUNK;
+    }
+    return makeInteger(limbs, length, negative);
+}
+
+char *integerToString(Value *value) {
+    uint64_t small;
+    Magnitude magnitude = magnitudeOf(value, &small);
+
+    // Peel off 19 digits at a time, least significant first
+    int length = magnitude.length;
+    uint64_t *limbs = allocateLimbs(length);
+    memcpy(limbs, magnitude.limbs, sizeof(uint64_t) * length);
+    uint64_t *chunks = allocateLimbs(2 * length + 1);
+    int numChunks = 0;
+    while (length > 0) {
+        chunks[numChunks++] = divideByDecimalChunk(limbs, length);
+        length = trimLimbs(limbs, length);
+    }
+    if (numChunks == 0) {
+        chunks[numChunks++] = 0;
+    }
+
+    char *text = talloc(numChunks * DECIMAL_CHUNK_DIGITS + 2);
+    char *end = text;
+    if (magnitude.negative) {
+        *end++ = '-';
+    }
+    for (int i = numChunks - 1; i >= 0; i--) {
+        char digits[DECIMAL_CHUNK_DIGITS];
+        uint64_t chunk = chunks[i];
+        for (int j = DECIMAL_CHUNK_DIGITS - 1; j >= 0; j--) {
+            digits[j] = '0' + chunk % 10;
+            chunk /= 10;
+        }
+        // The most significant chunk has no leading zeros
+        int start = 0;
+        if (i == numChunks - 1) {
+            while (start < DECIMAL_CHUNK_DIGITS - 1 && digits[start] == '0') {
+                start++;
+            }
+        }
+        memcpy(end, digits + start, DECIMAL_CHUNK_DIGITS - start);
+        end += DECIMAL_CHUNK_DIGITS - start;
+    }
+    *end = '\0';
+    return text;
+}
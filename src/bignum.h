@@ -0,0 +1,39 @@
+#ifndef _BIGNUM
+#define _BIGNUM
+
+#include <stdbool.h>
+#include "value.h"
+
+// Integers too big for a long are BIGNUM_TYPE Values. The functions here
+// take integers of either type, and give back an INT_TYPE Value whenever the
+// result fits in a long, so each integer has only one representation.
+
+// Checks that the value is an integer, of either type.
+bool isExactInteger(Value *value);
+
+Value *addIntegers(Value *a, Value *b);
+Value *subtractIntegers(Value *a, Value *b);
+Value *multiplyIntegers(Value *a, Value *b);
+
+// Divides a by b, which must not be zero, rounding toward zero. The
+// remainder has the sign of a, like C's %.
+void divideIntegers(Value *a, Value *b, Value **quotient, Value **remainder);
+
+// Returns a negative number, zero, or a positive number as a is less than,
+// equal to, or greater than b.
+int compareIntegers(Value *a, Value *b);
+
+// Returns the double nearest to an integer, or infinity if it is too big.
+double integerToDouble(Value *value);
+
+// Returns the double nearest to a / b, even when a and b are too big to be
+// doubles themselves. b must not be zero.
+double divideIntegersToDouble(Value *a, Value *b);
+
+// Reads a decimal integer, with an optional sign, of any size.
+Value *parseInteger(char *text);
+
+// Returns an integer's decimal digits, after a minus sign if it's negative.
+char *integerToString(Value *value);
+
+#endif
@@ -0,0 +1,599 @@
+// Bytecode compiler.
+//
+// Compiles parse trees to the instructions in bytecode.h. Syntax is checked
+// once, here, with the same checks and error messages as eval(). Variables are
+// resolved at compile time: local variables become (depth, slot) operands and
+// everything else is a global, looked up by name the first time it is used.
+//
+// Every lambda gets one frame at run time. The variables of lets inside it get
+// their own slots in that frame, so only a lambda adds a level of depth. This
+// works because there are no loops inside a single call: each let is
+// evaluated at most once per frame.
+
+#include "bytecode.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <assert.h>
+#include "linkedlist.h"
+#include "parser.h"
+#include "talloc.h"
+
+#define INITIAL_CODE_CAPACITY 32
+#define INITIAL_CONSTANT_CAPACITY 8
+
+// The state of the compiler for one CodeObject.
+typedef struct Compiler {
+    CodeObject *codeObject;
+    int codeCapacity;
+    int constantCapacity;
+    int stackDepth;
+    Value *uninitialized;
+} Compiler;
+
+/* A group of variables that are visible to some code: the parameters of a
+ * lambda, or the bindings of a let.
+ *
+ * names: binds each name to an INT_TYPE slot number. Being a Frame lets the
+ *        duplicate checks of checkBinding work on it directly.
+ * compiler: the compiler of the function whose frame holds the slots.
+ * letrec: whether these are a letrec's bindings, which have to be checked
+ *         when they're read, since they may not have values yet.
+ */
+typedef struct Scope {
+    Frame *names;
+    Compiler *compiler;
+    bool letrec;
+    struct Scope *parent;
+} Scope;
+
+void compileExpr(Compiler *compiler, Value *tree, Scope *scope, bool tail);
+void compileLambda(Compiler *compiler, Value *argsTree, Scope *scope);
+
+// Copies an array into a new talloc'd one with room for newCapacity elements.
+void *growArray(void *array, int count, int newCapacity, size_t size) {
+    void *newArray = talloc(newCapacity * size);
+    memcpy(newArray, array, count * size);
+    return newArray;
+}
+
+Compiler *makeCompiler() {
+    Compiler *compiler = talloc(sizeof(Compiler));
+    compiler->codeCapacity = INITIAL_CODE_CAPACITY;
+    compiler->constantCapacity = INITIAL_CONSTANT_CAPACITY;
+    compiler->stackDepth = 0;
+    compiler->uninitialized = makeValue(UNINITIALIZED);
+
+    CodeObject *codeObject = talloc(sizeof(CodeObject));
+    codeObject->code = talloc(compiler->codeCapacity * sizeof(int));
+    codeObject->length = 0;
+    codeObject->constants = talloc(compiler->constantCapacity * sizeof(Value *));
+    codeObject->globalCells = NULL;
+    codeObject->numConstants = 0;
+    codeObject->numSlots = 0;
+    codeObject->maxStack = 0;
+    codeObject->numParams = 0;
+    compiler->codeObject = codeObject;
+    return compiler;
+}
+
+// Finishes compilation, returning the compiled code.
+CodeObject *finishCompiler(Compiler *compiler) {
+    CodeObject *codeObject = compiler->codeObject;
+    codeObject->globalCells = talloc((codeObject->numConstants + 1) * sizeof(Value *));
+    for (int i = 0; i < codeObject->numConstants; i++) {
+        codeObject->globalCells[i] = NULL;
+    }
+    return codeObject;
+}
+
+Scope *makeScope(Scope *parent, Compiler *compiler) {
+    Scope *scope = talloc(sizeof(Scope));
+    scope->names = makeFrame(NULL);
+    scope->compiler = compiler;
+    scope->letrec = false;
+    scope->parent = parent;
+    return scope;
+}
+
+// Appends one word (an opcode or an operand) to the code.
+void emit(Compiler *compiler, int word) {
+    CodeObject *codeObject = compiler->codeObject;
+    if (codeObject->length == compiler->codeCapacity) {
+        compiler->codeCapacity *= 2;
+        codeObject->code = growArray(codeObject->code, codeObject->length,
+                                     compiler->codeCapacity, sizeof(int));
+    }
+    codeObject->code[codeObject->length] = word;
+    codeObject->length++;
+}
+
+// Appends an opcode, keeping track of how deep the stack gets.
+// stackEffect: how many values the instruction pushes, minus how many it pops.
+void emitOp(Compiler *compiler, opcode op, int stackEffect) {
+    emit(compiler, op);
+    compiler->stackDepth += stackEffect;
+    if (compiler->stackDepth > compiler->codeObject->maxStack) {
+        compiler->codeObject->maxStack = compiler->stackDepth;
+    }
+}
+
+// Emits a jump with a placeholder target. Returns where to patch the target.
+int emitJump(Compiler *compiler, opcode op, int stackEffect) {
+    emitOp(compiler, op, stackEffect);
+    emit(compiler, -1);
+    return compiler->codeObject->length - 1;
+}
+
+// Points the jump at operandIndex to the next instruction to be emitted.
+void patchJump(Compiler *compiler, int operandIndex) {
+    compiler->codeObject->code[operandIndex] = compiler->codeObject->length;
+}
+
+// Adds a value to the constant pool and returns its index. Symbols are only
+// added once, so that each global has one cache cell per CodeObject.
+int addConstant(Compiler *compiler, Value *value) {
+    CodeObject *codeObject = compiler->codeObject;
+    if (isSymbol(value)) {
+        for (int i = 0; i < codeObject->numConstants; i++) {
+            Value *constant = codeObject->constants[i];
+            if (isSymbol(constant) && !strcmp(constant->s, value->s)) {
+                return i;
+            }
+        }
+    }
+
+    if (codeObject->numConstants == compiler->constantCapacity) {
+        compiler->constantCapacity *= 2;
+        codeObject->constants = growArray(codeObject->constants,
+                                          codeObject->numConstants,
+                                          compiler->constantCapacity,
+                                          sizeof(Value *));
+    }
+    codeObject->constants[codeObject->numConstants] = value;
+    codeObject->numConstants++;
+    return codeObject->numConstants - 1;
+}
+
+// Gives a name a new slot in the frame of the function that scope is part of.
+int declareVariable(Scope *scope, Value *name) {
+    int slot = scope->compiler->codeObject->numSlots;
+    scope->compiler->codeObject->numSlots++;
+    addBinding(name, makeInt(slot), scope->names);
+    return slot;
+}
+
+/* Finds the frame slot of a local variable.
+ *
+ * depth: set to how many functions out the variable's frame is.
+ * slot: set to the variable's slot in that frame.
+ * Returns the scope that binds it, or NULL if the symbol isn't local, meaning
+ * it is a global.
+ */
+Scope *resolveLocal(Scope *scope, Compiler *compiler, Value *symbol,
+                  int *depth, int *slot) {
+    *depth = 0;
+    Compiler *currentCompiler = compiler;
+    while (scope != NULL) {
+        if (scope->compiler != currentCompiler) {
+            currentCompiler = scope->compiler;
+            (*depth)++;
+        }
+        Value *binding = lookupBindingInFrame(symbol, scope->names);
+        if (binding != NULL) {
+            *slot = car(binding)->i;
+            return scope;
+        }
+        scope = scope->parent;
+    }
+    return NULL;
+}
+
+// Emits code that stores the top of the stack in the variable named symbol.
+void compileStore(Compiler *compiler, Value *symbol, Scope *scope, opcode globalOp) {
+    int depth, slot;
+    if (resolveLocal(scope, compiler, symbol, &depth, &slot)) {
+        emitOp(compiler, LOCAL_SET_OP, -1);
+        emit(compiler, depth);
+        emit(compiler, slot);
+    } else {
+        emitOp(compiler, globalOp, -1);
+        emit(compiler, addConstant(compiler, symbol));
+    }
+}
+
+void compileAtom(Compiler *compiler, Value *expr, Scope *scope) {
+    if (isSymbol(expr)) {
+        int depth, slot;
+        Scope *binder = resolveLocal(scope, compiler, expr, &depth, &slot);
+        if (binder != NULL) {
+            emitOp(compiler, LOCAL_REF_OP, 1);
+            emit(compiler, depth);
+            emit(compiler, slot);
+            if (binder->letrec) {
+                emitOp(compiler, CHECK_BOUND_OP, 0);
+                emit(compiler, addConstant(compiler, expr));
+            }
+        } else {
+            emitOp(compiler, GLOBAL_REF_OP, 1);
+            emit(compiler, addConstant(compiler, expr));
+        }
+    } else if (isNumber(expr) || isString(expr) || isBoolean(expr)
+               || isNull(expr) || isVector(expr)) {
+        emitOp(compiler, CONST_OP, 1);
+        emit(compiler, addConstant(compiler, expr));
+    } else {
+        // Let evalAtom report the error if this is ever evaluated
+        emitOp(compiler, EVAL_ATOM_OP, 1);
+        emit(compiler, addConstant(compiler, expr));
+    }
+}
+
+// Compiles a body: every expression is evaluated, and the last one's value is
+// kept. An empty body is void, like begin.
+void compileSequence(Compiler *compiler, Value *body, Scope *scope, bool tail) {
+    if (isNull(body)) {
+        emitOp(compiler, VOID_OP, 1);
+        return;
+    }
+    Value *currentExpr = body;
+    while (!isNull(currentExpr)) {
+        bool isLast = isNull(cdr(currentExpr));
+        compileExpr(compiler, currentExpr, scope, tail && isLast);
+        if (!isLast) {
+            emitOp(compiler, POP_OP, -1);
+        }
+        currentExpr = cdr(currentExpr);
+    }
+}
+
+void compileIf(Compiler *compiler, Value *argsTree, Scope *scope, bool tail) {
+    checkIfSyntax(argsTree);
+    Value *thenExpr = cdr(argsTree);
+    Value *elseExpr = cdr(thenExpr);
+
+    compileExpr(compiler, argsTree, scope, false);
+    int elseJump = emitJump(compiler, JUMP_IF_FALSE_OP, -1);
+    compileExpr(compiler, thenExpr, scope, tail);
+    int endJump = emitJump(compiler, JUMP_OP, 0);
+
+    // Only one branch runs, so the else branch starts at the same depth
+    compiler->stackDepth--;
+    patchJump(compiler, elseJump);
+    compileExpr(compiler, elseExpr, scope, tail);
+    patchJump(compiler, endJump);
+}
+
+// Compiles when (isWhen) or unless. The body runs if the condition is true
+// for when, or false for unless; otherwise the result is void.
+void compileWhen(Compiler *compiler, Value *argsTree, Scope *scope, bool tail,
+                 bool isWhen) {
+    if (isWhen) {
+        checkWhenSyntax(argsTree);
+    } else {
+        checkUnlessSyntax(argsTree);
+    }
+
+    compileExpr(compiler, argsTree, scope, false);
+    int falseJump = emitJump(compiler, JUMP_IF_FALSE_OP, -1);
+    if (isWhen) {
+        compileSequence(compiler, cdr(argsTree), scope, tail);
+    } else {
+        emitOp(compiler, VOID_OP, 1);
+    }
+    int endJump = emitJump(compiler, JUMP_OP, 0);
+
+    compiler->stackDepth--;
+    patchJump(compiler, falseJump);
+    if (isWhen) {
+        emitOp(compiler, VOID_OP, 1);
+    } else {
+        compileSequence(compiler, cdr(argsTree), scope, tail);
+    }
+    patchJump(compiler, endJump);
+}
+
+void compileCond(Compiler *compiler, Value *argsTree, Scope *scope, bool tail) {
+    checkCondSyntax(argsTree);
+
+    // Every clause jumps to the end once its body is done
+    Value *endJumps = makeNull();
+    bool hasElse = false;
+
+    Value *currentExpr = argsTree;
+    while (!isNull(currentExpr)) {
+        Value *clause = car(currentExpr);
+        if (isElseClause(clause)) {
+            // checkCondSyntax made sure this is the last clause
+            compileSequence(compiler, cdr(clause), scope, tail);
+            hasElse = true;
+            break;
+        }
+
+        compileExpr(compiler, clause, scope, false);
+        int nextJump = emitJump(compiler, JUMP_IF_FALSE_OP, -1);
+        compileSequence(compiler, cdr(clause), scope, tail);
+        int endJump = emitJump(compiler, JUMP_OP, 0);
+        endJumps = cons(makeInt(endJump), endJumps);
+
+        compiler->stackDepth--;
+        patchJump(compiler, nextJump);
+        currentExpr = cdr(currentExpr);
+    }
+
+    // Void if none of the conditions are true
+    if (!hasElse) {
+        emitOp(compiler, VOID_OP, 1);
+    }
+
+    while (!isNull(endJumps)) {
+        patchJump(compiler, car(endJumps)->i);
+        endJumps = cdr(endJumps);
+    }
+}
+
+// Compiles and (isAnd) or or. Like eval, the result is always #t or #f.
+void compileAndOr(Compiler *compiler, Value *argsTree, Scope *scope, bool isAnd) {
+    if (isNull(argsTree)) {
+        emitOp(compiler, isAnd ? TRUE_OP : FALSE_OP, 1);
+        return;
+    }
+
+    // and jumps out when it finds a false value; or jumps past each true one
+    Value *shortCircuitJumps = makeNull();
+    Value *currentExpr = argsTree;
+    while (!isNull(currentExpr)) {
+        compileExpr(compiler, currentExpr, scope, false);
+        int falseJump = emitJump(compiler, JUMP_IF_FALSE_OP, -1);
+        if (isAnd) {
+            shortCircuitJumps = cons(makeInt(falseJump), shortCircuitJumps);
+        } else {
+            int trueJump = emitJump(compiler, JUMP_OP, 0);
+            shortCircuitJumps = cons(makeInt(trueJump), shortCircuitJumps);
+            patchJump(compiler, falseJump);
+        }
+        currentExpr = cdr(currentExpr);
+    }
+
+    emitOp(compiler, isAnd ? TRUE_OP : FALSE_OP, 1);
+    int endJump = emitJump(compiler, JUMP_OP, 0);
+    compiler->stackDepth--;
+    while (!isNull(shortCircuitJumps)) {
+        patchJump(compiler, car(shortCircuitJumps)->i);
+        shortCircuitJumps = cdr(shortCircuitJumps);
+    }
+    emitOp(compiler, isAnd ? FALSE_OP : TRUE_OP, 1);
+    patchJump(compiler, endJump);
+}
+
+void compileLet(Compiler *compiler, Value *argsTree, Scope *scope, bool tail) {
+    checkLetSyntax(argsTree, "let");
+    Scope *letScope = makeScope(scope, compiler);
+
+    Value *currentBindingPair = car(argsTree);
+    while (!isNull(currentBindingPair)) {
+        checkLetBindingPair(currentBindingPair, argsTree);
+        checkBinding(car(currentBindingPair), letScope->names);
+
+        // The expression can't see any of the let's own bindings
+        compileExpr(compiler, cdr(car(currentBindingPair)), scope, false);
+        int slot = declareVariable(letScope, car(car(currentBindingPair)));
+        emitOp(compiler, LOCAL_SET_OP, -1);
+        emit(compiler, 0);
+        emit(compiler, slot);
+
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    compileSequence(compiler, cdr(argsTree), letScope, tail);
+}
+
+void compileLetStar(Compiler *compiler, Value *argsTree, Scope *scope, bool tail) {
+    checkLetSyntax(argsTree, "let*");
+    Scope *letScope = scope;
+
+    // Each binding gets its own scope, so it can see the earlier ones
+    Value *currentBindingPair = car(argsTree);
+    while (!isNull(currentBindingPair)) {
+        checkLetBindingPair(currentBindingPair, argsTree);
+        Scope *newScope = makeScope(letScope, compiler);
+        checkBinding(car(currentBindingPair), newScope->names);
+
+        compileExpr(compiler, cdr(car(currentBindingPair)), letScope, false);
+        int slot = declareVariable(newScope, car(car(currentBindingPair)));
+        emitOp(compiler, LOCAL_SET_OP, -1);
+        emit(compiler, 0);
+        emit(compiler, slot);
+
+        letScope = newScope;
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    compileSequence(compiler, cdr(argsTree), letScope, tail);
+}
+
+void compileLetRec(Compiler *compiler, Value *argsTree, Scope *scope, bool tail) {
+    checkLetSyntax(argsTree, "let");
+    Scope *letScope = makeScope(scope, compiler);
+    letScope->letrec = true;
+
+    // First pass: every name starts out uninitialized
+    Value *currentBindingPair = car(argsTree);
+    while (!isNull(currentBindingPair)) {
+        checkLetRecBindingPair(currentBindingPair, argsTree);
+        int slot = declareVariable(letScope, car(car(currentBindingPair)));
+        emitOp(compiler, CONST_OP, 1);
+        emit(compiler, addConstant(compiler, compiler->uninitialized));
+        emitOp(compiler, LOCAL_SET_OP, -1);
+        emit(compiler, 0);
+        emit(compiler, slot);
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    // Second pass: evaluate each expression where it can see all the names
+    currentBindingPair = car(argsTree);
+    while (!isNull(currentBindingPair)) {
+        compileExpr(compiler, cdr(car(currentBindingPair)), letScope, false);
+        compileStore(compiler, car(car(currentBindingPair)), letScope,
+                     GLOBAL_SET_OP);
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    compileSequence(compiler, cdr(argsTree), letScope, tail);
+}
+
+void compileDefine(Compiler *compiler, Value *argsTree, Scope *scope) {
+    Value *symbol = checkDefineSyntax(argsTree);
+    if (isCons(car(argsTree))) {
+        // Lambda shorthand syntax
+        Value *lambdaExpr = cons(cdr(car(argsTree)), cdr(argsTree));
+        compileLambda(compiler, lambdaExpr, scope);
+    } else {
+        compileExpr(compiler, cdr(argsTree), scope, false);
+    }
+
+    // Define always binds in the global frame
+    emitOp(compiler, GLOBAL_DEFINE_OP, -1);
+    emit(compiler, addConstant(compiler, symbol));
+    emitOp(compiler, VOID_OP, 1);
+}
+
+void compileSetBang(Compiler *compiler, Value *argsTree, Scope *scope) {
+    checkSetBangSyntax(argsTree);
+    compileExpr(compiler, cdr(argsTree), scope, false);
+    compileStore(compiler, car(argsTree), scope, GLOBAL_SET_OP);
+    emitOp(compiler, VOID_OP, 1);
+}
+
+// Compiles the body of a lambda to its own CodeObject, and emits code that
+// makes a closure of it.
+void compileLambda(Compiler *compiler, Value *argsTree, Scope *scope) {
+    checkLambdaSyntax(argsTree);
+
+    Compiler *functionCompiler = makeCompiler();
+    Scope *functionScope = makeScope(scope, functionCompiler);
+
+    // Parameters take the first slots, in order
+    Value *params = car(argsTree);
+    if (isSymbol(params)) {
+        functionCompiler->codeObject->numParams = -1;
+        declareVariable(functionScope, params);
+    } else {
+        Value *currentParam = params;
+        while (!isNull(currentParam)) {
+            declareVariable(functionScope, car(currentParam));
+            functionCompiler->codeObject->numParams++;
+            currentParam = cdr(currentParam);
+        }
+    }
+
+    compileSequence(functionCompiler, cdr(argsTree), functionScope, true);
+    emitOp(functionCompiler, RETURN_OP, -1);
+
+    Value *code = makeValue(PTR_TYPE);
+    code->p = finishCompiler(functionCompiler);
+    emitOp(compiler, MAKE_CLOSURE_OP, 1);
+    emit(compiler, addConstant(compiler, code));
+}
+
+void compileApplication(Compiler *compiler, Value *expr, Scope *scope, bool tail) {
+    // Evaluate the operator, then each argument, left to right
+    compileExpr(compiler, expr, scope, false);
+    int numArgs = 0;
+    Value *currentArg = cdr(expr);
+    while (!isNull(currentArg)) {
+        compileExpr(compiler, currentArg, scope, false);
+        numArgs++;
+        currentArg = cdr(currentArg);
+    }
+
+    emitOp(compiler, tail ? TAIL_CALL_OP : CALL_OP, -numArgs);
+    emit(compiler, numArgs);
+}
+
+/* Compiles the expression car(tree).
+ *
+ * tail: whether the expression is in tail position in its function, so that
+ *       a call there can replace the current call instead of returning to it.
+ */
+void compileExpr(Compiler *compiler, Value *tree, Scope *scope, bool tail) {
+    assert(tree != NULL);
+    Value *expr = car(tree);
+
+    if (!isCons(expr)) {
+        compileAtom(compiler, expr, scope);
+        return;
+    }
+
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+
+    if (isSymbol(first)) {
+        // Special cases
+        if (!strcmp(first->s, "if")) {
+            compileIf(compiler, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "let")) {
+            compileLet(compiler, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "let*")) {
+            compileLetStar(compiler, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "letrec")) {
+            compileLetRec(compiler, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "display")) {
+            enforceArgumentArity(args, 1, "display");
+            compileExpr(compiler, args, scope, false);
+            emitOp(compiler, DISPLAY_OP, 0);
+            return;
+        } else if (!strcmp(first->s, "when")) {
+            compileWhen(compiler, args, scope, tail, true);
+            return;
+        } else if (!strcmp(first->s, "unless")) {
+            compileWhen(compiler, args, scope, tail, false);
+            return;
+        } else if (!strcmp(first->s, "quote")) {
+            emitOp(compiler, CONST_OP, 1);
+            emit(compiler, addConstant(compiler, evalQuote(args, NULL)));
+            return;
+        } else if (!strcmp(first->s, "define")) {
+            compileDefine(compiler, args, scope);
+            return;
+        } else if (!strcmp(first->s, "set!")) {
+            compileSetBang(compiler, args, scope);
+            return;
+        } else if (!strcmp(first->s, "begin")) {
+            compileSequence(compiler, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "cond")) {
+            compileCond(compiler, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "and")) {
+            compileAndOr(compiler, args, scope, true);
+            return;
+        } else if (!strcmp(first->s, "or")) {
+            compileAndOr(compiler, args, scope, false);
+            return;
+        } else if (!strcmp(first->s, "load")) {
+            enforceArgumentArity(args, 1, "load");
+            compileExpr(compiler, args, scope, false);
+            emitOp(compiler, LOAD_OP, 0);
+            emit(compiler, addConstant(compiler, args));
+            return;
+        } else if (!strcmp(first->s, "lambda")) {
+            compileLambda(compiler, args, scope);
+            return;
+        }
+    }
+
+    compileApplication(compiler, expr, scope, tail);
+}
+
+CodeObject *compileTopLevel(Value *tree) {
+    Compiler *compiler = makeCompiler();
+    compileExpr(compiler, tree, NULL, true);
+    emitOp(compiler, RETURN_OP, -1);
+    return finishCompiler(compiler);
+}
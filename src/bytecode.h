@@ -0,0 +1,72 @@
+#ifndef _BYTECODE
+#define _BYTECODE
+
+#include "value.h"
+#include "interpreter.h"
+
+// The instruction set of the virtual machine. Operands follow their opcode in
+// the code array, one int each:
+//   CONST_OP k             push constant k
+//   VOID_OP                push void
+//   TRUE_OP / FALSE_OP     push #t / #f
+//   LOCAL_REF_OP d i       push slot i of the frame d functions out
+//   LOCAL_SET_OP d i       pop into slot i of the frame d functions out
+//   GLOBAL_REF_OP k        push the global named by constant k
+//   GLOBAL_SET_OP k        pop into the (existing) global named by constant k
+//   GLOBAL_DEFINE_OP k     pop into the global named by constant k
+//   EVAL_ATOM_OP k         push evalAtom(constant k); reports unknown types
+//   POP_OP                 pop and discard
+//   JUMP_OP t              continue at code index t
+//   JUMP_IF_FALSE_OP t     pop; continue at code index t if it was #f
+//   MAKE_CLOSURE_OP k      push a closure of the code in constant k
+//   CALL_OP n              call the procedure below the top n values with them
+//   TAIL_CALL_OP n         like CALL_OP, but replaces the current call
+//   RETURN_OP              return the top value to the caller
+//   DISPLAY_OP             pop and print; push void
+//   LOAD_OP k              pop a file path, run that file; constant k is the
+//                          load expression's arguments, for error messages
+//   CHECK_BOUND_OP k       stop with an error if the top is uninitialized;
+//                          constant k names the letrec variable just pushed
+// The order must match the dispatch table in vm.c.
+typedef enum {CONST_OP, VOID_OP, TRUE_OP, FALSE_OP, LOCAL_REF_OP, LOCAL_SET_OP,
+              GLOBAL_REF_OP, GLOBAL_SET_OP, GLOBAL_DEFINE_OP, EVAL_ATOM_OP,
+              POP_OP, JUMP_OP, JUMP_IF_FALSE_OP, MAKE_CLOSURE_OP, CALL_OP,
+              TAIL_CALL_OP, RETURN_OP, DISPLAY_OP, LOAD_OP,
+              CHECK_BOUND_OP} opcode;
+
+/* The compiled code of one lambda, or of one top-level expression.
+ *
+ * code: the instructions.
+ * constants: the constant pool. Symbols of globals, quoted data, nested
+ *            CodeObjects (wrapped in PTR_TYPE Values), and so on.
+ * globalCells: for each constant naming a global, the cons cell holding its
+ *              value, once it has been looked up. NULL until then.
+ * numSlots: the size of the frame: parameters, then let-bound variables.
+ * maxStack: the most values this code ever has on the stack at once.
+ * numParams: the number of parameters, or -1 if all the arguments are
+ *            collected into a list in slot 0, like (lambda x ...).
+ */
+typedef struct CodeObject {
+    int *code;
+    int length;
+    Value **constants;
+    Value **globalCells;
+    int numConstants;
+    int numSlots;
+    int maxStack;
+    int numParams;
+} CodeObject;
+
+// Compiles one top-level expression, car(tree), to bytecode.
+CodeObject *compileTopLevel(Value *tree);
+
+// Runs compiled top-level code with the given global frame and returns its
+// value.
+Value *runBytecode(CodeObject *codeObject, Frame *global);
+
+// An alternative to interpret() that compiles each top-level expression to
+// bytecode and runs it on the virtual machine. Output is the same as
+// interpret().
+void interpretBytecode(Value *tree);
+
+#endif
@@ -0,0 +1,535 @@
+// Explicit-stack (CEK-style) evaluator.
+//
+// This evaluates the same language as eval() in interpreter.c, using the same
+// frames, closures, primitives and special form checks. The difference is in
+// how it keeps track of what to do next. eval() recurses in C, so deep
+// recursion in Scheme overflows the C stack. This machine never recurses:
+// the Control (the expression being evaluated) and the Environment (its frame)
+// are registers, and the Kontinuation (the work waiting for a value) is an
+// array of Continuation records that grows in the heap.
+
+#include "cek.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <assert.h>
+#include "linkedlist.h"
+#include "parser.h"
+#include "talloc.h"
+
+#define INITIAL_STACK_CAPACITY 256
+
+// Argument arrays up to this long are reused once their call has been made
+#define MAX_POOLED_ARGS 8
+
+// The kinds of work that can be waiting on the stack for a value.
+typedef enum {IF_K, BEGIN_K, OPERATOR_K, ARGS_K, LET_K, LET_STAR_K, LETREC_K,
+              DISPLAY_K, WHEN_K, UNLESS_K, DEFINE_K, SET_K, COND_K, AND_K,
+              OR_K, LOAD_K} continuationType;
+
+/* One entry on the continuation stack.
+ *
+ * exprs: the expressions left to evaluate, or the arguments of the special
+ *        form that is waiting.
+ * frame: the frame that exprs are evaluated in.
+ * form: the arguments of a let-family form, for its body and error messages.
+ * bodyFrame: the frame being built by a let-family form.
+ * operator: the evaluated operator of an application.
+ * values: the evaluated arguments of an application, in order, with room
+ *         for all of them; numValues of them have been evaluated so far.
+ */
+typedef struct {
+    continuationType type;
+    Value *exprs;
+    Frame *frame;
+    Value *form;
+    Frame *bodyFrame;
+    Value *operator;
+    Value **values;
+    int numValues;
+} Continuation;
+
+/* The state of the machine between steps.
+ *
+ * When returning is false, the next step evaluates car(tree) in frame.
+ * When it is true, the next step passes value to the continuation on top of
+ * the stack, or finishes if the stack is empty.
+ */
+typedef struct {
+    Continuation *stack;
+    int depth;
+    int capacity;
+    Value *tree;
+    Frame *frame;
+    Value *value;
+    bool returning;
+    // Argument arrays free for reuse, one list for each length, linked
+    // through their first element
+    Value **freeArgs[MAX_POOLED_ARGS + 1];
+} Machine;
+
+// The interned names of the special forms, so that stepExpression can
+// recognize them by comparing pointers. Set up by internSpecialForms.
+static char *ifName, *letName, *letStarName, *letrecName, *displayName,
+            *whenName, *unlessName, *quoteName, *defineName, *setName,
+            *beginName, *condName, *andName, *orName, *loadName, *lambdaName;
+
+void internSpecialForms() {
+    if (ifName != NULL) {
+        return;
+    }
+    ifName = internSymbolName("if");
+    letName = internSymbolName("let");
+    letStarName = internSymbolName("let*");
+    letrecName = internSymbolName("letrec");
+    displayName = internSymbolName("display");
+    whenName = internSymbolName("when");
+    unlessName = internSymbolName("unless");
+    quoteName = internSymbolName("quote");
+    defineName = internSymbolName("define");
+    setName = internSymbolName("set!");
+    beginName = internSymbolName("begin");
+    condName = internSymbolName("cond");
+    andName = internSymbolName("and");
+    orName = internSymbolName("or");
+    loadName = internSymbolName("load");
+    lambdaName = internSymbolName("lambda");
+}
+
+// Returns an array with room for numArgs arguments, reusing a free one if
+// there is one that long.
+Value **takeArgs(Machine *machine, int numArgs) {
+    if (numArgs <= MAX_POOLED_ARGS && machine->freeArgs[numArgs] != NULL) {
+        Value **args = machine->freeArgs[numArgs];
+        machine->freeArgs[numArgs] = (Value **) args[0];
+        return args;
+    }
+    return talloc(numArgs * sizeof(Value *));
+}
+
+// Gives back an array from takeArgs once nothing uses it any more.
+void releaseArgs(Machine *machine, Value **args, int numArgs) {
+    if (numArgs <= MAX_POOLED_ARGS) {
+        args[0] = (Value *) machine->freeArgs[numArgs];
+        machine->freeArgs[numArgs] = args;
+    }
+}
+
+// Pushes a new continuation, growing the stack if it is full.
+Continuation *pushContinuation(Machine *machine, continuationType type,
+                               Value *exprs, Frame *frame) {
+    if (machine->depth == machine->capacity) {
+        // The old stack is freed along with everything else by tfree.
+        int newCapacity = machine->capacity * 2;
+        Continuation *newStack = talloc(newCapacity * sizeof(Continuation));
+        memcpy(newStack, machine->stack, machine->depth * sizeof(Continuation));
+        machine->stack = newStack;
+        machine->capacity = newCapacity;
+    }
+
+    Continuation *continuation = &machine->stack[machine->depth];
+    machine->depth++;
+
+    continuation->type = type;
+    continuation->exprs = exprs;
+    continuation->frame = frame;
+    continuation->form = NULL;
+    continuation->bodyFrame = NULL;
+    continuation->operator = NULL;
+    continuation->values = NULL;
+    continuation->numValues = 0;
+    return continuation;
+}
+
+// Pops the top continuation. The copy stays valid after later pushes.
+Continuation popContinuation(Machine *machine) {
+    assert(machine->depth > 0);
+    machine->depth--;
+    return machine->stack[machine->depth];
+}
+
+// Sets the machine up to evaluate car(tree) in frame on its next step.
+void evalNext(Machine *machine, Value *tree, Frame *frame) {
+    machine->tree = tree;
+    machine->frame = frame;
+    machine->returning = false;
+}
+
+// Sets the machine up to pass value to the top continuation on its next step.
+void returnValue(Machine *machine, Value *value) {
+    machine->value = value;
+    machine->returning = true;
+}
+
+/* Evaluates body in frame, returning the value of the last expression.
+ *
+ * The last expression is evaluated without pushing anything, so calls in tail
+ * position don't grow the stack. An empty body returns void, like begin.
+ */
+void evalSequence(Machine *machine, Value *body, Frame *frame) {
+    if (isNull(body)) {
+        returnValue(machine, makeVoid());
+        return;
+    }
+    if (!isNull(cdr(body))) {
+        pushContinuation(machine, BEGIN_K, cdr(body), frame);
+    }
+    evalNext(machine, body, frame);
+}
+
+// Applies a primitive or closure to numArgs evaluated arguments. Neither
+// keeps args, so it can be reused as soon as this returns.
+void applyProcedure(Machine *machine, Value *function, Value **args,
+                    int numArgs) {
+    if (isType(function, PRIMITIVE_TYPE)) {
+        returnValue(machine, callPrimitive(function, numArgs, args));
+    } else {
+        Frame *evalFrame = makeApplyFrame(function, args, numArgs);
+        evalSequence(machine, function->cl.functionCode, evalFrame);
+    }
+}
+
+/* Starts evaluating the next binding of a let or let*, or its body if there
+ * are no bindings left.
+ *
+ * currentBindingPair: the remaining bindings.
+ * letFrame: the frame holding the bindings made so far.
+ * argsTree: the arguments of the let expression.
+ */
+void evalNextLetBinding(Machine *machine, continuationType type,
+                        Value *currentBindingPair, Frame *letFrame,
+                        Value *argsTree) {
+    if (isNull(currentBindingPair)) {
+        evalSequence(machine, cdr(argsTree), letFrame);
+        return;
+    }
+    checkLetBindingPair(currentBindingPair, argsTree);
+
+    // let* gets a new frame for each binding, so later ones can see earlier
+    Frame *bindingFrame = letFrame;
+    if (type == LET_STAR_K) {
+        bindingFrame = makeFrame(letFrame);
+    }
+    checkBinding(car(currentBindingPair), bindingFrame);
+
+    Continuation *continuation = pushContinuation(machine, type,
+                                                  currentBindingPair, NULL);
+    continuation->form = argsTree;
+    continuation->bodyFrame = bindingFrame;
+    evalNext(machine, cdr(car(currentBindingPair)), bindingFrame->parent);
+}
+
+// Starts evaluating the next binding of a letrec, or its body if there are
+// no bindings left.
+void evalNextLetRecBinding(Machine *machine, Value *currentBindingPair,
+                           Frame *letFrame, Value *argsTree) {
+    if (isNull(currentBindingPair)) {
+        evalSequence(machine, cdr(argsTree), letFrame);
+        return;
+    }
+
+    Continuation *continuation = pushContinuation(machine, LETREC_K,
+                                                  currentBindingPair, letFrame);
+    continuation->form = argsTree;
+    continuation->bodyFrame = letFrame;
+    evalNext(machine, cdr(car(currentBindingPair)), letFrame);
+}
+
+// Starts evaluating the test of the next cond clause, or the body of an else.
+void evalNextCondClause(Machine *machine, Value *clauses, Frame *frame) {
+    if (isNull(clauses)) {
+        // Return void if none of the conditions are true
+        returnValue(machine, makeVoid());
+        return;
+    }
+
+    Value *clause = car(clauses);
+    if (isElseClause(clause)) {
+        evalSequence(machine, cdr(clause), frame);
+        return;
+    }
+
+    pushContinuation(machine, COND_K, clauses, frame);
+    evalNext(machine, clause, frame);
+}
+
+/* Takes one step on the expression in car(machine->tree).
+ *
+ * Atoms are evaluated right away. Special forms check their syntax, then
+ * either finish or push a continuation and move on to a subexpression.
+ * Anything else is an application, which starts with its operator.
+ */
+void stepExpression(Machine *machine) {
+    Value *expr = car(machine->tree);
+    Frame *frame = machine->frame;
+
+    if (isSymbol(expr)) {
+        Value *value = car(lookUpCachedSymbol(machine->tree, frame));
+        if (value->type == UNINITIALIZED) {
+            uninitializedVariable(expr);
+        }
+        returnValue(machine, value);
+        return;
+    }
+    if (!isCons(expr)) {
+        returnValue(machine, evalAtom(expr, frame));
+        return;
+    }
+
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+
+    if (isSymbol(first)) {
+        // Special cases
+        if (first->s == ifName) {
+            checkIfSyntax(args);
+            pushContinuation(machine, IF_K, args, frame);
+            evalNext(machine, args, frame);
+            return;
+        } else if (first->s == letName) {
+            checkLetSyntax(args, "let");
+            evalNextLetBinding(machine, LET_K, car(args), makeFrame(frame), args);
+            return;
+        } else if (first->s == letStarName) {
+            checkLetSyntax(args, "let*");
+            evalNextLetBinding(machine, LET_STAR_K, car(args), frame, args);
+            return;
+        } else if (first->s == letrecName) {
+            Frame *letFrame = makeLetRecFrame(args, frame);
+            evalNextLetRecBinding(machine, car(args), letFrame, args);
+            return;
+        } else if (first->s == displayName) {
+            enforceArgumentArity(args, 1, "display");
+            pushContinuation(machine, DISPLAY_K, args, frame);
+            evalNext(machine, args, frame);
+            return;
+        } else if (first->s == whenName) {
+            checkWhenSyntax(args);
+            pushContinuation(machine, WHEN_K, cdr(args), frame);
+            evalNext(machine, args, frame);
+            return;
+        } else if (first->s == unlessName) {
+            checkUnlessSyntax(args);
+            pushContinuation(machine, UNLESS_K, cdr(args), frame);
+            evalNext(machine, args, frame);
+            return;
+        } else if (first->s == quoteName) {
+            returnValue(machine, evalQuote(args, frame));
+            return;
+        } else if (first->s == defineName) {
+            Value *symbol = checkDefineSyntax(args);
+            if (isCons(car(args))) {
+                // Lambda shorthand: nothing to evaluate
+                Value *lambdaExpr = cons(cdr(car(args)), cdr(args));
+                defineGlobal(symbol, evalLambda(lambdaExpr, frame), frame);
+                returnValue(machine, makeVoid());
+            } else {
+                pushContinuation(machine, DEFINE_K, args, frame);
+                evalNext(machine, cdr(args), frame);
+            }
+            return;
+        } else if (first->s == setName) {
+            checkSetBangSyntax(args);
+            pushContinuation(machine, SET_K, args, frame);
+            evalNext(machine, cdr(args), frame);
+            return;
+        } else if (first->s == beginName) {
+            evalSequence(machine, args, frame);
+            return;
+        } else if (first->s == condName) {
+            checkCondSyntax(args);
+            evalNextCondClause(machine, args, frame);
+            return;
+        } else if (first->s == andName || first->s == orName) {
+            continuationType type = first->s == andName ? AND_K : OR_K;
+            if (isNull(args)) {
+                // Empty and is #t; empty or is #f
+                returnValue(machine, makeBool(type == AND_K));
+            } else {
+                pushContinuation(machine, type, args, frame);
+                evalNext(machine, args, frame);
+            }
+            return;
+        } else if (first->s == loadName) {
+            enforceArgumentArity(args, 1, "load");
+            pushContinuation(machine, LOAD_K, args, frame);
+            evalNext(machine, args, frame);
+            return;
+        } else if (first->s == lambdaName) {
+            returnValue(machine, evalLambda(args, frame));
+            return;
+        }
+    }
+
+    // If not a special form, evaluate the first, evaluate the args,
+    // then apply the first to the args.
+    pushContinuation(machine, OPERATOR_K, args, frame);
+    evalNext(machine, expr, frame);
+}
+
+// Passes machine->value to the continuation on top of the stack.
+void stepContinuation(Machine *machine) {
+    Value *value = machine->value;
+    Continuation *top = &machine->stack[machine->depth - 1];
+
+    switch (top->type) {
+        case IF_K: {
+            Continuation k = popContinuation(machine);
+            Value *thenExpr = cdr(k.exprs);
+            if (isTrue(value)) {
+                evalNext(machine, thenExpr, k.frame);
+            } else {
+                evalNext(machine, cdr(thenExpr), k.frame);
+            }
+            break;
+        }
+        case BEGIN_K: {
+            // The value of every expression but the last is ignored
+            Value *currentExpr = top->exprs;
+            Frame *frame = top->frame;
+            if (isNull(cdr(currentExpr))) {
+                popContinuation(machine);
+            } else {
+                top->exprs = cdr(currentExpr);
+            }
+            evalNext(machine, currentExpr, frame);
+            break;
+        }
+        case OPERATOR_K: {
+            Continuation k = popContinuation(machine);
+            if (isNull(k.exprs)) {
+                applyProcedure(machine, value, NULL, 0);
+            } else {
+                Continuation *args = pushContinuation(machine, ARGS_K,
+                                                      k.exprs, k.frame);
+                args->operator = value;
+                args->values = takeArgs(machine, length(k.exprs));
+                args->numValues = 0;
+                evalNext(machine, k.exprs, k.frame);
+            }
+            break;
+        }
+        case ARGS_K: {
+            top->values[top->numValues++] = value;
+            top->exprs = cdr(top->exprs);
+            if (isNull(top->exprs)) {
+                Continuation k = popContinuation(machine);
+                applyProcedure(machine, k.operator, k.values, k.numValues);
+                releaseArgs(machine, k.values, k.numValues);
+            } else {
+                evalNext(machine, top->exprs, top->frame);
+            }
+            break;
+        }
+        case LET_K:
+        case LET_STAR_K: {
+            Continuation k = popContinuation(machine);
+            addBinding(car(car(k.exprs)), value, k.bodyFrame);
+            evalNextLetBinding(machine, k.type, cdr(k.exprs), k.bodyFrame,
+                               k.form);
+            break;
+        }
+        case LETREC_K: {
+            Continuation k = popContinuation(machine);
+            setLetRecBinding(k.exprs, value, k.bodyFrame);
+            evalNextLetRecBinding(machine, cdr(k.exprs), k.bodyFrame, k.form);
+            break;
+        }
+        case DISPLAY_K: {
+            popContinuation(machine);
+            printValue(value);
+            returnValue(machine, makeValue(VOID_TYPE));
+            break;
+        }
+        case WHEN_K:
+        case UNLESS_K: {
+            Continuation k = popContinuation(machine);
+            if (isTrue(value) == (k.type == WHEN_K)) {
+                evalSequence(machine, k.exprs, k.frame);
+            } else {
+                returnValue(machine, makeVoid());
+            }
+            break;
+        }
+        case DEFINE_K: {
+            Continuation k = popContinuation(machine);
+            defineGlobal(car(k.exprs), value, k.frame);
+            returnValue(machine, makeVoid());
+            break;
+        }
+        case SET_K: {
+            Continuation k = popContinuation(machine);
+            setVariable(k.exprs, value, k.frame);
+            returnValue(machine, makeVoid());
+            break;
+        }
+        case COND_K: {
+            Continuation k = popContinuation(machine);
+            if (isTrue(value)) {
+                evalSequence(machine, cdr(car(k.exprs)), k.frame);
+            } else {
+                evalNextCondClause(machine, cdr(k.exprs), k.frame);
+            }
+            break;
+        }
+        case AND_K:
+        case OR_K: {
+            // and short circuits on a false value, or on a true value
+            bool shortCircuit = isTrue(value) == (top->type == OR_K);
+            if (shortCircuit) {
+                Continuation k = popContinuation(machine);
+                returnValue(machine, makeBool(k.type == OR_K));
+            } else if (isNull(cdr(top->exprs))) {
+                Continuation k = popContinuation(machine);
+                returnValue(machine, makeBool(k.type == AND_K));
+            } else {
+                top->exprs = cdr(top->exprs);
+                evalNext(machine, top->exprs, top->frame);
+            }
+            break;
+        }
+        case LOAD_K: {
+            Continuation k = popContinuation(machine);
+            Value *tree = loadFile(k.exprs, value);
+            evalSequence(machine, tree, getGlobalFrame(k.frame));
+            break;
+        }
+    }
+}
+
+Value *evalCEK(Value *tree, Frame *frame) {
+    assert(tree != NULL);
+
+    Machine machine;
+    machine.capacity = INITIAL_STACK_CAPACITY;
+    machine.stack = talloc(machine.capacity * sizeof(Continuation));
+    machine.depth = 0;
+    for (int i = 0; i <= MAX_POOLED_ARGS; i++) {
+        machine.freeArgs[i] = NULL;
+    }
+    internSpecialForms();
+    evalNext(&machine, tree, frame);
+
+    while (true) {
+        if (!machine.returning) {
+            stepExpression(&machine);
+        } else if (machine.depth == 0) {
+            return machine.value;
+        } else {
+            stepContinuation(&machine);
+        }
+    }
+}
+
+void interpretCEK(Value *tree) {
+    Frame *global = makeGlobalFrame();
+
+    Value *current = tree;
+    while (!isNull(current)) {
+        Value *result = evalCEK(current, global);
+        printResult(result);
+        current = cdr(current);
+    }
+    printf("\n");
+}
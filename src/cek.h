@@ -0,0 +1,17 @@
+#ifndef _CEK
+#define _CEK
+
+#include "value.h"
+#include "interpreter.h"
+
+// An alternative to interpret() that evaluates each top-level expression with
+// evalCEK. Output is the same as interpret().
+void interpretCEK(Value *tree);
+
+// Evaluates the expression in car(tree), like eval(), but without recursing in
+// C. The machine keeps its continuation on a stack in the heap, which grows as
+// needed, so recursion depth in Scheme is bounded by memory instead of by the
+// C stack. Each step of evaluation is one iteration of a loop.
+Value *evalCEK(Value *tree, Frame *frame);
+
+#endif
@@ -0,0 +1,747 @@
+// Closure compiler.
+//
+// Compiles each expression once into a Node holding a pointer to the C
+// function that evaluates that kind of expression, along with its operands,
+// already resolved: a local variable becomes its frame depth and slot, a
+// global caches its binding cell, an if holds its three compiled branches,
+// and so on. Evaluating a node is then one indirect call, with no looking at
+// cons cells or comparing strings.
+//
+// Syntax checks, primitives and error messages are the ones in interpreter.c.
+// Frames are laid out like the bytecode compiler's: each lambda gets one
+// array-based frame per call, and the variables of its lets get slots in it.
+
+#include "closurecompiler.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <assert.h>
+#include "linkedlist.h"
+#include "parser.h"
+#include "talloc.h"
+
+/* A group of variables that are visible to some code: the parameters of a
+ * lambda, or the bindings of a let.
+ *
+ * names: binds each name to an INT_TYPE slot number.
+ * lambda: the lambda whose frame holds the slots.
+ * letrec: whether these are a letrec's bindings, which have to be checked
+ *         when they're read, since they may not have values yet.
+ */
+typedef struct Scope {
+    Frame *names;
+    Lambda *lambda;
+    bool letrec;
+    struct Scope *parent;
+} Scope;
+
+// The global frame of the program being run
+static Frame *globalFrame;
+
+// A call in tail position doesn't call its closure itself. It returns this
+// marker, and leaves the call in pendingLambda and pendingEnv for the
+// enclosing callClosure to make, so tail calls don't grow the C stack.
+static Value tailCallMarker;
+static Lambda *pendingLambda;
+static Env *pendingEnv;
+
+Node *compileNode(Value *tree, Scope *scope, bool tail);
+Node *compileLambdaNode(Value *argsTree, Scope *scope);
+
+//==============================================================================
+// Running nodes
+//==============================================================================
+
+Env *makeEnv(int numSlots, Env *parent) {
+    Env *env = talloc(sizeof(Env) + numSlots * sizeof(Value *));
+    env->parent = parent;
+    return env;
+}
+
+// Makes the frame for a call to a compiled closure. Stops with the same error
+// as apply() if the arity is wrong.
+Env *bindArguments(Value *function, Value **args, int numArgs) {
+    Lambda *lambda = function->cc.code;
+    Env *env;
+    if (lambda->freeEnvs != NULL) {
+        env = lambda->freeEnvs;
+        lambda->freeEnvs = env->parent;
+        env->parent = function->cc.env;
+    } else {
+        env = makeEnv(lambda->numSlots, function->cc.env);
+    }
+    if (lambda->numParams < 0) {
+        env->slots[0] = makeArgumentList(args, numArgs);
+    } else {
+        checkApplyArity(lambda->numParams, numArgs);
+        for (int i = 0; i < numArgs; i++) {
+            env->slots[i] = args[i];
+        }
+    }
+    return env;
+}
+
+// Runs the body of a lambda, then any tail calls it makes. Once a body has
+// returned, nothing uses its frame again unless a closure holds it.
+Value *callClosure(Lambda *lambda, Env *env) {
+    Value *result = lambda->body->run(lambda->body, env);
+    while (true) {
+        if (lambda->reusesEnvs) {
+            env->parent = lambda->freeEnvs;
+            lambda->freeEnvs = env;
+        }
+        if (result != &tailCallMarker) {
+            return result;
+        }
+        lambda = pendingLambda;
+        env = pendingEnv;
+        result = lambda->body->run(lambda->body, env);
+    }
+}
+
+Value *makeCompiledClosure(Lambda *lambda, Env *env) {
+    Value *closure = makeValue(COMPILED_CLOSURE_TYPE);
+    closure->cc.code = lambda;
+    closure->cc.env = env;
+    return closure;
+}
+
+Value *applyFunction(Value *function, Value **args, int numArgs) {
+    if (isType(function, PRIMITIVE_TYPE)) {
+        return callPrimitive(function, numArgs, args);
+    }
+    if (!isType(function, COMPILED_CLOSURE_TYPE)) {
+        // Fails the same way apply() does
+        makeApplyFrame(function, args, numArgs);
+    }
+    return callClosure(function->cc.code, bindArguments(function, args, numArgs));
+}
+
+Value *tailCallFunction(Value *function, Value **args, int numArgs) {
+    if (!isType(function, COMPILED_CLOSURE_TYPE)) {
+        return applyFunction(function, args, numArgs);
+    }
+    pendingEnv = bindArguments(function, args, numArgs);
+    pendingLambda = function->cc.code;
+    return &tailCallMarker;
+}
+
+Value *loadAndRun(Value *args, Value *filePath) {
+    Value *tree = loadFile(args, filePath);
+
+    // Run each expression in the file as if it were top-level
+    Value *result = makeVoid();
+    Value *current = tree;
+    while (!isNull(current)) {
+        result = runClosures(compileClosures(current), globalFrame);
+        current = cdr(current);
+    }
+    return result;
+}
+
+Value *runConstant(Node *node, Env *env) {
+    return node->value;
+}
+
+Value *runLocal0(Node *node, Env *env) {
+    return env->slots[node->slot];
+}
+
+Value *runLocal1(Node *node, Env *env) {
+    return env->parent->slots[node->slot];
+}
+
+Value *runLocal(Node *node, Env *env) {
+    for (int depth = node->depth; depth > 0; depth--) {
+        env = env->parent;
+    }
+    return env->slots[node->slot];
+}
+
+// A letrec variable, which may not have its value yet. node->value is its
+// name.
+Value *runLetRecLocal(Node *node, Env *env) {
+    Value *value = runLocal(node, env);
+    if (value->type == UNINITIALIZED) {
+        uninitializedVariable(node->value);
+    }
+    return value;
+}
+
+// Returns the binding cell of the global named by node->value. Stops with an
+// error if it isn't defined yet. Define reuses existing cells, so once found
+// the cell stays valid.
+Value *globalCell(Node *node) {
+    if (node->cell == NULL) {
+        node->cell = lookUpSymbol(node->value, globalFrame);
+    }
+    return node->cell;
+}
+
+Value *runGlobal(Node *node, Env *env) {
+    return car(globalCell(node));
+}
+
+Value *runEvalAtom(Node *node, Env *env) {
+    return evalAtom(node->value, globalFrame);
+}
+
+Value *runIf(Node *node, Env *env) {
+    Node *test = node->children[0];
+    Node *branch = isTrue(test->run(test, env)) ? node->children[1]
+                                                : node->children[2];
+    return branch->run(branch, env);
+}
+
+Value *runWhen(Node *node, Env *env) {
+    Node *test = node->children[0];
+    if (isTrue(test->run(test, env))) {
+        return node->children[1]->run(node->children[1], env);
+    }
+    return makeVoid();
+}
+
+Value *runUnless(Node *node, Env *env) {
+    Node *test = node->children[0];
+    if (!isTrue(test->run(test, env))) {
+        return node->children[1]->run(node->children[1], env);
+    }
+    return makeVoid();
+}
+
+Value *runSequence(Node *node, Env *env) {
+    for (int i = 0; i < node->count - 1; i++) {
+        node->children[i]->run(node->children[i], env);
+    }
+    Node *last = node->children[node->count - 1];
+    return last->run(last, env);
+}
+
+// children are pairs of a test and a body. The test of an else clause is
+// NULL.
+Value *runCond(Node *node, Env *env) {
+    for (int i = 0; i < node->count; i += 2) {
+        Node *test = node->children[i];
+        if (test == NULL || isTrue(test->run(test, env))) {
+            return node->children[i + 1]->run(node->children[i + 1], env);
+        }
+    }
+    return makeVoid();
+}
+
+Value *runAnd(Node *node, Env *env) {
+    for (int i = 0; i < node->count; i++) {
+        if (!isTrue(node->children[i]->run(node->children[i], env))) {
+            return makeBool(false);
+        }
+    }
+    return makeBool(true);
+}
+
+Value *runOr(Node *node, Env *env) {
+    for (int i = 0; i < node->count; i++) {
+        if (isTrue(node->children[i]->run(node->children[i], env))) {
+            return makeBool(true);
+        }
+    }
+    return makeBool(false);
+}
+
+// let and let*: children are the binding expressions, then the body. The
+// variables are in consecutive slots starting at node->slot.
+Value *runLet(Node *node, Env *env) {
+    int numBindings = node->count - 1;
+    for (int i = 0; i < numBindings; i++) {
+        env->slots[node->slot + i] = node->children[i]->run(node->children[i], env);
+    }
+    Node *body = node->children[numBindings];
+    return body->run(body, env);
+}
+
+// Like runLet, but every variable is uninitialized until its expression is
+// done.
+Value *runLetRec(Node *node, Env *env) {
+    int numBindings = node->count - 1;
+    for (int i = 0; i < numBindings; i++) {
+        env->slots[node->slot + i] = makeValue(UNINITIALIZED);
+    }
+
+    for (int i = 0; i < numBindings; i++) {
+        Value *result = node->children[i]->run(node->children[i], env);
+        env->slots[node->slot + i] = result;
+    }
+    Node *body = node->children[numBindings];
+    return body->run(body, env);
+}
+
+Value *runDefine(Node *node, Env *env) {
+    Value *value = node->children[0]->run(node->children[0], env);
+    defineGlobal(node->value, value, globalFrame);
+    return makeVoid();
+}
+
+Value *runSetLocal(Node *node, Env *env) {
+    Value *value = node->children[0]->run(node->children[0], env);
+    for (int depth = node->depth; depth > 0; depth--) {
+        env = env->parent;
+    }
+    env->slots[node->slot] = value;
+    return makeVoid();
+}
+
+Value *runSetGlobal(Node *node, Env *env) {
+    Value *value = node->children[0]->run(node->children[0], env);
+    globalCell(node)->c.car = value;
+    return makeVoid();
+}
+
+Value *runLambda(Node *node, Env *env) {
+    return makeCompiledClosure(node->lambda, env);
+}
+
+Value *runDisplay(Node *node, Env *env) {
+    printValue(node->children[0]->run(node->children[0], env));
+    return makeValue(VOID_TYPE);
+}
+
+// node->value is the load's arguments, for error messages.
+Value *runLoad(Node *node, Env *env) {
+    Value *filePath = node->children[0]->run(node->children[0], env);
+    return loadAndRun(node->value, filePath);
+}
+
+// children are the operator, then the arguments.
+Value *runCall(Node *node, Env *env) {
+    Value *function = node->children[0]->run(node->children[0], env);
+    int numArgs = node->count - 1;
+    Value *args[numArgs + 1];
+    for (int i = 0; i < numArgs; i++) {
+        args[i] = node->children[i + 1]->run(node->children[i + 1], env);
+    }
+    return applyFunction(function, args, numArgs);
+}
+
+// A call in tail position: closures are left for callClosure to call.
+Value *runTailCall(Node *node, Env *env) {
+    Value *function = node->children[0]->run(node->children[0], env);
+    int numArgs = node->count - 1;
+    Value *args[numArgs + 1];
+    for (int i = 0; i < numArgs; i++) {
+        args[i] = node->children[i + 1]->run(node->children[i + 1], env);
+    }
+    return tailCallFunction(function, args, numArgs);
+}
+
+// A top-level expression: node->lambda holds it, with the slots of its lets.
+Value *runTopLevel(Node *node, Env *env) {
+    return runLambdaBody(node->lambda, globalFrame);
+}
+
+//==============================================================================
+// Compiling nodes
+//==============================================================================
+
+Node *makeNode(NodeFunction run, int count) {
+    Node *node = talloc(sizeof(Node));
+    node->run = run;
+    node->value = NULL;
+    node->cell = NULL;
+    node->depth = 0;
+    node->slot = 0;
+    node->children = talloc((count + 1) * sizeof(Node *));
+    node->count = count;
+    node->lambda = NULL;
+    return node;
+}
+
+Scope *makeNodeScope(Scope *parent, Lambda *lambda) {
+    Scope *scope = talloc(sizeof(Scope));
+    scope->names = makeFrame(NULL);
+    scope->lambda = lambda;
+    scope->letrec = false;
+    scope->parent = parent;
+    return scope;
+}
+
+Lambda *makeLambda() {
+    Lambda *lambda = talloc(sizeof(Lambda));
+    lambda->body = NULL;
+    lambda->numSlots = 0;
+    lambda->numParams = 0;
+    lambda->reusesEnvs = true;
+    lambda->freeEnvs = NULL;
+    return lambda;
+}
+
+// Gives a name a new slot in the frame of the lambda that scope is part of.
+int declareSlot(Scope *scope, Value *name) {
+    int slot = scope->lambda->numSlots;
+    scope->lambda->numSlots++;
+    addBinding(name, makeInt(slot), scope->names);
+    return slot;
+}
+
+/* Finds the frame slot of a local variable.
+ *
+ * depth: set to how many lambdas out the variable's frame is.
+ * slot: set to the variable's slot in that frame.
+ * Returns the scope that binds it, or NULL if the symbol isn't local, meaning
+ * it is a global.
+ */
+Scope *resolveVariable(Scope *scope, Value *symbol, int *depth, int *slot) {
+    *depth = 0;
+    Lambda *currentLambda = scope == NULL ? NULL : scope->lambda;
+    while (scope != NULL) {
+        if (scope->lambda != currentLambda) {
+            currentLambda = scope->lambda;
+            (*depth)++;
+        }
+        Value *binding = lookupBindingInFrame(symbol, scope->names);
+        if (binding != NULL) {
+            *slot = car(binding)->i;
+            return scope;
+        }
+        scope = scope->parent;
+    }
+    return NULL;
+}
+
+Node *makeConstantNode(Value *value) {
+    Node *node = makeNode(runConstant, 0);
+    node->value = value;
+    return node;
+}
+
+Node *compileAtomNode(Value *expr, Scope *scope) {
+    if (isSymbol(expr)) {
+        int depth, slot;
+        Node *node;
+        Scope *binder = resolveVariable(scope, expr, &depth, &slot);
+        if (binder != NULL) {
+            if (binder->letrec) {
+                node = makeNode(runLetRecLocal, 0);
+                node->value = expr;
+            } else if (depth == 0) {
+                node = makeNode(runLocal0, 0);
+            } else if (depth == 1) {
+                node = makeNode(runLocal1, 0);
+            } else {
+                node = makeNode(runLocal, 0);
+            }
+            node->depth = depth;
+            node->slot = slot;
+        } else {
+            node = makeNode(runGlobal, 0);
+            node->value = expr;
+        }
+        return node;
+    } else if (isNumber(expr) || isString(expr) || isBoolean(expr)
+               || isNull(expr) || isVector(expr)) {
+        return makeConstantNode(expr);
+    }
+    // Let evalAtom report the error if this is ever evaluated
+    Node *node = makeNode(runEvalAtom, 0);
+    node->value = expr;
+    return node;
+}
+
+// Compiles a body. An empty body is void, like begin.
+Node *compileSequenceNode(Value *body, Scope *scope, bool tail) {
+    if (isNull(body)) {
+        return makeConstantNode(makeVoid());
+    }
+    if (isNull(cdr(body))) {
+        return compileNode(body, scope, tail);
+    }
+
+    Node *node = makeNode(runSequence, length(body));
+    Value *currentExpr = body;
+    for (int i = 0; i < node->count; i++) {
+        bool isLast = i == node->count - 1;
+        node->children[i] = compileNode(currentExpr, scope, tail && isLast);
+        currentExpr = cdr(currentExpr);
+    }
+    return node;
+}
+
+Node *compileIfNode(Value *argsTree, Scope *scope, bool tail) {
+    checkIfSyntax(argsTree);
+    Node *node = makeNode(runIf, 3);
+    node->children[0] = compileNode(argsTree, scope, false);
+    node->children[1] = compileNode(cdr(argsTree), scope, tail);
+    node->children[2] = compileNode(cdr(cdr(argsTree)), scope, tail);
+    return node;
+}
+
+Node *compileWhenNode(Value *argsTree, Scope *scope, bool tail, bool isWhen) {
+    Node *node;
+    if (isWhen) {
+        checkWhenSyntax(argsTree);
+        node = makeNode(runWhen, 2);
+    } else {
+        checkUnlessSyntax(argsTree);
+        node = makeNode(runUnless, 2);
+    }
+    node->children[0] = compileNode(argsTree, scope, false);
+    node->children[1] = compileSequenceNode(cdr(argsTree), scope, tail);
+    return node;
+}
+
+Node *compileCondNode(Value *argsTree, Scope *scope, bool tail) {
+    checkCondSyntax(argsTree);
+    Node *node = makeNode(runCond, 2 * length(argsTree));
+
+    Value *currentExpr = argsTree;
+    for (int i = 0; i < node->count; i += 2) {
+        Value *clause = car(currentExpr);
+        if (isElseClause(clause)) {
+            node->children[i] = NULL;
+        } else {
+            node->children[i] = compileNode(clause, scope, false);
+        }
+        node->children[i + 1] = compileSequenceNode(cdr(clause), scope, tail);
+        currentExpr = cdr(currentExpr);
+    }
+    return node;
+}
+
+Node *compileAndOrNode(Value *argsTree, Scope *scope, bool isAnd) {
+    Node *node = makeNode(isAnd ? runAnd : runOr, length(argsTree));
+    Value *currentExpr = argsTree;
+    for (int i = 0; i < node->count; i++) {
+        node->children[i] = compileNode(currentExpr, scope, false);
+        currentExpr = cdr(currentExpr);
+    }
+    return node;
+}
+
+// Compiles let (isStar false) or let*.
+Node *compileLetNode(Value *argsTree, Scope *scope, bool tail, bool isStar) {
+    checkLetSyntax(argsTree, isStar ? "let*" : "let");
+    int numBindings = length(car(argsTree));
+    Node *node = makeNode(runLet, numBindings + 1);
+
+    // Give the variables their slots first, so they are consecutive even if
+    // the expressions have lets of their own. exprScopes[i] is what the i-th
+    // expression can see: none of the let's variables, or for let*, the ones
+    // before it.
+    Scope *exprScopes[numBindings + 1];
+    Scope *letScope = makeNodeScope(scope, scope->lambda);
+    node->slot = scope->lambda->numSlots;
+    Value *currentBindingPair = car(argsTree);
+    for (int i = 0; i < numBindings; i++) {
+        checkLetBindingPair(currentBindingPair, argsTree);
+        if (isStar) {
+            // Each binding gets its own scope, so it can see the earlier ones
+            exprScopes[i] = letScope;
+            letScope = makeNodeScope(letScope, scope->lambda);
+        } else {
+            exprScopes[i] = scope;
+        }
+        checkBinding(car(currentBindingPair), letScope->names);
+        declareSlot(letScope, car(car(currentBindingPair)));
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    currentBindingPair = car(argsTree);
+    for (int i = 0; i < numBindings; i++) {
+        node->children[i] = compileNode(cdr(car(currentBindingPair)),
+                                        exprScopes[i], false);
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    node->children[numBindings] = compileSequenceNode(cdr(argsTree),
+                                                      letScope, tail);
+    return node;
+}
+
+Node *compileLetRecNode(Value *argsTree, Scope *scope, bool tail) {
+    checkLetSyntax(argsTree, "let");
+    Node *node = makeNode(runLetRec, length(car(argsTree)) + 1);
+    node->slot = scope->lambda->numSlots;
+
+    // Declare every name first, so all the expressions can see them
+    Scope *letScope = makeNodeScope(scope, scope->lambda);
+    letScope->letrec = true;
+    Value *currentBindingPair = car(argsTree);
+    while (!isNull(currentBindingPair)) {
+        checkLetRecBindingPair(currentBindingPair, argsTree);
+        declareSlot(letScope, car(car(currentBindingPair)));
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    currentBindingPair = car(argsTree);
+    for (int i = 0; i < node->count - 1; i++) {
+        node->children[i] = compileNode(cdr(car(currentBindingPair)),
+                                        letScope, false);
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    node->children[node->count - 1] = compileSequenceNode(cdr(argsTree),
+                                                          letScope, tail);
+    return node;
+}
+
+Node *compileDefineNode(Value *argsTree, Scope *scope) {
+    Value *symbol = checkDefineSyntax(argsTree);
+    Node *node = makeNode(runDefine, 1);
+    node->value = symbol;
+    if (isCons(car(argsTree))) {
+        // Lambda shorthand syntax
+        Value *lambdaExpr = cons(cdr(car(argsTree)), cdr(argsTree));
+        node->children[0] = compileLambdaNode(lambdaExpr, scope);
+    } else {
+        node->children[0] = compileNode(cdr(argsTree), scope, false);
+    }
+    return node;
+}
+
+Node *compileSetBangNode(Value *argsTree, Scope *scope) {
+    checkSetBangSyntax(argsTree);
+    Node *node;
+    int depth, slot;
+    if (resolveVariable(scope, car(argsTree), &depth, &slot)) {
+        node = makeNode(runSetLocal, 1);
+        node->depth = depth;
+        node->slot = slot;
+    } else {
+        node = makeNode(runSetGlobal, 1);
+        node->value = car(argsTree);
+    }
+    node->children[0] = compileNode(cdr(argsTree), scope, false);
+    return node;
+}
+
+Node *compileLambdaNode(Value *argsTree, Scope *scope) {
+    checkLambdaSyntax(argsTree);
+    // The closure holds on to the frame it's made in
+    scope->lambda->reusesEnvs = false;
+    Node *node = makeNode(runLambda, 0);
+    node->lambda = makeLambda();
+    Scope *lambdaScope = makeNodeScope(scope, node->lambda);
+
+    // Parameters take the first slots, in order
+    Value *params = car(argsTree);
+    if (isSymbol(params)) {
+        node->lambda->numParams = -1;
+        declareSlot(lambdaScope, params);
+    } else {
+        Value *currentParam = params;
+        while (!isNull(currentParam)) {
+            declareSlot(lambdaScope, car(currentParam));
+            node->lambda->numParams++;
+            currentParam = cdr(currentParam);
+        }
+    }
+
+    node->lambda->body = compileSequenceNode(cdr(argsTree), lambdaScope, true);
+    return node;
+}
+
+Node *compileCallNode(Value *expr, Scope *scope, bool tail) {
+    Node *node = makeNode(tail ? runTailCall : runCall, length(expr));
+    Value *currentExpr = expr;
+    for (int i = 0; i < node->count; i++) {
+        node->children[i] = compileNode(currentExpr, scope, false);
+        currentExpr = cdr(currentExpr);
+    }
+    return node;
+}
+
+/* Compiles the expression car(tree).
+ *
+ * tail: whether the expression is in tail position in a lambda body, so that
+ *       a call there can be made by the lambda's caller instead.
+ */
+Node *compileNode(Value *tree, Scope *scope, bool tail) {
+    assert(tree != NULL);
+    Value *expr = car(tree);
+
+    if (!isCons(expr)) {
+        return compileAtomNode(expr, scope);
+    }
+
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+
+    if (isSymbol(first)) {
+        // Special cases
+        if (!strcmp(first->s, "if")) {
+            return compileIfNode(args, scope, tail);
+        } else if (!strcmp(first->s, "let")) {
+            return compileLetNode(args, scope, tail, false);
+        } else if (!strcmp(first->s, "let*")) {
+            return compileLetNode(args, scope, tail, true);
+        } else if (!strcmp(first->s, "letrec")) {
+            return compileLetRecNode(args, scope, tail);
+        } else if (!strcmp(first->s, "display")) {
+            enforceArgumentArity(args, 1, "display");
+            Node *node = makeNode(runDisplay, 1);
+            node->children[0] = compileNode(args, scope, false);
+            return node;
+        } else if (!strcmp(first->s, "when")) {
+            return compileWhenNode(args, scope, tail, true);
+        } else if (!strcmp(first->s, "unless")) {
+            return compileWhenNode(args, scope, tail, false);
+        } else if (!strcmp(first->s, "quote")) {
+            return makeConstantNode(evalQuote(args, NULL));
+        } else if (!strcmp(first->s, "define")) {
+            return compileDefineNode(args, scope);
+        } else if (!strcmp(first->s, "set!")) {
+            return compileSetBangNode(args, scope);
+        } else if (!strcmp(first->s, "begin")) {
+            return compileSequenceNode(args, scope, tail);
+        } else if (!strcmp(first->s, "cond")) {
+            return compileCondNode(args, scope, tail);
+        } else if (!strcmp(first->s, "and")) {
+            return compileAndOrNode(args, scope, true);
+        } else if (!strcmp(first->s, "or")) {
+            return compileAndOrNode(args, scope, false);
+        } else if (!strcmp(first->s, "load")) {
+            enforceArgumentArity(args, 1, "load");
+            Node *node = makeNode(runLoad, 1);
+            node->value = args;
+            node->children[0] = compileNode(args, scope, false);
+            return node;
+        } else if (!strcmp(first->s, "lambda")) {
+            return compileLambdaNode(args, scope);
+        }
+    }
+
+    return compileCallNode(expr, scope, tail);
+}
+
+Node *compileClosures(Value *tree) {
+    // A top-level expression is compiled like the body of a lambda with no
+    // parameters, so its lets have a frame to put their variables in
+    Node *node = makeNode(runTopLevel, 0);
+    node->lambda = makeLambda();
+    Scope *scope = makeNodeScope(NULL, node->lambda);
+    node->lambda->body = compileNode(tree, scope, false);
+    return node;
+}
+
+Value *runLambdaBody(Lambda *lambda, Frame *global) {
+    globalFrame = global;
+    return callClosure(lambda, makeEnv(lambda->numSlots, NULL));
+}
+
+Value *runClosures(Node *node, Frame *global) {
+    globalFrame = global;
+    return node->run(node, NULL);
+}
+
+void interpretClosures(Value *tree) {
+    Frame *global = makeGlobalFrame();
+
+    Value *current = tree;
+    while (!isNull(current)) {
+        // Compile each expression just before running it, so that syntax
+        // errors come after the output of the expressions before them
+        Value *result = runClosures(compileClosures(current), global);
+        printResult(result);
+        current = cdr(current);
+    }
+    printf("\n");
+}
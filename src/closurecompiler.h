@@ -0,0 +1,90 @@
+#ifndef _CLOSURECOMPILER
+#define _CLOSURECOMPILER
+
+#include "value.h"
+#include "interpreter.h"
+
+// The frame of one call to a compiled lambda: its parameters, then the
+// variables of the lets inside it.
+typedef struct Env {
+    struct Env *parent;
+    Value *slots[];
+} Env;
+
+typedef struct Node Node;
+
+// Evaluates a node in the given frame.
+typedef Value *(*NodeFunction)(Node *node, Env *env);
+
+// What a compiled lambda needs to be called: its body, how big its frame is,
+// and how many parameters it has (-1 if it takes all its arguments as a list).
+// If reusesEnvs, no closure made in the body can hold on to its frame, so
+// frames are put in freeEnvs when a call returns and used again by the next.
+typedef struct Lambda {
+    Node *body;
+    int numSlots;
+    int numParams;
+    bool reusesEnvs;
+    struct Env *freeEnvs;
+} Lambda;
+
+/* One compiled expression. run is specialized for the kind of expression, and
+ * the operands it needs are resolved when the node is compiled. Which fields
+ * are used depends on run.
+ *
+ * value: a constant, the symbol of a global, or the form for error messages.
+ * cell: the binding cell of a global, once it has been looked up.
+ * depth, slot: where a local variable is, counted in frames out from the
+ *              current one.
+ * children: subexpressions, count of them.
+ * lambda: the code of a lambda expression.
+ */
+struct Node {
+    NodeFunction run;
+    Value *value;
+    Value *cell;
+    int depth;
+    int slot;
+    Node **children;
+    int count;
+    Lambda *lambda;
+};
+
+// Compiles one top-level expression, car(tree), to a tree of nodes.
+Node *compileClosures(Value *tree);
+
+// Runs a compiled top-level expression with the given global frame.
+Value *runClosures(Node *node, Frame *global);
+
+// The rest of these are the run-time support for compiled code. They are
+// shared with the code generated by the C translator in ctranslator.c.
+
+// Creates the frame for one call: numSlots empty slots.
+Env *makeEnv(int numSlots, Env *parent);
+
+// Creates a closure of lambda that captures env.
+Value *makeCompiledClosure(Lambda *lambda, Env *env);
+
+// Calls a primitive or compiled closure with numArgs evaluated arguments, and
+// returns the result. Stops with the same errors as apply().
+Value *applyFunction(Value *function, Value **args, int numArgs);
+
+// Like applyFunction, for a call in tail position of a lambda body. A call to
+// a compiled closure is left for the lambda's caller to make, so the result
+// must be returned straight out of the lambda.
+Value *tailCallFunction(Value *function, Value **args, int numArgs);
+
+// Runs a lambda body that has no parameters, like a top-level expression, in
+// a new frame, with the given global frame.
+Value *runLambdaBody(Lambda *lambda, Frame *global);
+
+// Runs the file named by a load expression, as top-level code. args is the
+// load's arguments, for error messages. Returns the value of the last
+// expression in the file.
+Value *loadAndRun(Value *args, Value *filePath);
+
+// An alternative to interpret() that compiles each top-level expression to
+// nodes and runs them. Output is the same as interpret().
+void interpretClosures(Value *tree);
+
+#endif
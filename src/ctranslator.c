@@ -0,0 +1,841 @@
+// Ahead-of-time translator from Scheme to C.
+//
+// Each lambda, and each top-level expression, becomes a C function whose body
+// is one C expression (using GCC statement expressions for sequencing). The
+// generated code uses the same frames, closures and calling convention as
+// the closure compiler in closurecompiler.c, so it can call into that file's
+// run-time support, the primitives, and the error paths in interpreter.c.
+//
+// Calls to +, -, *, <, > and = with two arguments get an inline fast path for
+// integers, guarded by a check that the global still holds the primitive, so
+// redefining them still works. When a comparison is the test of an if, cond,
+// when, unless, and or or, its fast path gives a C truth value rather than a
+// boolean Value. Other results are still boxed Values: the sum in (+ a b) is
+// a new integer Value, just as it is in the interpreter. A lambda whose body
+// makes no closures reuses its frames from one call to the next.
+
+#include "ctranslator.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <limits.h>
+#include "linkedlist.h"
+#include "parser.h"
+#include "talloc.h"
+#include "interpreter.h"
+#include "bignum.h"
+#include "text.h"
+
+#define INITIAL_BUFFER_CAPACITY 256
+
+// A growable string that C code is written to.
+typedef struct Buffer {
+    char *text;
+    int length;
+    int capacity;
+} Buffer;
+
+// A C function being generated: a lambda or a top-level expression.
+typedef struct Function {
+    int id;
+    int numSlots;
+    int numParams;
+    bool makesClosures;
+} Function;
+
+/* A group of variables that are visible to some code: the parameters of a
+ * lambda, or the bindings of a let.
+ *
+ * names: binds each name to an INT_TYPE slot number.
+ * function: the function whose frame holds the slots.
+ * letrec: whether these are a letrec's bindings, which have to be checked
+ *         when they're read, since they may not have values yet.
+ */
+typedef struct Scope {
+    Frame *names;
+    Function *function;
+    bool letrec;
+    struct Scope *parent;
+} Scope;
+
+/* Everything generated so far for the whole program.
+ *
+ * declarations: prototypes and Lambda structs of the generated functions.
+ * definitions: the generated functions.
+ * initialization: code that makes the constants and global symbols.
+ * globals: binds the name of each global used to its INT_TYPE index.
+ */
+typedef struct Translator {
+    Buffer *declarations;
+    Buffer *definitions;
+    Buffer *initialization;
+    Frame *globals;
+    int numConstants;
+    int numGlobals;
+    int numFunctions;
+} Translator;
+
+// The primitives that get integer fast paths, in the order of the builtins
+// array in the generated code, and the helper that does each one.
+static char *fastPathPrimitives[] = {"+", "-", "*", "<", ">", "="};
+static char *fastPathHelpers[] = {"fastAdd", "fastSubtract", "fastMultiply",
+                                  "fastLessThan", "fastGreaterThan",
+                                  "fastEqual"};
+#define NUM_FAST_PATHS 6
+// The fast paths from this one on are comparisons
+#define FIRST_COMPARISON 3
+
+void translateExpr(Translator *translator, Buffer *out, Value *tree,
+                   Scope *scope, bool tail);
+void translateLambda(Translator *translator, Buffer *out, Value *argsTree,
+                     Scope *scope);
+void translateTest(Translator *translator, Buffer *out, Value *tree,
+                   Scope *scope);
+
+//==============================================================================
+// Writing C code
+//==============================================================================
+
+Buffer *makeBuffer() {
+    Buffer *buffer = talloc(sizeof(Buffer));
+    buffer->capacity = INITIAL_BUFFER_CAPACITY;
+    buffer->text = talloc(buffer->capacity);
+    buffer->text[0] = '\0';
+    buffer->length = 0;
+    return buffer;
+}
+
+// Appends printf-style formatted text to a buffer.
+void appendf(Buffer *buffer, char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (buffer->length + needed + 1 > buffer->capacity) {
+        int newCapacity = 2 * buffer->capacity + needed;
+        char *newText = talloc(newCapacity);
+        memcpy(newText, buffer->text, buffer->length + 1);
+        buffer->text = newText;
+        buffer->capacity = newCapacity;
+    }
+
+    va_start(args, format);
+    vsnprintf(buffer->text + buffer->length, needed + 1, format, args);
+    va_end(args);
+    buffer->length += needed;
+}
+
+// Appends text as a C string literal.
+void appendCString(Buffer *buffer, char *text) {
+    appendf(buffer, "\"");
+    for (char *c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            appendf(buffer, "\\%c", *c);
+        } else if (*c < ' ' || *c > '~') {
+            appendf(buffer, "\\%03o", (unsigned char) *c);
+        } else {
+            appendf(buffer, "%c", *c);
+        }
+    }
+    appendf(buffer, "\"");
+}
+
+// Appends a C expression that builds a copy of a literal datum.
+void appendDatum(Buffer *buffer, Value *datum) {
+    switch (datum->type) {
+        case INT_TYPE:
+            if (datum->i == LONG_MIN) {
+                // -9223372036854775808 isn't a C literal, only its negation
+                appendf(buffer, "makeInt(%liL - 1)", datum->i + 1);
+            } else {
+                appendf(buffer, "makeInt(%liL)", datum->i);
+            }
+            break;
+        case BIGNUM_TYPE:
+            appendf(buffer, "parseInteger(\"%s\")", integerToString(datum));
+            break;
+        case DOUBLE_TYPE:
+            appendf(buffer, "makeDouble(%.17g)", datum->d);
+            break;
+        case STR_TYPE:
+            appendf(buffer, "makeString(");
+            appendCString(buffer, cString(datum));
+            appendf(buffer, ")");
+            break;
+        case SYMBOL_TYPE:
+            appendf(buffer, "makeSymbol(");
+            appendCString(buffer, datum->s);
+            appendf(buffer, ")");
+            break;
+        case BOOL_TYPE:
+            appendf(buffer, "makeBool(%s)", datum->i ? "true" : "false");
+            break;
+        case NULL_TYPE:
+            appendf(buffer, "makeNull()");
+            break;
+        case DOT_TYPE:
+            // The reader leaves the dot of a dotted pair in the list
+            appendf(buffer, "({ Value *dot = makeString(\".\"); "
+                    "dot->type = DOT_TYPE; dot; })");
+            break;
+        case VECTOR_TYPE:
+            appendf(buffer, "listToVector(");
+            appendDatum(buffer, vectorToList(datum));
+            appendf(buffer, ")");
+            break;
+        case CONS_TYPE:
+            appendf(buffer, "cons(");
+            appendDatum(buffer, car(datum));
+            appendf(buffer, ", ");
+            appendDatum(buffer, cdr(datum));
+            appendf(buffer, ")");
+            break;
+        default:
+            // The parser makes nothing else, but a void keeps the C valid
+            appendf(buffer, "makeVoid()");
+            break;
+    }
+}
+
+// Adds a constant that is built once, at startup. Returns its index.
+int addCConstant(Translator *translator, Value *datum) {
+    int index = translator->numConstants;
+    translator->numConstants++;
+    appendf(translator->initialization, "    constants[%i] = ", index);
+    appendDatum(translator->initialization, datum);
+    appendf(translator->initialization, ";\n");
+    return index;
+}
+
+// Returns the index of a global's symbol and cached cell, adding it if this
+// is the first time the global is used.
+int addGlobal(Translator *translator, Value *symbol) {
+    Value *binding = lookupBindingInFrame(symbol, translator->globals);
+    if (binding != NULL) {
+        return car(binding)->i;
+    }
+    int index = translator->numGlobals;
+    translator->numGlobals++;
+    addBinding(symbol, makeInt(index), translator->globals);
+    appendf(translator->initialization, "    symbols[%i] = makeSymbol(", index);
+    appendCString(translator->initialization, symbol->s);
+    appendf(translator->initialization, ");\n");
+    return index;
+}
+
+// Appends the C expression for the frame depth functions out from env.
+void appendEnv(Buffer *out, int depth) {
+    appendf(out, "env");
+    for (int i = 0; i < depth; i++) {
+        appendf(out, "->parent");
+    }
+}
+
+//==============================================================================
+// Scopes
+//==============================================================================
+
+Scope *makeTranslatorScope(Scope *parent, Function *function) {
+    Scope *scope = talloc(sizeof(Scope));
+    scope->names = makeFrame(NULL);
+    scope->function = function;
+    scope->letrec = false;
+    scope->parent = parent;
+    return scope;
+}
+
+Function *makeFunction(Translator *translator) {
+    Function *function = talloc(sizeof(Function));
+    function->id = translator->numFunctions;
+    function->numSlots = 0;
+    function->numParams = 0;
+    function->makesClosures = false;
+    translator->numFunctions++;
+    return function;
+}
+
+// Gives a name a new slot in the frame of the function that scope is part of.
+int declareLocal(Scope *scope, Value *name) {
+    int slot = scope->function->numSlots;
+    scope->function->numSlots++;
+    addBinding(name, makeInt(slot), scope->names);
+    return slot;
+}
+
+/* Finds the frame slot of a local variable.
+ *
+ * depth: set to how many functions out the variable's frame is.
+ * slot: set to the variable's slot in that frame.
+ * Returns the scope that binds it, or NULL if the symbol isn't local, meaning
+ * it is a global.
+ */
+Scope *resolveLocalSlot(Scope *scope, Value *symbol, int *depth, int *slot) {
+    *depth = 0;
+    Function *currentFunction = scope == NULL ? NULL : scope->function;
+    while (scope != NULL) {
+        if (scope->function != currentFunction) {
+            currentFunction = scope->function;
+            (*depth)++;
+        }
+        Value *binding = lookupBindingInFrame(symbol, scope->names);
+        if (binding != NULL) {
+            *slot = car(binding)->i;
+            return scope;
+        }
+        scope = scope->parent;
+    }
+    return NULL;
+}
+
+//==============================================================================
+// Translating expressions
+//==============================================================================
+
+void translateAtom(Translator *translator, Buffer *out, Value *expr,
+                   Scope *scope) {
+    if (isSymbol(expr)) {
+        int depth, slot;
+        Scope *binder = resolveLocalSlot(scope, expr, &depth, &slot);
+        if (binder != NULL && binder->letrec) {
+            // A letrec variable may not have its value yet
+            appendf(out, "({ Value *bound = ");
+            appendEnv(out, depth);
+            appendf(out, "->slots[%i]; if (bound->type == UNINITIALIZED) "
+                    "uninitializedVariable(constants[%i]); bound; })",
+                    slot, addCConstant(translator, expr));
+        } else if (binder != NULL) {
+            appendEnv(out, depth);
+            appendf(out, "->slots[%i]", slot);
+        } else {
+            appendf(out, "car(globalCell(%i))", addGlobal(translator, expr));
+        }
+    } else if (isNumber(expr) || isString(expr) || isBoolean(expr)
+               || isNull(expr) || isVector(expr)) {
+        appendf(out, "constants[%i]", addCConstant(translator, expr));
+    } else {
+        // Let evalAtom report the error if this is ever evaluated
+        appendf(out, "evalAtom(constants[%i], global)",
+                addCConstant(translator, expr));
+    }
+}
+
+// Translates a body. An empty body is void, like begin.
+void translateSequence(Translator *translator, Buffer *out, Value *body,
+                       Scope *scope, bool tail) {
+    if (isNull(body)) {
+        appendf(out, "makeVoid()");
+        return;
+    }
+    if (isNull(cdr(body))) {
+        translateExpr(translator, out, body, scope, tail);
+        return;
+    }
+
+    appendf(out, "({ ");
+    Value *currentExpr = body;
+    while (!isNull(currentExpr)) {
+        bool isLast = isNull(cdr(currentExpr));
+        translateExpr(translator, out, currentExpr, scope, tail && isLast);
+        appendf(out, "; ");
+        currentExpr = cdr(currentExpr);
+    }
+    appendf(out, "})");
+}
+
+void translateIf(Translator *translator, Buffer *out, Value *argsTree,
+                 Scope *scope, bool tail) {
+    checkIfSyntax(argsTree);
+    appendf(out, "(");
+    translateTest(translator, out, argsTree, scope);
+    appendf(out, " ? ");
+    translateExpr(translator, out, cdr(argsTree), scope, tail);
+    appendf(out, " : ");
+    translateExpr(translator, out, cdr(cdr(argsTree)), scope, tail);
+    appendf(out, ")");
+}
+
+// Translates when (isWhen) or unless.
+void translateWhen(Translator *translator, Buffer *out, Value *argsTree,
+                   Scope *scope, bool tail, bool isWhen) {
+    if (isWhen) {
+        checkWhenSyntax(argsTree);
+    } else {
+        checkUnlessSyntax(argsTree);
+    }
+    appendf(out, isWhen ? "(" : "(!");
+    translateTest(translator, out, argsTree, scope);
+    appendf(out, " ? ");
+    translateSequence(translator, out, cdr(argsTree), scope, tail);
+    appendf(out, " : makeVoid())");
+}
+
+// Translates cond to nested conditional expressions.
+void translateCond(Translator *translator, Buffer *out, Value *argsTree,
+                   Scope *scope, bool tail) {
+    checkCondSyntax(argsTree);
+    int numOpen = 0;
+    bool hasElse = false;
+
+    Value *currentExpr = argsTree;
+    while (!isNull(currentExpr)) {
+        Value *clause = car(currentExpr);
+        if (isElseClause(clause)) {
+            translateSequence(translator, out, cdr(clause), scope, tail);
+            hasElse = true;
+            break;
+        }
+        appendf(out, "(");
+        translateTest(translator, out, clause, scope);
+        appendf(out, " ? ");
+        translateSequence(translator, out, cdr(clause), scope, tail);
+        appendf(out, " : ");
+        numOpen++;
+        currentExpr = cdr(currentExpr);
+    }
+
+    if (!hasElse) {
+        appendf(out, "makeVoid()");
+    }
+    for (int i = 0; i < numOpen; i++) {
+        appendf(out, ")");
+    }
+}
+
+// Translates and (isAnd) or or. Like eval, the result is always #t or #f.
+void translateAndOr(Translator *translator, Buffer *out, Value *argsTree,
+                    Scope *scope, bool isAnd) {
+    appendf(out, "makeBool(%s", isAnd ? "true" : "false");
+    Value *currentExpr = argsTree;
+    while (!isNull(currentExpr)) {
+        appendf(out, isAnd ? " && " : " || ");
+        translateTest(translator, out, currentExpr, scope);
+        currentExpr = cdr(currentExpr);
+    }
+    appendf(out, ")");
+}
+
+// Translates let (isStar false) or let*.
+void translateLet(Translator *translator, Buffer *out, Value *argsTree,
+                  Scope *scope, bool tail, bool isStar) {
+    checkLetSyntax(argsTree, isStar ? "let*" : "let");
+    int numBindings = length(car(argsTree));
+
+    // exprScopes[i] is what the i-th expression can see: none of the let's
+    // variables, or for let*, the ones before it.
+    Scope *exprScopes[numBindings + 1];
+    int slots[numBindings + 1];
+    Scope *letScope = makeTranslatorScope(scope, scope->function);
+    Value *currentBindingPair = car(argsTree);
+    for (int i = 0; i < numBindings; i++) {
+        checkLetBindingPair(currentBindingPair, argsTree);
+        if (isStar) {
+            // Each binding gets its own scope, so it can see the earlier ones
+            exprScopes[i] = letScope;
+            letScope = makeTranslatorScope(letScope, scope->function);
+        } else {
+            exprScopes[i] = scope;
+        }
+        checkBinding(car(currentBindingPair), letScope->names);
+        slots[i] = declareLocal(letScope, car(car(currentBindingPair)));
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    appendf(out, "({ ");
+    currentBindingPair = car(argsTree);
+    for (int i = 0; i < numBindings; i++) {
+        appendf(out, "env->slots[%i] = ", slots[i]);
+        translateExpr(translator, out, cdr(car(currentBindingPair)),
+                      exprScopes[i], false);
+        appendf(out, "; ");
+        currentBindingPair = cdr(currentBindingPair);
+    }
+    translateSequence(translator, out, cdr(argsTree), letScope, tail);
+    appendf(out, "; })");
+}
+
+void translateLetRec(Translator *translator, Buffer *out, Value *argsTree,
+                     Scope *scope, bool tail) {
+    checkLetSyntax(argsTree, "let");
+
+    // Declare every name first, so all the expressions can see them
+    Scope *letScope = makeTranslatorScope(scope, scope->function);
+    letScope->letrec = true;
+    appendf(out, "({ ");
+    Value *currentBindingPair = car(argsTree);
+    while (!isNull(currentBindingPair)) {
+        checkLetRecBindingPair(currentBindingPair, argsTree);
+        int slot = declareLocal(letScope, car(car(currentBindingPair)));
+        appendf(out, "env->slots[%i] = makeValue(UNINITIALIZED); ", slot);
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    currentBindingPair = car(argsTree);
+    while (!isNull(currentBindingPair)) {
+        int depth, slot;
+        resolveLocalSlot(letScope, car(car(currentBindingPair)), &depth, &slot);
+        appendf(out, "env->slots[%i] = ", slot);
+        translateExpr(translator, out, cdr(car(currentBindingPair)),
+                      letScope, false);
+        appendf(out, "; ");
+        currentBindingPair = cdr(currentBindingPair);
+    }
+
+    translateSequence(translator, out, cdr(argsTree), letScope, tail);
+    appendf(out, "; })");
+}
+
+void translateDefine(Translator *translator, Buffer *out, Value *argsTree,
+                     Scope *scope) {
+    Value *symbol = checkDefineSyntax(argsTree);
+    appendf(out, "({ defineGlobal(symbols[%i], ", addGlobal(translator, symbol));
+    if (isCons(car(argsTree))) {
+        // Lambda shorthand syntax
+        Value *lambdaExpr = cons(cdr(car(argsTree)), cdr(argsTree));
+        translateLambda(translator, out, lambdaExpr, scope);
+    } else {
+        translateExpr(translator, out, cdr(argsTree), scope, false);
+    }
+    appendf(out, ", global); makeVoid(); })");
+}
+
+void translateSetBang(Translator *translator, Buffer *out, Value *argsTree,
+                      Scope *scope) {
+    checkSetBangSyntax(argsTree);
+    appendf(out, "({ Value *value = ");
+    translateExpr(translator, out, cdr(argsTree), scope, false);
+    appendf(out, "; ");
+
+    int depth, slot;
+    if (resolveLocalSlot(scope, car(argsTree), &depth, &slot)) {
+        appendEnv(out, depth);
+        appendf(out, "->slots[%i] = value; ", slot);
+    } else {
+        appendf(out, "globalCell(%i)->c.car = value; ",
+                addGlobal(translator, car(argsTree)));
+    }
+    appendf(out, "makeVoid(); })");
+}
+
+// Generates the C function and Lambda struct for a function whose body has
+// been translated to bodyCode.
+void finishFunction(Translator *translator, Function *function,
+                    Buffer *bodyCode) {
+    appendf(translator->declarations,
+            "static Value *function%i(Node *node, Env *env);\n"
+            "static Node function%iBody = {.run = function%i};\n"
+            "static Lambda function%iLambda = {&function%iBody, %i, %i, %s};\n",
+            function->id, function->id, function->id, function->id,
+            function->id, function->numSlots, function->numParams,
+            function->makesClosures ? "false" : "true");
+    appendf(translator->definitions,
+            "static Value *function%i(Node *node, Env *env) {\n"
+            "    return %s;\n"
+            "}\n\n",
+            function->id, bodyCode->text);
+}
+
+void translateLambda(Translator *translator, Buffer *out, Value *argsTree,
+                     Scope *scope) {
+    checkLambdaSyntax(argsTree);
+    // The closure holds on to the frame it's made in
+    scope->function->makesClosures = true;
+    Function *function = makeFunction(translator);
+    Scope *lambdaScope = makeTranslatorScope(scope, function);
+
+    // Parameters take the first slots, in order
+    Value *params = car(argsTree);
+    if (isSymbol(params)) {
+        function->numParams = -1;
+        declareLocal(lambdaScope, params);
+    } else {
+        Value *currentParam = params;
+        while (!isNull(currentParam)) {
+            declareLocal(lambdaScope, car(currentParam));
+            function->numParams++;
+            currentParam = cdr(currentParam);
+        }
+    }
+
+    Buffer *bodyCode = makeBuffer();
+    translateSequence(translator, bodyCode, cdr(argsTree), lambdaScope, true);
+    finishFunction(translator, function, bodyCode);
+    appendf(out, "makeCompiledClosure(&function%iLambda, env)", function->id);
+}
+
+// Returns which fast path a call can use, or -1 if it can't use one: the
+// operator must be one of the global primitives with a fast path, and it must
+// have two arguments.
+int findFastPath(Value *expr, Scope *scope) {
+    Value *operatorExpr = car(expr);
+    int depth, slot;
+    if (!isSymbol(operatorExpr) || length(cdr(expr)) != 2
+        || resolveLocalSlot(scope, operatorExpr, &depth, &slot)) {
+        return -1;
+    }
+    for (int i = 0; i < NUM_FAST_PATHS; i++) {
+        if (!strcmp(operatorExpr->s, fastPathPrimitives[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Translates a call with a fast path to a call to helper, which is given the
+// operator and the two arguments.
+void translateFastPath(Translator *translator, Buffer *out, Value *expr,
+                       Scope *scope, char *helper) {
+    // The operator is evaluated first, then each argument, left to right
+    appendf(out, "({ Value *function = ");
+    translateExpr(translator, out, expr, scope, false);
+    appendf(out, "; Value *first = ");
+    translateExpr(translator, out, cdr(expr), scope, false);
+    appendf(out, "; Value *second = ");
+    translateExpr(translator, out, cdr(cdr(expr)), scope, false);
+    appendf(out, "; %s(function, first, second); })", helper);
+}
+
+void translateApplication(Translator *translator, Buffer *out, Value *expr,
+                          Scope *scope, bool tail) {
+    int fastPath = findFastPath(expr, scope);
+    if (fastPath >= 0) {
+        translateFastPath(translator, out, expr, scope,
+                          fastPathHelpers[fastPath]);
+        return;
+    }
+
+    int numArgs = length(cdr(expr));
+    appendf(out, "({ Value *function = ");
+    translateExpr(translator, out, expr, scope, false);
+    appendf(out, "; Value *args[%i]; ", numArgs + 1);
+    Value *currentArg = cdr(expr);
+    for (int i = 0; i < numArgs; i++) {
+        appendf(out, "args[%i] = ", i);
+        translateExpr(translator, out, currentArg, scope, false);
+        appendf(out, "; ");
+        currentArg = cdr(currentArg);
+    }
+    appendf(out, "%s(function, args, %i); })",
+            tail ? "tailCallFunction" : "applyFunction", numArgs);
+}
+
+/* Translates car(tree) to a C expression that is true unless its value is #f.
+ * A comparison with a fast path uses the helper that compares integers
+ * without making a boolean Value.
+ */
+void translateTest(Translator *translator, Buffer *out, Value *tree,
+                   Scope *scope) {
+    Value *expr = car(tree);
+    int fastPath = isCons(expr) ? findFastPath(expr, scope) : -1;
+    if (fastPath >= FIRST_COMPARISON) {
+        char *helper = talloc(strlen(fastPathHelpers[fastPath]) + 5);
+        sprintf(helper, "%sTest", fastPathHelpers[fastPath]);
+        translateFastPath(translator, out, expr, scope, helper);
+        return;
+    }
+    appendf(out, "isTrue(");
+    translateExpr(translator, out, tree, scope, false);
+    appendf(out, ")");
+}
+
+/* Translates the expression car(tree) to a C expression.
+ *
+ * tail: whether the expression is in tail position in a lambda body, so that
+ *       a call there can be made by the lambda's caller instead.
+ */
+void translateExpr(Translator *translator, Buffer *out, Value *tree,
+                   Scope *scope, bool tail) {
+    assert(tree != NULL);
+    Value *expr = car(tree);
+
+    if (!isCons(expr)) {
+        translateAtom(translator, out, expr, scope);
+        return;
+    }
+
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+
+    if (isSymbol(first)) {
+        // Special cases
+        if (!strcmp(first->s, "if")) {
+            translateIf(translator, out, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "let")) {
+            translateLet(translator, out, args, scope, tail, false);
+            return;
+        } else if (!strcmp(first->s, "let*")) {
+            translateLet(translator, out, args, scope, tail, true);
+            return;
+        } else if (!strcmp(first->s, "letrec")) {
+            translateLetRec(translator, out, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "display")) {
+            enforceArgumentArity(args, 1, "display");
+            appendf(out, "({ printValue(");
+            translateExpr(translator, out, args, scope, false);
+            appendf(out, "); makeValue(VOID_TYPE); })");
+            return;
+        } else if (!strcmp(first->s, "when")) {
+            translateWhen(translator, out, args, scope, tail, true);
+            return;
+        } else if (!strcmp(first->s, "unless")) {
+            translateWhen(translator, out, args, scope, tail, false);
+            return;
+        } else if (!strcmp(first->s, "quote")) {
+            appendf(out, "constants[%i]",
+                    addCConstant(translator, evalQuote(args, NULL)));
+            return;
+        } else if (!strcmp(first->s, "define")) {
+            translateDefine(translator, out, args, scope);
+            return;
+        } else if (!strcmp(first->s, "set!")) {
+            translateSetBang(translator, out, args, scope);
+            return;
+        } else if (!strcmp(first->s, "begin")) {
+            translateSequence(translator, out, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "cond")) {
+            translateCond(translator, out, args, scope, tail);
+            return;
+        } else if (!strcmp(first->s, "and")) {
+            translateAndOr(translator, out, args, scope, true);
+            return;
+        } else if (!strcmp(first->s, "or")) {
+            translateAndOr(translator, out, args, scope, false);
+            return;
+        } else if (!strcmp(first->s, "load")) {
+            enforceArgumentArity(args, 1, "load");
+            int argsIndex = addCConstant(translator, args);
+            appendf(out, "loadAndRun(constants[%i], ", argsIndex);
+            translateExpr(translator, out, args, scope, false);
+            appendf(out, ")");
+            return;
+        } else if (!strcmp(first->s, "lambda")) {
+            translateLambda(translator, out, args, scope);
+            return;
+        }
+    }
+
+    translateApplication(translator, out, expr, scope, tail);
+}
+
+//==============================================================================
+// Translating a program
+//==============================================================================
+
+// Prints the run-time helpers used by the generated code.
+void printPreamble(Translator *translator) {
+    printf("// Generated from a Scheme program by interpreter --emit-c.\n\n");
+    printf("#include <stdio.h>\n");
+    printf("#include \"value.h\"\n");
+    printf("#include \"linkedlist.h\"\n");
+    printf("#include \"parser.h\"\n");
+    printf("#include \"talloc.h\"\n");
+    printf("#include \"interpreter.h\"\n");
+    printf("#include \"closurecompiler.h\"\n");
+    printf("#include \"output.h\"\n");
+    printf("#include \"bignum.h\"\n\n");
+
+    printf("static Frame *global;\n");
+    printf("static Value *constants[%i];\n", translator->numConstants + 1);
+    printf("static Value *symbols[%i];\n", translator->numGlobals + 1);
+    printf("static Value *cells[%i];\n", translator->numGlobals + 1);
+    printf("static Value *builtins[%i];\n\n", NUM_FAST_PATHS);
+
+    printf("// Returns the binding cell of global number index, looking it up "
+           "the first\n// time.\n");
+    printf("static inline Value *globalCell(int index) {\n"
+           "    if (cells[index] == NULL) {\n"
+           "        cells[index] = lookUpSymbol(symbols[index], global);\n"
+           "    }\n"
+           "    return cells[index];\n"
+           "}\n\n");
+
+    // On overflow, the integer cases leave it to the primitive
+    char *arithmetic[] = {"add", "sub", "mul"};
+    for (int i = 0; i < 3; i++) {
+        printf("static inline Value *%s(Value *function, Value *first, "
+               "Value *second) {\n"
+               "    long result;\n"
+               "    if (function == builtins[%i] && isInteger(first) "
+               "&& isInteger(second)\n"
+               "        && !__builtin_%s_overflow(first->i, second->i, "
+               "&result)) {\n"
+               "        return makeInt(result);\n"
+               "    }\n"
+               "    Value *args[2] = {first, second};\n"
+               "    return applyFunction(function, args, 2);\n"
+               "}\n\n", fastPathHelpers[i], i, arithmetic[i]);
+    }
+    // Each comparison also has a Test version for the tests of conditionals
+    char *comparisons[] = {"<", ">", "=="};
+    for (int i = FIRST_COMPARISON; i < NUM_FAST_PATHS; i++) {
+        char *comparison = comparisons[i - FIRST_COMPARISON];
+        printf("static inline Value *%s(Value *function, Value *first, "
+               "Value *second) {\n"
+               "    if (function == builtins[%i] && isInteger(first) "
+               "&& isInteger(second)) {\n"
+               "        return makeBool(first->i %s second->i);\n"
+               "    }\n"
+               "    Value *args[2] = {first, second};\n"
+               "    return applyFunction(function, args, 2);\n"
+               "}\n\n", fastPathHelpers[i], i, comparison);
+        printf("static inline bool %sTest(Value *function, Value *first, "
+               "Value *second) {\n"
+               "    if (function == builtins[%i] && isInteger(first) "
+               "&& isInteger(second)) {\n"
+               "        return first->i %s second->i;\n"
+               "    }\n"
+               "    Value *args[2] = {first, second};\n"
+               "    return isTrue(applyFunction(function, args, 2));\n"
+               "}\n\n", fastPathHelpers[i], i, comparison);
+    }
+}
+
+void translateToC(Value *tree) {
+    Translator *translator = talloc(sizeof(Translator));
+    translator->declarations = makeBuffer();
+    translator->definitions = makeBuffer();
+    translator->initialization = makeBuffer();
+    translator->globals = makeFrame(NULL);
+    translator->numConstants = 0;
+    translator->numGlobals = 0;
+    translator->numFunctions = 0;
+
+    // Each top-level expression is a function with no parameters, so its lets
+    // have a frame to put their variables in
+    Buffer *runCode = makeBuffer();
+    Value *current = tree;
+    while (!isNull(current)) {
+        Function *function = makeFunction(translator);
+        Scope *scope = makeTranslatorScope(NULL, function);
+        Buffer *bodyCode = makeBuffer();
+        translateExpr(translator, bodyCode, current, scope, false);
+        finishFunction(translator, function, bodyCode);
+        appendf(runCode, "    printResult(runLambdaBody(&function%iLambda, "
+                "global));\n", function->id);
+        current = cdr(current);
+    }
+
+    printPreamble(translator);
+    printf("%s\n", translator->declarations->text);
+    printf("%s", translator->definitions->text);
+
+    printf("int main() {\n");
+    printf("    initOutput();\n");
+    printf("    global = makeGlobalFrame();\n");
+    for (int i = 0; i < NUM_FAST_PATHS; i++) {
+        printf("    builtins[%i] = car(lookUpSymbol(makeSymbol(\"%s\"), "
+               "global));\n", i, fastPathPrimitives[i]);
+    }
+    printf("%s", translator->initialization->text);
+    printf("%s", runCode->text);
+    printf("    printf(\"\\n\");\n");
+    printf("    tfree();\n");
+    printf("    return 0;\n");
+    printf("}\n");
+}
@@ -0,0 +1,12 @@
+#ifndef _CTRANSLATOR
+#define _CTRANSLATOR
+
+#include "value.h"
+
+// Translates a whole program to C source code and prints it. The C program
+// does what interpret(tree) would. It is linked against the runtime (every
+// object file but main.o) to make a standalone executable; see the .bin rule
+// in the Makefile. Syntax errors are reported here, at translation time.
+void translateToC(Value *tree);
+
+#endif
@@ -0,0 +1,408 @@
+// Shortest round-trip formatting of doubles.
+//
+// The digits come from Ryu (Ulf Adams, "Ryu: Fast Float-to-String
+// Conversion", PLDI 2018). The double and the halfway points to its two
+// neighbours are scaled to decimal with a 128-bit multiplication by a power
+// of five, and digits are dropped from the end for as long as the interval
+// between the halfway points still holds a single number. The tables of
+// powers of five are worked out the first time a double is printed, rather
+// than written out here.
+//
+// Doubles that hold small integers, which are most of them in practice,
+// skip all of that.
+
+#include "dtoa.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_BIAS 1023
+
+// How many bits of each power of five, and of each inverse, the tables keep
+#define POW5_BITCOUNT 125
+#define POW5_INV_BITCOUNT 125
+
+// How many powers the tables need to cover every double
+#define POW5_TABLE_SIZE 326
+#define POW5_INV_TABLE_SIZE 342
+
+typedef __uint128_t uint128;
+
+// The top POW5_BITCOUNT bits of 5^i
+static uint128 pow5Split[POW5_TABLE_SIZE];
+
+// 2^(bits in 5^i - 1 + POW5_INV_BITCOUNT) / 5^i, rounded up
+static uint128 pow5InvSplit[POW5_INV_TABLE_SIZE];
+
+static bool tablesReady = false;
+
+//==================
+// Tables
+//==================
+
+// Enough 32-bit limbs, least significant first, for twice 5^341
+#define BIG_LIMBS 32
+
+typedef struct BigNumber {
+    uint32_t limbs[BIG_LIMBS];
+} BigNumber;
+
+int bigBitLength(const BigNumber *n) {
+    for (int i = BIG_LIMBS - 1; i >= 0; i--) {
+        if (n->limbs[i] != 0) {
+            return i * 32 + 32 - __builtin_clz(n->limbs[i]);
+        }
+    }
+    return 0;
+}
+
+bool bigBit(const BigNumber *n, int bit) {
+    return (n->limbs[bit / 32] >> (bit % 32)) & 1;
+}
+
+void bigMultiplySmall(BigNumber *n, uint32_t factor) {
+    uint64_t carry = 0;
+    for (int i = 0; i < BIG_LIMBS; i++) {
+        uint64_t product = (uint64_t) n->limbs[i] * factor + carry;
+        n->limbs[i] = (uint32_t) product;
+        carry = product >> 32;
+    }
+}
+
+bool bigAtLeast(const BigNumber *a, const BigNumber *b) {
+    for (int i = BIG_LIMBS - 1; i >= 0; i--) {
+        if (a->limbs[i] != b->limbs[i]) {
+            return a->limbs[i] > b->limbs[i];
+        }
+    }
+    return true;
+}
+
+void bigSubtract(BigNumber *a, const BigNumber *b) {
+    int64_t borrow = 0;
+    for (int i = 0; i < BIG_LIMBS; i++) {
+        int64_t difference = (int64_t) a->limbs[i] - b->limbs[i] - borrow;
+        borrow = difference < 0;
+        a->limbs[i] = (uint32_t) (difference + (borrow << 32));
+    }
+}
+
+// Returns the number made of bits [low, low + count) of n, count <= 128.
+uint128 bigBits(const BigNumber *n, int low, int count) {
+    uint128 result = 0;
+    for (int bit = low + count - 1; bit >= low; bit--) {
+        result = (result << 1) | (bit >= 0 && bigBit(n, bit));
+    }
+    return result;
+}
+
+/* Fills in both tables.
+ *
+ * pow5Split[i] is 5^i shifted so it has exactly POW5_BITCOUNT bits.
+ * pow5InvSplit[i] comes from long division, one quotient bit at a time:
+ * the dividend is a one followed by zeros, so the remainder can start at
+ * the leading one's value, which is already less than 5^i.
+ */
+void computeTables() {
+    BigNumber pow5;
+    memset(&pow5, 0, sizeof(pow5));
+    pow5.limbs[0] = 1;
+
+    for (int i = 0; i < POW5_INV_TABLE_SIZE; i++) {
+        int length = bigBitLength(&pow5);
+        if (i < POW5_TABLE_SIZE) {
+            pow5Split[i] = bigBits(&pow5, length - POW5_BITCOUNT, POW5_BITCOUNT);
+        }
+
+        if (i == 0) {
+            pow5InvSplit[i] = ((uint128) 1 << POW5_INV_BITCOUNT) + 1;
+        } else {
+            BigNumber remainder;
+            memset(&remainder, 0, sizeof(remainder));
+            remainder.limbs[(length - 1) / 32] = 1u << ((length - 1) % 32);
+            uint128 quotient = 0;
+            for (int bit = 0; bit < POW5_INV_BITCOUNT; bit++) {
+                bigMultiplySmall(&remainder, 2);
+                quotient <<= 1;
+                if (bigAtLeast(&remainder, &pow5)) {
+                    bigSubtract(&remainder, &pow5);
+                    quotient |= 1;
+                }
+            }
+            pow5InvSplit[i] = quotient + 1;
+        }
+
+        bigMultiplySmall(&pow5, 5);
+    }
+    tablesReady = true;
+}
+
+//==================
+// Digits
+//==================
+
+// The number of bits in 5^e, for 0 <= e <= 3528; 1 for e = 0.
+int pow5Bits(int e) {
+    return ((e * 1217359) >> 19) + 1;
+}
+
+// floor(log10(2^e)) and floor(log10(5^e)), for e >= 0
+int log10Pow2(int e) {
+    return (e * 78913) >> 18;
+}
+
+int log10Pow5(int e) {
+    return (e * 732923) >> 20;
+}
+
+bool isMultipleOfPow5(uint64_t value, int p) {
+    int count = 0;
+    while (value % 5 == 0) {
+        value /= 5;
+        count++;
+    }
+    return count >= p;
+}
+
+bool isMultipleOfPow2(uint64_t value, int p) {
+    return (value & ((1ull << p) - 1)) == 0;
+}
+
+// (m * factor) >> shift, where shift > 64 and the result fits in 64 bits.
+uint64_t mulShift(uint64_t m, uint128 factor, int shift) {
+    uint128 low = (uint128) m * (uint64_t) factor;
+    uint128 high = (uint128) m * (uint64_t) (factor >> 64);
+    return (uint64_t) (((low >> 64) + high) >> (shift - 64));
+}
+
+/* Finds the shortest decimal that rounds to the finite, positive double with
+ * the given mantissa and exponent fields: *digits * 10^*exponent.
+ */
+void shortestDigits(uint64_t ieeeMantissa, int ieeeExponent, uint64_t *digits,
+                    int *exponent) {
+    // The value is m2 * 2^e2, and the two halfway points are mv +- 2 in units
+    // of 2^e2 / 4; the lower one is closer when m2 is a power of two
+    int e2;
+    uint64_t m2;
+    if (ieeeExponent == 0) {
+        e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+        m2 = ieeeMantissa;
+    } else {
+        e2 = ieeeExponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+        m2 = (1ull << DOUBLE_MANTISSA_BITS) | ieeeMantissa;
+    }
+    bool acceptBounds = (m2 & 1) == 0;
+    uint64_t mv = 4 * m2;
+    int mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+
+    // Scale the value and the halfway points to vr, vp and vm times 10^e10
+    uint64_t vr, vp, vm;
+    int e10;
+    bool vmIsTrailingZeros = false;
+    bool vrIsTrailingZeros = false;
+    if (e2 >= 0) {
+        int q = log10Pow2(e2) - (e2 > 3);
+        e10 = q;
+        int k = POW5_INV_BITCOUNT + pow5Bits(q) - 1;
+        int i = -e2 + q + k;
+        vr = mulShift(4 * m2, pow5InvSplit[q], i);
+        vp = mulShift(4 * m2 + 2, pow5InvSplit[q], i);
+        vm = mulShift(4 * m2 - 1 - mmShift, pow5InvSplit[q], i);
+        if (q <= 21) {
+            if (mv % 5 == 0) {
+                vrIsTrailingZeros = isMultipleOfPow5(mv, q);
+            } else if (acceptBounds) {
+                vmIsTrailingZeros = isMultipleOfPow5(mv - 1 - mmShift, q);
+            } else {
+                vp -= isMultipleOfPow5(mv + 2, q);
+            }
+        }
+    } else {
+        int q = log10Pow5(-e2) - (-e2 > 1);
+        e10 = q + e2;
+        int i = -e2 - q;
+        int k = pow5Bits(i) - POW5_BITCOUNT;
+        int j = q - k;
+        vr = mulShift(4 * m2, pow5Split[i], j);
+        vp = mulShift(4 * m2 + 2, pow5Split[i], j);
+        vm = mulShift(4 * m2 - 1 - mmShift, pow5Split[i], j);
+        if (q <= 1) {
+            vrIsTrailingZeros = true;
+            if (acceptBounds) {
+                vmIsTrailingZeros = mmShift == 1;
+            } else {
+                vp--;
+            }
+        } else if (q < 63) {
+            vrIsTrailingZeros = isMultipleOfPow2(mv, q);
+        }
+    }
+
+    // Drop digits while the interval still holds only one number
+    int removed = 0;
+    int lastRemovedDigit = 0;
+    uint64_t output;
+    if (vmIsTrailingZeros || vrIsTrailingZeros) {
+        // The exact value may end in zeros, which matters for rounding
+        while (vp / 10 > vm / 10) {
+            vmIsTrailingZeros &= vm % 10 == 0;
+            vrIsTrailingZeros &= lastRemovedDigit == 0;
+            lastRemovedDigit = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vmIsTrailingZeros) {
+            while (vm % 10 == 0) {
+                vrIsTrailingZeros &= lastRemovedDigit == 0;
+                lastRemovedDigit = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0) {
+            // Exactly halfway: round to even
+            lastRemovedDigit = 4;
+        }
+        output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros))
+                       || lastRemovedDigit >= 5);
+    } else {
+        bool roundUp = false;
+        if (vp / 100 > vm / 100) {
+            roundUp = vr % 100 >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+        while (vp / 10 > vm / 10) {
+            roundUp = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || roundUp);
+    }
+    *digits = output;
+    *exponent = e10 + removed;
+}
+
+//==================
+// Formatting
+//==================
+
+// Copies s to buffer and returns its length.
+int copyText(char *buffer, const char *s) {
+    strcpy(buffer, s);
+    return strlen(s);
+}
+
+// Writes n zeros to p and returns the end.
+char *writeZeros(char *p, int n) {
+    memset(p, '0', n);
+    return p + n;
+}
+
+int formatDouble(double value, char *buffer) {
+    if (isnan(value)) {
+        return copyText(buffer, signbit(value) ? "-nan" : "nan");
+    } else if (isinf(value)) {
+        return copyText(buffer, value < 0 ? "-inf" : "inf");
+    }
+
+    char *p = buffer;
+    if (signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+
+    uint64_t digits;
+    int exponent = 0;
+    if (value < 9007199254740992.0 && value == (double) (uint64_t) value) {
+        // A whole number below 2^53 is exactly its own digits
+        digits = (uint64_t) value;
+    } else {
+        if (!tablesReady) {
+            computeTables();
+        }
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        shortestDigits(bits & ((1ull << DOUBLE_MANTISSA_BITS) - 1),
+                       (int) (bits >> DOUBLE_MANTISSA_BITS), &digits,
+                       &exponent);
+        while (digits != 0 && digits % 10 == 0) {
+            digits /= 10;
+            exponent++;
+        }
+    }
+
+    char text[24];
+    int length = 0;
+    do {
+        text[length++] = '0' + digits % 10;
+        digits /= 10;
+    } while (digits != 0);
+    for (int i = 0; i < length / 2; i++) {
+        char c = text[i];
+        text[i] = text[length - 1 - i];
+        text[length - 1 - i] = c;
+    }
+
+    int leadingExponent = length - 1 + exponent;
+    if (value != 0 && (leadingExponent < -7 || leadingExponent >= 21)) {
+        // d.ddde+XX
+        *p++ = text[0];
+        if (length > 1) {
+            *p++ = '.';
+            memcpy(p, text + 1, length - 1);
+            p += length - 1;
+        }
+        *p++ = 'e';
+        *p++ = leadingExponent < 0 ? '-' : '+';
+        int magnitude = abs(leadingExponent);
+        if (magnitude >= 100) {
+            *p++ = '0' + magnitude / 100;
+        }
+        *p++ = '0' + magnitude / 10 % 10;
+        *p++ = '0' + magnitude % 10;
+        *p = '\0';
+        return p - buffer;
+    }
+
+    // ddd.dddddd, with at least six digits after the point
+    int fractionDigits;
+    if (exponent >= 0) {
+        memcpy(p, text, length);
+        p = writeZeros(p + length, exponent);
+        *p++ = '.';
+        fractionDigits = 0;
+    } else {
+        int integerDigits = length + exponent;
+        if (integerDigits > 0) {
+            memcpy(p, text, integerDigits);
+            p += integerDigits;
+            *p++ = '.';
+            memcpy(p, text + integerDigits, length - integerDigits);
+            p += length - integerDigits;
+        } else {
+            *p++ = '0';
+            *p++ = '.';
+            p = writeZeros(p, -integerDigits);
+            memcpy(p, text, length);
+            p += length;
+        }
+        fractionDigits = -exponent;
+    }
+    if (fractionDigits < 6) {
+        p = writeZeros(p, 6 - fractionDigits);
+    }
+    *p = '\0';
+    return p - buffer;
+}
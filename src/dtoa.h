@@ -0,0 +1,20 @@
+#ifndef _DTOA
+#define _DTOA
+
+// The most characters formatDouble writes, not counting the terminating NUL.
+#define FORMAT_DOUBLE_MAX 40
+
+/* Writes value to buffer as the shortest decimal that reads back as the same
+ * double, and returns its length. buffer must have room for
+ * FORMAT_DOUBLE_MAX + 1 characters.
+ *
+ * It looks like printf's %f: at least six digits after the point, padded with
+ * zeros, so values like 6.0 and 2.5 print just as %f prints them. More digits
+ * are printed when they are needed to tell the value apart from its
+ * neighbours, like 0.30000000000000004, and fewer when %f would print digits
+ * that make no difference. Values from 1e21 up, or below 1e-7,
+ * use an exponent: 1e+21, 1.5e-08. Infinities and NaN print as %f does.
+ */
+int formatDouble(double value, char *buffer);
+
+#endif
@@ -0,0 +1,299 @@
+// Expansion of derived forms into the core language.
+//
+// interpret() expands each top-level expression just before evaluating it, so
+// syntax is checked once instead of every time a form runs, and eval() only
+// has the core forms to handle. Each derived form becomes the core forms it
+// means:
+//
+//   (let ((x e) ...) body...)     ((lambda (x ...) body...) e ...)
+//   (let* ((x e) rest...) body...) (let ((x e)) (let* (rest...) body...))
+//   (letrec ((x e) ...) body...)  ((lambda (x ...) (set! x e) ... body...)
+//                                  'uninitialized ...)
+//   (when c body...)              (if c (begin body...) 'void)
+//   (unless c body...)            (if c 'void (begin body...))
+//   (cond (c body...) ... (else body...))
+//                                 (if c (begin body...) ... (begin body...))
+//   (and a b ...)                 (if a (and b ...) #f), (and) is #t
+//   (or a b ...)                  (if a #t (or b ...)), (or) is #f
+//
+// and and or give #t or #f, as they always have here. A let with no bindings
+// is just a begin. Reading a letrec variable before it has been set is an
+// error in eval().
+
+#include "expander.h"
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "linkedlist.h"
+#include "parser.h"
+#include "talloc.h"
+#include "interpreter.h"
+
+Value *expandEach(Value *exprs);
+
+//==================
+// Building forms
+//==================
+
+// Returns (name . rest).
+Value *makeForm(char *name, Value *rest) {
+    return cons(makeSymbol(name), rest);
+}
+
+// Returns (quote value), for a constant that has no syntax of its own.
+Value *makeQuoteForm(Value *value) {
+    return makeForm("quote", cons(value, makeNull()));
+}
+
+// Returns (if condExpr thenExpr elseExpr).
+Value *makeIfForm(Value *condExpr, Value *thenExpr, Value *elseExpr) {
+    Value *branches = cons(thenExpr, cons(elseExpr, makeNull()));
+    return makeForm("if", cons(condExpr, branches));
+}
+
+// Returns (begin body...), after expanding body.
+Value *makeBeginForm(Value *body) {
+    return makeForm("begin", expandEach(body));
+}
+
+// Returns (lambda params body...), after expanding body.
+Value *makeLambdaForm(Value *params, Value *body) {
+    return makeForm("lambda", cons(params, expandEach(body)));
+}
+
+//==================
+// Derived forms
+//==================
+
+/* Checks the bindings of a let-family form and returns its names, in order.
+ *
+ * Each binding must be a (name expr) pair, and no name may be repeated, since
+ * they all go in one frame. letRec picks which form's pair check to use.
+ */
+Value *bindingNames(Value *argsTree, bool letRec) {
+    Frame *scratch = makeFrame(NULL);
+    Value *names = makeNull();
+    Value *currentBindingPair = car(argsTree);
+    while (!isNull(currentBindingPair)) {
+        if (letRec) {
+            checkLetRecBindingPair(currentBindingPair, argsTree);
+        } else {
+            checkLetBindingPair(currentBindingPair, argsTree);
+        }
+        checkBinding(car(currentBindingPair), scratch);
+        addBinding(car(car(currentBindingPair)), makeVoid(), scratch);
+
+        names = cons(car(car(currentBindingPair)), names);
+        currentBindingPair = cdr(currentBindingPair);
+    }
+    return reverse(names);
+}
+
+// Returns the expanded expressions of a let-family form's bindings, in order.
+Value *bindingExprs(Value *bindings) {
+    Value *exprs = makeNull();
+    while (!isNull(bindings)) {
+        exprs = cons(expand(car(cdr(car(bindings)))), exprs);
+        bindings = cdr(bindings);
+    }
+    return reverse(exprs);
+}
+
+Value *expandLet(Value *argsTree) {
+    checkLetSyntax(argsTree, "let");
+    Value *names = bindingNames(argsTree, false);
+    if (isNull(names)) {
+        return makeBeginForm(cdr(argsTree));
+    }
+
+    Value *lambda = makeLambdaForm(names, cdr(argsTree));
+    return cons(lambda, bindingExprs(car(argsTree)));
+}
+
+Value *expandLetStar(Value *argsTree) {
+    checkLetSyntax(argsTree, "let*");
+    Value *bindings = car(argsTree);
+    if (isNull(bindings)) {
+        return makeBeginForm(cdr(argsTree));
+    }
+
+    // Each binding gets its own let, so it can see the ones before it
+    checkLetBindingPair(bindings, argsTree);
+    checkBinding(car(bindings), makeFrame(NULL));
+    Value *body;
+    if (isNull(cdr(bindings))) {
+        body = expandEach(cdr(argsTree));
+    } else {
+        Value *rest = cons(cdr(bindings), cdr(argsTree));
+        body = cons(expandLetStar(rest), makeNull());
+    }
+
+    Value *name = car(car(bindings));
+    Value *lambda = makeForm("lambda", cons(cons(name, makeNull()), body));
+    return cons(lambda, cons(expand(car(cdr(car(bindings)))), makeNull()));
+}
+
+Value *expandLetRec(Value *argsTree) {
+    checkLetSyntax(argsTree, "let");
+    Value *names = bindingNames(argsTree, true);
+    if (isNull(names)) {
+        return makeBeginForm(cdr(argsTree));
+    }
+
+    // The body of the lambda: a set! for each binding, in order, then the
+    // letrec's own body
+    Value *body = expandEach(cdr(argsTree));
+    Value *exprs = reverse(bindingExprs(car(argsTree)));
+    Value *reversedNames = reverse(names);
+    Value *uninitialized = makeQuoteForm(makeValue(UNINITIALIZED));
+    Value *args = makeNull();
+    while (!isNull(exprs)) {
+        Value *setArgs = cons(car(reversedNames), cons(car(exprs), makeNull()));
+        body = cons(makeForm("set!", setArgs), body);
+        args = cons(uninitialized, args);
+        exprs = cdr(exprs);
+        reversedNames = cdr(reversedNames);
+    }
+
+    Value *lambda = makeForm("lambda", cons(names, body));
+    return cons(lambda, args);
+}
+
+Value *expandWhen(Value *argsTree) {
+    checkWhenSyntax(argsTree);
+    return makeIfForm(expand(car(argsTree)), makeBeginForm(cdr(argsTree)),
+                      makeQuoteForm(makeVoid()));
+}
+
+Value *expandUnless(Value *argsTree) {
+    checkUnlessSyntax(argsTree);
+    return makeIfForm(expand(car(argsTree)), makeQuoteForm(makeVoid()),
+                      makeBeginForm(cdr(argsTree)));
+}
+
+// Expands the clauses of a cond, from clauses on. No clause being true gives
+// void.
+Value *expandCondClauses(Value *clauses) {
+    if (isNull(clauses)) {
+        return makeQuoteForm(makeVoid());
+    }
+
+    Value *clause = car(clauses);
+    if (isElseClause(clause)) {
+        return makeBeginForm(cdr(clause));
+    }
+    return makeIfForm(expand(car(clause)), makeBeginForm(cdr(clause)),
+                      expandCondClauses(cdr(clauses)));
+}
+
+Value *expandCond(Value *argsTree) {
+    for (Value *clauses = argsTree; !isNull(clauses); clauses = cdr(clauses)) {
+        if (!isCons(car(clauses))) {
+            printf("Cond clause must be a list.\n");
+            printf("At expression: ");
+            printTree(clauses);
+            printf("\n");
+            texit(1);
+        }
+    }
+    checkCondSyntax(argsTree);
+    return expandCondClauses(argsTree);
+}
+
+Value *expandAnd(Value *argsTree) {
+    if (isNull(argsTree)) {
+        return makeBool(true);
+    }
+    Value *rest = isNull(cdr(argsTree)) ? makeBool(true)
+                                        : expandAnd(cdr(argsTree));
+    return makeIfForm(expand(car(argsTree)), rest, makeBool(false));
+}
+
+Value *expandOr(Value *argsTree) {
+    if (isNull(argsTree)) {
+        return makeBool(false);
+    }
+    return makeIfForm(expand(car(argsTree)), makeBool(true),
+                      expandOr(cdr(argsTree)));
+}
+
+//==================
+// Core forms
+//==================
+
+Value *expandDefine(Value *argsTree) {
+    Value *symbol = checkDefineSyntax(argsTree);
+    Value *expr;
+    if (isCons(car(argsTree))) {
+        // (define (name params...) body...)
+        Value *lambdaArgs = cons(cdr(car(argsTree)), cdr(argsTree));
+        checkLambdaSyntax(lambdaArgs);
+        expr = makeLambdaForm(car(lambdaArgs), cdr(lambdaArgs));
+    } else {
+        expr = expand(car(cdr(argsTree)));
+    }
+    return makeForm("define", cons(symbol, cons(expr, makeNull())));
+}
+
+// Returns a copy of the list exprs with each expression expanded.
+Value *expandEach(Value *exprs) {
+    Value *result = makeNull();
+    while (isCons(exprs)) {
+        result = cons(expand(car(exprs)), result);
+        exprs = cdr(exprs);
+    }
+    return reverse(result);
+}
+
+Value *expand(Value *expr) {
+    if (!isCons(expr)) {
+        return expr;
+    }
+
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+    if (isSymbol(first)) {
+        if (!strcmp(first->s, "quote")) {
+            enforceArgumentArity(args, 1, "quote");
+            return expr;
+        } else if (!strcmp(first->s, "if")) {
+            checkIfSyntax(args);
+            return makeForm("if", expandEach(args));
+        } else if (!strcmp(first->s, "lambda")) {
+            checkLambdaSyntax(args);
+            return makeLambdaForm(car(args), cdr(args));
+        } else if (!strcmp(first->s, "define")) {
+            return expandDefine(args);
+        } else if (!strcmp(first->s, "set!")) {
+            checkSetBangSyntax(args);
+            return makeForm("set!", cons(car(args), expandEach(cdr(args))));
+        } else if (!strcmp(first->s, "begin")) {
+            return makeBeginForm(args);
+        } else if (!strcmp(first->s, "display")) {
+            enforceArgumentArity(args, 1, "display");
+            return makeForm("display", expandEach(args));
+        } else if (!strcmp(first->s, "load")) {
+            enforceArgumentArity(args, 1, "load");
+            return makeForm("load", expandEach(args));
+        } else if (!strcmp(first->s, "let")) {
+            return expandLet(args);
+        } else if (!strcmp(first->s, "let*")) {
+            return expandLetStar(args);
+        } else if (!strcmp(first->s, "letrec")) {
+            return expandLetRec(args);
+        } else if (!strcmp(first->s, "when")) {
+            return expandWhen(args);
+        } else if (!strcmp(first->s, "unless")) {
+            return expandUnless(args);
+        } else if (!strcmp(first->s, "cond")) {
+            return expandCond(args);
+        } else if (!strcmp(first->s, "and")) {
+            return expandAnd(args);
+        } else if (!strcmp(first->s, "or")) {
+            return expandOr(args);
+        }
+    }
+
+    // An application
+    return expandEach(expr);
+}
@@ -0,0 +1,15 @@
+#ifndef _EXPANDER
+#define _EXPANDER
+
+#include "value.h"
+
+// Checks the syntax of one expression and rewrites it into the core language
+// that eval() runs: lambda, if, set!, begin, quote, application, and define
+// of a name, plus display and load. let, let*, letrec, when, unless, cond,
+// and, or, and the (define (name params...) body...) shorthand are turned into
+// core forms. Quoted data is left alone. Stops with the same errors as the
+// forms' own checks, but when the expression is expanded instead of when each
+// part of it runs. Returns the expanded expression; expr is not changed.
+Value *expand(Value *expr);
+
+#endif
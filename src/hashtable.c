@@ -0,0 +1,461 @@
+// Hash tables.
+//
+// A table is an array of entries with open addressing and linear probing;
+// its capacity is a power of two. Each entry keeps its key's hash, so
+// probing compares hashes before keys and moving an entry doesn't hash it
+// again. Removing a key leaves a tombstone, which lookups step over and
+// inserts reuse.
+//
+// Growing is incremental. When the entries in use (live ones and
+// tombstones) would pass half the capacity, a new array is made with room
+// for four times the live entries, and the old one is kept alongside it.
+// Every later insert or remove moves a few of the old entries across, so no
+// single operation pays for rehashing the whole table. Until the old array
+// is empty, lookups look in both.
+
+#include "hashtable.h"
+#include <string.h>
+#include "talloc.h"
+#include "bignum.h"
+#include "text.h"
+
+// The smallest array a table has
+#define MIN_CAPACITY 8
+
+// How many slots of the old array each insert or remove moves across
+#define MIGRATION_STEP 8
+
+// Only this much of a long list or vector, or this deep into nested ones,
+// goes into its hash, so hashing a key takes bounded time
+#define HASHED_ELEMENTS 16
+#define HASHED_DEPTH 4
+
+typedef struct HashEntry {
+    // NULL for a slot never used, &tombstone for a removed entry
+    Value *key;
+    Value *value;
+    unsigned long hash;
+} HashEntry;
+
+struct HashTable {
+    bool equalKeyed;
+    // How many keys the table has, in both arrays
+    long count;
+
+    HashEntry *entries;
+    long capacity;
+    // Slots of entries that aren't empty, counting tombstones
+    long used;
+
+    // The array being moved out of, or NULL, and how many of its slots have
+    // been moved so far
+    HashEntry *oldEntries;
+    long oldCapacity;
+    long migrated;
+};
+
+static Value tombstone;
+
+//==================
+// Hashing
+//==================
+
+// Scrambles the bits of x, so that keys that differ in a few bits end up in
+// unrelated slots. This is the finalizer of MurmurHash3.
+unsigned long mixHash(unsigned long x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdul;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ul;
+    x ^= x >> 33;
+    return x;
+}
+
+// Hashes length characters of text, eight bytes at a time.
+unsigned long hashText(char *text, long length) {
+    unsigned long hash = 0x9e3779b97f4a7c15ul ^ length;
+    while (length >= 8) {
+        unsigned long word;
+        memcpy(&word, text, 8);
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ul;
+        hash ^= hash >> 29;
+        text += 8;
+        length -= 8;
+    }
+    unsigned long word = 0;
+    memcpy(&word, text, length);
+    return mixHash(hash ^ word);
+}
+
+unsigned long hashDouble(double d) {
+    // 0.0 and -0.0 are equal, so they must hash the same
+    if (d == 0) {
+        d = 0;
+    }
+    unsigned long bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return mixHash(bits ^ DOUBLE_TYPE);
+}
+
+// Hashes the values that are matched by value in both kinds of table.
+// Returns false for any other kind of value.
+bool hashAtom(Value *value, unsigned long *hash) {
+    switch (value->type) {
+        case INT_TYPE:
+            *hash = mixHash(value->i);
+            return true;
+        case DOUBLE_TYPE:
+            *hash = hashDouble(value->d);
+            return true;
+        case BIGNUM_TYPE: {
+            unsigned long combined = value->big.negative;
+            for (int i = 0; i < value->big.length; i++) {
+                combined = mixHash(combined ^ value->big.limbs[i]);
+            }
+            *hash = combined;
+            return true;
+        }
+        case BOOL_TYPE:
+            *hash = mixHash(value->i + BOOL_TYPE);
+            return true;
+        case NULL_TYPE:
+            *hash = mixHash(NULL_TYPE);
+            return true;
+        case SYMBOL_TYPE:
+            *hash = hashText(value->s, strlen(value->s)) ^ SYMBOL_TYPE;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Hashes any value consistently with valuesEqual: values it says are equal
+// hash the same.
+unsigned long hashEqual(Value *value, int depth) {
+    unsigned long hash;
+    if (hashAtom(value, &hash)) {
+        return hash;
+    }
+    switch (value->type) {
+        case STR_TYPE:
+            return hashText(value->s, value->length) ^ STR_TYPE;
+        case CONS_TYPE:
+            hash = CONS_TYPE;
+            for (int i = 0; i < HASHED_ELEMENTS && isCons(value); i++) {
+                if (depth < HASHED_DEPTH) {
+                    hash = mixHash(hash ^ hashEqual(value->c.car, depth + 1));
+                }
+                value = value->c.cdr;
+            }
+            return hash;
+        case VECTOR_TYPE:
+            hash = mixHash(value->vector.length ^ VECTOR_TYPE);
+            for (long i = 0; i < HASHED_ELEMENTS && i < value->vector.length
+                     && depth < HASHED_DEPTH; i++) {
+                hash = mixHash(hash ^ hashEqual(value->vector.items[i],
+                                                depth + 1));
+            }
+            return hash;
+        case F64VECTOR_TYPE:
+            hash = mixHash(value->packed.length ^ F64VECTOR_TYPE);
+            for (long i = 0; i < HASHED_ELEMENTS && i < value->packed.length;
+                 i++) {
+                hash = mixHash(hash ^ hashDouble(value->packed.doubles[i]));
+            }
+            return hash;
+        case S64VECTOR_TYPE:
+            hash = mixHash(value->packed.length ^ S64VECTOR_TYPE);
+            for (long i = 0; i < HASHED_ELEMENTS && i < value->packed.length;
+                 i++) {
+                hash = mixHash(hash ^ value->packed.longs[i]);
+            }
+            return hash;
+        default:
+            return mixHash((unsigned long) value);
+    }
+}
+
+unsigned long hashKey(struct HashTable *table, Value *key) {
+    unsigned long hash;
+    if (table->equalKeyed) {
+        return hashEqual(key, 0);
+    } else if (hashAtom(key, &hash)) {
+        return hash;
+    }
+    return mixHash((unsigned long) key);
+}
+
+//==================
+// Equality
+//==================
+
+// Compares two values of the kinds hashAtom takes.
+bool atomsEqual(Value *a, Value *b) {
+    if (a->type != b->type) {
+        return false;
+    }
+    switch (a->type) {
+        case INT_TYPE:
+        case BOOL_TYPE:
+            return a->i == b->i;
+        case DOUBLE_TYPE:
+            return a->d == b->d;
+        case BIGNUM_TYPE:
+            return compareIntegers(a, b) == 0;
+        case NULL_TYPE:
+            return true;
+        case SYMBOL_TYPE:
+            return !strcmp(a->s, b->s);
+        default:
+            return false;
+    }
+}
+
+/* Compares two values the way equal? does. Lists are followed along their
+ * cdrs in a loop, so only nesting in the cars uses C stack.
+ */
+bool valuesEqual(Value *a, Value *b) {
+    while (a != b) {
+        if (a->type != b->type) {
+            return false;
+        }
+        switch (a->type) {
+            case INT_TYPE:
+            case BOOL_TYPE:
+            case DOUBLE_TYPE:
+            case BIGNUM_TYPE:
+            case NULL_TYPE:
+            case SYMBOL_TYPE:
+                return atomsEqual(a, b);
+            case STR_TYPE:
+                return compareStrings(a, b) == 0;
+            case VECTOR_TYPE:
+                if (a->vector.length != b->vector.length) {
+                    return false;
+                }
+                for (long i = 0; i < a->vector.length; i++) {
+                    if (!valuesEqual(a->vector.items[i], b->vector.items[i])) {
+                        return false;
+                    }
+                }
+                return true;
+            case F64VECTOR_TYPE:
+            case S64VECTOR_TYPE:
+                if (a->packed.length != b->packed.length) {
+                    return false;
+                }
+                for (long i = 0; i < a->packed.length; i++) {
+                    if (isType(a, F64VECTOR_TYPE)
+                        ? a->packed.doubles[i] != b->packed.doubles[i]
+                        : a->packed.longs[i] != b->packed.longs[i]) {
+                        return false;
+                    }
+                }
+                return true;
+            case CONS_TYPE:
+                if (!valuesEqual(a->c.car, b->c.car)) {
+                    return false;
+                }
+                a = a->c.cdr;
+                b = b->c.cdr;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool keysMatch(struct HashTable *table, Value *a, Value *b) {
+    if (a == b) {
+        return true;
+    } else if (table->equalKeyed) {
+        return valuesEqual(a, b);
+    }
+    return atomsEqual(a, b);
+}
+
+//==================
+// Entry arrays
+//==================
+
+HashEntry *allocateEntries(long capacity) {
+    HashEntry *entries = talloc(sizeof(HashEntry) * capacity);
+    memset(entries, 0, sizeof(HashEntry) * capacity);
+    return entries;
+}
+
+/* Looks for key in an array of entries. Returns its entry, or NULL if it
+ * isn't there; then, if slot isn't NULL, sets it to where the key would be
+ * inserted: the first tombstone on the way, or else the empty slot that
+ * ended the search. An array is never full, so the search always ends.
+ */
+HashEntry *findEntry(struct HashTable *table, HashEntry *entries,
+                     long capacity, Value *key, unsigned long hash,
+                     HashEntry **slot) {
+    long mask = capacity - 1;
+    long index = hash & mask;
+    HashEntry *firstTombstone = NULL;
+    while (true) {
+        HashEntry *entry = &entries[index];
+        if (entry->key == NULL) {
+            if (slot != NULL) {
+                *slot = firstTombstone != NULL ? firstTombstone : entry;
+            }
+            return NULL;
+        } else if (entry->key == &tombstone) {
+            if (firstTombstone == NULL) {
+                firstTombstone = entry;
+            }
+        } else if (entry->hash == hash && keysMatch(table, entry->key, key)) {
+            return entry;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+// Puts an entry for a key that isn't in the table into the new array.
+void insertEntry(struct HashTable *table, Value *key, Value *value,
+                 unsigned long hash) {
+    HashEntry *slot;
+    findEntry(table, table->entries, table->capacity, key, hash, &slot);
+    if (slot->key == NULL) {
+        table->used++;
+    }
+    slot->key = key;
+    slot->value = value;
+    slot->hash = hash;
+}
+
+// Moves up to slots entries of the old array into the new one, and lets go
+// of the old array once it's empty.
+void migrateEntries(struct HashTable *table, long slots) {
+    if (table->oldEntries == NULL) {
+        return;
+    }
+    long end = table->migrated + slots;
+    if (end > table->oldCapacity) {
+        end = table->oldCapacity;
+    }
+    for (long i = table->migrated; i < end; i++) {
+        HashEntry *entry = &table->oldEntries[i];
+        if (entry->key != NULL && entry->key != &tombstone) {
+            insertEntry(table, entry->key, entry->value, entry->hash);
+            // Keys still in the old array may have probed past this slot
+            entry->key = &tombstone;
+        }
+    }
+    table->migrated = end;
+    if (end == table->oldCapacity) {
+        table->oldEntries = NULL;
+        table->oldCapacity = 0;
+        table->migrated = 0;
+    }
+}
+
+// Starts moving the table into a new array with room for four times its
+// keys. An earlier move still going on is finished first.
+void growTable(struct HashTable *table) {
+    migrateEntries(table, table->oldCapacity);
+    long capacity = MIN_CAPACITY;
+    while (capacity < 4 * (table->count + 1)) {
+        capacity *= 2;
+    }
+    table->oldEntries = table->entries;
+    table->oldCapacity = table->capacity;
+    table->migrated = 0;
+    table->entries = allocateEntries(capacity);
+    table->capacity = capacity;
+    table->used = 0;
+}
+
+// Finds key's entry in either array, or returns NULL.
+HashEntry *lookUpEntry(struct HashTable *table, Value *key,
+                       unsigned long hash) {
+    if (table->oldEntries != NULL) {
+        HashEntry *entry = findEntry(table, table->oldEntries,
+                                     table->oldCapacity, key, hash, NULL);
+        if (entry != NULL) {
+            return entry;
+        }
+    }
+    return findEntry(table, table->entries, table->capacity, key, hash, NULL);
+}
+
+//==================
+// Tables
+//==================
+
+Value *makeHashTable(bool equalKeyed) {
+    struct HashTable *table = talloc(sizeof(struct HashTable));
+    table->equalKeyed = equalKeyed;
+    table->count = 0;
+    table->entries = allocateEntries(MIN_CAPACITY);
+    table->capacity = MIN_CAPACITY;
+    table->used = 0;
+    table->oldEntries = NULL;
+    table->oldCapacity = 0;
+    table->migrated = 0;
+
+    Value *result = makeValue(HASH_TABLE_TYPE);
+    result->table = table;
+    return result;
+}
+
+Value *hashTableRef(Value *table, Value *key) {
+    HashEntry *entry = lookUpEntry(table->table, key,
+                                   hashKey(table->table, key));
+    return entry != NULL ? entry->value : NULL;
+}
+
+void hashTableSet(Value *tableValue, Value *key, Value *value) {
+    struct HashTable *table = tableValue->table;
+    migrateEntries(table, MIGRATION_STEP);
+    unsigned long hash = hashKey(table, key);
+    HashEntry *entry = lookUpEntry(table, key, hash);
+    if (entry != NULL) {
+        entry->value = value;
+        return;
+    }
+
+    if (2 * (table->used + 1) > table->capacity) {
+        growTable(table);
+    }
+    insertEntry(table, key, value, hash);
+    table->count++;
+}
+
+bool hashTableRemove(Value *tableValue, Value *key) {
+    struct HashTable *table = tableValue->table;
+    migrateEntries(table, MIGRATION_STEP);
+    HashEntry *entry = lookUpEntry(table, key, hashKey(table, key));
+    if (entry == NULL) {
+        return false;
+    }
+    entry->key = &tombstone;
+    entry->value = NULL;
+    table->count--;
+    return true;
+}
+
+long hashTableCount(Value *table) {
+    return table->table->count;
+}
+
+bool hashTableNext(Value *tableValue, long *position, Value **key,
+                   Value **value) {
+    struct HashTable *table = tableValue->table;
+    // Positions go through the old array, then the new one
+    while (*position < table->oldCapacity + table->capacity) {
+        HashEntry *entry = *position < table->oldCapacity
+            ? &table->oldEntries[*position]
+            : &table->entries[*position - table->oldCapacity];
+        (*position)++;
+        if (entry->key != NULL && entry->key != &tombstone) {
+            *key = entry->key;
+            *value = entry->value;
+            return true;
+        }
+    }
+    return false;
+}
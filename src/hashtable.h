@@ -0,0 +1,38 @@
+#ifndef _HASHTABLE
+#define _HASHTABLE
+
+#include <stdbool.h>
+#include "value.h"
+
+// Hash tables are HASH_TABLE_TYPE Values. An equal?-keyed table matches keys
+// the way equal? compares them. An eq?-keyed table matches other keys only
+// if they are the same object, except numbers, booleans, symbols and the
+// empty list, which this interpreter doesn't share between equal copies, so
+// those are matched by value.
+
+// Compares two values the way equal? does: numbers of the same type by
+// value, strings and symbols by their text, and lists and vectors element by
+// element. Anything else is only equal to itself.
+bool valuesEqual(Value *a, Value *b);
+
+// Create a new, empty HASH_TABLE_TYPE Value.
+Value *makeHashTable(bool equalKeyed);
+
+// Returns the value stored under key, or NULL if there isn't one.
+Value *hashTableRef(Value *table, Value *key);
+
+void hashTableSet(Value *table, Value *key, Value *value);
+
+// Removes key and its value. Returns whether it was there.
+bool hashTableRemove(Value *table, Value *key);
+
+// Returns how many keys the table has.
+long hashTableCount(Value *table);
+
+// Steps through the keys and values of a table, in no particular order.
+// Start position at 0; each call puts the next key and value in key and value
+// and returns true, until there are no more. The table mustn't be changed
+// while this is going on.
+bool hashTableNext(Value *table, long *position, Value **key, Value **value);
+
+#endif
@@ -4,33 +4,55 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <assert.h>
+#include <limits.h>
 #include "linkedlist.h"
 #include "parser.h"
 #include "talloc.h"
 #include "tokenizer.h"
+#include "jit.h"
+#include "expander.h"
+#include "optimizer.h"
+#include "output.h"
+#include "bignum.h"
+#include "hashtable.h"
+#include "numvector.h"
+#include "text.h"
 
 //==================
 // Helper Functions
 //==================
 
+// Returns a number as a double.
+double numberToDouble(Value *number) {
+    return isDouble(number) ? number->d : integerToDouble(number);
+}
+
 /* Compares the value of two number-type Values.
  *
  * Assumes that both arguments are numbers.
  * Check this before you call it.
  */
 bool compareNumbers(Value *one, Value *two) {
-    if (isInteger(one)) {
-        if (isInteger(two)) {
-            return one->i == two->i;
-        } else {
-            return one->i == two->d;
-        }
+    if (isInteger(one) && isInteger(two)) {
+        return one->i == two->i;
+    } else if (isExactInteger(one) && isExactInteger(two)) {
+        return compareIntegers(one, two) == 0;
     } else {
-        if (isInteger(two)) {
-            return one->d == two->i;
-        } else {
-            return one->d == two->d;
-        }
+        return numberToDouble(one) == numberToDouble(two);
+    }
+}
+
+/* Checks whether the number one is less than the number two.
+ *
+ * Assumes that both arguments are numbers.
+ */
+bool isLessThan(Value *one, Value *two) {
+    if (isInteger(one) && isInteger(two)) {
+        return one->i < two->i;
+    } else if (isExactInteger(one) && isExactInteger(two)) {
+        return compareIntegers(one, two) < 0;
+    } else {
+        return numberToDouble(one) < numberToDouble(two);
     }
 }
 
@@ -147,625 +169,1460 @@ Frame *getGlobalFrame(Frame *activeFrame) {
 }
 
 /*
- * Evaluates each expression in body.
- * Returns a linked list of all the expression results.
+ * Evaluates each expression in body, storing the results in order in args,
+ * which must have room for all of them.
  */
-Value *evalEach(Value *body, Frame *activeFrame) {
-    Value *result = makeNull();
+void evalArguments(Value *body, Frame *activeFrame, Value **args) {
     Value *currentExpr = body;
     while (!isNull(currentExpr)) {
-        result = cons(eval(currentExpr, activeFrame), result);
+        *args++ = eval(currentExpr, activeFrame);
         currentExpr = cdr(currentExpr);
     }
+}
 
-    return reverse(result);
+Value *makeArgumentList(Value **args, int numArgs) {
+    Value *argList = makeNull();
+    for (int i = numArgs - 1; i >= 0; i--) {
+        argList = cons(args[i], argList);
+    }
+    return argList;
 }
 
 //==================
 // Primitives
 //==================
 
-Value *primitiveAdd(Value *args) {
-    double sum = 0;
-    bool isInt = true;
+// Primitives take their evaluated arguments as an array, argv, of argc
+// values. They only make a list of them to print in an error message. The
+// caller has already checked argc against the primitive's descriptor.
 
-    Value *current = args;
-    while (!isNull(current)) {
-        if (!isNumber(car(current))) {
+/* The arithmetic primitives work on integers exactly: with overflow-checked
+ * 64-bit operations while the arguments and results fit in a long, and with
+ * bignums after that. From the first double on, they go on in double.
+ */
+
+Value *primitiveAdd(int argc, Value **argv) {
+    long sum = 0;
+    int i = 0;
+    for (; i < argc && isInteger(argv[i]); i++) {
+        long next;
+        if (__builtin_add_overflow(sum, argv[i]->i, &next)) {
+            break;
+        }
+        sum = next;
+    }
+    if (i == argc) {
+        return makeInt(sum);
+    }
+
+    Value *exactSum = makeInt(sum);
+    for (; i < argc && isExactInteger(argv[i]); i++) {
+        exactSum = addIntegers(exactSum, argv[i]);
+    }
+    if (i == argc) {
+        return exactSum;
+    }
+
+    double doubleSum = integerToDouble(exactSum);
+    for (; i < argc; i++) {
+        if (!isNumber(argv[i])) {
             printf("Expected number in +\n");
             printf("Given: ");
-            printTree(current);
+            printTree(makeArgumentList(argv + i, argc - i));
             printf("\n");
             texit(1);
-        } else if (isInteger(car(current))) {
-            sum += car(current)->i;
-        } else {
-            sum += car(current)->d;
-            isInt = false;
         }
-        current = cdr(current);
+        doubleSum += numberToDouble(argv[i]);
     }
-
-    Value *result;
-    if (isInt){
-        result = makeInt(sum);
-    } else {
-        result = makeDouble(sum);
-    }
-
-    return result;
+    return makeDouble(doubleSum);
 }
 
-Value *primitiveSubtract(Value *args) {
-    if (!isCons(args)) {
-        printf("- expression has no arguments: expected at least 2, given none.\n");
-        texit(1);
-    }
-    if (!isCons(cdr(args))) {
-        printf("- expression has too few arguments: expected at least 2, given 1\n");
-        printf("Expression: (- ");
-        printTree(args);
-        printf(")\n");
-        texit(1);
-    }
-
-    double difference = 0;
-    bool isInt = true;
-    if (!isNumber(car(args))) {
+Value *primitiveSubtract(int argc, Value **argv) {
+    if (!isNumber(argv[0])) {
         //TODO Reorganize if statement flow here
         printf("Expected number in +\n");
         printf("Given: ");
-        printTree(args);
+        printTree(makeArgumentList(argv, argc));
         printf("\n");
         texit(1);
-    } else if (isInteger(car(args))) {
-        difference = car(args)->i;
+    }
+
+    double doubleDifference;
+    int i = 1;
+    if (isExactInteger(argv[0])) {
+        Value *exactDifference = argv[0];
+        if (isInteger(argv[0])) {
+            long difference = argv[0]->i;
+            for (; i < argc && isInteger(argv[i]); i++) {
+                long next;
+                if (__builtin_sub_overflow(difference, argv[i]->i, &next)) {
+                    break;
+                }
+                difference = next;
+            }
+            if (i == argc) {
+                return makeInt(difference);
+            }
+            exactDifference = makeInt(difference);
+        }
+
+        for (; i < argc && isExactInteger(argv[i]); i++) {
+            exactDifference = subtractIntegers(exactDifference, argv[i]);
+        }
+        if (i == argc) {
+            return exactDifference;
+        }
+        doubleDifference = integerToDouble(exactDifference);
     } else {
-        difference = car(args)->d;
-        isInt = false;
+        doubleDifference = argv[0]->d;
     }
 
-    Value *current = cdr(args);
-    while (!isNull(current)) {
-        if (!isNumber(car(current))) {
+    for (; i < argc; i++) {
+        if (!isNumber(argv[i])) {
             printf("Expected number in +\n");
             printf("Given: ");
-            printTree(current);
+            printTree(makeArgumentList(argv + i, argc - i));
             printf("\n");
             texit(1);
-        } else if (isInteger(car(current))) {
-            difference -= car(current)->i;
-        } else {
-            difference -= car(current)->d;
-            isInt = false;
         }
-        current = cdr(current);
+        doubleDifference -= numberToDouble(argv[i]);
     }
+    return makeDouble(doubleDifference);
+}
 
-    Value *result;
-    if (isInt){
-        result = makeInt(difference);
-    } else {
-        result = makeDouble(difference);
+Value *primitiveMult(int argc, Value **argv) {
+    long product = 1;
+    int i = 0;
+    for (; i < argc && isInteger(argv[i]); i++) {
+        long next;
+        if (__builtin_mul_overflow(product, argv[i]->i, &next)) {
+            break;
+        }
+        product = next;
+    }
+    if (i == argc) {
+        return makeInt(product);
     }
 
-    return result;
-}
-
-Value *primitiveMult(Value *args) {
-    double product = 1;
-    bool isInt = true;
+    Value *exactProduct = makeInt(product);
+    for (; i < argc && isExactInteger(argv[i]); i++) {
+        exactProduct = multiplyIntegers(exactProduct, argv[i]);
+    }
+    if (i == argc) {
+        return exactProduct;
+    }
 
-    Value *current = args;
-    while (!isNull(current)) {
-        if (!isNumber(car(current))) {
+    double doubleProduct = integerToDouble(exactProduct);
+    for (; i < argc; i++) {
+        if (!isNumber(argv[i])) {
             printf("Expected number in *\n");
             printf("Given: ");
-            printTree(current);
+            printTree(makeArgumentList(argv + i, argc - i));
             printf("\n");
             texit(1);
-        } else if (isInteger(car(current))) {
-            product *= car(current)->i;
-        } else {
-            product *= car(current)->d;
-            isInt = false;
         }
-        current = cdr(current);
+        doubleProduct *= numberToDouble(argv[i]);
     }
+    return makeDouble(doubleProduct);
+}
 
-    // Package result in a Value
-    Value *result;
-    if (isInt){
-        result = makeInt(product);
-    } else {
-        result = makeDouble(product);
-    }
+// Stops execution with an error because value, an argument of the primitive
+// name, isn't a number.
+void numberExpected(Value *value, int argc, Value **argv, char *name) {
+    printf("Expected number in %s\n", name);
+    printf("Given: ");
+    printValue(value);
+    printf("\n");
+    printf("At expression: (%s ", name);
+    printTree(makeArgumentList(argv, argc));
+    printf(")\n");
+    texit(1);
+}
 
-    return result;
+// Stops execution with an error because the primitive name was asked to
+// divide an integer by zero.
+void divisionByZero(int argc, Value **argv, char *name) {
+    printf("Division by zero in %s\n", name);
+    printf("At expression: (%s ", name);
+    printTree(makeArgumentList(argv, argc));
+    printf(")\n");
+    texit(1);
 }
 
-Value *primitiveDivide(Value *args) {
-    if (!isCons(args)) {
-        printf("/ expression has no arguments: expected 2, given none.\n");
-        texit(1);
-    }
-    if (!isCons(cdr(args))) {
-        printf("/ expression has too few arguments: expected 2, given 1\n");
-        printf("Expression: (/ ");
-        printTree(args);
-        printf(")\n");
-        texit(1);
-    }
-    if (!isNull(cdr(cdr(args)))) {
-        printf("/ statement has too many arguments: expected 2, given %i\n", length(args));
-        printf("Expression: (/ ");
-        printTree(args);
-        printf(")\n");
-        texit(1);
+Value *primitiveDivide(int argc, Value **argv) {
+    Value *numerator = argv[0];
+    Value *denominator = argv[1];
+    if (!isNumber(numerator)) {
+        numberExpected(numerator, argc, argv, "/");
+    } else if (!isNumber(denominator)) {
+        numberExpected(denominator, argc, argv, "/");
     }
 
-    Value *result;
-    Value *numerator = car(args);
-    Value *denominator = car(cdr(args));
-    if (isInteger(numerator)) {
-        if (isInteger(denominator)) {
-            if (numerator->i % denominator->i != 0) {
-                double dividend = (1.0 * numerator->i) / denominator->i;
-                result = makeDouble(dividend);
-            } else {
-                int dividend = numerator->i / denominator->i;
-                result = makeInt(dividend);
-            }
-        } else if (isDouble(denominator)) {
-            result = makeDouble(numerator->i / denominator->d);
-        } else {
-            printf("Expected number in /\n");
-            printf("Given: ");
-            printValue(denominator);
-            printf("\n");
-            printf("At expression: (/ ");
-            printTree(args);
-            printf(")\n");
-            texit(1);
+    if (isExactInteger(numerator) && isExactInteger(denominator)) {
+        if (isInteger(denominator) && denominator->i == 0) {
+            divisionByZero(argc, argv, "/");
         }
-    } else  if (isDouble(numerator)) {
-        if (isInteger(denominator)) {
-            result = makeDouble(numerator->d / denominator->i);
-        } else if (isDouble(denominator)) {
-            result = makeDouble(numerator->d / denominator->d);
-        } else {
-            printf("Expected number in /\n");
-            printf("Given: ");
-            printValue(denominator);
-            printf("\n");
-            printf("At expression: (/ ");
-            printTree(args);
-            printf(")\n");
-            texit(1);
+        Value *quotient;
+        Value *remainder;
+        divideIntegers(numerator, denominator, &quotient, &remainder);
+        if (isInteger(remainder) && remainder->i == 0) {
+            return quotient;
         }
-    } else {
-        printf("Expected number in /\n");
-        printf("Given: ");
-        printValue(numerator);
-        printf("\n");
-        printf("At expression: (/ ");
-        printTree(args);
-        printf(")\n");
-        texit(1);
+        return makeDouble(divideIntegersToDouble(numerator, denominator));
     }
-
-    return result;
+    return makeDouble(numberToDouble(numerator) / numberToDouble(denominator));
 }
 
-Value *primitiveIsNull(Value *args) {
-    enforceArgumentArity(args, 1, "null?");
-
-    if (isNull(car(args))) {
+Value *primitiveIsNull(int argc, Value **argv) {
+    if (isNull(argv[0])) {
         return makeBool(true);
     } else {
         return makeBool(false);
     }
 }
 
-Value *primitiveIsList(Value *args) {
-    enforceArgumentArity(args, 1, "list?");
-
-    Value *listVal = car(args);
-    return makeBool(isProperList(listVal));
+Value *primitiveIsList(int argc, Value **argv) {
+    return makeBool(isProperList(argv[0]));
 }
 
-Value *primitiveCar(Value *args) {
-    enforceArgumentArity(args, 1, "cons");
-    if (!isCons(car(args))) {
+Value *primitiveCar(int argc, Value **argv) {
+    if (!isCons(argv[0])) {
         printf("car statement needs to act on a cons cell\n");
         printf("Expression: (car ");
-        printTree(args);
+        printTree(makeArgumentList(argv, argc));
         printf(")\n");
         texit(1);
     }
 
-    return car(car(args));
+    return car(argv[0]);
 }
 
-Value *primitiveCdr(Value *args) {
-    enforceArgumentArity(args, 1, "cdr");
-    if (!isCons(car(args))) {
+Value *primitiveCdr(int argc, Value **argv) {
+    if (!isCons(argv[0])) {
         printf("cdr statement needs to act on a cons cell\n");
         printf("Expression: (cdr ");
-        printTree(args);
+        printTree(makeArgumentList(argv, argc));
         printf(")\n");
         texit(1);
     }
 
-    return cdr(car(args));
+    return cdr(argv[0]);
 }
 
-Value *primitiveCons(Value *args) {
-    enforceArgumentArity(args, 2, "cons");
-
-    Value *result = cons(car(args), car(cdr(args)));
-    return result;
+Value *primitiveCons(int argc, Value **argv) {
+    return cons(argv[0], argv[1]);
 }
 
-Value *primitiveList(Value *args) {
-    Value *result = args;
-    return result;
+// The only primitive that needs its arguments as a list
+Value *primitiveList(int argc, Value **argv) {
+    return makeArgumentList(argv, argc);
 }
 
-Value *primitiveAppend(Value *args) {
-    if (!isCons(args)) {
+Value *primitiveAppend(int argc, Value **argv) {
+    if (argc == 0) {
         return makeNull();
     }
 
-    Value *orderedArgs = reverse(args);
-
-    Value *currentList = car(orderedArgs);
-    Value *currentArg = cdr(orderedArgs);
-    while (!isNull(currentArg)) {
-        currentList = append(car(currentArg), currentList);
-        currentArg = cdr(currentArg);
+    Value *currentList = argv[argc - 1];
+    for (int i = argc - 2; i >= 0; i--) {
+        currentList = append(argv[i], currentList);
     }
     return currentList;
 }
 
-Value *primitiveReverse(Value *args) {
-    enforceArgumentArity(args, 1, "reverse");
-    if (!isCons(car(args)) && !isNull(car(args))) {
+Value *primitiveReverse(int argc, Value **argv) {
+    if (!isCons(argv[0]) && !isNull(argv[0])) {
         printf("reverse expression needs to act on a cons cell\n");
         printf("Expression: (reverse ");
-        printTree(args);
+        printTree(makeArgumentList(argv, argc));
         printf(")\n");
         texit(1);
     }
 
-    return reverse(car(args));
+    return reverse(argv[0]);
 }
 
-Value *primitiveLength(Value *args) {
-    enforceArgumentArity(args, 1, "length");
-
+Value *primitiveLength(int argc, Value **argv) {
     // Null is an empty (zero-length) list
-    if (isNull(car(args))) {
+    if (isNull(argv[0])) {
         return makeInt(0);
     }
 
-    if (!isCons(car(args))) {
+    if (!isCons(argv[0])) {
         printf("length expression needs to act on a cons cell\n");
         printf("Expression: (length ");
-        printTree(args);
+        printTree(makeArgumentList(argv, argc));
         printf(")\n");
         texit(1);
     }
 
-    int len = length(car(args));
+    int len = length(argv[0]);
     return makeInt(len);
 }
 
-Value *primitiveEqual(Value *args) {
-    enforceArgumentArity(args, 2, "equal?");
-
-    Value *first = car(args);
-    Value *second = car(cdr(args));
-
-    if (first->type != second->type) {
-        return makeBool(false);
-    }
-
-    if (isInteger(first) || isBoolean(first)) {
-        // Booleans are really C ints, so they can be treated identically
-        if (first->i == second->i) {
-            return makeBool(true);
-        } else {
-            return makeBool(false);
-        }
-    } else if (isDouble(first)) {
-        if (first->d == second->d) {
-            return makeBool(true);
-        } else {
-            return makeBool(false);
-        }
-    } else if (isString(first) || isSymbol(first)) {
-        //TEST test coverage
-        if (!strcmp(first->s, second->s)) {
-            return makeBool(true);
-        } else {
-            return makeBool(false);
-        }
-    } else {
-        printf("Unknown type in equal?\n");
-        printf("given: ");
-        printValue(first);
-        printf("\n");
-        texit(1);
-    }
-    assert(false && "Internal error: should have returned or texited out of if/else block but did not");
+Value *primitiveEqual(int argc, Value **argv) {
+    return makeBool(valuesEqual(argv[0], argv[1]));
 }
 
-Value *primitiveEq(Value *args) {
-    enforceArgumentArity(args, 2, "eq?");
-
-    Value *first = car(args);
-    Value *second = car(cdr(args));
-
-    if (first == second) {
+Value *primitiveEq(int argc, Value **argv) {
+    if (argv[0] == argv[1]) {
         return makeBool(true);
     } else {
         return makeBool(false);
     }
 }
 
-Value *primitiveIsNumber(Value *args) {
-    enforceArgumentArity(args, 1, "equal?");
-
-    Value *val = car(args);
-    return makeBool(isNumber(val));
+Value *primitiveIsNumber(int argc, Value **argv) {
+    return makeBool(isNumber(argv[0]));
 }
 
-Value *primitiveEqualNum(Value *args) {
-    enforceArgumentArityRange(args, 1, -1, "=");
-
-    if (!isCons(args)) {
-        printf("= statement has no arguments: expected at least one.\n");
-        printf("At: (=)\n");
-        texit(1);
-    }
-
-    Value *first = car(args);
+Value *primitiveEqualNum(int argc, Value **argv) {
+    Value *first = argv[0];
     if (!isNumber(first)) {
         printf("Expected number in =\n");
         printf("Given ");
         printValue(first);
         printf("\n");
         printf("At expression: (= ");
-        printTree(args);
+        printTree(makeArgumentList(argv, argc));
         printf(")\n");
         texit(1);
     }
 
-    Value *current = cdr(args);
-    while (!isNull(current)) {
-        Value *currentValue = car(current);
+    for (int i = 1; i < argc; i++) {
+        Value *currentValue = argv[i];
         if (!isNumber(currentValue)) {
             printf("Expected number in =\n");
             printf("Given ");
             printValue(currentValue);
             printf("\n");
             printf("At expression: (= ");
-            printTree(args);
+            printTree(makeArgumentList(argv, argc));
             printf(")\n");
             texit(1);
         }
         if (!compareNumbers(first, currentValue)) {
             return makeBool(false);
         }
-        current = cdr(current);
     }
 
     // If we made it here, they must be equal
     return makeBool(true);
 }
 
-Value *primitiveLessThan(Value *args) {
-    if (!isCons(args)) {
-        printf("< expression has no arguments: expected 2, given none.\n");
-        texit(1);
-    }
-    if (!isCons(cdr(args))) {
-        printf("< expression has too few arguments: expected 2, given 1\n");
-        printf("Expression: (< ");
-        printTree(args);
-        printf(")\n");
-        texit(1);
+Value *primitiveLessThan(int argc, Value **argv) {
+    Value *first = argv[0];
+    Value *second = argv[1];
+    if (!isNumber(first)) {
+        numberExpected(first, argc, argv, "<");
+    } else if (!isNumber(second)) {
+        numberExpected(second, argc, argv, "<");
     }
-    if (!isNull(cdr(cdr(args)))) {
-        printf("< statement has too many arguments: expected 2, given %i\n", length(args));
-        printf("Expression: (< ");
-        printTree(args);
-        printf(")\n");
-        texit(1);
+    return makeBool(isLessThan(first, second));
+}
+
+Value *primitiveGreaterThan(int argc, Value **argv) {
+    Value *first = argv[0];
+    Value *second = argv[1];
+    if (!isNumber(first)) {
+        numberExpected(first, argc, argv, ">");
+    } else if (!isNumber(second)) {
+        numberExpected(second, argc, argv, ">");
     }
+    return makeBool(isLessThan(second, first));
+}
 
-    Value *first = car(args);
-    Value *second = car(cdr(args));
-    if (isInteger(first)) {
-        if (isInteger(second)) {
-            return makeBool(first->i < second->i);
-        } else if (isDouble(second)) {
-            return makeBool(first->i < second->d);
-        } else {
-            printf("Expected number in <\n");
-            printf("Given: ");
-            printValue(second);
-            printf("\n");
-            printf("At expression: (< ");
-            printTree(args);
-            printf(")\n");
-            texit(1);
-        }
-    } else if (isDouble(first)) {
-        if (isInteger(second)) {
-            return makeBool(first->d < second->i);
-        } else if (isDouble(second)) {
-            return makeBool(first->d < second->d);
+Value *primitiveModulo(int argc, Value **argv) {
+    Value *first = argv[0];
+    Value *second = argv[1];
+    if (isExactInteger(first)) {
+        if (isExactInteger(second)) {
+            if (isInteger(second) && second->i == 0) {
+                divisionByZero(argc, argv, "modulo");
+            }
+            Value *quotient;
+            Value *remainder;
+            divideIntegers(first, second, &quotient, &remainder);
+            return remainder;
         } else {
-            printf("Expected number in <\n");
+            printf("Expected integer in modulo\n");
             printf("Given: ");
             printValue(second);
             printf("\n");
-            printf("At expression: (< ");
-            printTree(args);
+            printf("At expression: (modulo ");
+            printTree(makeArgumentList(argv, argc));
             printf(")\n");
             texit(1);
         }
     } else {
-        printf("Expected number in <\n");
+        printf("Expected integer in modulo\n");
         printf("Given: ");
         printValue(first);
         printf("\n");
-        printf("At expression: (< ");
-        printTree(args);
+        printf("At expression: (modulo ");
+        printTree(makeArgumentList(argv, argc));
         printf(")\n");
         texit(1);
     }
 
-    assert(false && "Internal error: should have returned or texited out of if/else block but did not");
+    assert(false && "Reached end of primitiveModulo without returning\n");
 }
 
-Value *primitiveGreaterThan(Value *args) {
-    if (!isCons(args)) {
-        printf("> expression has no arguments: expected 2, given none.\n");
-        texit(1);
-    }
-    if (!isCons(cdr(args))) {
-        printf("> expression has too few arguments: expected 2, given 1\n");
-        printf("Expression: (> ");
-        printTree(args);
+Value *primitiveNot(int argc, Value **argv) {
+    bool argValue = isTrue(argv[0]);
+    return makeBool(!argValue);
+}
+
+Value *primitiveSetCar(int argc, Value **argv) {
+    if (!isCons(argv[0])) {
+        printf("set-car! statement needs to act on a cons cell\n");
+        printf("Expression: (set-car! ");
+        printTree(makeArgumentList(argv, argc));
         printf(")\n");
         texit(1);
     }
-    if (!isNull(cdr(cdr(args)))) {
-        printf("> statement has too many arguments: expected 2, given %i\n", length(args));
-        printf("Expression: (> ");
-        printTree(args);
+
+    argv[0]->c.car = argv[1];
+    return makeVoid();
+}
+
+Value *primitiveSetCdr(int argc, Value **argv) {
+    if (!isCons(argv[0])) {
+        printf("set-cdr! statement needs to act on a cons cell\n");
+        printf("Expression: (set-cdr! ");
+        printTree(makeArgumentList(argv, argc));
         printf(")\n");
         texit(1);
     }
 
-    Value *first = car(args);
-    Value *second = car(cdr(args));
-    if (isInteger(first)) {
-        if (isInteger(second)) {
-            return makeBool(first->i > second->i);
-        } else if (isDouble(second)) {
-            return makeBool(first->i > second->d);
-        } else {
-            printf("Expected number in >\n");
-            printf("Given: ");
-            printValue(second);
-            printf("\n");
-            printf("At expression: (> ");
-            printTree(args);
-            printf(")\n");
-            texit(1);
-        }
-    } else if (isDouble(first)) {
-        if (isInteger(second)) {
-            return makeBool(first->d > second->i);
-        } else if (isDouble(second)) {
-            return makeBool(first->d > second->d);
-        } else {
-            printf("Expected number in >\n");
-            printf("Given: ");
-            printValue(second);
-            printf("\n");
-            printf("At expression: (> ");
-            printTree(args);
-            printf(")\n");
-            texit(1);
-        }
-    } else {
-        printf("Expected number in >\n");
-        printf("Given: ");
-        printValue(first);
-        printf("\n");
-        printf("At expression: (> ");
-        printTree(args);
+    argv[0]->c.cdr = argv[1];
+    return makeVoid();
+}
+
+/* The vector primitives. A vector's elements are in one array, so getting
+ * or setting one by index takes the same time wherever it is.
+ */
+
+// Stops execution with an error because argv[position], an argument of the
+// primitive name, isn't what it should be.
+void wrongArgument(char *expected, int position, int argc, Value **argv,
+                   char *name) {
+    printf("Expected %s in %s\n", expected, name);
+    printf("Given: ");
+    printValue(argv[position]);
+    printf("\n");
+    printf("At expression: (%s ", name);
+    printTree(makeArgumentList(argv, argc));
+    printf(")\n");
+    texit(1);
+}
+
+// Checks that argv[0] is a vector and argv[1] an index into it, for the
+// primitive name, and returns the index.
+long vectorIndex(int argc, Value **argv, char *name) {
+    if (!isVector(argv[0])) {
+        wrongArgument("vector", 0, argc, argv, name);
+    } else if (!isInteger(argv[1])) {
+        wrongArgument("integer", 1, argc, argv, name);
+    }
+    long index = argv[1]->i;
+    if (index < 0 || index >= argv[0]->vector.length) {
+        printf("Index out of range in %s\n", name);
+        printf("Index: %li, length: %li\n", index, argv[0]->vector.length);
+        printf("At expression: (%s ", name);
+        printTree(makeArgumentList(argv, argc));
         printf(")\n");
         texit(1);
     }
+    return index;
+}
 
-    assert(false && "Internal error: should have returned or texited out of if/else block but did not");
+Value *primitiveIsVector(int argc, Value **argv) {
+    return makeBool(isVector(argv[0]));
 }
 
-Value *primitiveModulo(Value *args) {
-    if (!isCons(args)) {
-        printf("modulo expression has no arguments: expected 2, given none.\n");
-        texit(1);
+Value *primitiveMakeVector(int argc, Value **argv) {
+    if (!isInteger(argv[0]) || argv[0]->i < 0) {
+        wrongArgument("non-negative integer", 0, argc, argv, "make-vector");
     }
-    if (!isCons(cdr(args))) {
-        printf("modulo expression has too few arguments: expected 2, given 1\n");
-        printf("Expression: (modulo ");
-        printTree(args);
-        printf(")\n");
-        texit(1);
+    Value *vector = makeVector(argv[0]->i, argc > 1 ? argv[1] : makeInt(0));
+    if (vector == NULL) {
+        wrongArgument("length there is memory for", 0, argc, argv,
+                      "make-vector");
     }
-    if (!isNull(cdr(cdr(args)))) {
-        printf("modulo statement has too many arguments: expected 2, given %i\n", length(args));
-        printf("Expression: (modulo ");
-        printTree(args);
-        printf(")\n");
-        texit(1);
+    return vector;
+}
+
+Value *primitiveVector(int argc, Value **argv) {
+    Value *vector = makeVector(argc, makeNull());
+    for (int i = 0; i < argc; i++) {
+        vector->vector.items[i] = argv[i];
     }
+    return vector;
+}
 
-    Value *first = car(args);
-    Value *second = car(cdr(args));
-    if (isInteger(first)) {
-        if (isInteger(second)) {
-            return makeInt(first->i % second->i);
-        } else {
-            printf("Expected integer in modulo\n");
-            printf("Given: ");
-            printValue(second);
-            printf("\n");
-            printf("At expression: (modulo ");
-            printTree(args);
-            printf(")\n");
-            texit(1);
-        }
-    } else {
-        printf("Expected integer in modulo\n");
-        printf("Given: ");
-        printValue(first);
-        printf("\n");
-        printf("At expression: (modulo ");
-        printTree(args);
-        printf(")\n");
-        texit(1);
+Value *primitiveVectorLength(int argc, Value **argv) {
+    if (!isVector(argv[0])) {
+        wrongArgument("vector", 0, argc, argv, "vector-length");
     }
+    return makeInt(argv[0]->vector.length);
+}
 
-    assert(false && "Reached end of primitiveModulo without returning\n");
+Value *primitiveVectorRef(int argc, Value **argv) {
+    long index = vectorIndex(argc, argv, "vector-ref");
+    return argv[0]->vector.items[index];
 }
 
-Value *primitiveNot(Value *args) {
-    enforceArgumentArity(args, 1, "not");
-    bool argValue = isTrue(car(args));
-    return makeBool(!argValue);
+Value *primitiveVectorSet(int argc, Value **argv) {
+    long index = vectorIndex(argc, argv, "vector-set!");
+    argv[0]->vector.items[index] = argv[2];
+    return makeVoid();
 }
 
-void bindPrimitive(char *name, Value *(*function)(struct Value *), Frame *frame) {
-    // Add primitive functions to top-level bindings list
-    Value *symbol = makeSymbol(name);
+Value *primitiveVectorFill(int argc, Value **argv) {
+    if (!isVector(argv[0])) {
+        wrongArgument("vector", 0, argc, argv, "vector-fill!");
+    }
+    for (long i = 0; i < argv[0]->vector.length; i++) {
+        argv[0]->vector.items[i] = argv[1];
+    }
+    return makeVoid();
+}
 
-    Value *value = makeValue(PRIMITIVE_TYPE);
-    value->pf = function;
+Value *primitiveVectorToList(int argc, Value **argv) {
+    if (!isVector(argv[0])) {
+        wrongArgument("vector", 0, argc, argv, "vector->list");
+    }
+    return vectorToList(argv[0]);
+}
 
-	Value *binding = makeNull();
-	binding = cons(value, binding);
-	binding = cons(symbol, binding);
-	frame->bindings = cons(binding, frame->bindings);
+Value *primitiveListToVector(int argc, Value **argv) {
+    if (!isProperList(argv[0])) {
+        wrongArgument("list", 0, argc, argv, "list->vector");
+    }
+    return listToVector(argv[0]);
 }
 
-//============================
+/* The hash table primitives. A table made by (make-hash-table) or
+ * (make-hash-table equal?) matches keys with equal?; one made by
+ * (make-hash-table eq?) matches them as eq? would if numbers, booleans and
+ * symbols were shared. See hashtable.h.
+ */
+
+// Stops execution with an error unless argv[0] is a hash table.
+void checkHashTable(int argc, Value **argv, char *name) {
+    if (!isType(argv[0], HASH_TABLE_TYPE)) {
+        wrongArgument("hash table", 0, argc, argv, name);
+    }
+}
+
+Value *primitiveMakeHashTable(int argc, Value **argv) {
+    if (argc == 0) {
+        return makeHashTable(true);
+    }
+    if (isType(argv[0], PRIMITIVE_TYPE) && argv[0]->pf == primitiveEqual) {
+        return makeHashTable(true);
+    } else if (isType(argv[0], PRIMITIVE_TYPE) && argv[0]->pf == primitiveEq) {
+        return makeHashTable(false);
+    }
+    wrongArgument("eq? or equal?", 0, argc, argv, "make-hash-table");
+    return NULL;
+}
+
+Value *primitiveIsHashTable(int argc, Value **argv) {
+    return makeBool(isType(argv[0], HASH_TABLE_TYPE));
+}
+
+Value *primitiveHashRef(int argc, Value **argv) {
+    checkHashTable(argc, argv, "hash-ref");
+    Value *value = hashTableRef(argv[0], argv[1]);
+    if (value != NULL) {
+        return value;
+    } else if (argc > 2) {
+        return argv[2];
+    }
+    printf("No value found for key in hash-ref\n");
+    printf("Key: ");
+    printValue(argv[1]);
+    printf("\n");
+    texit(1);
+    return NULL;
+}
+
+Value *primitiveHashHasKey(int argc, Value **argv) {
+    checkHashTable(argc, argv, "hash-has-key?");
+    return makeBool(hashTableRef(argv[0], argv[1]) != NULL);
+}
+
+Value *primitiveHashSet(int argc, Value **argv) {
+    checkHashTable(argc, argv, "hash-set!");
+    hashTableSet(argv[0], argv[1], argv[2]);
+    return makeVoid();
+}
+
+Value *primitiveHashRemove(int argc, Value **argv) {
+    checkHashTable(argc, argv, "hash-remove!");
+    hashTableRemove(argv[0], argv[1]);
+    return makeVoid();
+}
+
+Value *primitiveHashCount(int argc, Value **argv) {
+    checkHashTable(argc, argv, "hash-count");
+    return makeInt(hashTableCount(argv[0]));
+}
+
+// The parts of each entry of a table that hash-keys, hash-values and
+// hash->list list
+typedef enum { HASH_KEYS, HASH_VALUES, HASH_PAIRS } HashListing;
+
+Value *listHashTable(Value *table, HashListing listing) {
+    Value *result = makeNull();
+    long position = 0;
+    Value *key;
+    Value *value;
+    while (hashTableNext(table, &position, &key, &value)) {
+        if (listing == HASH_KEYS) {
+            result = cons(key, result);
+        } else if (listing == HASH_VALUES) {
+            result = cons(value, result);
+        } else {
+            result = cons(cons(key, value), result);
+        }
+    }
+    return result;
+}
+
+Value *primitiveHashKeys(int argc, Value **argv) {
+    checkHashTable(argc, argv, "hash-keys");
+    return listHashTable(argv[0], HASH_KEYS);
+}
+
+Value *primitiveHashValues(int argc, Value **argv) {
+    checkHashTable(argc, argv, "hash-values");
+    return listHashTable(argv[0], HASH_VALUES);
+}
+
+Value *primitiveHashToList(int argc, Value **argv) {
+    checkHashTable(argc, argv, "hash->list");
+    return listHashTable(argv[0], HASH_PAIRS);
+}
+
+// Checks that each of argv from position first on is a string.
+void checkStrings(int first, int argc, Value **argv, char *name) {
+    for (int i = first; i < argc; i++) {
+        if (!isString(argv[i])) {
+            wrongArgument("string", i, argc, argv, name);
+        }
+    }
+}
+
+// Checks that argv[position] is an integer from 0 to limit, and returns it.
+long stringIndex(int position, long limit, int argc, Value **argv,
+                 char *name) {
+    if (!isInteger(argv[position])) {
+        wrongArgument("integer", position, argc, argv, name);
+    }
+    long index = argv[position]->i;
+    if (index < 0 || index > limit) {
+        printf("Index out of range in %s\n", name);
+        printf("Index: %li, length: %li\n", index, argv[0]->length);
+        printf("At expression: (%s ", name);
+        printTree(makeArgumentList(argv, argc));
+        printf(")\n");
+        texit(1);
+    }
+    return index;
+}
+
+Value *primitiveIsString(int argc, Value **argv) {
+    return makeBool(isString(argv[0]));
+}
+
+Value *primitiveStringLength(int argc, Value **argv) {
+    checkStrings(0, argc, argv, "string-length");
+    return makeInt(argv[0]->length);
+}
+
+/* There are no characters in this interpreter, so string-ref gives a string
+ * of the one character, which shares the text of the string it's from.
+ */
+Value *primitiveStringRef(int argc, Value **argv) {
+    checkStrings(0, 1, argv, "string-ref");
+    long index = stringIndex(1, argv[0]->length - 1, argc, argv,
+                             "string-ref");
+    return substring(argv[0], index, index + 1);
+}
+
+Value *primitiveSubstring(int argc, Value **argv) {
+    checkStrings(0, 1, argv, "substring");
+    long length = argv[0]->length;
+    long start = stringIndex(1, length, argc, argv, "substring");
+    long end = argc > 2 ? stringIndex(2, length, argc, argv, "substring")
+                        : length;
+    if (end < start) {
+        printf("End index before start in substring\n");
+        printf("At expression: (substring ");
+        printTree(makeArgumentList(argv, argc));
+        printf(")\n");
+        texit(1);
+    }
+    return substring(argv[0], start, end);
+}
+
+Value *primitiveStringAppend(int argc, Value **argv) {
+    checkStrings(0, argc, argv, "string-append");
+    return appendStrings(argc, argv);
+}
+
+Value *primitiveStringEqual(int argc, Value **argv) {
+    checkStrings(0, argc, argv, "string=?");
+    for (int i = 1; i < argc; i++) {
+        if (compareStrings(argv[i - 1], argv[i]) != 0) {
+            return makeBool(false);
+        }
+    }
+    return makeBool(true);
+}
+
+Value *primitiveStringLessThan(int argc, Value **argv) {
+    checkStrings(0, argc, argv, "string<?");
+    for (int i = 1; i < argc; i++) {
+        if (compareStrings(argv[i - 1], argv[i]) >= 0) {
+            return makeBool(false);
+        }
+    }
+    return makeBool(true);
+}
+
+Value *primitiveStringToSymbol(int argc, Value **argv) {
+    checkStrings(0, argc, argv, "string->symbol");
+    return makeSymbol(cString(argv[0]));
+}
+
+Value *primitiveSymbolToString(int argc, Value **argv) {
+    if (!isSymbol(argv[0])) {
+        wrongArgument("symbol", 0, argc, argv, "symbol->string");
+    }
+    return makeString(argv[0]->s);
+}
+
+Value *primitiveNumberToString(int argc, Value **argv) {
+    if (!isNumber(argv[0])) {
+        wrongArgument("number", 0, argc, argv, "number->string");
+    }
+    return numberToString(argv[0]);
+}
+
+// Gives #f if the string isn't a number.
+Value *primitiveStringToNumber(int argc, Value **argv) {
+    checkStrings(0, argc, argv, "string->number");
+    Value *number = stringToNumber(argv[0]);
+    return number != NULL ? number : makeBool(false);
+}
+
+Value *primitiveOpenOutputString(int argc, Value **argv) {
+    return makeOutputString();
+}
+
+// (write-string string [output-string]): without an output string, the
+// text goes to standard output, without the quotes printing would add.
+Value *primitiveWriteString(int argc, Value **argv) {
+    checkStrings(0, 1, argv, "write-string");
+    if (argc == 1) {
+        writeText(argv[0]->s, argv[0]->length);
+    } else if (isType(argv[1], OUTPUT_STRING_TYPE)) {
+        writeToOutputString(argv[1], argv[0]);
+    } else {
+        wrongArgument("output string", 1, argc, argv, "write-string");
+    }
+    return makeVoid();
+}
+
+Value *primitiveGetOutputString(int argc, Value **argv) {
+    if (!isType(argv[0], OUTPUT_STRING_TYPE)) {
+        wrongArgument("output string", 0, argc, argv, "get-output-string");
+    }
+    return outputStringContents(argv[0]);
+}
+
+/* The f64vector and s64vector primitives. The two sets are the same apart
+ * from their element type, so each primitive passes its type and name to
+ * one function that does the work for both. An f64vector takes any number
+ * as an element and keeps it as a double; an s64vector takes integers that
+ * fit in a long. The bulk operations are in numvector.c.
+ */
+
+char *packedTypeName(valueType type) {
+    return type == F64VECTOR_TYPE ? "f64vector" : "s64vector";
+}
+
+void checkPacked(valueType type, int position, int argc, Value **argv,
+                 char *name) {
+    if (!isType(argv[position], type)) {
+        wrongArgument(packedTypeName(type), position, argc, argv, name);
+    }
+}
+
+bool fitsPacked(valueType type, Value *value) {
+    return type == F64VECTOR_TYPE ? isNumber(value) : isInteger(value);
+}
+
+char *packedElementName(valueType type) {
+    return type == F64VECTOR_TYPE ? "number" : "64-bit integer";
+}
+
+// Checks that argv[position] can be stored in a vector of type.
+void checkPackedElement(valueType type, int position, int argc, Value **argv,
+                        char *name) {
+    if (!fitsPacked(type, argv[position])) {
+        wrongArgument(packedElementName(type), position, argc, argv, name);
+    }
+}
+
+Value *makePacked(valueType type, long length) {
+    return type == F64VECTOR_TYPE ? makeF64Vector(length, 0)
+                                  : makeS64Vector(length, 0);
+}
+
+Value *loadElement(Value *vector, long index) {
+    if (isType(vector, F64VECTOR_TYPE)) {
+        return makeDouble(vector->packed.doubles[index]);
+    }
+    return makeInt(vector->packed.longs[index]);
+}
+
+// Stores a value that checkPackedElement has accepted.
+void storeElement(Value *vector, long index, Value *value) {
+    if (isType(vector, F64VECTOR_TYPE)) {
+        vector->packed.doubles[index] = numberToDouble(value);
+    } else {
+        vector->packed.longs[index] = value->i;
+    }
+}
+
+// Stops execution with an error because an s64vector operation overflowed.
+void packedOverflow(int argc, Value **argv, char *name) {
+    printf("Integer overflow in %s\n", name);
+    printf("At expression: (%s ", name);
+    printTree(makeArgumentList(argv, argc));
+    printf(")\n");
+    texit(1);
+}
+
+// Checks that the vectors in argv[first] and argv[first + 1] are of type
+// and have the same length, and returns it.
+long checkPackedPair(valueType type, int first, int argc, Value **argv,
+                     char *name) {
+    checkPacked(type, first, argc, argv, name);
+    checkPacked(type, first + 1, argc, argv, name);
+    long length = argv[first]->packed.length;
+    if (argv[first + 1]->packed.length != length) {
+        printf("Vectors of different lengths in %s\n", name);
+        printf("At expression: (%s ", name);
+        printTree(makeArgumentList(argv, argc));
+        printf(")\n");
+        texit(1);
+    }
+    return length;
+}
+
+Value *packedMake(valueType type, int argc, Value **argv, char *name) {
+    if (!isInteger(argv[0]) || argv[0]->i < 0) {
+        wrongArgument("non-negative integer", 0, argc, argv, name);
+    }
+    Value *vector = makePacked(type, argv[0]->i);
+    if (vector == NULL) {
+        wrongArgument("length there is memory for", 0, argc, argv, name);
+    }
+    if (argc > 1) {
+        checkPackedElement(type, 1, argc, argv, name);
+        for (long i = 0; i < argv[0]->i; i++) {
+            storeElement(vector, i, argv[1]);
+        }
+    }
+    return vector;
+}
+
+Value *packedOf(valueType type, int argc, Value **argv, char *name) {
+    Value *vector = makePacked(type, argc);
+    for (int i = 0; i < argc; i++) {
+        checkPackedElement(type, i, argc, argv, name);
+        storeElement(vector, i, argv[i]);
+    }
+    return vector;
+}
+
+Value *packedLength(valueType type, int argc, Value **argv, char *name) {
+    checkPacked(type, 0, argc, argv, name);
+    return makeInt(argv[0]->packed.length);
+}
+
+long packedIndex(valueType type, int argc, Value **argv, char *name) {
+    checkPacked(type, 0, argc, argv, name);
+    if (!isInteger(argv[1])) {
+        wrongArgument("integer", 1, argc, argv, name);
+    }
+    long index = argv[1]->i;
+    if (index < 0 || index >= argv[0]->packed.length) {
+        printf("Index out of range in %s\n", name);
+        printf("Index: %li, length: %li\n", index, argv[0]->packed.length);
+        printf("At expression: (%s ", name);
+        printTree(makeArgumentList(argv, argc));
+        printf(")\n");
+        texit(1);
+    }
+    return index;
+}
+
+Value *packedRef(valueType type, int argc, Value **argv, char *name) {
+    return loadElement(argv[0], packedIndex(type, argc, argv, name));
+}
+
+Value *packedSet(valueType type, int argc, Value **argv, char *name) {
+    long index = packedIndex(type, argc, argv, name);
+    checkPackedElement(type, 2, argc, argv, name);
+    storeElement(argv[0], index, argv[2]);
+    return makeVoid();
+}
+
+Value *packedToList(valueType type, int argc, Value **argv, char *name) {
+    checkPacked(type, 0, argc, argv, name);
+    Value *result = makeNull();
+    for (long i = argv[0]->packed.length - 1; i >= 0; i--) {
+        result = cons(loadElement(argv[0], i), result);
+    }
+    return result;
+}
+
+Value *listToPacked(valueType type, int argc, Value **argv, char *name) {
+    if (!isProperList(argv[0])) {
+        wrongArgument("list", 0, argc, argv, name);
+    }
+    int numElements = length(argv[0]);
+    Value *elements[numElements + 1];
+    Value *current = argv[0];
+    for (int i = 0; i < numElements; i++) {
+        elements[i] = car(current);
+        current = cdr(current);
+    }
+    return packedOf(type, numElements, elements, name);
+}
+
+/* Does + - * or / on every pair of elements of a and b with the kernels, if
+ * there are kernels for it, into a new vector. Returns NULL if there
+ * aren't, which is the case for / on s64vectors.
+ */
+Value *packedArithmetic(PrimitiveFunction pf, Value *a, Value *b, int argc,
+                        Value **argv, char *name) {
+    long length = a->packed.length;
+    if (isType(a, F64VECTOR_TYPE)) {
+        void (*kernel)(double *, double *, double *, long) =
+            pf == primitiveAdd ? addF64
+            : pf == primitiveSubtract ? subtractF64
+            : pf == primitiveMult ? multiplyF64
+            : pf == primitiveDivide ? divideF64 : NULL;
+        if (kernel == NULL) {
+            return NULL;
+        }
+        Value *result = makeF64Vector(length, 0);
+        kernel(result->packed.doubles, a->packed.doubles, b->packed.doubles,
+               length);
+        return result;
+    }
+
+    bool (*kernel)(long *, long *, long *, long) =
+        pf == primitiveAdd ? addS64
+        : pf == primitiveSubtract ? subtractS64
+        : pf == primitiveMult ? multiplyS64 : NULL;
+    if (kernel == NULL) {
+        return NULL;
+    }
+    Value *result = makeS64Vector(length, 0);
+    if (!kernel(result->packed.longs, a->packed.longs, b->packed.longs,
+                length)) {
+        packedOverflow(argc, argv, name);
+    }
+    return result;
+}
+
+Value *packedAdd(valueType type, int argc, Value **argv, char *name) {
+    checkPackedPair(type, 0, argc, argv, name);
+    return packedArithmetic(primitiveAdd, argv[0], argv[1], argc, argv, name);
+}
+
+Value *packedMultiply(valueType type, int argc, Value **argv, char *name) {
+    checkPackedPair(type, 0, argc, argv, name);
+    return packedArithmetic(primitiveMult, argv[0], argv[1], argc, argv, name);
+}
+
+Value *packedScale(valueType type, int argc, Value **argv, char *name) {
+    checkPacked(type, 0, argc, argv, name);
+    checkPackedElement(type, 1, argc, argv, name);
+    long length = argv[0]->packed.length;
+    Value *result = makePacked(type, length);
+    if (type == F64VECTOR_TYPE) {
+        scaleF64(result->packed.doubles, argv[0]->packed.doubles,
+                 numberToDouble(argv[1]), length);
+    } else if (!scaleS64(result->packed.longs, argv[0]->packed.longs,
+                         argv[1]->i, length)) {
+        packedOverflow(argc, argv, name);
+    }
+    return result;
+}
+
+Value *packedDot(valueType type, int argc, Value **argv, char *name) {
+    long length = checkPackedPair(type, 0, argc, argv, name);
+    if (type == F64VECTOR_TYPE) {
+        return makeDouble(dotF64(argv[0]->packed.doubles,
+                                 argv[1]->packed.doubles, length));
+    }
+    return dotS64(argv[0]->packed.longs, argv[1]->packed.longs, length);
+}
+
+Value *packedSum(valueType type, int argc, Value **argv, char *name) {
+    checkPacked(type, 0, argc, argv, name);
+    if (type == F64VECTOR_TYPE) {
+        return makeDouble(sumF64(argv[0]->packed.doubles,
+                                 argv[0]->packed.length));
+    }
+    return sumS64(argv[0]->packed.longs, argv[0]->packed.length);
+}
+
+Value *packedExtreme(valueType type, bool max, int argc, Value **argv,
+                     char *name) {
+    checkPacked(type, 0, argc, argv, name);
+    long length = argv[0]->packed.length;
+    if (length == 0) {
+        printf("Empty vector in %s\n", name);
+        texit(1);
+    }
+    if (type == F64VECTOR_TYPE) {
+        double *doubles = argv[0]->packed.doubles;
+        return makeDouble(max ? maxF64(doubles, length)
+                              : minF64(doubles, length));
+    }
+    long *longs = argv[0]->packed.longs;
+    return makeInt(max ? maxS64(longs, length) : minS64(longs, length));
+}
+
+/* (map op v) or (map op v w): a new vector of op applied to each element,
+ * or to each pair of elements. op must be a primitive. + - * and / go
+ * through the bulk kernels; any other primitive is called on each element,
+ * boxed, and must return something the vector can hold.
+ */
+Value *packedMap(valueType type, int argc, Value **argv, char *name) {
+    Value *op = argv[0];
+    if (!isType(op, PRIMITIVE_TYPE)) {
+        wrongArgument("primitive", 0, argc, argv, name);
+    }
+    int numArgs = argc - 1;
+    long length;
+    if (numArgs == 2) {
+        length = checkPackedPair(type, 1, argc, argv, name);
+        Value *result = packedArithmetic(op->pf, argv[1], argv[2], argc, argv,
+                                         name);
+        if (result != NULL) {
+            return result;
+        }
+    } else {
+        checkPacked(type, 1, argc, argv, name);
+        length = argv[1]->packed.length;
+    }
+    if (!acceptsArity(op->descriptor, numArgs)) {
+        printf("Wrong number of arguments for the primitive in %s\n", name);
+        printf("At expression: (%s ", name);
+        printTree(makeArgumentList(argv, argc));
+        printf(")\n");
+        texit(1);
+    }
+
+    Value *result = makePacked(type, length);
+    for (long i = 0; i < length; i++) {
+        Value *elements[2];
+        for (int j = 0; j < numArgs; j++) {
+            elements[j] = loadElement(argv[j + 1], i);
+        }
+        Value *mapped = (*(op->pf))(numArgs, elements);
+        if (!fitsPacked(type, mapped)) {
+            printf("Expected %s from the primitive in %s\n",
+                   packedElementName(type), name);
+            printf("Given: ");
+            printValue(mapped);
+            printf("\n");
+            printf("At expression: (%s ", name);
+            printTree(makeArgumentList(argv, argc));
+            printf(")\n");
+            texit(1);
+        }
+        storeElement(result, i, mapped);
+    }
+    return result;
+}
+
+Value *primitiveIsF64Vector(int argc, Value **argv) {
+    return makeBool(isType(argv[0], F64VECTOR_TYPE));
+}
+
+Value *primitiveIsS64Vector(int argc, Value **argv) {
+    return makeBool(isType(argv[0], S64VECTOR_TYPE));
+}
+
+Value *primitiveMakeF64Vector(int argc, Value **argv) {
+    return packedMake(F64VECTOR_TYPE, argc, argv, "make-f64vector");
+}
+
+Value *primitiveMakeS64Vector(int argc, Value **argv) {
+    return packedMake(S64VECTOR_TYPE, argc, argv, "make-s64vector");
+}
+
+Value *primitiveF64Vector(int argc, Value **argv) {
+    return packedOf(F64VECTOR_TYPE, argc, argv, "f64vector");
+}
+
+Value *primitiveS64Vector(int argc, Value **argv) {
+    return packedOf(S64VECTOR_TYPE, argc, argv, "s64vector");
+}
+
+Value *primitiveF64VectorLength(int argc, Value **argv) {
+    return packedLength(F64VECTOR_TYPE, argc, argv, "f64vector-length");
+}
+
+Value *primitiveS64VectorLength(int argc, Value **argv) {
+    return packedLength(S64VECTOR_TYPE, argc, argv, "s64vector-length");
+}
+
+Value *primitiveF64VectorRef(int argc, Value **argv) {
+    return packedRef(F64VECTOR_TYPE, argc, argv, "f64vector-ref");
+}
+
+Value *primitiveS64VectorRef(int argc, Value **argv) {
+    return packedRef(S64VECTOR_TYPE, argc, argv, "s64vector-ref");
+}
+
+Value *primitiveF64VectorSet(int argc, Value **argv) {
+    return packedSet(F64VECTOR_TYPE, argc, argv, "f64vector-set!");
+}
+
+Value *primitiveS64VectorSet(int argc, Value **argv) {
+    return packedSet(S64VECTOR_TYPE, argc, argv, "s64vector-set!");
+}
+
+Value *primitiveF64VectorToList(int argc, Value **argv) {
+    return packedToList(F64VECTOR_TYPE, argc, argv, "f64vector->list");
+}
+
+Value *primitiveS64VectorToList(int argc, Value **argv) {
+    return packedToList(S64VECTOR_TYPE, argc, argv, "s64vector->list");
+}
+
+Value *primitiveListToF64Vector(int argc, Value **argv) {
+    return listToPacked(F64VECTOR_TYPE, argc, argv, "list->f64vector");
+}
+
+Value *primitiveListToS64Vector(int argc, Value **argv) {
+    return listToPacked(S64VECTOR_TYPE, argc, argv, "list->s64vector");
+}
+
+Value *primitiveF64VectorAdd(int argc, Value **argv) {
+    return packedAdd(F64VECTOR_TYPE, argc, argv, "f64vector-add");
+}
+
+Value *primitiveS64VectorAdd(int argc, Value **argv) {
+    return packedAdd(S64VECTOR_TYPE, argc, argv, "s64vector-add");
+}
+
+Value *primitiveF64VectorMultiply(int argc, Value **argv) {
+    return packedMultiply(F64VECTOR_TYPE, argc, argv, "f64vector-mul");
+}
+
+Value *primitiveS64VectorMultiply(int argc, Value **argv) {
+    return packedMultiply(S64VECTOR_TYPE, argc, argv, "s64vector-mul");
+}
+
+Value *primitiveF64VectorScale(int argc, Value **argv) {
+    return packedScale(F64VECTOR_TYPE, argc, argv, "f64vector-scale");
+}
+
+Value *primitiveS64VectorScale(int argc, Value **argv) {
+    return packedScale(S64VECTOR_TYPE, argc, argv, "s64vector-scale");
+}
+
+Value *primitiveF64VectorDot(int argc, Value **argv) {
+    return packedDot(F64VECTOR_TYPE, argc, argv, "f64vector-dot");
+}
+
+Value *primitiveS64VectorDot(int argc, Value **argv) {
+    return packedDot(S64VECTOR_TYPE, argc, argv, "s64vector-dot");
+}
+
+Value *primitiveF64VectorSum(int argc, Value **argv) {
+    return packedSum(F64VECTOR_TYPE, argc, argv, "f64vector-sum");
+}
+
+Value *primitiveS64VectorSum(int argc, Value **argv) {
+    return packedSum(S64VECTOR_TYPE, argc, argv, "s64vector-sum");
+}
+
+Value *primitiveF64VectorMin(int argc, Value **argv) {
+    return packedExtreme(F64VECTOR_TYPE, false, argc, argv, "f64vector-min");
+}
+
+Value *primitiveS64VectorMin(int argc, Value **argv) {
+    return packedExtreme(S64VECTOR_TYPE, false, argc, argv, "s64vector-min");
+}
+
+Value *primitiveF64VectorMax(int argc, Value **argv) {
+    return packedExtreme(F64VECTOR_TYPE, true, argc, argv, "f64vector-max");
+}
+
+Value *primitiveS64VectorMax(int argc, Value **argv) {
+    return packedExtreme(S64VECTOR_TYPE, true, argc, argv, "s64vector-max");
+}
+
+Value *primitiveF64VectorMap(int argc, Value **argv) {
+    return packedMap(F64VECTOR_TYPE, argc, argv, "f64vector-map");
+}
+
+Value *primitiveS64VectorMap(int argc, Value **argv) {
+    return packedMap(S64VECTOR_TYPE, argc, argv, "s64vector-map");
+}
+
+Value *primitivePrintGraph(int argc, Value **argv) {
+    if (argc == 0) {
+        return makeBool(isPrintGraphEnabled());
+    }
+    setPrintGraph(isTrue(argv[0]));
+    return makeVoid();
+}
+
+Value *primitiveNewline(int argc, Value **argv) {
+    writeChar('\n');
+    return makeVoid();
+}
+
+Value *primitiveFlushOutput(int argc, Value **argv) {
+    flushOutput();
+    return makeVoid();
+}
+
+/* Every primitive, with the arity its callers check before calling it.
+ * Pure primitives have no side effects and always give equal results for
+ * equal arguments, so a call to one with constant arguments can be done
+ * ahead of time.
+ */
+static const PrimitiveDescriptor primitiveTable[] = {
+    // name      function              min max pure   signature
+    {"+",        primitiveAdd,          0, -1, true,  "(+ number ...) -> number"},
+    {"-",        primitiveSubtract,     2, -1, true,  "(- number number ...) -> number"},
+    {"*",        primitiveMult,         0, -1, true,  "(* number ...) -> number"},
+    {"/",        primitiveDivide,       2,  2, true,  "(/ number number) -> number"},
+    {"null?",    primitiveIsNull,       1,  1, true,  "(null? any) -> boolean"},
+    {"list?",    primitiveIsList,       1,  1, true,  "(list? any) -> boolean"},
+    {"car",      primitiveCar,          1,  1, true,  "(car pair) -> any"},
+    {"cdr",      primitiveCdr,          1,  1, true,  "(cdr pair) -> any"},
+    {"cons",     primitiveCons,         2,  2, false, "(cons any any) -> pair"},
+    {"list",     primitiveList,         0, -1, false, "(list any ...) -> list"},
+    {"append",   primitiveAppend,       0, -1, false, "(append list ... any) -> any"},
+    {"reverse",  primitiveReverse,      1,  1, false, "(reverse list) -> list"},
+    {"length",   primitiveLength,       1,  1, true,  "(length list) -> integer"},
+    {"equal?",   primitiveEqual,        2,  2, true,  "(equal? any any) -> boolean"},
+    {"eq?",      primitiveEq,           2,  2, true,  "(eq? any any) -> boolean"},
+    {"number?",  primitiveIsNumber,     1,  1, true,  "(number? any) -> boolean"},
+    {"=",        primitiveEqualNum,     1, -1, true,  "(= number ...) -> boolean"},
+    {"<",        primitiveLessThan,     2,  2, true,  "(< number number) -> boolean"},
+    {">",        primitiveGreaterThan,  2,  2, true,  "(> number number) -> boolean"},
+    {"modulo",   primitiveModulo,       2,  2, true,  "(modulo integer integer) -> integer"},
+    {"not",      primitiveNot,          1,  1, true,  "(not any) -> boolean"},
+    {"set-car!", primitiveSetCar,       2,  2, false, "(set-car! pair any) -> void"},
+    {"set-cdr!", primitiveSetCdr,       2,  2, false, "(set-cdr! pair any) -> void"},
+    {"vector?",  primitiveIsVector,     1,  1, true,  "(vector? any) -> boolean"},
+    {"make-vector", primitiveMakeVector, 1, 2, false, "(make-vector integer [any]) -> vector"},
+    {"vector",   primitiveVector,       0, -1, false, "(vector any ...) -> vector"},
+    {"vector-length", primitiveVectorLength, 1, 1, true, "(vector-length vector) -> integer"},
+    {"vector-ref", primitiveVectorRef,  2,  2, true,  "(vector-ref vector integer) -> any"},
+    {"vector-set!", primitiveVectorSet, 3,  3, false, "(vector-set! vector integer any) -> void"},
+    {"vector-fill!", primitiveVectorFill, 2, 2, false, "(vector-fill! vector any) -> void"},
+    {"vector->list", primitiveVectorToList, 1, 1, false, "(vector->list vector) -> list"},
+    {"list->vector", primitiveListToVector, 1, 1, false, "(list->vector list) -> vector"},
+    {"make-hash-table", primitiveMakeHashTable, 0, 1, false, "(make-hash-table [procedure]) -> hash-table"},
+    {"hash-table?", primitiveIsHashTable, 1, 1, true, "(hash-table? any) -> boolean"},
+    {"hash-ref", primitiveHashRef,      2,  3, false, "(hash-ref hash-table any [any]) -> any"},
+    {"hash-has-key?", primitiveHashHasKey, 2, 2, false, "(hash-has-key? hash-table any) -> boolean"},
+    {"hash-set!", primitiveHashSet,     3,  3, false, "(hash-set! hash-table any any) -> void"},
+    {"hash-remove!", primitiveHashRemove, 2, 2, false, "(hash-remove! hash-table any) -> void"},
+    {"hash-count", primitiveHashCount,  1,  1, false, "(hash-count hash-table) -> integer"},
+    {"hash-keys", primitiveHashKeys,    1,  1, false, "(hash-keys hash-table) -> list"},
+    {"hash-values", primitiveHashValues, 1, 1, false, "(hash-values hash-table) -> list"},
+    {"hash->list", primitiveHashToList, 1,  1, false, "(hash->list hash-table) -> list"},
+    {"string?",  primitiveIsString,     1,  1, true,  "(string? any) -> boolean"},
+    {"string-length", primitiveStringLength, 1, 1, true, "(string-length string) -> integer"},
+    {"string-ref", primitiveStringRef,  2,  2, false, "(string-ref string integer) -> string"},
+    {"substring", primitiveSubstring,   2,  3, false, "(substring string integer [integer]) -> string"},
+    {"string-append", primitiveStringAppend, 0, -1, false, "(string-append string ...) -> string"},
+    {"string=?", primitiveStringEqual,  1, -1, true,  "(string=? string ...) -> boolean"},
+    {"string<?", primitiveStringLessThan, 1, -1, true, "(string<? string ...) -> boolean"},
+    {"string->symbol", primitiveStringToSymbol, 1, 1, false, "(string->symbol string) -> symbol"},
+    {"symbol->string", primitiveSymbolToString, 1, 1, false, "(symbol->string symbol) -> string"},
+    {"number->string", primitiveNumberToString, 1, 1, false, "(number->string number) -> string"},
+    {"string->number", primitiveStringToNumber, 1, 1, true, "(string->number string) -> any"},
+    {"open-output-string", primitiveOpenOutputString, 0, 0, false, "(open-output-string) -> output-string"},
+    {"write-string", primitiveWriteString, 1, 2, false, "(write-string string [output-string]) -> void"},
+    {"get-output-string", primitiveGetOutputString, 1, 1, false, "(get-output-string output-string) -> string"},
+    {"f64vector?", primitiveIsF64Vector, 1, 1, true, "(f64vector? any) -> boolean"},
+    {"make-f64vector", primitiveMakeF64Vector, 1, 2, false, "(make-f64vector integer [number]) -> f64vector"},
+    {"f64vector", primitiveF64Vector, 0, -1, false, "(f64vector number ...) -> f64vector"},
+    {"f64vector-length", primitiveF64VectorLength, 1, 1, true, "(f64vector-length f64vector) -> integer"},
+    {"f64vector-ref", primitiveF64VectorRef, 2, 2, false, "(f64vector-ref f64vector integer) -> number"},
+    {"f64vector-set!", primitiveF64VectorSet, 3, 3, false, "(f64vector-set! f64vector integer number) -> void"},
+    {"f64vector->list", primitiveF64VectorToList, 1, 1, false, "(f64vector->list f64vector) -> list"},
+    {"list->f64vector", primitiveListToF64Vector, 1, 1, false, "(list->f64vector list) -> f64vector"},
+    {"f64vector-add", primitiveF64VectorAdd, 2, 2, false, "(f64vector-add f64vector f64vector) -> f64vector"},
+    {"f64vector-mul", primitiveF64VectorMultiply, 2, 2, false, "(f64vector-mul f64vector f64vector) -> f64vector"},
+    {"f64vector-scale", primitiveF64VectorScale, 2, 2, false, "(f64vector-scale f64vector number) -> f64vector"},
+    {"f64vector-dot", primitiveF64VectorDot, 2, 2, false, "(f64vector-dot f64vector f64vector) -> number"},
+    {"f64vector-sum", primitiveF64VectorSum, 1, 1, false, "(f64vector-sum f64vector) -> number"},
+    {"f64vector-min", primitiveF64VectorMin, 1, 1, false, "(f64vector-min f64vector) -> number"},
+    {"f64vector-max", primitiveF64VectorMax, 1, 1, false, "(f64vector-max f64vector) -> number"},
+    {"f64vector-map", primitiveF64VectorMap, 2, 3, false, "(f64vector-map primitive f64vector [f64vector]) -> f64vector"},
+    {"s64vector?", primitiveIsS64Vector, 1, 1, true, "(s64vector? any) -> boolean"},
+    {"make-s64vector", primitiveMakeS64Vector, 1, 2, false, "(make-s64vector integer [number]) -> s64vector"},
+    {"s64vector", primitiveS64Vector, 0, -1, false, "(s64vector number ...) -> s64vector"},
+    {"s64vector-length", primitiveS64VectorLength, 1, 1, true, "(s64vector-length s64vector) -> integer"},
+    {"s64vector-ref", primitiveS64VectorRef, 2, 2, false, "(s64vector-ref s64vector integer) -> number"},
+    {"s64vector-set!", primitiveS64VectorSet, 3, 3, false, "(s64vector-set! s64vector integer number) -> void"},
+    {"s64vector->list", primitiveS64VectorToList, 1, 1, false, "(s64vector->list s64vector) -> list"},
+    {"list->s64vector", primitiveListToS64Vector, 1, 1, false, "(list->s64vector list) -> s64vector"},
+    {"s64vector-add", primitiveS64VectorAdd, 2, 2, false, "(s64vector-add s64vector s64vector) -> s64vector"},
+    {"s64vector-mul", primitiveS64VectorMultiply, 2, 2, false, "(s64vector-mul s64vector s64vector) -> s64vector"},
+    {"s64vector-scale", primitiveS64VectorScale, 2, 2, false, "(s64vector-scale s64vector number) -> s64vector"},
+    {"s64vector-dot", primitiveS64VectorDot, 2, 2, false, "(s64vector-dot s64vector s64vector) -> number"},
+    {"s64vector-sum", primitiveS64VectorSum, 1, 1, false, "(s64vector-sum s64vector) -> number"},
+    {"s64vector-min", primitiveS64VectorMin, 1, 1, false, "(s64vector-min s64vector) -> number"},
+    {"s64vector-max", primitiveS64VectorMax, 1, 1, false, "(s64vector-max s64vector) -> number"},
+    {"s64vector-map", primitiveS64VectorMap, 2, 3, false, "(s64vector-map primitive s64vector [s64vector]) -> s64vector"},
+    {"print-graph", primitivePrintGraph, 0, 1, false, "(print-graph [any]) -> boolean or void"},
+    {"newline",  primitiveNewline,      0,  0, false, "(newline) -> void"},
+    {"flush-output", primitiveFlushOutput, 0, 0, false, "(flush-output) -> void"},
+};
+
+#define NUM_PRIMITIVES (sizeof(primitiveTable) / sizeof(primitiveTable[0]))
+
+const PrimitiveDescriptor *lookUpPrimitive(char *name) {
+    for (int i = 0; i < NUM_PRIMITIVES; i++) {
+        if (!strcmp(primitiveTable[i].name, name)) {
+            return &primitiveTable[i];
+        }
+    }
+    return NULL;
+}
+
+bool acceptsArity(const PrimitiveDescriptor *descriptor, int argc) {
+    return argc >= descriptor->minArgs
+        && (descriptor->maxArgs < 0 || argc <= descriptor->maxArgs);
+}
+
+// Checks whether value is of a type named in a primitive's signature.
+bool hasSignatureType(Value *value, char *type) {
+    if (!strcmp(type, "any")) {
+        return true;
+    } else if (!strcmp(type, "number")) {
+        return isNumber(value);
+    } else if (!strcmp(type, "integer")) {
+        return isInteger(value);
+    } else if (!strcmp(type, "pair")) {
+        return isCons(value);
+    } else if (!strcmp(type, "list")) {
+        return isProperList(value);
+    } else if (!strcmp(type, "boolean")) {
+        return isBoolean(value);
+    } else if (!strcmp(type, "vector")) {
+        return isVector(value);
+    } else if (!strcmp(type, "string")) {
+        return isString(value);
+    } else if (!strcmp(type, "symbol")) {
+        return isSymbol(value);
+    }
+    return false;
+}
+
+/* Reads the argument types from the signature, "(name type type ...)": each
+ * argument must have the type in its position, and a trailing ... repeats the
+ * type before it. A signature this doesn't understand matches nothing.
+ */
+bool acceptsArguments(const PrimitiveDescriptor *descriptor, int argc,
+                      Value **argv) {
+    if (!acceptsArity(descriptor, argc)) {
+        return false;
+    }
+
+    char type[16] = "";
+    bool repeating = false;
+    char *cursor = strchr(descriptor->signature, ' ');
+    for (int i = 0; i < argc; i++) {
+        if (!repeating) {
+            if (cursor == NULL || *cursor != ' ') {
+                return false;
+            }
+            cursor++;
+            int typeLength = strcspn(cursor, " )");
+            if (typeLength == 3 && !strncmp(cursor, "...", 3)) {
+                repeating = true;
+            } else if (typeLength < sizeof(type)) {
+                memcpy(type, cursor, typeLength);
+                type[typeLength] = '\0';
+            } else {
+                return false;
+            }
+            cursor += typeLength;
+        }
+        if (!hasSignatureType(argv[i], type)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void checkPrimitiveArity(Value *primitive, int argc, Value **argv) {
+    const PrimitiveDescriptor *descriptor = primitive->descriptor;
+    if (acceptsArity(descriptor, argc)) {
+        return;
+    }
+
+    printf("Usage: %s\n", descriptor->signature);
+    Value *args = makeArgumentList(argv, argc);
+    if (descriptor->minArgs == descriptor->maxArgs) {
+        enforceArgumentArity(args, descriptor->minArgs, descriptor->name);
+    } else {
+        enforceArgumentArityRange(args, descriptor->minArgs,
+                                  descriptor->maxArgs, descriptor->name);
+    }
+}
+
+Value *callPrimitive(Value *primitive, int argc, Value **argv) {
+    checkPrimitiveArity(primitive, argc, argv);
+    return (*(primitive->pf))(argc, argv);
+}
+
+Value *makePrimitive(const PrimitiveDescriptor *descriptor) {
+    Value *value = makeValue(PRIMITIVE_TYPE);
+    value->pf = descriptor->function;
+    value->descriptor = descriptor;
+    return value;
+}
+
+// Binds the primitive described by descriptor in frame.
+void bindPrimitive(const PrimitiveDescriptor *descriptor, Frame *frame) {
+    // Add primitive functions to top-level bindings list
+    Value *symbol = makeSymbol(descriptor->name);
+    Value *value = makePrimitive(descriptor);
+
+	Value *binding = makeNull();
+	binding = cons(value, binding);
+	binding = cons(symbol, binding);
+	frame->bindings = cons(binding, frame->bindings);
+}
+
+//============================
 // Standard Evaluation: apply
 //============================
 
@@ -805,7 +1662,12 @@ Value *lookUpSymbol(Value *symbol, Frame *activeFrame) {
     return NULL;
 }
 
-Frame *makeBinding(Value *bindingPair, Frame *activeFrame) {
+/* Stops execution with an error if a let binding pair is malformed.
+ *
+ * Checks that bindingPair is a (name expr) pair, that name is a symbol, and
+ * that name is not already bound in activeFrame (the frame being built).
+ */
+void checkBinding(Value *bindingPair, Frame *activeFrame) {
     Value *name = car(bindingPair);
     Value *expr = cdr(bindingPair);
 
@@ -843,13 +1705,22 @@ Frame *makeBinding(Value *bindingPair, Frame *activeFrame) {
             texit(1);
         }
     }
+}
 
-    Value *exprResult = eval(expr, activeFrame->parent);
+// Binds the symbol name to value in frame.
+void addBinding(Value *name, Value *value, Frame *frame) {
     Value *newBinding = makeNull();
-    newBinding = cons(exprResult, newBinding);
+    newBinding = cons(value, newBinding);
     newBinding = cons(name, newBinding);
 
-    activeFrame->bindings = cons(newBinding, activeFrame->bindings);
+    frame->bindings = cons(newBinding, frame->bindings);
+}
+
+Frame *makeBinding(Value *bindingPair, Frame *activeFrame) {
+    checkBinding(bindingPair, activeFrame);
+
+    Value *exprResult = eval(cdr(bindingPair), activeFrame->parent);
+    addBinding(car(bindingPair), exprResult, activeFrame);
     return activeFrame;
 }
 
@@ -883,49 +1754,60 @@ bool checkValidParameters(Value *paramsList) {
     return true;
 }
 
-// Yes, we know how this name sounds...
-Frame *makeApplyBindings(Value *functionParams, Value *args, Frame *functionFrame) {
+// Stops execution with an error if a function is given the wrong number of
+// arguments.
+void checkApplyArity(int numParams, int numArgs) {
+    if (numParams != numArgs) {
+        printf("Arity mismatch in function application.\n");
+        printf("Function expected %i arguments, ", numParams);
+        printf("given %i.\n", numArgs);
+        texit(1);
+    }
+}
+
+/* Binds a closure's parameters to its arguments in functionFrame, without
+ * checking that there are as many arguments as parameters. A rest parameter
+ * gets all the arguments as a list.
+ */
+void bindParameters(Value *functionParams, Value **args, int numArgs,
+                    Frame *functionFrame) {
     if (isSymbol(functionParams)) {
-            Value *newBinding = makeNull();
-            newBinding = cons(args, newBinding);
-            newBinding = cons(functionParams, newBinding);
-            functionFrame->bindings = cons(newBinding, functionFrame->bindings);
+        addBinding(functionParams, makeArgumentList(args, numArgs),
+                   functionFrame);
     } else {
-        //TEST test coverage
-        assert(isCons(functionParams) || isNull(functionParams));
-
-        if (length(functionParams) != length(args)) {
-            printf("Arity mismatch in function application.\n");
-            printf("Function expected %i arguments, ", length(functionParams));
-            printf("given %i.\n", length(args));
-            texit(1);
-        }
-
-        Value *currentParam = functionParams;
-        Value *currentArg = args;
-
-        // Iterate through both at once.
-        // Bind the current param to the current arg.
-        // Note: we can now assume that functionParams and args have the same length.
-        // Also, functionParams can't include duplicate symbols to bind. That was
+        // functionParams can't include duplicate symbols to bind. That was
         // handled in evalLambda.
+        Value *currentParam = functionParams;
         while (!isNull(currentParam)) {
-            // Make the binding
-            Value *newBinding = makeNull();
-            newBinding = cons(car(currentArg), newBinding);
-            newBinding = cons(car(currentParam), newBinding);
-            functionFrame->bindings = cons(newBinding, functionFrame->bindings);
-
+            addBinding(car(currentParam), *args++, functionFrame);
             currentParam = cdr(currentParam);
-            currentArg = cdr(currentArg);
         }
     }
+}
+
+// Yes, we know how this name sounds...
+Frame *makeApplyBindings(Value *functionParams, Value **args, int numArgs,
+                         Frame *functionFrame) {
+    if (!isSymbol(functionParams)) {
+        //TEST test coverage
+        assert(isCons(functionParams) || isNull(functionParams));
+
+        checkApplyArity(length(functionParams), numArgs);
+    }
+    bindParameters(functionParams, args, numArgs, functionFrame);
     return functionFrame;
 }
 
-Value *apply(Value *function, Value *argsTree) {
-    //Sanity checks for closure
+// Creates an empty frame whose parent is the given frame.
+Frame *makeFrame(Frame *parent) {
+    Frame *frame = talloc(sizeof(Frame));
+    frame->parent = parent;
+    frame->bindings = makeNull();
+    return frame;
+}
 
+// Stops execution with an error if function is not a closure.
+void checkClosure(Value *function) {
     if (function->type != CLOSURE_TYPE) {
         assert(false);
         printf("Application not a procedure.\n");
@@ -935,16 +1817,27 @@ Value *apply(Value *function, Value *argsTree) {
         printf("This is not a procedure\n");
         texit(1);
     }
+}
+
+/* Builds the frame that a closure's body is evaluated in.
+ *
+ * Stops execution with an error if function is not a closure or if the
+ * arguments don't match its parameters.
+ */
+Frame *makeApplyFrame(Value *function, Value **args, int numArgs) {
+    checkClosure(function);
 
     // Construct a new frame whose parent is the environment stored in the closure (function)
-    Frame *evalFrame = talloc(sizeof(Frame));
-    evalFrame->parent = function->cl.frame;
-    evalFrame->bindings = makeNull();
+    Frame *evalFrame = makeFrame(function->cl.frame);
 
     // Bind parameters to arguments in this frame
-    evalFrame = makeApplyBindings(function->cl.paramNames, argsTree, evalFrame);
+    return makeApplyBindings(function->cl.paramNames, args, numArgs,
+                             evalFrame);
+}
 
-    // Evaluate the function body expressions
+// Evaluates the body of a closure in evalFrame, which has its parameters
+// bound, and returns the value of the last expression.
+Value *evalClosureBody(Value *function, Frame *evalFrame) {
     Value *result = makeNull();
     Value *currentExpr = function->cl.functionCode;
     while (!isNull(currentExpr)) {
@@ -955,6 +1848,23 @@ Value *apply(Value *function, Value *argsTree) {
     return result;
 }
 
+Value *runClosureCall(Value *function, Value **args, int numArgs);
+
+Value *apply(Value *function, Value **args, int numArgs) {
+    // Hot closures may have been compiled to machine code
+    JitFunction code = getJitCode(function);
+    if (code != NULL) {
+        return runJitCode(code, function, args, numArgs);
+    }
+
+    checkClosure(function);
+    Value *params = function->cl.paramNames;
+    if (!isSymbol(params)) {
+        checkApplyArity(length(params), numArgs);
+    }
+    return runClosureCall(function, args, numArgs);
+}
+
 //==================
 // Special Forms
 //==================
@@ -970,8 +1880,16 @@ Value *evalBegin(Value *argsTree, Frame *activeFrame) {
     return result;
 }
 
-Value *evalCond(Value *argsTree, Frame *activeFrame) {
-    // Check for correct syntax with else
+// Checks whether a cond clause is an else clause.
+bool isElseClause(Value *clause) {
+    return isSymbol(car(clause)) && !strcmp(car(clause)->s, "else");
+}
+
+/* Stops execution with an error if a cond expression is malformed.
+ *
+ * An else clause must have a body and must be the last clause.
+ */
+void checkCondSyntax(Value *argsTree) {
     Value *currentExpr = argsTree;
     while (!isNull(currentExpr)) {
         Value *condition = car(currentExpr);
@@ -982,81 +1900,25 @@ Value *evalCond(Value *argsTree, Frame *activeFrame) {
             if (!strcmp(car(condition)->s, "else")) {
                 if (isNull(body)) {
                     printf("Else clause must have a body.\n");
-                    printf("At expression: ");
-                    printTree(currentExpr);
-                    printf("\n");
-                    texit(1);
-                }
-                if (!isNull(cdr(currentExpr))) {
-                    printf("Else clause must be last; given too many.\n");
-                    printf("At expression: ");
-                    printTree(cdr(currentExpr));
-                    printf("\n");
-                    texit(1);
-                }
-            }
-        }
-        currentExpr = cdr(currentExpr);
-    }
-
-    // Actually evaluate
-    currentExpr = argsTree;
-    while (!isNull(currentExpr)) {
-        Value *condition = car(currentExpr);
-        Value *body = cdr(car(currentExpr));
-
-        // Check for else special case
-        if (isSymbol(car(condition))) {
-            if (!strcmp(car(condition)->s, "else")) {
-                return evalBegin(body, activeFrame);
-            }
-        }
-
-        Value *conditionResult = eval(condition, activeFrame);
-        if (isTrue(conditionResult)) {
-            return evalBegin(body, activeFrame);
-        }
-
-        currentExpr = cdr(currentExpr);
-    }
-
-    // Return void if none of the conditions are true
-    return makeVoid();
-}
-
-Value *evalAnd(Value *argsTree, Frame *activeFrame) {
-    // Evaluates to #t until it hits a false case
-    Value *currentExpr = argsTree;
-    while (!isNull(currentExpr)) {
-        Value *condition = eval(currentExpr, activeFrame);
-        if (!isTrue(condition)) {
-            return makeBool(false);
-            //TODO implement arbitrary typed returns, instead of hard-coding
-        }
-        currentExpr = cdr(currentExpr);
-    }
-    return makeBool(true);
-}
-
-Value *evalOr(Value *argsTree, Frame *activeFrame) {
-    // Evaluates to #f until it hits a true case
-
-    Value *currentExpr = argsTree;
-    while (!isNull(currentExpr)) {
-        Value *condition = eval(currentExpr, activeFrame);
-        if (isTrue(condition)) {
-            //TODO implement arbitrary typed returns, instead of hard-coding
-            return makeBool(true);
+                    printf("At expression: ");
+                    printTree(currentExpr);
+                    printf("\n");
+                    texit(1);
+                }
+                if (!isNull(cdr(currentExpr))) {
+                    printf("Else clause must be last; given too many.\n");
+                    printf("At expression: ");
+                    printTree(cdr(currentExpr));
+                    printf("\n");
+                    texit(1);
+                }
+            }
         }
         currentExpr = cdr(currentExpr);
     }
-
-    return makeBool(false);
 }
 
 Value *evalDisplay(Value *argTree, Frame *activeFrame) {
-    enforceArgumentArity(argTree, 1, "display");
-
     // Evaluate the argument to display it
     Value *evalResult = eval(argTree, activeFrame);
     printValue(evalResult);
@@ -1065,8 +1927,8 @@ Value *evalDisplay(Value *argTree, Frame *activeFrame) {
     return result;
 }
 
-Value *evalWhen(Value *argsTree, Frame *activeFrame) {
-    // Initialize expressions; sanity checks
+// Stops execution with an error if a when expression is malformed.
+void checkWhenSyntax(Value *argsTree) {
     Value *condExpr = argsTree;
     if (!isCons(condExpr)) {
         printf("When statement has no condition: expected at least 2 arguments, given none.\n");
@@ -1083,24 +1945,10 @@ Value *evalWhen(Value *argsTree, Frame *activeFrame) {
         printf(")\n");
         texit(1);
     }
-
-    Value *cond = eval(condExpr, activeFrame);
-    if (isTrue(cond)) {
-        // Evaluate the body expressions
-        Value *result = makeNull();
-        Value *currentExpr = thenExpr;
-        while (!isNull(currentExpr)) {
-            result = eval(currentExpr, activeFrame);
-            currentExpr = cdr(currentExpr);
-        }
-        return result;
-    } else {
-        return makeVoid();
-    }
 }
 
-Value *evalUnless(Value *argsTree, Frame *activeFrame) {
-    // Initialize expressions; sanity checks
+// Stops execution with an error if an unless expression is malformed.
+void checkUnlessSyntax(Value *argsTree) {
     Value *condExpr = argsTree;
     if (!isCons(condExpr)) {
         printf("Unless statement has no condition: expected at least 2 arguments, given none.\n");
@@ -1117,24 +1965,10 @@ Value *evalUnless(Value *argsTree, Frame *activeFrame) {
         printf(")\n");
         texit(1);
     }
-
-    Value *cond = eval(condExpr, activeFrame);
-    if (!isTrue(cond)) {
-        // Evaluate the body expressions
-        Value *result = makeNull();
-        Value *currentExpr = thenExpr;
-        while (!isNull(currentExpr)) {
-            result = eval(currentExpr, activeFrame);
-            currentExpr = cdr(currentExpr);
-        }
-        return result;
-    } else {
-        return makeVoid();
-    }
 }
 
-Value *evalIf(Value *argsTree, Frame *activeFrame) {
-    // Initialize expressions; sanity checks
+// Stops execution with an error if an if expression is malformed.
+void checkIfSyntax(Value *argsTree) {
     Value *condExpr = argsTree;
     if (!isCons(condExpr)) {
         printf("If statement has no body: expected 3 arguments, given none.\n");
@@ -1159,6 +1993,12 @@ Value *evalIf(Value *argsTree, Frame *activeFrame) {
         printf(")\n");
         texit(1);
     }
+}
+
+Value *evalIf(Value *argsTree, Frame *activeFrame) {
+    Value *condExpr = argsTree;
+    Value *thenExpr = cdr(condExpr);
+    Value *elseExpr = cdr(thenExpr);
 
     Value *cond = eval(condExpr, activeFrame);
     if (isTrue(cond)) {
@@ -1168,261 +2008,738 @@ Value *evalIf(Value *argsTree, Frame *activeFrame) {
     }
 }
 
-Value *evalLet(Value *argsTree, Frame *activeFrame) {
+/* Stops execution with an error if a let-family expression is malformed.
+ *
+ * Checks that the expression has a body and that its bindings are a list.
+ * formName is the name of the form (let, let*, ...), for use in error
+ * reporting.
+ */
+void checkLetSyntax(Value *argsTree, char *formName) {
     assert(argsTree != NULL);
-    assert(activeFrame != NULL);
     if (!isCons(argsTree)) {
-        printf("let statement has no body; expected one.\n");
-        printf("At expression: (let)\n");
+        printf("%s statement has no body; expected one.\n", formName);
+        printf("At expression: (%s)\n", formName);
         texit(1);
     }
     if (isNull(cdr(argsTree))) {
-        printf("let statement has no body; expected one.\n");
-        printf("At expression: (let ");
+        printf("%s statement has no body; expected one.\n", formName);
+        printf("At expression: (%s ", formName);
         printTree(argsTree);
         printf(")\n");
         texit(1);
     }
 
     if (!isCons(car(argsTree)) && !isNull(car(argsTree))) {
-        printf("Bindings in let statement is not a list.\n");
+        printf("Bindings in %s statement is not a list.\n", formName);
+        printf("At expression: (%s ", formName);
+        printTree(argsTree);
+        printf(")\n");
+        texit(1);
+    }
+}
+
+/* Stops execution with an error if the next binding of a let or let* is not
+ * a list.
+ *
+ * currentBindingPair: the remaining bindings, starting at the one to check.
+ * argsTree: the whole let expression, for use in error reporting.
+ */
+void checkLetBindingPair(Value *currentBindingPair, Value *argsTree) {
+    if (!isCons(car(currentBindingPair))) {
+        printf("Binding in let statement is not a pair.\n");
         printf("At expression: (let ");
         printTree(argsTree);
         printf(")\n");
+        printf("At token: ");
+        printValue(currentBindingPair);
+        printf("\n");
+        texit(1);
+    }
+}
+
+// Stops execution with an error if the next binding of a letrec is not a
+// pair.
+void checkLetRecBindingPair(Value *currentBindingPair, Value *argsTree) {
+    if (!isCons(car(currentBindingPair)) && !isCons(cdr(car(currentBindingPair)))) {
+        printf("Binding in let statement is not a pair.\n");
+        printf("At expression: (let ");
+        printTree(argsTree);
+        printf(")\n");
+        printf("At token: ");
+        printValue(currentBindingPair);
+        printf("\n");
         texit(1);
     }
+}
+
+/* Builds the frame for a letrec expression: the first of its two passes.
+ *
+ * Checks the syntax of the expression and binds each of its names to an
+ * uninitialized value in the new frame. The second pass evaluates each
+ * binding's expression in this frame and stores it with setLetRecBinding.
+ */
+Frame *makeLetRecFrame(Value *argsTree, Frame *activeFrame) {
+    assert(activeFrame != NULL);
+    checkLetSyntax(argsTree, "let");
+
+    Frame *letFrame = makeFrame(activeFrame);
 
-    Frame *letFrame = talloc(sizeof(Frame));
-    letFrame->parent = activeFrame;
-    letFrame->bindings = makeNull();
+    // Make bindings: first pass
+    Value *uninitializedValue = makeValue(UNINITIALIZED);
 
-    // Make bindings
     Value *currentBindingPair = car(argsTree);
     while (!isNull(currentBindingPair)) {
-        if (!isCons(car(currentBindingPair))) {
-            printf("Binding in let statement is not a pair.\n");
-            printf("At expression: (let ");
-            printTree(argsTree);
-            printf(")\n");
-            printf("At token: ");
-            printValue(currentBindingPair);
-            printf("\n");
-            texit(1);
-        }
-        letFrame = makeBinding(car(currentBindingPair), letFrame);
+        checkLetRecBindingPair(currentBindingPair, argsTree);
+
+        // Construct a binding pair to pass to makeBinding
+        Value *tempBinding = cons(uninitializedValue, makeNull());
+        tempBinding = cons(car(car(currentBindingPair)), tempBinding);
+        letFrame = makeBinding(tempBinding, letFrame);
+
         currentBindingPair = cdr(currentBindingPair);
     }
 
-    // Evaluate the body expressions
-    Value *result = makeNull();
-    Value *currentExpr = cdr(argsTree);
-    while (!isNull(currentExpr)) {
-        result = eval(currentExpr, letFrame);
-        currentExpr = cdr(currentExpr);
-    }
+    return letFrame;
+}
 
-    return result;
+void uninitializedVariable(Value *name) {
+    printf("Cannot use a letrec variable before it is bound: %s\n", name->s);
+    texit(1);
+}
+
+/* Stores the value of a letrec binding: the second of its two passes.
+ *
+ * currentBindingPair: the remaining bindings, starting at the one being set.
+ * exprResult: the value its expression evaluated to in letFrame.
+ */
+void setLetRecBinding(Value *currentBindingPair, Value *exprResult,
+                      Frame *letFrame) {
+    Value *name = car(car(currentBindingPair));
+    Value *currentBinding = lookUpSymbol(name, letFrame);
+    currentBinding->c.car = exprResult;
 }
 
-Value *evalLetStar(Value *argsTree, Frame *activeFrame)  {
+Value *evalQuote(Value *argsTree, Frame *activeFrame) {
     assert(argsTree != NULL);
-    assert(activeFrame != NULL);
+    enforceArgumentArity(argsTree, 1, "quote");
+
+    return car(argsTree);
+}
+
+// Stops execution with an error if a lambda expression is malformed.
+void checkLambdaSyntax(Value *argsTree) {
+    assert(argsTree != NULL);
+
     if (!isCons(argsTree)) {
-        printf("let* statement has no body; expected one.\n");
-        printf("At expression: (let*)\n");
+        printf("Lambda statement has no or invalid parameters.\n");
+        printf("Expected either a list or ().");
+        printf("At expression: (lambda ");
+        printTree(argsTree);
+        printf(")\n");
         texit(1);
     }
+
     if (isNull(cdr(argsTree))) {
-        printf("let* statement has no body; expected one.\n");
-        printf("At expression: (let* ");
+        printf("Lambda statement has no body; expected one.\n");
+        printf("At expression: (lambda ");
         printTree(argsTree);
         printf(")\n");
         texit(1);
     }
 
-    if (!isCons(car(argsTree)) && !isNull(car(argsTree))) {
-        printf("Bindings in let* statement is not a list.\n");
-        printf("At expression: (let* ");
+    Value *params = car(argsTree);
+
+    // Check parameters list: can be cons or null
+    if (!isCons(params) && !isNull(params)
+            && !isSymbol(params)) {
+        //TEST test coverage
+        printf("Parameters in lambda statement are not a list.\n");
+        printf("At expression: (lambda ");
+        printTree(argsTree);
+        printf(")\n");
+        texit(1);
+    }
+    if (!checkValidParameters(params)) {
+        printf("Ill-formed parameter list.\n");
+        printf("Must be a list of unique symbols.\n");
+        printf("At expression: (lambda ");
         printTree(argsTree);
         printf(")\n");
         texit(1);
     }
+}
 
-    Frame *letFrame = activeFrame;
+//==================
+// Inline caches
+//==================
 
-    // Make bindings
-    Value *currentBindingPair = car(argsTree);
-    while (!isNull(currentBindingPair)) {
-        if (!isCons(car(currentBindingPair))) {
-            printf("Binding in let statement is not a pair.\n");
-            printf("At expression: (let ");
-            printTree(argsTree);
-            printf(")\n");
-            printf("At token: ");
-            printValue(currentBindingPair);
-            printf("\n");
-            texit(1);
-        }
+/* What eval remembers about one cell of code, hung off the cell's cache
+ * field. Made the first time something is cached on the cell.
+ *
+ * freeVariables: for a lambda's (params body...) cell, the free variables of
+ *                the lambda.
+ * globalCell: for a cell whose car is a symbol that turned out to be a global,
+ *             the binding cell of that global. Binding cells in the global
+ *             frame are never replaced, and scoping is lexical, so this
+ *             stays right forever.
+ * callee, numArgs, version: for a call whose operator is a global, the
+ *                           operator's value when it was last called here,
+ *                           how many arguments the call has (which callee
+ *                           is known to accept), and the globalVersion the
+ *                           call was made at.
+ * inlinedSymbol: for a cell whose car was a global's name and is now its
+ *                value, the name.
+ * frameUse: for the first cell of a lambda body, whether the body can make a
+ *           closure that captures variables of the frame it runs in.
+ * closure: for a lambda's (params body...) cell, the one closure made of it
+ *          if it has nothing to capture.
+ * arithmetic: for a call to an arithmetic primitive, whether any of its
+ *             arguments is one too, so that it's worth evaluating unboxed.
+ */
+typedef struct CodeCache {
+    Value *freeVariables;
+    Value *globalCell;
+    Value *callee;
+    int numArgs;
+    unsigned long version;
+    Value *inlinedSymbol;
+    enum { FRAME_UNKNOWN, FRAME_CAPTURED, FRAME_LOCAL } frameUse;
+    Value *closure;
+    enum { ARITHMETIC_UNKNOWN, ARITHMETIC_BOXED, ARITHMETIC_UNBOXED } arithmetic;
+} CodeCache;
+
+// Bumped whenever a global is defined or set!, which makes every cached call
+// site check its operator again.
+static unsigned long globalVersion = 0;
+
+// Returns the cache of a cell of code, making an empty one if needed.
+CodeCache *getCodeCache(Value *tree) {
+    if (tree->c.cache == NULL) {
+        CodeCache *cache = talloc(sizeof(CodeCache));
+        cache->freeVariables = NULL;
+        cache->globalCell = NULL;
+        cache->callee = NULL;
+        cache->numArgs = 0;
+        cache->version = 0;
+        cache->inlinedSymbol = NULL;
+        cache->frameUse = FRAME_UNKNOWN;
+        cache->closure = NULL;
+        cache->arithmetic = ARITHMETIC_UNKNOWN;
+        tree->c.cache = cache;
+    }
+    return tree->c.cache;
+}
+
+//==================
+// Inlined globals
+//==================
 
-        Frame *newFrame = talloc(sizeof(Frame));
-        newFrame->parent = letFrame;
-        newFrame->bindings = makeNull();
+// The cells each global's value has been put into, as a frame binding the
+// name to a list of the cells
+static Frame *inlinedSites = NULL;
 
-        letFrame = makeBinding(car(currentBindingPair), newFrame);
-        currentBindingPair = cdr(currentBindingPair);
+void inlineGlobalValue(Value *tree, Value *value) {
+    Value *symbol = car(tree);
+    if (inlinedSites == NULL) {
+        inlinedSites = makeFrame(NULL);
+    }
+    Value *sites = lookupBindingInFrame(symbol, inlinedSites);
+    if (sites == NULL) {
+        addBinding(symbol, makeNull(), inlinedSites);
+        sites = lookupBindingInFrame(symbol, inlinedSites);
     }
+    sites->c.car = cons(tree, car(sites));
 
-    // Evaluate the body expressions
-    Value *result = makeNull();
-    Value *currentExpr = cdr(argsTree);
-    while (!isNull(currentExpr)) {
-        result = eval(currentExpr, letFrame);
-        currentExpr = cdr(currentExpr);
+    getCodeCache(tree)->inlinedSymbol = symbol;
+    tree->c.car = value;
+}
+
+Value *sourceExpr(Value *tree) {
+    CodeCache *cache = tree->c.cache;
+    if (cache != NULL && cache->inlinedSymbol != NULL) {
+        return cache->inlinedSymbol;
     }
+    return car(tree);
+}
 
-    return result;
+void deoptimizeGlobal(Value *symbol) {
+    forgetConstantGlobal(symbol);
+    if (inlinedSites == NULL) {
+        return;
+    }
+    Value *sites = lookupBindingInFrame(symbol, inlinedSites);
+    if (sites == NULL) {
+        return;
+    }
+    for (Value *site = car(sites); !isNull(site); site = cdr(site)) {
+        Value *tree = car(site);
+        tree->c.car = symbol;
+        getCodeCache(tree)->inlinedSymbol = NULL;
+    }
+    sites->c.car = makeNull();
 }
 
-Value *evalLetRec(Value *argsTree, Frame *activeFrame)  {
-    assert(argsTree != NULL);
-    assert(activeFrame != NULL);
-    if (!isCons(argsTree)) {
-        printf("let statement has no body; expected one.\n");
-        printf("At expression: (let)\n");
-        texit(1);
+// Checks whether a global's value can go straight into the code in place of
+// its name: it must evaluate to itself. Primitives aren't put into the code
+// this way, since a primitive operator is taken to have been checked for
+// arity already; see foldConstants.
+bool isInlinableValue(Value *value) {
+    return isType(value, CLOSURE_TYPE) || isNumber(value)
+        || isString(value) || isBoolean(value) || isVector(value);
+}
+
+/* Looks up the symbol car(tree) like lookUpSymbol, and returns its binding
+ * cell. If the symbol is a global, its cell is cached on tree so later
+ * lookups skip the search, and if the global is a constant its value
+ * replaces the symbol in the code.
+ */
+Value *lookUpCachedSymbol(Value *tree, Frame *activeFrame) {
+    CodeCache *cache = tree->c.cache;
+    if (cache != NULL && cache->globalCell != NULL) {
+        return cache->globalCell;
     }
-    if (isNull(cdr(argsTree))) {
-        printf("let statement has no body; expected one.\n");
-        printf("At expression: (let ");
-        printTree(argsTree);
-        printf(")\n");
-        texit(1);
+
+    Value *symbol = car(tree);
+    Frame *currentFrame = activeFrame;
+    while (currentFrame != NULL) {
+        Value *search = lookupBindingInFrame(symbol, currentFrame);
+        if (search != NULL) {
+            if (currentFrame->parent == NULL) {
+                getCodeCache(tree)->globalCell = search;
+                if (isConstantGlobal(symbol) && isInlinableValue(car(search))) {
+                    inlineGlobalValue(tree, car(search));
+                }
+            }
+            return search;
+        }
+        currentFrame = currentFrame->parent;
     }
 
-    if (!isCons(car(argsTree)) && !isNull(car(argsTree))) {
-        printf("Bindings in let statement is not a list.\n");
-        printf("At expression: (let ");
-        printTree(argsTree);
-        printf(")\n");
-        texit(1);
+    // Not found: report it the usual way
+    return lookUpSymbol(symbol, activeFrame);
+}
+
+/* Remembers the operator of a call, so the next call here can skip looking it
+ * up and checking it, and counting the arguments. Only calls to a global are
+ * cached, and only if they can't fail on arity: a primitive or closure that
+ * takes numArgs arguments.
+ */
+void cacheCallee(Value *expr, Value *function, int numArgs) {
+    CodeCache *cache = expr->c.cache;
+    if (cache == NULL || cache->globalCell == NULL) {
+        return;
     }
 
-    Frame *letFrame = talloc(sizeof(Frame));
-    letFrame->parent = activeFrame;
-    letFrame->bindings = makeNull();
+    if (isType(function, PRIMITIVE_TYPE)) {
+        if (!acceptsArity(function->descriptor, numArgs)) {
+            return;
+        }
+    } else if (isType(function, CLOSURE_TYPE)) {
+        Value *params = function->cl.paramNames;
+        if (!isSymbol(params) && length(params) != numArgs) {
+            return;
+        }
+    } else {
+        return;
+    }
+    cache->callee = function;
+    cache->numArgs = numArgs;
+    cache->version = globalVersion;
+}
 
-    // Make bindings: first pass
-    Value *uninitializedValue = makeValue(UNINITIALIZED);
+/* Like apply, for a closure already known to take as many arguments as it is
+ * given, so the arity isn't checked again.
+ */
+Value *applyKnownArity(Value *function, Value **args, int numArgs) {
+    JitFunction code = getJitCode(function);
+    if (code != NULL) {
+        return code(args);
+    }
 
-    Value *currentBindingPair = car(argsTree);
-    while (!isNull(currentBindingPair)) {
-        if (!isCons(car(currentBindingPair)) && !isCons(cdr(car(currentBindingPair)))) {
-            printf("Binding in let statement is not a pair.\n");
-            printf("At expression: (let ");
-            printTree(argsTree);
-            printf(")\n");
-            printf("At token: ");
-            printValue(currentBindingPair);
-            printf("\n");
-            texit(1);
+    return runClosureCall(function, args, numArgs);
+}
+
+//==================
+// Frame pool
+//==================
+
+// Frames released by calls that have returned, linked through their parent
+// fields, and the cons cells of their bindings, linked through their cdrs
+static Frame *freeFrames = NULL;
+static Value *freeCells = NULL;
+
+// The empty list that ends pooled binding lists, shared since it is never
+// changed
+static Value *pooledNull = NULL;
+
+/* Checks whether evaluating a core expression can make a closure, which
+ * would capture the cells of the frame it runs in.
+ *
+ * A lambda that is applied right away, like the ones let expands into, isn't
+ * made into a closure, so only its body and arguments count.
+ */
+bool canMakeClosure(Value *expr);
+
+// Checks whether evaluating any expression in the list exprs can make a
+// closure.
+bool canEachMakeClosure(Value *exprs) {
+    for (; isCons(exprs); exprs = cdr(exprs)) {
+        if (canMakeClosure(car(exprs))) {
+            return true;
         }
+    }
+    return false;
+}
 
-        // Construct a binding pair to pass to makeBinding
-        Value *tempBinding = cons(uninitializedValue, makeNull());
-        tempBinding = cons(car(car(currentBindingPair)), tempBinding);
-        letFrame = makeBinding(tempBinding, letFrame);
+bool canMakeClosure(Value *expr) {
+    if (!isCons(expr)) {
+        return false;
+    }
+    Value *first = car(expr);
+    if (isSymbol(first)) {
+        if (!strcmp(first->s, "quote")) {
+            return false;
+        } else if (!strcmp(first->s, "lambda")) {
+            return true;
+        }
+    } else if (isCons(first) && isSymbol(car(first))
+               && !strcmp(car(first)->s, "lambda")) {
+        return canEachMakeClosure(cdr(cdr(first)))
+            || canEachMakeClosure(cdr(expr));
+    }
+    return canEachMakeClosure(expr);
+}
 
-        currentBindingPair = cdr(currentBindingPair);
+// Checks whether a frame that the lambda body body runs in can be reused as
+// soon as the body returns: nothing made by the body can still refer to it.
+// The answer is cached on the body.
+bool isFrameLocal(Value *body) {
+    if (!isCons(body)) {
+        return false;
     }
+    CodeCache *cache = getCodeCache(body);
+    if (cache->frameUse == FRAME_UNKNOWN) {
+        cache->frameUse = canEachMakeClosure(body) ? FRAME_CAPTURED
+                                                   : FRAME_LOCAL;
+    }
+    return cache->frameUse == FRAME_LOCAL;
+}
 
-    // Second pass: for real this time.
-    // Letrec 2: Electric Boogaloo
-    currentBindingPair = car(argsTree);
-    while (!isNull(currentBindingPair)) {
-        Value *name = car(car(currentBindingPair));
-        Value *expr = cdr(car(currentBindingPair));
-        assert(car(lookUpSymbol(name, letFrame))->type == UNINITIALIZED);
-
-        Value *exprResult = eval(expr, letFrame);
-        if (exprResult->type == UNINITIALIZED) {
-            printf("Cannot bind to uninitialized value.\n");
-            printf("Binding: ");
-            printValue(currentBindingPair);
-            printf("\n");
-            printf("Expression: (letrec ");
-            printTree(argsTree);
-            printf(")\n");
-            texit(1);
+// Returns a cons cell from the pool, or a new one if it is empty. Unlike
+// cons(), string cars aren't copied; the binding only refers to the value.
+Value *makePooledCell(Value *newCar, Value *newCdr) {
+    Value *cell = freeCells;
+    if (cell == NULL) {
+        cell = makeValue(CONS_TYPE);
+    } else {
+        freeCells = cell->c.cdr;
+    }
+    cell->c.car = newCar;
+    cell->c.cdr = newCdr;
+    cell->c.cache = NULL;
+    return cell;
+}
+
+// Binds name to value in a pooled frame, the way addBinding does.
+void addPooledBinding(Value *name, Value *value, Frame *frame) {
+    Value *binding = makePooledCell(name, makePooledCell(value, pooledNull));
+    frame->bindings = makePooledCell(binding, frame->bindings);
+}
+
+/* Makes a frame from the pool whose parent is parent, with params bound to
+ * the numArgs arguments in args, like makeFrame and bindParameters. The
+ * arity must already have been checked. Give it back with releaseFrame.
+ */
+Frame *makePooledFrame(Frame *parent, Value *params, Value **args,
+                       int numArgs) {
+    if (pooledNull == NULL) {
+        pooledNull = makeNull();
+    }
+    Frame *frame = freeFrames;
+    if (frame == NULL) {
+        frame = talloc(sizeof(Frame));
+    } else {
+        freeFrames = frame->parent;
+    }
+    frame->parent = parent;
+    frame->bindings = pooledNull;
+
+    if (isSymbol(params)) {
+        addPooledBinding(params, makeArgumentList(args, numArgs), frame);
+    } else {
+        for (; !isNull(params); params = cdr(params)) {
+            addPooledBinding(car(params), *args++, frame);
         }
+    }
+    return frame;
+}
 
-        Value *currentBinding = lookUpSymbol(name, letFrame);
-        currentBinding->c.car = exprResult;
+// Puts a frame from makePooledFrame, and its bindings, back in the pool.
+void releaseFrame(Frame *frame) {
+    Value *cell = frame->bindings;
+    while (!isNull(cell)) {
+        Value *binding = car(cell);
+        Value *next = cdr(cell);
+        cdr(binding)->c.cdr = freeCells;
+        binding->c.cdr = cdr(binding);
+        cell->c.cdr = binding;
+        freeCells = cell;
+        cell = next;
+    }
+    frame->parent = freeFrames;
+    freeFrames = frame;
+}
 
-        currentBindingPair = cdr(currentBindingPair);
+/* Binds a closure's parameters to its arguments and evaluates its body, once
+ * the arity has been checked.
+ *
+ * If the body can't make a closure, nothing can refer to its frame after it
+ * returns, so the frame comes from the pool and goes back to it. Calls
+ * return in the opposite order they were made, so the pool only ever holds
+ * as many frames as the deepest recursion has needed.
+ */
+Value *runClosureCall(Value *function, Value **args, int numArgs) {
+    if (!isFrameLocal(function->cl.functionCode)) {
+        Frame *evalFrame = makeFrame(function->cl.frame);
+        bindParameters(function->cl.paramNames, args, numArgs, evalFrame);
+        return evalClosureBody(function, evalFrame);
+    }
+
+    Frame *evalFrame = makePooledFrame(function->cl.frame,
+                                       function->cl.paramNames, args, numArgs);
+    Value *result = evalClosureBody(function, evalFrame);
+    releaseFrame(evalFrame);
+    return result;
+}
+
+//==================
+// Free variables
+//==================
+
+// Checks whether symbol is bound in scope or any of its parents.
+bool isBoundIn(Value *symbol, Frame *scope) {
+    while (scope != NULL) {
+        if (lookupBindingInFrame(symbol, scope) != NULL) {
+            return true;
+        }
+        scope = scope->parent;
+    }
+    return false;
+}
+
+// Adds symbol to the list of free variables, unless it is bound in scope or
+// already in the list.
+void addFreeVariable(Value *symbol, Frame *scope, Value **freeVars) {
+    if (isBoundIn(symbol, scope)) {
+        return;
+    }
+    Value *current = *freeVars;
+    while (!isNull(current)) {
+        if (!strcmp(car(current)->s, symbol->s)) {
+            return;
+        }
+        current = cdr(current);
     }
+    *freeVars = cons(symbol, *freeVars);
+}
 
-    Value *body = cdr(argsTree);
-    return evalBegin(body, letFrame);
+// Binds the names in a parameter list (or a single rest parameter) in scope.
+void bindScopeNames(Value *params, Frame *scope) {
+    Value *unused = makeNull();
+    if (isSymbol(params)) {
+        addBinding(params, unused, scope);
+        return;
+    }
+    while (isCons(params)) {
+        if (isSymbol(car(params))) {
+            addBinding(car(params), unused, scope);
+        }
+        params = cdr(params);
+    }
 }
 
-Value *evalQuote(Value *argsTree, Frame *activeFrame) {
-    assert(argsTree != NULL);
-    enforceArgumentArity(argsTree, 1, "quote");
+void collectFreeVariables(Value *expr, Frame *scope, Value **freeVars);
 
-    return car(argsTree);
+// Collects the free variables of every expression in a list.
+void collectEach(Value *exprs, Frame *scope, Value **freeVars) {
+    while (isCons(exprs)) {
+        collectFreeVariables(car(exprs), scope, freeVars);
+        exprs = cdr(exprs);
+    }
+    if (!isNull(exprs)) {
+        collectFreeVariables(exprs, scope, freeVars);
+    }
 }
 
-Value *evalLambda(Value *argsTree, Frame *activeFrame) {
-    assert(argsTree != NULL);
-    assert(activeFrame != NULL);
-
-    if (!isCons(argsTree)) {
-        printf("Lambda statement has no or invalid parameters.\n");
-        printf("Expected either a list or ().");
-        printf("At expression: (lambda ");
-        printTree(argsTree);
-        printf(")\n");
-        texit(1);
+// Checks whether a let-family form has a list of (name expr) pairs and a body,
+// so that its names can be scoped. Malformed ones are treated as plain lists,
+// which can only find more free variables than there are.
+bool isWellFormedLet(Value *argsTree) {
+    if (!isCons(argsTree) || !isCons(cdr(argsTree))) {
+        return false;
+    }
+    Value *bindings = car(argsTree);
+    while (isCons(bindings)) {
+        Value *pair = car(bindings);
+        if (!isCons(pair) || !isSymbol(car(pair)) || !isCons(cdr(pair))) {
+            return false;
+        }
+        bindings = cdr(bindings);
     }
+    return isNull(bindings);
+}
 
-    if (isNull(cdr(argsTree))) {
-        printf("Lambda statement has no body; expected one.\n");
-        printf("At expression: (lambda ");
-        printTree(argsTree);
-        printf(")\n");
-        texit(1);
+/* Finds the variables that expr refers to without binding them itself.
+ *
+ * scope: the names bound by the forms around expr, inside the lambda being
+ *        analyzed.
+ * freeVars: the list the free variables are added to.
+ *
+ * This only ever needs to be conservative: an extra name costs a little
+ * space in a closure, but a missing one would break lookup.
+ */
+void collectFreeVariables(Value *expr, Frame *scope, Value **freeVars) {
+    if (isSymbol(expr)) {
+        addFreeVariable(expr, scope, freeVars);
+        return;
+    }
+    if (!isCons(expr)) {
+        return;
+    }
+
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+    if (isSymbol(first)) {
+        if (!strcmp(first->s, "quote")) {
+            return;
+        } else if (!strcmp(first->s, "lambda") && isCons(args)) {
+            Frame *lambdaScope = makeFrame(scope);
+            bindScopeNames(car(args), lambdaScope);
+            collectEach(cdr(args), lambdaScope, freeVars);
+            return;
+        } else if (!strcmp(first->s, "define") && isCons(args)
+                   && isCons(car(args))) {
+            // Lambda shorthand; the name itself is global
+            Frame *lambdaScope = makeFrame(scope);
+            bindScopeNames(cdr(car(args)), lambdaScope);
+            collectEach(cdr(args), lambdaScope, freeVars);
+            return;
+        } else if ((!strcmp(first->s, "let") || !strcmp(first->s, "let*")
+                    || !strcmp(first->s, "letrec")) && isWellFormedLet(args)) {
+            bool isStar = !strcmp(first->s, "let*");
+            bool isRec = !strcmp(first->s, "letrec");
+            Frame *letScope = makeFrame(scope);
+            if (isRec) {
+                Value *pair = car(args);
+                while (!isNull(pair)) {
+                    addBinding(car(car(pair)), makeNull(), letScope);
+                    pair = cdr(pair);
+                }
+            }
+            Value *pair = car(args);
+            while (!isNull(pair)) {
+                Frame *exprScope = (isStar || isRec) ? letScope : scope;
+                collectEach(cdr(car(pair)), exprScope, freeVars);
+                if (isStar) {
+                    letScope = makeFrame(letScope);
+                }
+                if (!isRec) {
+                    addBinding(car(car(pair)), makeNull(), letScope);
+                }
+                pair = cdr(pair);
+            }
+            collectEach(cdr(args), letScope, freeVars);
+            return;
+        }
     }
 
-    Value *params = car(argsTree);
-    Value *body = cdr(argsTree);
+    // Everything else just evaluates some of its subexpressions, so treating
+    // every element as one is safe
+    collectEach(expr, scope, freeVars);
+}
 
-    // Check parameters list: can be cons or null
-    if (!isCons(params) && !isNull(params)
-            && !isSymbol(params)) {
-        //TEST test coverage
-        printf("Parameters in lambda statement are not a list.\n");
-        printf("At expression: (lambda ");
-        printTree(argsTree);
-        printf(")\n");
-        texit(1);
+// Returns the free variables of a lambda expression, working them out the
+// first time and caching them on the expression after that.
+Value *freeVariables(Value *argsTree) {
+    CodeCache *cache = getCodeCache(argsTree);
+    if (cache->freeVariables == NULL) {
+        Frame *lambdaScope = makeFrame(NULL);
+        bindScopeNames(car(argsTree), lambdaScope);
+        Value *freeVars = makeNull();
+        collectEach(cdr(argsTree), lambdaScope, &freeVars);
+        cache->freeVariables = freeVars;
+    }
+    return cache->freeVariables;
+}
+
+/* Builds the environment for a new closure: a frame holding only the
+ * variables the closure refers to, whose parent is the global frame.
+ *
+ * Each captured binding shares its cell with the frame it came from. The cell
+ * already is the box a set! needs, and sharing it is what lets a letrec
+ * closure see names that are only initialized after it is made. Globals
+ * aren't captured; they are found through the global frame when used. With
+ * nothing to capture, the closure just uses the global frame.
+ */
+Frame *captureFreeVariables(Value *argsTree, Frame *activeFrame) {
+    Frame *global = getGlobalFrame(activeFrame);
+    Frame *closureFrame = global;
+
+    Value *currentVar = freeVariables(argsTree);
+    while (!isNull(currentVar)) {
+        Value *cell = NULL;
+        Frame *frame = activeFrame;
+        while (cell == NULL && frame != global) {
+            cell = lookupBindingInFrame(car(currentVar), frame);
+            frame = frame->parent;
+        }
+        if (cell != NULL) {
+            if (closureFrame == global) {
+                closureFrame = makeFrame(global);
+            }
+            Value *binding = cons(car(currentVar), cell);
+            closureFrame->bindings = cons(binding, closureFrame->bindings);
+        }
+        currentVar = cdr(currentVar);
     }
-    if (!checkValidParameters(params)) {
-        printf("Ill-formed parameter list.\n");
-        printf("Must be a list of unique symbols.\n");
-        printf("At expression: (lambda ");
-        printTree(argsTree);
-        printf(")\n");
-        texit(1);
+    return closureFrame;
+}
+
+/* Makes a closure of a lambda expression whose syntax has been checked.
+ *
+ * A lambda whose free variables are all globals makes the same closure
+ * every time, so it is only made once, and shared after that: a loop that
+ * makes one on each pass doesn't allocate, and the JIT sees all of its calls.
+ */
+Value *makeClosure(Value *argsTree, Frame *activeFrame) {
+    CodeCache *cache = getCodeCache(argsTree);
+    if (cache->closure != NULL) {
+        return cache->closure;
     }
 
     Value *closure = makeValue(CLOSURE_TYPE);
-    closure->cl.frame = activeFrame;
-    closure->cl.paramNames = params;
-    closure->cl.functionCode = body;
+    closure->cl.frame = captureFreeVariables(argsTree, activeFrame);
+    closure->cl.paramNames = car(argsTree);
+    closure->cl.functionCode = cdr(argsTree);
+    closure->cl.jit = NULL;
+    if (closure->cl.frame->parent == NULL) {
+        cache->closure = closure;
+    }
     return closure;
 }
 
-Value *evalDefine(Value *argsTree, Frame *activeFrame) {
+Value *evalLambda(Value *argsTree, Frame *activeFrame) {
+    assert(activeFrame != NULL);
+    checkLambdaSyntax(argsTree);
+    return makeClosure(argsTree, activeFrame);
+}
+
+/* Stops execution with an error if a define expression is malformed.
+ *
+ * Supports both the standard (define name expr) and the lambda shorthand
+ * (define (name params...) body...) syntax. Returns the symbol being defined.
+ */
+Value *checkDefineSyntax(Value *argsTree) {
     assert(argsTree != NULL);
     if (!isCons(argsTree)) {
         printf("Define statement has no body: expected 2 arguments, given none.\n");
@@ -1439,7 +2756,6 @@ Value *evalDefine(Value *argsTree, Frame *activeFrame) {
     }
 
     Value *symbol;
-    Value *exprResult;
     // Lambda shorthand syntax
     if (isCons(car(argsTree))) {
         symbol = car(car(argsTree));
@@ -1451,9 +2767,7 @@ Value *evalDefine(Value *argsTree, Frame *activeFrame) {
             texit(1);
         }
 
-        Value *params = cdr(car(argsTree));
         Value *body = cdr(argsTree);
-
         if (!isCons(body)) {
             printf("No function body found.\n");
             printf("At expression: (define ");
@@ -1461,9 +2775,6 @@ Value *evalDefine(Value *argsTree, Frame *activeFrame) {
             printf(")\n");
             texit(1);
         }
-
-        Value *lambdaExpr = cons(params, body);
-        exprResult = evalLambda(lambdaExpr, activeFrame);
     // Standard define
     } else if (isSymbol(car(argsTree))) {
         symbol = car(argsTree);
@@ -1476,9 +2787,6 @@ Value *evalDefine(Value *argsTree, Frame *activeFrame) {
             printf(")\n");
             texit(1);
         }
-
-        exprResult = eval(expr, activeFrame);
-
     } else {
         printf("Define must bind a value to symbol; wrong token type found for symbol name.\n");
         printf("At expression: (define ");
@@ -1487,27 +2795,39 @@ Value *evalDefine(Value *argsTree, Frame *activeFrame) {
         texit(1);
     }
 
+    return symbol;
+}
+
+/* Binds symbol to value in the global frame.
+ *
+ * Define always acts on the global frame, no matter which frame it is
+ * evaluated in. An existing binding is overwritten.
+ */
+void defineGlobal(Value *symbol, Value *value, Frame *activeFrame) {
     Frame *globalFrame = getGlobalFrame(activeFrame);
 
     Value *currentBindingValue = lookupBindingInFrame(symbol, globalFrame);
     if (currentBindingValue == NULL) {
         // Not already bound: make a new one
-        Value *newBinding = makeNull();
-        newBinding = cons(exprResult, newBinding);
-        newBinding = cons(symbol, newBinding);
-
-        globalFrame->bindings = cons(newBinding, globalFrame->bindings);
+        addBinding(symbol, value, globalFrame);
     } else {
         // Binding already exists
         // Set the value this binding points to to the new result
-        currentBindingValue->c.car = exprResult;
+        currentBindingValue->c.car = value;
+        deoptimizeGlobal(symbol);
     }
+    globalVersion++;
+}
 
+// Evaluates an expanded define, which always has the form (define name expr).
+Value *evalDefine(Value *argsTree, Frame *activeFrame) {
+    Value *exprResult = eval(cdr(argsTree), activeFrame);
+    defineGlobal(car(argsTree), exprResult, activeFrame);
     return makeVoid();
 }
 
-Value *evalSetBang(Value *argsTree, Frame *activeFrame) {
-    // Table setting: same as define behavior
+// Stops execution with an error if a set! expression is malformed.
+void checkSetBangSyntax(Value *argsTree) {
     assert(argsTree != NULL);
     if (!isCons(argsTree)) {
         printf("Set! statement has no body: expected 2 arguments, given none.\n");
@@ -1523,7 +2843,6 @@ Value *evalSetBang(Value *argsTree, Frame *activeFrame) {
         texit(1);
     }
 
-    Value *symbol = car(argsTree);
     Value *expr = cdr(argsTree);
 
     if (!isSymbol(car(argsTree))) {
@@ -1540,157 +2859,412 @@ Value *evalSetBang(Value *argsTree, Frame *activeFrame) {
         printf(")\n");
         texit(1);
     }
+}
 
-    Value *exprResult = eval(expr, activeFrame);
-
+/* Changes the value of the variable named by a set! expression.
+ *
+ * argsTree: the set! expression, whose first element is the symbol to set.
+ * value: the new value of the variable.
+ */
+void setVariable(Value *argsTree, Value *value, Frame *activeFrame) {
     // Lookup and redefine symbol in active environment
-    Value *currentBinding = lookUpSymbol(symbol, activeFrame);
+    Value *currentBinding = NULL;
+    Frame *currentFrame = activeFrame;
+    while (currentBinding == NULL && currentFrame != NULL) {
+        currentBinding = lookupBindingInFrame(car(argsTree), currentFrame);
+        if (currentBinding != NULL && currentFrame->parent == NULL) {
+            // Setting a global may change what a cached call site calls
+            globalVersion++;
+            deoptimizeGlobal(car(argsTree));
+        }
+        currentFrame = currentFrame->parent;
+    }
     if (currentBinding == NULL) {
-        // Not already bound: this is an error
-        printf("Error: cannot set variable before its definition.\n");
-        printf("At: (set! ");
-        printTree(argsTree);
-        printf(")\n");
-        texit(1);
-    } else {
-        // Binding already exists
-        // Set the value this binding points to to the new result
-        currentBinding->c.car = exprResult;
+        // Not already bound: this is an error, reported the way any other
+        // unbound symbol is
+        lookUpSymbol(car(argsTree), activeFrame);
     }
 
-    return makeVoid();
+    // Set the value this binding points to to the new result
+    currentBinding->c.car = value;
 }
 
-Value *evalLoad(Value *args, Frame *activeFrame) {
-    enforceArgumentArity(args, 1, "load");
+Value *evalSetBang(Value *argsTree, Frame *activeFrame) {
+    // Table setting: same as define behavior
+    Value *exprResult = eval(cdr(argsTree), activeFrame);
+    setVariable(argsTree, exprResult, activeFrame);
 
-    Value *filePath = eval(args, activeFrame);
+    return makeVoid();
+}
 
-    if (!isString(car(args))) {
+/* Reads and parses the file named by a load expression.
+ *
+ * args: the arguments of the load expression.
+ * filePath: the value its argument evaluated to.
+ * Returns the parse tree of the file, to be evaluated in the global frame.
+ */
+Value *loadFile(Value *args, Value *filePath) {
+    if (!isString(sourceExpr(args))) {
         //TEST test coverage
         printf("load needs a string file path.\n");
         printf("Given wrong type. \n");
         printf("Expression: (load ");
-        printTree(args);
+        printTree(cons(sourceExpr(args), cdr(args)));
         printf(")\n");
         texit(1);
     }
 
-    FILE *fp = fopen(filePath->s, "r");
+    char *path = cString(filePath);
+    FILE *fp = fopen(path, "r");
     if (fp == NULL) {
-        printf("File not found: %s\n", filePath->s);
+        printf("File not found: %s\n", path);
         texit(1);
     }
 
     Value *tokenList = tokenize(fp);
     Value *tree = parse(tokenList);
     fclose(fp);
+    return tree;
+}
+
+Value *evalLoad(Value *args, Frame *activeFrame) {
+    Value *filePath = eval(args, activeFrame);
+    Value *tree = loadFile(args, filePath);
 
     Frame *globalFrame = getGlobalFrame(activeFrame);
 
-    return evalBegin(tree, globalFrame);
+    // Like interpret(), expand each expression just before running it
+    Value *result = makeVoid();
+    Value *current = tree;
+    while (!isNull(current)) {
+        current->c.car = foldConstants(expand(car(current)));
+        result = eval(current, globalFrame);
+        current = cdr(current);
+    }
+    return result;
 }
 
-//=======================================================
-// Fundamentals: Base Function and Expression Evaluation
-//=======================================================
+//=====================
+// Unboxed arithmetic
+//=====================
 
-Value *eval(Value *tree, Frame *frame) {
-    assert(tree != NULL);
+/* Nested calls to the arithmetic primitives, like (+ (* a b) (* c d)), are
+ * evaluated here without a Value for each intermediate result. Operands are
+ * read straight out of literals and variables' Values, the inner calls give
+ * back plain longs and doubles, and only the outermost result is boxed.
+ *
+ * The arithmetic is the primitives' own: overflow-checked on longs, and in
+ * double from the first double on. Whatever else can happen, like a bignum
+ * or a non-number operand, an overflow, or a division by zero, is left to
+ * the primitive, called with the operands boxed, so the result or error is
+ * the same as if every call had been made by eval.
+ */
+
+typedef enum {
+    NOT_ARITHMETIC, ARITHMETIC_ADD, ARITHMETIC_SUBTRACT, ARITHMETIC_MULTIPLY,
+    ARITHMETIC_DIVIDE, ARITHMETIC_LESS, ARITHMETIC_GREATER, ARITHMETIC_EQUAL
+} ArithmeticOperator;
+
+// A number as the unboxed evaluator has it: a long, a double, or a Value for
+// anything the primitive has to deal with.
+typedef struct {
+    enum { UNBOXED_INT, UNBOXED_DOUBLE, BOXED } kind;
+    union {
+        long i;
+        double d;
+        Value *value;
+    };
+} UnboxedNumber;
+
+// Returns which arithmetic primitive an operator is, if any.
+ArithmeticOperator arithmeticOperator(Value *operator) {
+    if (!isType(operator, PRIMITIVE_TYPE)) {
+        return NOT_ARITHMETIC;
+    }
+    PrimitiveFunction pf = operator->pf;
+    if (pf == primitiveAdd) {
+        return ARITHMETIC_ADD;
+    } else if (pf == primitiveSubtract) {
+        return ARITHMETIC_SUBTRACT;
+    } else if (pf == primitiveMult) {
+        return ARITHMETIC_MULTIPLY;
+    } else if (pf == primitiveDivide) {
+        return ARITHMETIC_DIVIDE;
+    } else if (pf == primitiveLessThan) {
+        return ARITHMETIC_LESS;
+    } else if (pf == primitiveGreaterThan) {
+        return ARITHMETIC_GREATER;
+    } else if (pf == primitiveEqualNum) {
+        return ARITHMETIC_EQUAL;
+    }
+    return NOT_ARITHMETIC;
+}
+
+// Checks whether an expression is a call that gives back a number unboxed:
+// + - * or / put into the code as its operator. A comparison's result is a
+// boolean, so it is only evaluated unboxed as the outermost call.
+bool isUnboxedCall(Value *expr) {
+    if (!isCons(expr)) {
+        return false;
+    }
+    ArithmeticOperator op = arithmeticOperator(car(expr));
+    return op != NOT_ARITHMETIC && op < ARITHMETIC_LESS;
+}
+
+/* Checks whether a call to a primitive is worth evaluating unboxed: the
+ * primitive is arithmetic and at least one of its arguments is a call that
+ * gives back a number unboxed. The answer is cached on the call, since the
+ * optimizer only ever puts a primitive into the code once. If a nested
+ * call's operator is later given back its name, evalUnboxed just evaluates
+ * that argument the ordinary way.
+ */
+bool isUnboxedArithmetic(Value *expr) {
+    CodeCache *cache = getCodeCache(expr);
+    if (cache->arithmetic == ARITHMETIC_UNKNOWN) {
+        cache->arithmetic = ARITHMETIC_BOXED;
+        if (arithmeticOperator(car(expr)) != NOT_ARITHMETIC) {
+            for (Value *arg = cdr(expr); !isNull(arg); arg = cdr(arg)) {
+                if (isUnboxedCall(car(arg))) {
+                    cache->arithmetic = ARITHMETIC_UNBOXED;
+                }
+            }
+        }
+    }
+    return cache->arithmetic == ARITHMETIC_UNBOXED;
+}
+
+UnboxedNumber unbox(Value *value) {
+    UnboxedNumber number;
+    if (isInteger(value)) {
+        number.kind = UNBOXED_INT;
+        number.i = value->i;
+    } else if (isDouble(value)) {
+        number.kind = UNBOXED_DOUBLE;
+        number.d = value->d;
+    } else {
+        number.kind = BOXED;
+        number.value = value;
+    }
+    return number;
+}
+
+Value *box(UnboxedNumber number) {
+    if (number.kind == UNBOXED_INT) {
+        return makeInt(number.i);
+    } else if (number.kind == UNBOXED_DOUBLE) {
+        return makeDouble(number.d);
+    }
+    return number.value;
+}
+
+double unboxedToDouble(UnboxedNumber number) {
+    return number.kind == UNBOXED_INT ? (double) number.i : number.d;
+}
 
+UnboxedNumber applyUnboxed(Value *operator, Value *args, Frame *frame);
+
+/* Evaluates the expression in the car of tree, which should be a number.
+ * Number literals are read as they are, calls to + - * and / are made
+ * unboxed, and anything else is evaluated by eval.
+ */
+UnboxedNumber evalUnboxed(Value *tree, Frame *frame) {
     Value *expr = car(tree);
+    if (isInteger(expr) || isDouble(expr)) {
+        return unbox(expr);
+    } else if (isUnboxedCall(expr)) {
+        return applyUnboxed(car(expr), cdr(expr), frame);
+    }
+    return unbox(eval(tree, frame));
+}
+
+/* Does the arithmetic of op on argc unboxed operands the way its primitive
+ * would, putting the answer in result; a comparison's is 1 or 0. Returns
+ * false, without a result, when the primitive has to be called instead.
+ */
+bool computeUnboxed(ArithmeticOperator op, int argc, UnboxedNumber *operands,
+                    UnboxedNumber *result) {
+    int i = 0;
+    switch (op) {
+    case ARITHMETIC_ADD:
+    case ARITHMETIC_MULTIPLY: {
+        long exact = op == ARITHMETIC_ADD ? 0 : 1;
+        for (; i < argc && operands[i].kind == UNBOXED_INT; i++) {
+            bool overflow = op == ARITHMETIC_ADD
+                ? __builtin_add_overflow(exact, operands[i].i, &exact)
+                : __builtin_mul_overflow(exact, operands[i].i, &exact);
+            if (overflow) {
+                return false;
+            }
+        }
+        if (i == argc) {
+            result->kind = UNBOXED_INT;
+            result->i = exact;
+            return true;
+        }
+        double inexact = exact;
+        for (; i < argc; i++) {
+            if (op == ARITHMETIC_ADD) {
+                inexact += unboxedToDouble(operands[i]);
+            } else {
+                inexact *= unboxedToDouble(operands[i]);
+            }
+        }
+        result->kind = UNBOXED_DOUBLE;
+        result->d = inexact;
+        return true;
+    }
+    case ARITHMETIC_SUBTRACT: {
+        double inexact;
+        i = 1;
+        if (operands[0].kind == UNBOXED_INT) {
+            long exact = operands[0].i;
+            for (; i < argc && operands[i].kind == UNBOXED_INT; i++) {
+                if (__builtin_sub_overflow(exact, operands[i].i, &exact)) {
+                    return false;
+                }
+            }
+            if (i == argc) {
+                result->kind = UNBOXED_INT;
+                result->i = exact;
+                return true;
+            }
+            inexact = exact;
+        } else {
+            inexact = operands[0].d;
+        }
+        for (; i < argc; i++) {
+            inexact -= unboxedToDouble(operands[i]);
+        }
+        result->kind = UNBOXED_DOUBLE;
+        result->d = inexact;
+        return true;
+    }
+    case ARITHMETIC_DIVIDE: {
+        UnboxedNumber numerator = operands[0];
+        UnboxedNumber denominator = operands[1];
+        if (numerator.kind == UNBOXED_INT && denominator.kind == UNBOXED_INT) {
+            if (denominator.i == 0
+                || (numerator.i == LONG_MIN && denominator.i == -1)) {
+                return false;
+            }
+            if (numerator.i % denominator.i == 0) {
+                result->kind = UNBOXED_INT;
+                result->i = numerator.i / denominator.i;
+                return true;
+            }
+        }
+        result->kind = UNBOXED_DOUBLE;
+        result->d = unboxedToDouble(numerator) / unboxedToDouble(denominator);
+        return true;
+    }
+    case ARITHMETIC_LESS:
+    case ARITHMETIC_GREATER: {
+        UnboxedNumber one = operands[op == ARITHMETIC_LESS ? 0 : 1];
+        UnboxedNumber two = operands[op == ARITHMETIC_LESS ? 1 : 0];
+        result->kind = UNBOXED_INT;
+        if (one.kind == UNBOXED_INT && two.kind == UNBOXED_INT) {
+            result->i = one.i < two.i;
+        } else {
+            result->i = unboxedToDouble(one) < unboxedToDouble(two);
+        }
+        return true;
+    }
+    case ARITHMETIC_EQUAL:
+        result->kind = UNBOXED_INT;
+        result->i = 1;
+        for (i = 1; i < argc && result->i; i++) {
+            if (operands[0].kind == UNBOXED_INT
+                && operands[i].kind == UNBOXED_INT) {
+                result->i = operands[0].i == operands[i].i;
+            } else {
+                result->i = unboxedToDouble(operands[0])
+                    == unboxedToDouble(operands[i]);
+            }
+        }
+        return true;
+    default:
+        return false;
+    }
+}
 
+/* Calls an arithmetic primitive on the expressions in args, evaluating them
+ * unboxed, and gives back its result unboxed if it could be worked out that
+ * way. Otherwise the result is whatever the primitive returned, BOXED.
+ */
+UnboxedNumber applyUnboxed(Value *operator, Value *args, Frame *frame) {
+    int argc = length(args);
+    UnboxedNumber operands[argc + 1];
+    bool allUnboxed = true;
+    for (int i = 0; i < argc; i++) {
+        operands[i] = evalUnboxed(args, frame);
+        allUnboxed = allUnboxed && operands[i].kind != BOXED;
+        args = cdr(args);
+    }
+
+    UnboxedNumber result;
+    if (allUnboxed && argc > 0
+        && computeUnboxed(arithmeticOperator(operator), argc, operands,
+                          &result)) {
+        return result;
+    }
+
+    Value *argv[argc + 1];
+    for (int i = 0; i < argc; i++) {
+        argv[i] = box(operands[i]);
+    }
+    result.kind = BOXED;
+    result.value = (*(operator->pf))(argc, argv);
+    return result;
+}
+
+// Evaluates a call to an arithmetic primitive unboxed, and boxes its result.
+Value *evalArithmetic(Value *expr, Frame *frame) {
+    UnboxedNumber result = applyUnboxed(car(expr), cdr(expr), frame);
+    if (result.kind == BOXED) {
+        return result.value;
+    } else if (arithmeticOperator(car(expr)) >= ARITHMETIC_LESS) {
+        return makeBool(result.i);
+    }
+    return box(result);
+}
+
+//=======================================================
+// Fundamentals: Base Function and Expression Evaluation
+//=======================================================
+
+/* Evaluates an atomic (non-cons) expression.
+ *
+ * Self-evaluating values are returned as they are, and symbols are looked up
+ * in activeFrame. Stops execution with an error for any other type.
+ */
+Value *evalAtom(Value *expr, Frame *activeFrame) {
     // Primitive (atomic) types
-    if (isInteger(expr)) {
-        return expr;
-    } else if (isDouble(expr)) {
+    if (isNumber(expr)) {
         return expr;
     } else if (isString(expr)) {
         return expr;
     } else if (isBoolean(expr)) {
         return expr;
+    } else if (isVector(expr)) {
+        return expr;
     } else if (isType(expr, PRIMITIVE_TYPE)) {
         //TEST test coverage
         return expr;
+    } else if (isType(expr, CLOSURE_TYPE)) {
+        // A constant global's value, put into the code by the optimizer
+        return expr;
     } else if (isNull(expr)) {
         return expr;
     } else if (isSymbol(expr)) {
-        Value *binding = lookUpSymbol(expr, frame);
-        return car(binding); // Gets value from binding
+        Value *value = car(lookUpSymbol(expr, activeFrame));
+        if (value->type == UNINITIALIZED) {
+            uninitializedVariable(expr);
+        }
+        return value;
     } else if (expr->type == UNINITIALIZED) {
         return expr;
     }
-    // This means that the expression is a complete S-expression
-    else if (isCons(expr)) {
-
-        Value *first = car(expr);
-        Value *args = cdr(expr);
-
-        //TODO: sanity and error checking on first...
-        assert(first != NULL);
-        assert(args != NULL);
-
-
-        if (isSymbol(first)) {
-                // Special cases
-            if (!strcmp(first->s, "if")) {
-                return evalIf(args, frame);
-            } else if (!strcmp(first->s, "let")) {
-                return evalLet(args, frame);
-            } else if (!strcmp(first->s, "let*")) {
-                return evalLetStar(args, frame);
-            } else if (!strcmp(first->s, "letrec")) {
-                return evalLetRec(args, frame);
-            } else if (!strcmp(first->s, "display")) {
-                return evalDisplay(args, frame);
-            } else if (!strcmp(first->s, "when")) {
-                return evalWhen(args, frame);
-            } else if (!strcmp(first->s, "unless")) {
-                return evalUnless(args, frame);
-            } else if (!strcmp(first->s, "quote")) {
-                return evalQuote(args, frame);
-            } else if (!strcmp(first->s, "define")) {
-                return evalDefine(args, frame);
-            } else if (!strcmp(first->s, "set!")) {
-                return evalSetBang(args, frame);
-            } else if (!strcmp(first->s, "begin")) {
-                return evalBegin(args, frame);
-            } else if (!strcmp(first->s, "cond")) {
-                return evalCond(args, frame);
-            } else if (!strcmp(first->s, "and")) {
-                return evalAnd(args, frame);
-            } else if (!strcmp(first->s, "or")) {
-                return evalOr(args, frame);
-            } else if (!strcmp(first->s, "load")) {
-                return evalLoad(args, frame);
-            } else if (!strcmp(first->s, "lambda")) {
-                return evalLambda(args, frame);
-            // Otherwise, proceed with standard evaluation
-            } else {
-                // If not a special form, evaluate the first, evaluate the args,
-                // then apply the first to the args.
-                Value *evaledOperator = eval(expr, frame);
-                Value *evaledArgs = evalEach(args, frame);
-                if (isType(evaledOperator, PRIMITIVE_TYPE)) {
-                    //TEST test coverage
-                    return (*(evaledOperator->pf))(evaledArgs);
-                } else {
-                    return apply(evaledOperator,evaledArgs);
-                }
-            }
-        } else {
-            // If not a special form, evaluate the first, evaluate the args,
-            // then apply the first to the args.
-            Value *evaledOperator = eval(expr, frame);
-            Value *evaledArgs = evalEach(args, frame);
-            if (isType(evaledOperator, PRIMITIVE_TYPE)) {
-                    //TEST test coverage
-                    return (*(evaledOperator->pf))(evaledArgs);
-                } else {
-                    return apply(evaledOperator,evaledArgs);
-                }
-        }
-    }
+
     // The expression is of a type we don't know how to evaluate.
     // This is an error.
     printf("Error: you entered an unkown type of expression or token.\n");
@@ -1702,44 +3276,153 @@ Value *eval(Value *tree, Frame *frame) {
     return NULL;
 }
 
+Value *eval(Value *tree, Frame *frame) {
+    assert(tree != NULL);
+
+    Value *expr = car(tree);
+
+    if (isSymbol(expr)) {
+        Value *value = car(lookUpCachedSymbol(tree, frame));
+        if (value->type == UNINITIALIZED) {
+            uninitializedVariable(expr);
+        }
+        return value;
+    }
+    if (!isCons(expr)) {
+        return evalAtom(expr, frame);
+    }
+
+    // This means that the expression is a complete S-expression
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+
+    // A call site that has called the same global before: a special form
+    // never gets cached, so it can skip straight to the call
+    CodeCache *cache = expr->c.cache;
+    if (cache != NULL && cache->callee != NULL && cache->version == globalVersion) {
+        Value *function = cache->callee;
+        int numArgs = cache->numArgs;
+        Value *evaledArgs[numArgs + 1];
+        evalArguments(args, frame, evaledArgs);
+        if (isType(function, PRIMITIVE_TYPE)) {
+            return (*(function->pf))(numArgs, evaledArgs);
+        }
+        return applyKnownArity(function, evaledArgs, numArgs);
+    }
+
+    // A call to a primitive or constant closure that is part of the code:
+    // a primitive was only put there if it takes this many arguments
+    if (isType(first, PRIMITIVE_TYPE)) {
+        if (isUnboxedArithmetic(expr)) {
+            return evalArithmetic(expr, frame);
+        }
+        int numArgs = length(args);
+        Value *evaledArgs[numArgs + 1];
+        evalArguments(args, frame, evaledArgs);
+        return (*(first->pf))(numArgs, evaledArgs);
+    } else if (isType(first, CLOSURE_TYPE)) {
+        int numArgs = length(args);
+        Value *evaledArgs[numArgs + 1];
+        evalArguments(args, frame, evaledArgs);
+        return apply(first, evaledArgs, numArgs);
+    }
+
+    //TODO: sanity and error checking on first...
+    assert(first != NULL);
+    assert(args != NULL);
+
+    // Only the core forms are left after expand()
+    if (isSymbol(first)) {
+        // Special cases
+        if (!strcmp(first->s, "if")) {
+            return evalIf(args, frame);
+        } else if (!strcmp(first->s, "quote")) {
+            return car(args);
+        } else if (!strcmp(first->s, "lambda")) {
+            return makeClosure(args, frame);
+        } else if (!strcmp(first->s, "begin")) {
+            return evalBegin(args, frame);
+        } else if (!strcmp(first->s, "set!")) {
+            return evalSetBang(args, frame);
+        } else if (!strcmp(first->s, "define")) {
+            return evalDefine(args, frame);
+        } else if (!strcmp(first->s, "display")) {
+            return evalDisplay(args, frame);
+        } else if (!strcmp(first->s, "load")) {
+            return evalLoad(args, frame);
+        }
+    } else if (isCons(first) && isSymbol(car(first))
+               && !strcmp(car(first)->s, "lambda")) {
+        // ((lambda (params...) body...) args...), which is what a let becomes:
+        // bind the arguments in a new frame, without making a closure
+        Value *lambdaArgs = cdr(first);
+        int numArgs = length(args);
+        Value *evaledArgs[numArgs + 1];
+        evalArguments(args, frame, evaledArgs);
+        if (isFrameLocal(cdr(lambdaArgs))) {
+            Value *params = car(lambdaArgs);
+            if (!isSymbol(params)) {
+                checkApplyArity(length(params), numArgs);
+            }
+            Frame *letFrame = makePooledFrame(frame, params, evaledArgs,
+                                              numArgs);
+            Value *result = evalBegin(cdr(lambdaArgs), letFrame);
+            releaseFrame(letFrame);
+            return result;
+        }
+        Frame *letFrame = makeApplyBindings(car(lambdaArgs), evaledArgs,
+                                            numArgs, makeFrame(frame));
+        return evalBegin(cdr(lambdaArgs), letFrame);
+    }
+
+    // If not a special form, evaluate the first, evaluate the args,
+    // then apply the first to the args.
+    // The arguments go in an array on the C stack; the +1 keeps it from
+    // being empty.
+    Value *evaledOperator = eval(expr, frame);
+    int numArgs = length(args);
+    Value *evaledArgs[numArgs + 1];
+    evalArguments(args, frame, evaledArgs);
+    if (isSymbol(first)) {
+        cacheCallee(expr, evaledOperator, numArgs);
+    }
+    if (isType(evaledOperator, PRIMITIVE_TYPE)) {
+        //TEST test coverage
+        return callPrimitive(evaledOperator, numArgs, evaledArgs);
+    } else {
+        return apply(evaledOperator, evaledArgs, numArgs);
+    }
+}
+
+// Creates the global frame, with all of the primitive functions bound in it.
+Frame *makeGlobalFrame() {
+    Frame *global = makeFrame(NULL);
+
+    for (int i = 0; i < NUM_PRIMITIVES; i++) {
+        bindPrimitive(&primitiveTable[i], global);
+    }
+
+    return global;
+}
+
+// Prints the result of a top-level expression, unless it is void.
+void printResult(Value *result) {
+    if (result->type != VOID_TYPE) {
+        printValue(result);
+        writeChar('\n');
+    }
+}
 
 void interpret(Value *tree) {
-    Frame *global = talloc(sizeof(Frame));
-    global->parent = NULL;
-    global->bindings = makeNull();
-
-	bindPrimitive("+", primitiveAdd, global);
-	bindPrimitive("-", primitiveSubtract, global);
-	bindPrimitive("*", primitiveMult, global);
-	bindPrimitive("/", primitiveDivide, global);
-    bindPrimitive("null?", primitiveIsNull, global);
-    bindPrimitive("list?", primitiveIsList, global);
-    bindPrimitive("car", primitiveCar, global);
-    bindPrimitive("cdr", primitiveCdr, global);
-    bindPrimitive("cons", primitiveCons, global);
-    bindPrimitive("list", primitiveList, global);
-    bindPrimitive("append", primitiveAppend, global);
-    bindPrimitive("reverse", primitiveReverse, global);
-    bindPrimitive("length", primitiveLength, global);
-    bindPrimitive("equal?", primitiveEqual, global);
-    bindPrimitive("eq?", primitiveEq, global);
-    bindPrimitive("number?", primitiveIsNumber, global);
-    bindPrimitive("=", primitiveEqualNum, global);
-    bindPrimitive("<", primitiveLessThan, global);
-    bindPrimitive(">", primitiveGreaterThan, global);
-    bindPrimitive("modulo", primitiveModulo, global);
-    bindPrimitive("not", primitiveNot, global);
+    Frame *global = makeGlobalFrame();
+    analyzeProgram(tree);
 
     Value *current = tree;
     while (!isNull(current)) {
+        current->c.car = foldConstants(expand(car(current)));
         Value *result = eval(current, global);
-
-        if (result->type != VOID_TYPE) {
-            printValue(result);
-            printf("\n");
-        }
-
+        printResult(result);
         current = cdr(current);
     }
     printf("\n");
-}
\ No newline at end of file
+}
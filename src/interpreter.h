@@ -14,8 +14,164 @@ struct Frame {
 
 typedef struct Frame Frame;
 
+/* The description of a primitive, from the table in interpreter.c that the
+ * global frame is made from.
+ *
+ * minArgs, maxArgs: how many arguments it takes; maxArgs is -1 if there is no
+ *                   limit. Callers check this, not the primitive.
+ * pure: whether it has no side effects, gives equal results for equal
+ *       arguments and makes no new object but a number, so that calls with
+ *       constant arguments can be folded. A folded call gives the same
+ *       object every time it runs, which eq? could tell from a new one.
+ * signature: how to call it and what it returns, for error messages.
+ */
+typedef struct PrimitiveDescriptor {
+    char *name;
+    PrimitiveFunction function;
+    int minArgs;
+    int maxArgs;
+    bool pure;
+    char *signature;
+} PrimitiveDescriptor;
+
 void interpret(Value *tree);
 Value *eval(Value *expr, Frame *frame);
 
-#endif
+// The rest of these are the building blocks of eval. They are shared with the
+// other evaluation engines, so that every engine has the same primitives,
+// special form syntax, and error messages.
+
+// Creates the global frame, with all of the primitive functions bound in it.
+Frame *makeGlobalFrame();
+
+// Prints the result of a top-level expression, unless it is void.
+void printResult(Value *result);
+
+// Creates an empty frame whose parent is the given frame.
+Frame *makeFrame(Frame *parent);
+
+// Returns the global frame of the environment that activeFrame is part of.
+Frame *getGlobalFrame(Frame *activeFrame);
+
+// Looks up the binding of symbol, starting at activeFrame. Returns the cons
+// cell whose car is the bound value; stops with an error if it is unbound.
+Value *lookUpSymbol(Value *symbol, Frame *activeFrame);
+
+// Looks up symbol in frame only, not its parents. Returns the cons cell whose
+// car is the bound value, or NULL if it isn't bound there.
+Value *lookupBindingInFrame(Value *symbol, Frame *frame);
+
+// Looks up the symbol car(tree) like lookUpSymbol. A global's binding is
+// cached on tree, so later lookups of it there skip the search.
+Value *lookUpCachedSymbol(Value *tree, Frame *activeFrame);
+
+// Binds the symbol name to value in frame.
+void addBinding(Value *name, Value *value, Frame *frame);
+
+// Evaluates an atomic (non-cons) expression: a literal or a symbol.
+Value *evalAtom(Value *expr, Frame *activeFrame);
+
+// Builds the frame that a closure's body is evaluated in, with its parameters
+// bound to the numArgs evaluated arguments in args.
+Frame *makeApplyFrame(Value *function, Value **args, int numArgs);
+
+// Calls a closure with numArgs evaluated arguments, in order in args.
+Value *apply(Value *function, Value **args, int numArgs);
+
+// Makes a list of numArgs evaluated arguments, for a rest parameter or an
+// error message.
+Value *makeArgumentList(Value **args, int numArgs);
+
+// Returns the descriptor of the primitive with the given name, or NULL if
+// there isn't one.
+const PrimitiveDescriptor *lookUpPrimitive(char *name);
+
+// Checks whether a primitive can be called with argc arguments.
+bool acceptsArity(const PrimitiveDescriptor *descriptor, int argc);
+
+// Checks whether a primitive can be called with these arguments: the right
+// number of them, each of the type its signature gives.
+bool acceptsArguments(const PrimitiveDescriptor *descriptor, int argc,
+                      Value **argv);
+
+// Stops execution with an error if a primitive can't be called with argc
+// arguments.
+void checkPrimitiveArity(Value *primitive, int argc, Value **argv);
 
+// Calls a primitive with argc evaluated arguments, after checking the arity.
+Value *callPrimitive(Value *primitive, int argc, Value **argv);
+
+// Creates a primitive function value for a descriptor.
+Value *makePrimitive(const PrimitiveDescriptor *descriptor);
+
+// Replaces the name of a global, car(tree), with its value in the code, and
+// remembers where, so deoptimizeGlobal can put the name back.
+void inlineGlobalValue(Value *tree, Value *value);
+
+// Puts the name of a global back everywhere its value was put into the code,
+// when the global changes, and stops treating it as a constant.
+void deoptimizeGlobal(Value *symbol);
+
+// Returns car(tree) as it was written: the name of a global whose value has
+// been put there, or car(tree) itself.
+Value *sourceExpr(Value *tree);
+
+// Primitives that the JIT has inline fast paths for, so it can tell whether a
+// global is still bound to one of them.
+Value *primitiveAdd(int argc, Value **argv);
+Value *primitiveSubtract(int argc, Value **argv);
+Value *primitiveMult(int argc, Value **argv);
+Value *primitiveLessThan(int argc, Value **argv);
+Value *primitiveGreaterThan(int argc, Value **argv);
+Value *primitiveEqualNum(int argc, Value **argv);
+
+// Stops execution with an error if a function is given the wrong number of
+// arguments.
+void checkApplyArity(int numParams, int numArgs);
+
+// Stops execution with an error if args doesn't have exactly numArgs elements.
+void enforceArgumentArity(Value *args, int numArgs, char *expressionType);
+
+// Syntax checks for special forms. Each stops execution with an error if its
+// expression is malformed. argsTree is everything after the keyword.
+void checkIfSyntax(Value *argsTree);
+void checkWhenSyntax(Value *argsTree);
+void checkUnlessSyntax(Value *argsTree);
+void checkCondSyntax(Value *argsTree);
+void checkLetSyntax(Value *argsTree, char *formName);
+void checkLetBindingPair(Value *currentBindingPair, Value *argsTree);
+void checkLetRecBindingPair(Value *currentBindingPair, Value *argsTree);
+void checkBinding(Value *bindingPair, Frame *activeFrame);
+void checkSetBangSyntax(Value *argsTree);
+void checkLambdaSyntax(Value *argsTree);
+Value *checkDefineSyntax(Value *argsTree);
+
+// Checks whether a cond clause is an else clause.
+bool isElseClause(Value *clause);
+
+// First pass of letrec: checks syntax and binds all names as uninitialized.
+Frame *makeLetRecFrame(Value *argsTree, Frame *activeFrame);
+
+// Stops execution with an error because the letrec variable name was read
+// before its binding's expression had given it a value. Every engine checks
+// for an UNINITIALIZED value where it reads such a variable.
+void uninitializedVariable(Value *name);
+
+// Second pass of letrec: stores the value of one binding.
+void setLetRecBinding(Value *currentBindingPair, Value *exprResult,
+                      Frame *letFrame);
+
+// Binds symbol to value in the global frame.
+void defineGlobal(Value *symbol, Value *value, Frame *activeFrame);
+
+// Changes the value of the variable named by a set! expression.
+void setVariable(Value *argsTree, Value *value, Frame *activeFrame);
+
+// Reads and parses the file named by a load expression.
+Value *loadFile(Value *args, Value *filePath);
+
+// Special forms that don't evaluate any subexpressions.
+Value *evalQuote(Value *argsTree, Frame *activeFrame);
+Value *evalLambda(Value *argsTree, Frame *activeFrame);
+
+#endif
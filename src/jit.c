@@ -0,0 +1,608 @@
+// Template JIT for closures, for x86-64.
+//
+// apply() counts the calls to each closure. Once a closure has been called
+// JIT_THRESHOLD times, its body is translated to machine code by pasting
+// together a fixed template for each construct: loading a parameter or a
+// global, an integer add/subtract/multiply/compare with a guard that falls
+// back to the primitive, a conditional branch, and a call into apply() or a
+// primitive. If the body uses anything without a template, the closure is
+// left to eval(), which stays the reference for what everything means. So is
+// a body with a double literal in it, since eval() does floating-point
+// arithmetic without boxing intermediate results.
+//
+// Only closures made in the global frame are compiled, so that every free
+// variable is a global whose binding cell can be baked into the code.
+// Parameters can't be captured or changed by anything the templates allow,
+// so the machine code reads them straight from the argument array.
+
+#include "jit.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <assert.h>
+#include "linkedlist.h"
+#include "talloc.h"
+#include "interpreter.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#define JIT_THRESHOLD 50
+#define INITIAL_CODE_CAPACITY 256
+#define CODE_AREA_SIZE (1 << 20)
+
+static bool jitEnabled = JIT_SUPPORTED;
+
+void setJitEnabled(bool enabled) {
+    jitEnabled = enabled && JIT_SUPPORTED;
+}
+
+//==============================================================================
+// Helpers called from machine code
+//==============================================================================
+
+// Applies a procedure the way eval() does. The arguments are on the machine
+// stack, so the last one is first in memory.
+Value *jitApply(Value *function, Value **reversedArgs, int numArgs) {
+    Value *args[numArgs + 1];
+    for (int i = 0; i < numArgs; i++) {
+        args[i] = reversedArgs[numArgs - 1 - i];
+    }
+    if (isType(function, PRIMITIVE_TYPE)) {
+        return callPrimitive(function, numArgs, args);
+    }
+    return apply(function, args, numArgs);
+}
+
+// The slow path of the integer templates: any two-argument call.
+Value *jitApply2(Value *function, Value *first, Value *second) {
+    Value *args[] = {second, first};
+    return jitApply(function, args, 2);
+}
+
+Value *runJitCode(JitFunction code, Value *closure, Value **args, int numArgs) {
+    // The same check as makeApplyBindings
+    checkApplyArity(length(closure->cl.paramNames), numArgs);
+    return code(args);
+}
+
+#if JIT_SUPPORTED
+
+//==============================================================================
+// Emitting machine code
+//==============================================================================
+
+/* The state of the compiler for one closure.
+ *
+ * code: the machine code so far, length bytes of it.
+ * params: the closure's parameter names; parameter i is args[i].
+ * global: the global frame, where every other variable is.
+ * depth: how many 8-byte words have been pushed since the prologue, to keep
+ *        the stack 16-byte aligned at calls.
+ * supported: false once something without a template has been found.
+ */
+typedef struct JitCompiler {
+    unsigned char *code;
+    int length;
+    int capacity;
+    Value *params;
+    Frame *global;
+    int depth;
+    bool supported;
+} JitCompiler;
+
+// The integer operations with templates
+typedef enum {ADD_OP, SUBTRACT_OP, MULTIPLY_OP, LESS_OP, GREATER_OP,
+              EQUAL_OP} integerOp;
+
+typedef struct {
+    char *name;
+    PrimitiveFunction primitive;
+    integerOp op;
+} IntegerTemplate;
+
+static IntegerTemplate integerTemplates[] = {
+    {"+", primitiveAdd, ADD_OP},
+    {"-", primitiveSubtract, SUBTRACT_OP},
+    {"*", primitiveMult, MULTIPLY_OP},
+    {"<", primitiveLessThan, LESS_OP},
+    {">", primitiveGreaterThan, GREATER_OP},
+    {"=", primitiveEqualNum, EQUAL_OP}
+};
+#define NUM_INTEGER_TEMPLATES 6
+
+// Special forms other than if and quote have no templates
+static char *specialForms[] = {"let", "let*", "letrec", "display", "when",
+                               "unless", "define", "set!", "begin", "cond",
+                               "and", "or", "load", "lambda"};
+#define NUM_SPECIAL_FORMS 14
+
+// Condition codes, for the low nibble of jcc and setcc
+#define CC_OVERFLOW 0x0
+#define CC_EQUAL 0x4
+#define CC_NOT_EQUAL 0x5
+#define CC_LESS 0xC
+#define CC_GREATER_EQUAL 0xD
+#define CC_LESS_EQUAL 0xE
+#define CC_GREATER 0xF
+
+void jitExpr(JitCompiler *jc, Value *expr);
+
+void emitByte(JitCompiler *jc, unsigned char byte) {
+    if (jc->length == jc->capacity) {
+        unsigned char *newCode = talloc(2 * jc->capacity);
+        memcpy(newCode, jc->code, jc->length);
+        jc->code = newCode;
+        jc->capacity *= 2;
+    }
+    jc->code[jc->length] = byte;
+    jc->length++;
+}
+
+void emitBytes(JitCompiler *jc, unsigned char *bytes, int count) {
+    for (int i = 0; i < count; i++) {
+        emitByte(jc, bytes[i]);
+    }
+}
+
+void emitInt32(JitCompiler *jc, int value) {
+    emitBytes(jc, (unsigned char *) &value, 4);
+}
+
+// mov rax, pointer
+void emitLoadPointer(JitCompiler *jc, void *pointer) {
+    emitBytes(jc, (unsigned char []) {0x48, 0xB8}, 2);
+    emitBytes(jc, (unsigned char *) &pointer, 8);
+}
+
+// mov rcx, pointer
+void emitLoadPointerRcx(JitCompiler *jc, void *pointer) {
+    emitBytes(jc, (unsigned char []) {0x48, 0xB9}, 2);
+    emitBytes(jc, (unsigned char *) &pointer, 8);
+}
+
+// push rax
+void emitPush(JitCompiler *jc) {
+    emitByte(jc, 0x50);
+    jc->depth++;
+}
+
+// pop into rdi (7), rsi (6) or rdx (2)
+void emitPop(JitCompiler *jc, unsigned char reg) {
+    emitByte(jc, 0x58 + reg);
+    jc->depth--;
+}
+
+// Calls a C function, with the stack aligned. Arguments are already in
+// registers; the result is in rax.
+void emitCall(JitCompiler *jc, void *function) {
+    bool pad = jc->depth % 2 == 1;
+    if (pad) {
+        emitBytes(jc, (unsigned char []) {0x48, 0x83, 0xEC, 0x08}, 4);
+    }
+    emitLoadPointer(jc, function);
+    emitBytes(jc, (unsigned char []) {0xFF, 0xD0}, 2);
+    if (pad) {
+        emitBytes(jc, (unsigned char []) {0x48, 0x83, 0xC4, 0x08}, 4);
+    }
+}
+
+// Emits a jump with the given condition code (or an unconditional one if
+// condition is negative), and returns where to patch its target.
+int emitBranch(JitCompiler *jc, int condition) {
+    if (condition < 0) {
+        emitByte(jc, 0xE9);
+    } else {
+        emitBytes(jc, (unsigned char []) {0x0F, 0x80 + condition}, 2);
+    }
+    emitInt32(jc, 0);
+    return jc->length - 4;
+}
+
+// Points the jump whose target is at offset to the next instruction.
+void patchBranch(JitCompiler *jc, int offset) {
+    int relative = jc->length - (offset + 4);
+    memcpy(jc->code + offset, &relative, 4);
+}
+
+//==============================================================================
+// Templates
+//==============================================================================
+
+// Returns the index of a parameter, or -1 if symbol isn't one.
+int paramIndex(JitCompiler *jc, Value *symbol) {
+    int index = 0;
+    Value *currentParam = jc->params;
+    while (!isNull(currentParam)) {
+        if (!strcmp(car(currentParam)->s, symbol->s)) {
+            return index;
+        }
+        index++;
+        currentParam = cdr(currentParam);
+    }
+    return -1;
+}
+
+void jitAtom(JitCompiler *jc, Value *expr) {
+    if (isSymbol(expr)) {
+        int index = paramIndex(jc, expr);
+        if (index >= 0) {
+            // mov rax, [r12 + 8 * index]
+            emitBytes(jc, (unsigned char []) {0x49, 0x8B, 0x84, 0x24}, 4);
+            emitInt32(jc, 8 * index);
+            return;
+        }
+
+        // A global that isn't defined yet would be an error; leave it to eval
+        Value *cell = lookupBindingInFrame(expr, jc->global);
+        if (cell == NULL) {
+            jc->supported = false;
+            return;
+        }
+        // mov rax, cell; mov rax, [rax + car]
+        emitLoadPointer(jc, cell);
+        emitBytes(jc, (unsigned char []) {0x48, 0x8B, 0x40,
+                                          offsetof(Value, c.car)}, 4);
+    } else if (isDouble(expr)) {
+        // Floating-point code: the templates would box every intermediate
+        // result, where eval keeps nested arithmetic unboxed
+        jc->supported = false;
+    } else if (isNumber(expr) || isString(expr) || isBoolean(expr)
+               || isNull(expr) || isVector(expr)) {
+        // Literals evaluate to themselves
+        emitLoadPointer(jc, expr);
+    } else {
+        jc->supported = false;
+    }
+}
+
+// Finds the integer template for a call, or returns NULL if it has none: the
+// operator must be a global that is bound to the primitive right now.
+IntegerTemplate *findIntegerTemplate(JitCompiler *jc, Value *expr) {
+    Value *operator = sourceExpr(expr);
+    if (!isSymbol(operator) || paramIndex(jc, operator) >= 0
+        || !isCons(cdr(expr)) || !isCons(cdr(cdr(expr)))
+        || !isNull(cdr(cdr(cdr(expr))))) {
+        return NULL;
+    }
+    for (int i = 0; i < NUM_INTEGER_TEMPLATES; i++) {
+        if (!strcmp(operator->s, integerTemplates[i].name)) {
+            Value *cell = lookupBindingInFrame(operator, jc->global);
+            if (cell != NULL && isType(car(cell), PRIMITIVE_TYPE)
+                && car(cell)->pf == integerTemplates[i].primitive) {
+                return &integerTemplates[i];
+            }
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+/* Emits an integer operation with a fallback to the primitive.
+ *
+ * Evaluates the operator and both arguments, then checks that the operator
+ * is still the primitive and both arguments are integers. If so, the
+ * operation is done inline; arithmetic that overflows goes to the slow path
+ * too, so the result is always exactly what the primitive would give. The
+ * slow path calls whatever the operator is.
+ *
+ * elseJumps: NULL to produce a Value in rax. Otherwise the operation must be
+ *            a comparison, and instead of a Value, code is emitted that
+ *            jumps to one of the two returned offsets if the result is false
+ *            and falls through if it is true.
+ */
+void jitIntegerOp(JitCompiler *jc, Value *expr, IntegerTemplate *template,
+                  int *elseJumps) {
+    jitExpr(jc, expr);
+    emitPush(jc);
+    jitExpr(jc, cdr(expr));
+    emitPush(jc);
+    jitExpr(jc, cdr(cdr(expr)));
+    emitBytes(jc, (unsigned char []) {0x48, 0x89, 0xC6}, 3);    // mov rsi, rax
+    emitPop(jc, 7);                                             // pop rdi
+    emitPop(jc, 2);                                             // pop rdx
+
+    // Guards: is the operator still the primitive it was bound to when this
+    // was compiled, and are both integers?
+    emitLoadPointerRcx(jc,
+        car(lookupBindingInFrame(sourceExpr(expr), jc->global)));
+    emitBytes(jc, (unsigned char []) {0x48, 0x39, 0xCA}, 3);    // cmp rdx, rcx
+    int notPrimitive = emitBranch(jc, CC_NOT_EQUAL);
+    emitBytes(jc, (unsigned char []) {0x83, 0x3F, INT_TYPE}, 3);
+    int firstNotInt = emitBranch(jc, CC_NOT_EQUAL);
+    emitBytes(jc, (unsigned char []) {0x83, 0x3E, INT_TYPE}, 3);
+    int secondNotInt = emitBranch(jc, CC_NOT_EQUAL);
+
+    // mov rax, [rdi + i]
+    emitBytes(jc, (unsigned char []) {0x48, 0x8B, 0x47, offsetof(Value, i)}, 4);
+    int overflow = -1;
+    int condition = -1;
+    switch (template->op) {
+        case ADD_OP:
+            emitBytes(jc, (unsigned char []) {0x48, 0x03, 0x46,
+                                              offsetof(Value, i)}, 4);
+            overflow = emitBranch(jc, CC_OVERFLOW);
+            break;
+        case SUBTRACT_OP:
+            emitBytes(jc, (unsigned char []) {0x48, 0x2B, 0x46,
+                                              offsetof(Value, i)}, 4);
+            overflow = emitBranch(jc, CC_OVERFLOW);
+            break;
+        case MULTIPLY_OP:
+            emitBytes(jc, (unsigned char []) {0x48, 0x0F, 0xAF, 0x46,
+                                              offsetof(Value, i)}, 5);
+            overflow = emitBranch(jc, CC_OVERFLOW);
+            break;
+        case LESS_OP:
+            condition = CC_LESS;
+            break;
+        case GREATER_OP:
+            condition = CC_GREATER;
+            break;
+        case EQUAL_OP:
+            condition = CC_EQUAL;
+            break;
+    }
+
+    int done;
+    if (condition < 0) {
+        emitBytes(jc, (unsigned char []) {0x48, 0x89, 0xC7}, 3); // mov rdi, rax
+        emitCall(jc, makeInt);
+        done = emitBranch(jc, -1);
+    } else {
+        // cmp rax, [rsi + i]
+        emitBytes(jc, (unsigned char []) {0x48, 0x3B, 0x46, offsetof(Value, i)}, 4);
+        if (elseJumps != NULL) {
+            // Jump to the else branch on the opposite condition
+            elseJumps[0] = emitBranch(jc, condition ^ 1);
+        } else {
+            // setcc al; movzx edi, al
+            emitBytes(jc, (unsigned char []) {0x0F, 0x90 + condition, 0xC0,
+                                              0x0F, 0xB6, 0xF8}, 6);
+            emitCall(jc, makeBool);
+        }
+        done = emitBranch(jc, -1);
+    }
+
+    // Slow path: jitApply2(operator, first, second)
+    patchBranch(jc, notPrimitive);
+    patchBranch(jc, firstNotInt);
+    patchBranch(jc, secondNotInt);
+    if (overflow >= 0) {
+        patchBranch(jc, overflow);
+    }
+    emitBytes(jc, (unsigned char []) {0x48, 0x89, 0xD0,         // mov rax, rdx
+                                      0x48, 0x89, 0xF2,         // mov rdx, rsi
+                                      0x48, 0x89, 0xFE,         // mov rsi, rdi
+                                      0x48, 0x89, 0xC7}, 12);   // mov rdi, rax
+    emitCall(jc, jitApply2);
+    if (elseJumps != NULL) {
+        // Any value but #f is true
+        emitBytes(jc, (unsigned char []) {0x83, 0x38, BOOL_TYPE,
+                                          0x75, 0x0A,
+                                          0x83, 0x78, offsetof(Value, i), 0x00}, 9);
+        elseJumps[1] = emitBranch(jc, CC_EQUAL);
+    }
+    patchBranch(jc, done);
+}
+
+// Emits a call through jitApply, which does what eval does for any procedure.
+void jitCall(JitCompiler *jc, Value *expr) {
+    int numArgs = 0;
+    Value *currentArg = cdr(expr);
+    while (isCons(currentArg)) {
+        numArgs++;
+        currentArg = cdr(currentArg);
+    }
+
+    // Pad first, so the operator and arguments end up in one array
+    bool pad = (jc->depth + numArgs + 1) % 2 == 1;
+    if (pad) {
+        emitBytes(jc, (unsigned char []) {0x48, 0x83, 0xEC, 0x08}, 4);
+        jc->depth++;
+    }
+
+    // The operator is evaluated first, then each argument, left to right
+    jitExpr(jc, expr);
+    emitPush(jc);
+    currentArg = cdr(expr);
+    for (int i = 0; i < numArgs; i++) {
+        jitExpr(jc, currentArg);
+        emitPush(jc);
+        currentArg = cdr(currentArg);
+    }
+
+    // mov rdi, [rsp + 8 * numArgs]; mov rsi, rsp; mov edx, numArgs
+    emitBytes(jc, (unsigned char []) {0x48, 0x8B, 0xBC, 0x24}, 4);
+    emitInt32(jc, 8 * numArgs);
+    emitBytes(jc, (unsigned char []) {0x48, 0x89, 0xE6, 0xBA}, 4);
+    emitInt32(jc, numArgs);
+    emitCall(jc, jitApply);
+
+    // add rsp, everything pushed
+    int pushed = numArgs + 1 + (pad ? 1 : 0);
+    emitBytes(jc, (unsigned char []) {0x48, 0x81, 0xC4}, 3);
+    emitInt32(jc, 8 * pushed);
+    jc->depth -= pushed;
+}
+
+void jitIf(JitCompiler *jc, Value *argsTree) {
+    // Malformed ifs are left to eval, to report
+    if (!isCons(argsTree) || !isCons(cdr(argsTree))
+        || !isCons(cdr(cdr(argsTree)))) {
+        jc->supported = false;
+        return;
+    }
+
+    Value *test = car(argsTree);
+    int elseJumps[2] = {-1, -1};
+    IntegerTemplate *template = NULL;
+    if (isCons(test)) {
+        template = findIntegerTemplate(jc, test);
+    }
+    if (template != NULL && template->op >= LESS_OP) {
+        jitIntegerOp(jc, test, template, elseJumps);
+    } else {
+        jitExpr(jc, argsTree);
+        // cmp dword [rax], BOOL_TYPE; jne +10; cmp dword [rax + i], 0; je else
+        emitBytes(jc, (unsigned char []) {0x83, 0x38, BOOL_TYPE,
+                                          0x75, 0x0A,
+                                          0x83, 0x78, offsetof(Value, i), 0x00}, 9);
+        elseJumps[0] = emitBranch(jc, CC_EQUAL);
+    }
+
+    jitExpr(jc, cdr(argsTree));
+    int end = emitBranch(jc, -1);
+    for (int i = 0; i < 2; i++) {
+        if (elseJumps[i] >= 0) {
+            patchBranch(jc, elseJumps[i]);
+        }
+    }
+    jitExpr(jc, cdr(cdr(argsTree)));
+    patchBranch(jc, end);
+}
+
+// Emits code that leaves the value of car(tree) in rax.
+void jitExpr(JitCompiler *jc, Value *tree) {
+    if (!jc->supported) {
+        return;
+    }
+    // A global's value may have been put into the code; the machine code
+    // looks it up instead, so it doesn't have to be thrown away if the
+    // global changes
+    Value *expr = sourceExpr(tree);
+    if (!isCons(expr)) {
+        jitAtom(jc, expr);
+        return;
+    }
+
+    Value *first = car(expr);
+    if (isSymbol(first)) {
+        if (!strcmp(first->s, "if")) {
+            jitIf(jc, cdr(expr));
+            return;
+        } else if (!strcmp(first->s, "quote")) {
+            if (!isCons(cdr(expr)) || !isNull(cdr(cdr(expr)))) {
+                jc->supported = false;
+                return;
+            }
+            emitLoadPointer(jc, car(cdr(expr)));
+            return;
+        }
+        for (int i = 0; i < NUM_SPECIAL_FORMS; i++) {
+            if (!strcmp(first->s, specialForms[i])) {
+                jc->supported = false;
+                return;
+            }
+        }
+    }
+
+    IntegerTemplate *template = findIntegerTemplate(jc, expr);
+    if (template != NULL) {
+        jitIntegerOp(jc, expr, template, NULL);
+    } else {
+        jitCall(jc, expr);
+    }
+}
+
+//==============================================================================
+// Installing machine code
+//==============================================================================
+
+static unsigned char *codeArea = NULL;
+static size_t codeAreaUsed = 0;
+
+// Copies machine code into executable memory, and returns where it is.
+void *installCode(unsigned char *code, int length) {
+    if (codeArea == NULL || codeAreaUsed + length > CODE_AREA_SIZE) {
+        if (length > CODE_AREA_SIZE) {
+            return NULL;
+        }
+        void *area = mmap(NULL, CODE_AREA_SIZE, PROT_READ | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (area == MAP_FAILED) {
+            return NULL;
+        }
+        codeArea = area;
+        codeAreaUsed = 0;
+    }
+
+    // Only writable while it is being written to
+    if (mprotect(codeArea, CODE_AREA_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+    unsigned char *start = codeArea + codeAreaUsed;
+    memcpy(start, code, length);
+    codeAreaUsed += (length + 15) & ~15;
+    mprotect(codeArea, CODE_AREA_SIZE, PROT_READ | PROT_EXEC);
+    return start;
+}
+
+// Compiles a closure's body, or returns NULL if it can't be.
+JitFunction compileClosure(Value *closure) {
+    // Only fixed parameter lists; (lambda x ...) is left to eval
+    Value *params = closure->cl.paramNames;
+    if (!isCons(params) && !isNull(params)) {
+        return NULL;
+    }
+
+    JitCompiler *jc = talloc(sizeof(JitCompiler));
+    jc->capacity = INITIAL_CODE_CAPACITY;
+    jc->code = talloc(jc->capacity);
+    jc->length = 0;
+    jc->params = params;
+    jc->global = closure->cl.frame;
+    jc->depth = 0;
+    jc->supported = true;
+
+    // push rbp; mov rbp, rsp; push r12; push rbx; mov r12, rdi
+    emitBytes(jc, (unsigned char []) {0x55, 0x48, 0x89, 0xE5, 0x41, 0x54, 0x53,
+                                      0x49, 0x89, 0xFC}, 10);
+
+    Value *currentExpr = closure->cl.functionCode;
+    while (!isNull(currentExpr)) {
+        jitExpr(jc, currentExpr);
+        currentExpr = cdr(currentExpr);
+    }
+
+    // pop rbx; pop r12; pop rbp; ret
+    emitBytes(jc, (unsigned char []) {0x5B, 0x41, 0x5C, 0x5D, 0xC3}, 5);
+
+    if (!jc->supported) {
+        return NULL;
+    }
+    return (JitFunction) installCode(jc->code, jc->length);
+}
+
+#else
+
+JitFunction compileClosure(Value *closure) {
+    return NULL;
+}
+
+#endif
+
+JitFunction getJitCode(Value *closure) {
+    // Only closures made in the global frame are compiled
+    if (!jitEnabled || !isType(closure, CLOSURE_TYPE)
+        || closure->cl.frame->parent != NULL) {
+        return NULL;
+    }
+
+    if (closure->cl.jit == NULL) {
+        closure->cl.jit = talloc(sizeof(struct JitState));
+        closure->cl.jit->callCount = 0;
+        closure->cl.jit->code = NULL;
+    }
+    struct JitState *state = closure->cl.jit;
+    state->callCount++;
+    if (state->callCount == JIT_THRESHOLD) {
+        state->code = compileClosure(closure);
+    }
+    return state->code;
+}
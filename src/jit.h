@@ -0,0 +1,30 @@
+#ifndef _JIT
+#define _JIT
+
+#include <stdbool.h>
+#include "value.h"
+
+// Machine code for a closure body. Takes the closure's arguments, in order.
+typedef Value *(*JitFunction)(Value **args);
+
+// How a closure is doing with the JIT: how many times it has been called,
+// and its machine code once it has been compiled.
+struct JitState {
+    int callCount;
+    JitFunction code;
+};
+
+// Turns the JIT on or off. It starts on, unless it isn't supported on this
+// machine, in which case it can't be turned on.
+void setJitEnabled(bool enabled);
+
+// Counts a call to a closure. Once the closure has been called often enough,
+// tries to compile its body to machine code. Returns the machine code, or
+// NULL if the closure should be interpreted.
+JitFunction getJitCode(Value *closure);
+
+// Runs a closure's machine code with numArgs arguments, in order in args.
+// Stops with the same error as apply() if the arity is wrong.
+Value *runJitCode(JitFunction code, Value *closure, Value **args, int numArgs);
+
+#endif
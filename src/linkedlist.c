@@ -15,32 +15,17 @@
 
 // Create a new CONS_TYPE value node.
 //
-// FAQ: If the newCdr contains a string within, do we need to make a copy of
-// that string?
-//
-// ANS: Yes, you should make a copy of that string. The function cleanup (below)
-// is then responsible for freeing the memory associated with this copy of the
-// string.
+// Strings in the car or cdr aren't copied: nothing changes a string's text
+// once it is made, so any number of lists can share it.
 Value *cons(Value *newCar, Value *newCdr) {
     assert(newCar != NULL);
     assert(newCdr != NULL);
 
     Value *cell = makeValue(CONS_TYPE);
 
-    if ((*newCar).type == STR_TYPE){
-        char* newString = talloc(sizeof(char) * (strlen((*newCar).s)+1));
-        strcpy(newString, (*newCar).s);
-        (*newCar).s = newString;
-    }
-
-    if ((*newCdr).type == STR_TYPE){
-        char* newString = talloc(sizeof(char) * (strlen((*newCdr).s)+1));
-        strcpy(newString, (*newCdr).s);
-        (*newCdr).s = newString;
-    }
-
     (*cell).c.car = newCar;
     (*cell).c.cdr = newCdr;
+    (*cell).c.cache = NULL;
     return cell;
 
 }
@@ -54,13 +39,13 @@ void display(Value *list) {
         display((*list).c.cdr);
     }
     else if ((*list).type == INT_TYPE) {
-        printf("%i\n", (*list).i);
+        printf("%li\n", (*list).i);
     }
     else if ((*list).type == DOUBLE_TYPE) {
         printf("%f\n", (*list).d);
     }
     else if ((*list).type == STR_TYPE) {
-        printf("%s\n", (*list).s);
+        printf("%.*s\n", (int) list->length, list->s);
     }
     else if (isType(list, PTR_TYPE)) {
         printf("%p\n", list->p);
@@ -204,3 +189,24 @@ Value *list(int dim, Value *values[]) {
 
     return result;
 }
+
+// Makes a vector of the elements of a proper list, in order.
+Value *listToVector(Value *list) {
+    assert(isProperList(list));
+    Value *vector = makeVector(length(list), makeNull());
+    Value **item = vector->vector.items;
+    for (Value *current = list; !isNull(current); current = cdr(current)) {
+        *item++ = car(current);
+    }
+    return vector;
+}
+
+// Makes a list of the elements of a vector, in order.
+Value *vectorToList(Value *vector) {
+    assert(isVector(vector));
+    Value *result = makeNull();
+    for (long i = vector->vector.length - 1; i >= 0; i--) {
+        result = cons(vector->vector.items[i], result);
+    }
+    return result;
+}
@@ -5,13 +5,7 @@
 #include "value.h"
 
 // Create a new CONS_TYPE value node.
-//
-// FAQ: If the newCdr contains a string within, do we need to make a copy of
-// that string?
-//
-// ANS: Yes, you should make a copy of that string. The function cleanup (below)
-// is then responsible for freeing the memory associated with this copy of the
-// string.
+// Strings aren't copied; they share their text (see text.h).
 Value *cons(Value *newCar, Value *newCdr);
 
 // Display the contents of the linked list to the screen in some kind of
@@ -72,4 +66,12 @@ Value *append(Value *newList, Value *oldList);
 // (for example, with an array of length 3 to add 3 elements)
 Value *list(int dim, Value *values[]);
 
+// Makes a vector of the elements of a proper list, in order.
+// This mimics the Scheme function list->vector.
+Value *listToVector(Value *list);
+
+// Makes a list of the elements of a vector, in order.
+// This mimics the Scheme function vector->list.
+Value *vectorToList(Value *vector);
+
 #endif
@@ -1,18 +1,60 @@
 #include <stdio.h>
+#include <string.h>
 #include "tokenizer.h"
 #include "value.h"
 #include "linkedlist.h"
 #include "parser.h"
 #include "talloc.h"
 #include "interpreter.h"
+#include "cek.h"
+#include "bytecode.h"
+#include "closurecompiler.h"
+#include "ctranslator.h"
+#include "jit.h"
+#include "output.h"
+#include "numvector.h"
 
-int main() {
+void printUsage(char *programName) {
+    printf("Usage: %s [--cek | --bytecode | --closures | --emit-c] [--no-jit] [--no-simd] < program.rkt\n", programName);
+    printf("  --cek       evaluate with the explicit-stack evaluator, which\n");
+    printf("              supports recursion as deep as memory allows\n");
+    printf("  --bytecode  compile to bytecode and run it on the virtual machine\n");
+    printf("  --closures  compile each expression to a tree of C function\n");
+    printf("              pointers and run that\n");
+    printf("  --emit-c    don't run the program; print it translated to C\n");
+    printf("  --no-jit    don't compile hot closures to machine code\n");
+    printf("  --no-simd   use the scalar code for f64vector and s64vector\n");
+    printf("              operations, not the SIMD kernels\n");
+}
+
+int main(int argc, char *argv[]) {
+    // The evaluation engine to run the program with
+    void (*interpretTree)(Value *) = interpret;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--cek")) {
+            interpretTree = interpretCEK;
+        } else if (!strcmp(argv[i], "--bytecode")) {
+            interpretTree = interpretBytecode;
+        } else if (!strcmp(argv[i], "--closures")) {
+            interpretTree = interpretClosures;
+        } else if (!strcmp(argv[i], "--emit-c")) {
+            interpretTree = translateToC;
+        } else if (!strcmp(argv[i], "--no-jit")) {
+            setJitEnabled(false);
+        } else if (!strcmp(argv[i], "--no-simd")) {
+            setSimdEnabled(false);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
 
+    initOutput();
     Value *list = tokenize(stdin);
     Value *tree = parse(list);
     // printTree(tree);
     // printf("\n");
-    interpret(tree);
+    interpretTree(tree);
 
     tfree();
     return 0;
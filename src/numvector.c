@@ -0,0 +1,656 @@
+// Numeric vectors and their bulk operations.
+//
+// Each operation that has a SIMD version goes through a table of kernels,
+// chosen the first time one is needed: AVX2 if the processor has it, and
+// otherwise SSE2, which every x86-64 processor has. Elsewhere, or with
+// --no-simd, the table holds the scalar code. The SIMD kernels work on four
+// or two elements at a time with unaligned loads, and leave the elements
+// after the last full block to the scalar code.
+//
+// Reductions of doubles are defined by the four-lane order described in
+// numvector.h, which the scalar code follows too, so every kernel gives the
+// same bits. Operations on longs check for overflow: element-wise ones fail,
+// and sums and dot products start over with bignums.
+
+#include "numvector.h"
+#include <string.h>
+#include <limits.h>
+#include "talloc.h"
+#include "bignum.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_SUPPORTED 1
+#include <immintrin.h>
+#else
+#define SIMD_SUPPORTED 0
+#endif
+
+// How many lanes the reductions of doubles are split into
+#define LANES 4
+
+typedef enum { ADD_ELEMENTS, SUBTRACT_ELEMENTS, MULTIPLY_ELEMENTS,
+               DIVIDE_ELEMENTS } ElementOp;
+
+typedef struct Kernels {
+    void (*binaryF64)(ElementOp op, double *result, double *a, double *b,
+                      long length);
+    void (*scaleF64)(double *result, double *a, double factor, long length);
+    // Reductions: these fill in the lanes from the full blocks of four, and
+    // return how many elements that covered
+    long (*sumLanesF64)(double *lanes, double *a, long length);
+    long (*dotLanesF64)(double *lanes, double *a, double *b, long length);
+    long (*extremeLanesF64)(double *lanes, double *a, long length, bool max);
+    // Addition and subtraction only; false on overflow
+    bool (*binaryS64)(ElementOp op, long *result, long *a, long *b,
+                      long length);
+    // False on overflow
+    bool (*sumS64)(long *a, long length, long *sum);
+    long (*extremeS64)(long *a, long length, bool max);
+} Kernels;
+
+//==================
+// Numeric vectors
+//==================
+
+Value *makeF64Vector(long length, double fill) {
+    if (length > LONG_MAX / (long) sizeof(double)) {
+        return NULL;
+    }
+    double *doubles = talloc(sizeof(double) * (length > 0 ? length : 1));
+    if (doubles == NULL) {
+        return NULL;
+    }
+    Value *result = makeValue(F64VECTOR_TYPE);
+    result->packed.doubles = doubles;
+    result->packed.length = length;
+    for (long i = 0; i < length; i++) {
+        result->packed.doubles[i] = fill;
+    }
+    return result;
+}
+
+Value *makeS64Vector(long length, long fill) {
+    if (length > LONG_MAX / (long) sizeof(long)) {
+        return NULL;
+    }
+    long *longs = talloc(sizeof(long) * (length > 0 ? length : 1));
+    if (longs == NULL) {
+        return NULL;
+    }
+    Value *result = makeValue(S64VECTOR_TYPE);
+    result->packed.longs = longs;
+    result->packed.length = length;
+    for (long i = 0; i < length; i++) {
+        result->packed.longs[i] = fill;
+    }
+    return result;
+}
+
+//==================
+// Scalar kernels
+//==================
+
+void binaryF64Scalar(ElementOp op, double *result, double *a, double *b,
+                     long length) {
+    switch (op) {
+        case ADD_ELEMENTS:
+            for (long i = 0; i < length; i++) {
+                result[i] = a[i] + b[i];
+            }
+            break;
+        case SUBTRACT_ELEMENTS:
+            for (long i = 0; i < length; i++) {
+                result[i] = a[i] - b[i];
+            }
+            break;
+        case MULTIPLY_ELEMENTS:
+            for (long i = 0; i < length; i++) {
+                result[i] = a[i] * b[i];
+            }
+            break;
+        case DIVIDE_ELEMENTS:
+            for (long i = 0; i < length; i++) {
+                result[i] = a[i] / b[i];
+            }
+            break;
+    }
+}
+
+void scaleF64Scalar(double *result, double *a, double factor, long length) {
+    for (long i = 0; i < length; i++) {
+        result[i] = a[i] * factor;
+    }
+}
+
+long sumLanesF64Scalar(double *lanes, double *a, long length) {
+    long i = 0;
+    for (; i + LANES <= length; i += LANES) {
+        for (int lane = 0; lane < LANES; lane++) {
+            lanes[lane] += a[i + lane];
+        }
+    }
+    return i;
+}
+
+long dotLanesF64Scalar(double *lanes, double *a, double *b, long length) {
+    long i = 0;
+    for (; i + LANES <= length; i += LANES) {
+        for (int lane = 0; lane < LANES; lane++) {
+            lanes[lane] += a[i + lane] * b[i + lane];
+        }
+    }
+    return i;
+}
+
+// The smaller of two doubles the way MINPD picks it: the second unless the
+// first is less. MAXPD likewise.
+double minOf(double x, double y) {
+    return x < y ? x : y;
+}
+
+double maxOf(double x, double y) {
+    return x > y ? x : y;
+}
+
+// Lanes start at the first four elements, so length must be at least four
+long extremeLanesF64Scalar(double *lanes, double *a, long length, bool max) {
+    memcpy(lanes, a, sizeof(double) * LANES);
+    long i = LANES;
+    for (; i + LANES <= length; i += LANES) {
+        for (int lane = 0; lane < LANES; lane++) {
+            lanes[lane] = max ? maxOf(lanes[lane], a[i + lane])
+                              : minOf(lanes[lane], a[i + lane]);
+        }
+    }
+    return i;
+}
+
+bool binaryS64Scalar(ElementOp op, long *result, long *a, long *b,
+                     long length) {
+    for (long i = 0; i < length; i++) {
+        bool overflow = op == ADD_ELEMENTS
+            ? __builtin_add_overflow(a[i], b[i], &result[i])
+            : __builtin_sub_overflow(a[i], b[i], &result[i]);
+        if (overflow) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sumS64Scalar(long *a, long length, long *sum) {
+    long total = 0;
+    for (long i = 0; i < length; i++) {
+        if (__builtin_add_overflow(total, a[i], &total)) {
+            return false;
+        }
+    }
+    *sum = total;
+    return true;
+}
+
+long extremeS64Scalar(long *a, long length, bool max) {
+    long extreme = a[0];
+    for (long i = 1; i < length; i++) {
+        if (max ? a[i] > extreme : a[i] < extreme) {
+            extreme = a[i];
+        }
+    }
+    return extreme;
+}
+
+static const Kernels scalarKernels = {
+    binaryF64Scalar, scaleF64Scalar, sumLanesF64Scalar, dotLanesF64Scalar,
+    extremeLanesF64Scalar, binaryS64Scalar, sumS64Scalar, extremeS64Scalar
+};
+
+#if SIMD_SUPPORTED
+
+//==================
+// SSE2 kernels
+//==================
+
+void binaryF64Sse2(ElementOp op, double *result, double *a, double *b,
+                   long length) {
+    long i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        __m128d y = _mm_loadu_pd(b + i);
+        switch (op) {
+            case ADD_ELEMENTS:      x = _mm_add_pd(x, y); break;
+            case SUBTRACT_ELEMENTS: x = _mm_sub_pd(x, y); break;
+            case MULTIPLY_ELEMENTS: x = _mm_mul_pd(x, y); break;
+            case DIVIDE_ELEMENTS:   x = _mm_div_pd(x, y); break;
+        }
+        _mm_storeu_pd(result + i, x);
+    }
+    binaryF64Scalar(op, result + i, a + i, b + i, length - i);
+}
+
+void scaleF64Sse2(double *result, double *a, double factor, long length) {
+    __m128d factors = _mm_set1_pd(factor);
+    long i = 0;
+    for (; i + 2 <= length; i += 2) {
+        _mm_storeu_pd(result + i, _mm_mul_pd(_mm_loadu_pd(a + i), factors));
+    }
+    scaleF64Scalar(result + i, a + i, factor, length - i);
+}
+
+// Lanes 0 and 1 are in low, 2 and 3 in high
+long sumLanesF64Sse2(double *lanes, double *a, long length) {
+    __m128d low = _mm_loadu_pd(lanes);
+    __m128d high = _mm_loadu_pd(lanes + 2);
+    long i = 0;
+    for (; i + LANES <= length; i += LANES) {
+        low = _mm_add_pd(low, _mm_loadu_pd(a + i));
+        high = _mm_add_pd(high, _mm_loadu_pd(a + i + 2));
+    }
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+    return i;
+}
+
+long dotLanesF64Sse2(double *lanes, double *a, double *b, long length) {
+    __m128d low = _mm_loadu_pd(lanes);
+    __m128d high = _mm_loadu_pd(lanes + 2);
+    long i = 0;
+    for (; i + LANES <= length; i += LANES) {
+        low = _mm_add_pd(low, _mm_mul_pd(_mm_loadu_pd(a + i),
+                                         _mm_loadu_pd(b + i)));
+        high = _mm_add_pd(high, _mm_mul_pd(_mm_loadu_pd(a + i + 2),
+                                           _mm_loadu_pd(b + i + 2)));
+    }
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+    return i;
+}
+
+long extremeLanesF64Sse2(double *lanes, double *a, long length, bool max) {
+    __m128d low = _mm_loadu_pd(a);
+    __m128d high = _mm_loadu_pd(a + 2);
+    long i = LANES;
+    for (; i + LANES <= length; i += LANES) {
+        __m128d nextLow = _mm_loadu_pd(a + i);
+        __m128d nextHigh = _mm_loadu_pd(a + i + 2);
+        low = max ? _mm_max_pd(low, nextLow) : _mm_min_pd(low, nextLow);
+        high = max ? _mm_max_pd(high, nextHigh) : _mm_min_pd(high, nextHigh);
+    }
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+    return i;
+}
+
+/* Adds or subtracts longs two at a time. A sum overflowed if it has a
+ * different sign from both operands, and a difference if the operands have
+ * different signs and it has a different sign from the first; the sign
+ * bits of those tests are gathered in overflow and checked at the end.
+ */
+bool binaryS64Sse2(ElementOp op, long *result, long *a, long *b,
+                   long length) {
+    __m128i overflow = _mm_setzero_si128();
+    long i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128i x = _mm_loadu_si128((__m128i *) (a + i));
+        __m128i y = _mm_loadu_si128((__m128i *) (b + i));
+        __m128i r;
+        if (op == ADD_ELEMENTS) {
+            r = _mm_add_epi64(x, y);
+            overflow = _mm_or_si128(overflow,
+                _mm_and_si128(_mm_xor_si128(x, r), _mm_xor_si128(y, r)));
+        } else {
+            r = _mm_sub_epi64(x, y);
+            overflow = _mm_or_si128(overflow,
+                _mm_and_si128(_mm_xor_si128(x, y), _mm_xor_si128(x, r)));
+        }
+        _mm_storeu_si128((__m128i *) (result + i), r);
+    }
+    if (_mm_movemask_pd(_mm_castsi128_pd(overflow)) != 0) {
+        return false;
+    }
+    return binaryS64Scalar(op, result + i, a + i, b + i, length - i);
+}
+
+static const Kernels sse2Kernels = {
+    binaryF64Sse2, scaleF64Sse2, sumLanesF64Sse2, dotLanesF64Sse2,
+    extremeLanesF64Sse2, binaryS64Sse2, sumS64Scalar, extremeS64Scalar
+};
+
+//==================
+// AVX2 kernels
+//==================
+
+__attribute__((target("avx2")))
+void binaryF64Avx2(ElementOp op, double *result, double *a, double *b,
+                   long length) {
+    long i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        __m256d y = _mm256_loadu_pd(b + i);
+        switch (op) {
+            case ADD_ELEMENTS:      x = _mm256_add_pd(x, y); break;
+            case SUBTRACT_ELEMENTS: x = _mm256_sub_pd(x, y); break;
+            case MULTIPLY_ELEMENTS: x = _mm256_mul_pd(x, y); break;
+            case DIVIDE_ELEMENTS:   x = _mm256_div_pd(x, y); break;
+        }
+        _mm256_storeu_pd(result + i, x);
+    }
+    binaryF64Scalar(op, result + i, a + i, b + i, length - i);
+}
+
+__attribute__((target("avx2")))
+void scaleF64Avx2(double *result, double *a, double factor, long length) {
+    __m256d factors = _mm256_set1_pd(factor);
+    long i = 0;
+    for (; i + 4 <= length; i += 4) {
+        _mm256_storeu_pd(result + i,
+                         _mm256_mul_pd(_mm256_loadu_pd(a + i), factors));
+    }
+    scaleF64Scalar(result + i, a + i, factor, length - i);
+}
+
+__attribute__((target("avx2")))
+long sumLanesF64Avx2(double *lanes, double *a, long length) {
+    __m256d sums = _mm256_loadu_pd(lanes);
+    long i = 0;
+    for (; i + LANES <= length; i += LANES) {
+        sums = _mm256_add_pd(sums, _mm256_loadu_pd(a + i));
+    }
+    _mm256_storeu_pd(lanes, sums);
+    return i;
+}
+
+__attribute__((target("avx2")))
+long dotLanesF64Avx2(double *lanes, double *a, double *b, long length) {
+    __m256d sums = _mm256_loadu_pd(lanes);
+    long i = 0;
+    for (; i + LANES <= length; i += LANES) {
+        // Not fused, so every kernel rounds the product the same way
+        sums = _mm256_add_pd(sums, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+                                                 _mm256_loadu_pd(b + i)));
+    }
+    _mm256_storeu_pd(lanes, sums);
+    return i;
+}
+
+__attribute__((target("avx2")))
+long extremeLanesF64Avx2(double *lanes, double *a, long length, bool max) {
+    __m256d extremes = _mm256_loadu_pd(a);
+    long i = LANES;
+    for (; i + LANES <= length; i += LANES) {
+        __m256d next = _mm256_loadu_pd(a + i);
+        extremes = max ? _mm256_max_pd(extremes, next)
+                       : _mm256_min_pd(extremes, next);
+    }
+    _mm256_storeu_pd(lanes, extremes);
+    return i;
+}
+
+// See binaryS64Sse2 for the overflow tests
+__attribute__((target("avx2")))
+bool binaryS64Avx2(ElementOp op, long *result, long *a, long *b,
+                   long length) {
+    __m256i overflow = _mm256_setzero_si256();
+    long i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+        __m256i y = _mm256_loadu_si256((__m256i *) (b + i));
+        __m256i r;
+        if (op == ADD_ELEMENTS) {
+            r = _mm256_add_epi64(x, y);
+            overflow = _mm256_or_si256(overflow,
+                _mm256_and_si256(_mm256_xor_si256(x, r),
+                                 _mm256_xor_si256(y, r)));
+        } else {
+            r = _mm256_sub_epi64(x, y);
+            overflow = _mm256_or_si256(overflow,
+                _mm256_and_si256(_mm256_xor_si256(x, y),
+                                 _mm256_xor_si256(x, r)));
+        }
+        _mm256_storeu_si256((__m256i *) (result + i), r);
+    }
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)) != 0) {
+        return false;
+    }
+    return binaryS64Scalar(op, result + i, a + i, b + i, length - i);
+}
+
+// Sums in four lanes, checking each addition for overflow. An overflow in a
+// lane doesn't mean the total overflows, but the caller starts over exactly
+// either way.
+__attribute__((target("avx2")))
+bool sumS64Avx2(long *a, long length, long *sum) {
+    __m256i sums = _mm256_setzero_si256();
+    __m256i overflow = _mm256_setzero_si256();
+    long i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+        __m256i r = _mm256_add_epi64(sums, x);
+        overflow = _mm256_or_si256(overflow,
+            _mm256_and_si256(_mm256_xor_si256(sums, r),
+                             _mm256_xor_si256(x, r)));
+        sums = r;
+    }
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)) != 0) {
+        return false;
+    }
+    long lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, sums);
+    long total;
+    if (!sumS64Scalar(a + i, length - i, &total)) {
+        return false;
+    }
+    for (int lane = 0; lane < 4; lane++) {
+        if (__builtin_add_overflow(total, lanes[lane], &total)) {
+            return false;
+        }
+    }
+    *sum = total;
+    return true;
+}
+
+__attribute__((target("avx2")))
+long extremeS64Avx2(long *a, long length, bool max) {
+    if (length < 4) {
+        return extremeS64Scalar(a, length, max);
+    }
+    __m256i extremes = _mm256_loadu_si256((__m256i *) a);
+    long i = 4;
+    for (; i + 4 <= length; i += 4) {
+        __m256i next = _mm256_loadu_si256((__m256i *) (a + i));
+        // Take next in the lanes where it is further out
+        __m256i further = max ? _mm256_cmpgt_epi64(next, extremes)
+                              : _mm256_cmpgt_epi64(extremes, next);
+        extremes = _mm256_blendv_epi8(extremes, next, further);
+    }
+    long lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, extremes);
+    long extreme = extremeS64Scalar(lanes, 4, max);
+    if (i < length) {
+        long rest = extremeS64Scalar(a + i, length - i, max);
+        extreme = max ? (rest > extreme ? rest : extreme)
+                      : (rest < extreme ? rest : extreme);
+    }
+    return extreme;
+}
+
+static const Kernels avx2Kernels = {
+    binaryF64Avx2, scaleF64Avx2, sumLanesF64Avx2, dotLanesF64Avx2,
+    extremeLanesF64Avx2, binaryS64Avx2, sumS64Avx2, extremeS64Avx2
+};
+
+#endif
+
+//==================
+// Kernel selection
+//==================
+
+static bool simdEnabled = true;
+static const Kernels *kernels = NULL;
+
+void setSimdEnabled(bool enabled) {
+    simdEnabled = enabled;
+    kernels = NULL;
+}
+
+const Kernels *getKernels() {
+    if (kernels == NULL) {
+        kernels = &scalarKernels;
+#if SIMD_SUPPORTED
+        if (simdEnabled) {
+            __builtin_cpu_init();
+            kernels = __builtin_cpu_supports("avx2") ? &avx2Kernels
+                                                     : &sse2Kernels;
+        }
+#endif
+    }
+    return kernels;
+}
+
+//==================
+// Bulk operations
+//==================
+
+void addF64(double *result, double *a, double *b, long length) {
+    getKernels()->binaryF64(ADD_ELEMENTS, result, a, b, length);
+}
+
+void subtractF64(double *result, double *a, double *b, long length) {
+    getKernels()->binaryF64(SUBTRACT_ELEMENTS, result, a, b, length);
+}
+
+void multiplyF64(double *result, double *a, double *b, long length) {
+    getKernels()->binaryF64(MULTIPLY_ELEMENTS, result, a, b, length);
+}
+
+void divideF64(double *result, double *a, double *b, long length) {
+    getKernels()->binaryF64(DIVIDE_ELEMENTS, result, a, b, length);
+}
+
+void scaleF64(double *result, double *a, double factor, long length) {
+    getKernels()->scaleF64(result, a, factor, length);
+}
+
+bool addS64(long *result, long *a, long *b, long length) {
+    return getKernels()->binaryS64(ADD_ELEMENTS, result, a, b, length);
+}
+
+bool subtractS64(long *result, long *a, long *b, long length) {
+    return getKernels()->binaryS64(SUBTRACT_ELEMENTS, result, a, b, length);
+}
+
+// There is no 64-bit multiplication in AVX2, so these are always scalar
+bool multiplyS64(long *result, long *a, long *b, long length) {
+    for (long i = 0; i < length; i++) {
+        if (__builtin_mul_overflow(a[i], b[i], &result[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool scaleS64(long *result, long *a, long factor, long length) {
+    for (long i = 0; i < length; i++) {
+        if (__builtin_mul_overflow(a[i], factor, &result[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Adds up the lanes, pairwise, and then the elements after the last full
+// block, one by one.
+double finishSum(double *lanes, double *rest, long length) {
+    double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (long i = 0; i < length; i++) {
+        sum += rest[i];
+    }
+    return sum;
+}
+
+double sumF64(double *a, long length) {
+    double lanes[LANES] = {0, 0, 0, 0};
+    long done = getKernels()->sumLanesF64(lanes, a, length);
+    return finishSum(lanes, a + done, length - done);
+}
+
+double dotF64(double *a, double *b, long length) {
+    double lanes[LANES] = {0, 0, 0, 0};
+    long done = getKernels()->dotLanesF64(lanes, a, b, length);
+    double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (long i = done; i < length; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// Combines the lanes pairwise like finishSum, then goes through the rest.
+// Vectors shorter than a block have no lanes.
+double extremeF64(double *a, long length, bool max) {
+    double extreme;
+    long done;
+    if (length < LANES) {
+        extreme = a[0];
+        done = 1;
+    } else {
+        double lanes[LANES];
+        done = getKernels()->extremeLanesF64(lanes, a, length, max);
+        extreme = max ? maxOf(maxOf(lanes[0], lanes[1]),
+                              maxOf(lanes[2], lanes[3]))
+                      : minOf(minOf(lanes[0], lanes[1]),
+                              minOf(lanes[2], lanes[3]));
+    }
+    for (long i = done; i < length; i++) {
+        extreme = max ? maxOf(extreme, a[i]) : minOf(extreme, a[i]);
+    }
+    return extreme;
+}
+
+double minF64(double *a, long length) {
+    return extremeF64(a, length, false);
+}
+
+double maxF64(double *a, long length) {
+    return extremeF64(a, length, true);
+}
+
+long minS64(long *a, long length) {
+    return getKernels()->extremeS64(a, length, false);
+}
+
+long maxS64(long *a, long length) {
+    return getKernels()->extremeS64(a, length, true);
+}
+
+Value *sumS64(long *a, long length) {
+    long sum;
+    if (getKernels()->sumS64(a, length, &sum)) {
+        return makeInt(sum);
+    }
+    Value *exactSum = makeInt(0);
+    for (long i = 0; i < length; i++) {
+        exactSum = addIntegers(exactSum, makeInt(a[i]));
+    }
+    return exactSum;
+}
+
+Value *dotS64(long *a, long *b, long length) {
+    long sum = 0;
+    long i = 0;
+    for (; i < length; i++) {
+        long product;
+        if (__builtin_mul_overflow(a[i], b[i], &product)
+            || __builtin_add_overflow(sum, product, &sum)) {
+            break;
+        }
+    }
+    if (i == length) {
+        return makeInt(sum);
+    }
+
+    Value *exactSum = makeInt(0);
+    for (i = 0; i < length; i++) {
+        exactSum = addIntegers(exactSum,
+                               multiplyIntegers(makeInt(a[i]), makeInt(b[i])));
+    }
+    return exactSum;
+}
@@ -0,0 +1,57 @@
+#ifndef _NUMVECTOR
+#define _NUMVECTOR
+
+#include <stdbool.h>
+#include "value.h"
+
+// Numeric vectors: F64VECTOR_TYPE Values hold doubles and S64VECTOR_TYPE
+// Values hold longs, unboxed, in one array. The bulk operations below run
+// SIMD kernels, chosen the first time one is used by what the processor
+// supports, with scalar code where there is no kernel.
+//
+// Sums, dot products, minimums and maximums of doubles are worked out in
+// four interleaved lanes that are combined at the end, whichever kernel
+// runs, so the result is the same on every machine, but may differ in the
+// last bits from adding the elements up one by one.
+
+// Create a new F64VECTOR_TYPE Value of length elements, each of them fill.
+// Returns NULL if there isn't memory for that many.
+Value *makeF64Vector(long length, double fill);
+
+// Create a new S64VECTOR_TYPE Value of length elements, each of them fill.
+// Returns NULL if there isn't memory for that many.
+Value *makeS64Vector(long length, long fill);
+
+// Turns the SIMD kernels on or off, for testing the scalar code. They start
+// on where the processor has them.
+void setSimdEnabled(bool enabled);
+
+// The element-wise operations put the result for each index of a and b
+// into result, which may be one of them. The ones on longs return false,
+// leaving result partly written, if any element overflows.
+void addF64(double *result, double *a, double *b, long length);
+void subtractF64(double *result, double *a, double *b, long length);
+void multiplyF64(double *result, double *a, double *b, long length);
+void divideF64(double *result, double *a, double *b, long length);
+void scaleF64(double *result, double *a, double factor, long length);
+bool addS64(long *result, long *a, long *b, long length);
+bool subtractS64(long *result, long *a, long *b, long length);
+bool multiplyS64(long *result, long *a, long *b, long length);
+bool scaleS64(long *result, long *a, long factor, long length);
+
+double sumF64(double *a, long length);
+double dotF64(double *a, double *b, long length);
+
+// The ones on longs return an integer Value, which is a bignum if the
+// result doesn't fit in a long.
+Value *sumS64(long *a, long length);
+Value *dotS64(long *a, long *b, long length);
+
+// The smallest or largest element; length must be at least 1. If some of
+// the doubles are NaNs, the result may or may not be one.
+double minF64(double *a, long length);
+double maxF64(double *a, long length);
+long minS64(long *a, long length);
+long maxS64(long *a, long length);
+
+#endif
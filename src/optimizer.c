@@ -0,0 +1,729 @@
+// Optimizations on expanded code, done before it runs.
+//
+// Constant folding needs to know that a name like + still means the
+// primitive when the code runs. analyzeProgram finds every name the program
+// could redefine, by looking for define and set! of it anywhere in the
+// program and in the files it loads. A load whose file can't be known ahead
+// of time could redefine anything, so it turns folding off.
+//
+// The same analysis finds the globals that are defined at most once and
+// never set!. Their values can be put straight into the code that uses them
+// (see inlineGlobalValue), and calls to a primitive that is never redefined
+// can call it directly. A load that can't be known ahead of time doesn't
+// stop this: if a global turns out to change after all, the interpreter puts
+// the names back with deoptimizeGlobal.
+//
+// Small procedures defined at top level are inlined: a call to one, with
+// arguments that are constants or local variables, is replaced by a copy of
+// its body with the arguments put in place of the parameters. The copy's own
+// lambda parameters get fresh names, with a # in them so they can't be
+// written in a program, and the inlining is skipped where the call site
+// binds a name the body uses as a global.
+//
+// A procedure bound by a let, and only ever called in its body, doesn't need
+// to be a closure over the let's surroundings: the variables it captures are
+// passed to it as extra arguments instead. It then has nothing to capture,
+// so eval makes its closure only once (see makeClosure).
+
+#include "optimizer.h"
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "linkedlist.h"
+#include "parser.h"
+#include "talloc.h"
+#include "tokenizer.h"
+#include "interpreter.h"
+
+// The names the program might redefine, bound to nothing in particular
+static Frame *redefinedNames = NULL;
+
+// The names the program defines or sets more than once, which can't be
+// treated as constants
+static Frame *changedNames = NULL;
+
+// The names defined in loaded files, which could be loaded more than once
+static Frame *loadedNames = NULL;
+
+// Whether the program loads a file that analyzeProgram couldn't read
+static bool unknownLoad = false;
+
+// Whether analyzeExpr is looking at a loaded file rather than the program
+static bool inLoadedFile = false;
+
+// The top-level procedures small enough to inline, bound to their lambda
+// expressions and the globals they use: (lambda globals...)
+static Frame *inlinableProcedures = NULL;
+
+// The files already looked at, so that files that load each other are only
+// read once
+static Value *analyzedFiles = NULL;
+
+//==================
+// Analysis
+//==================
+
+// Checks whether symbol is bound in frame or any of its parents.
+bool isBoundInScope(Value *symbol, Frame *scope) {
+    while (scope != NULL) {
+        if (lookupBindingInFrame(symbol, scope) != NULL) {
+            return true;
+        }
+        scope = scope->parent;
+    }
+    return false;
+}
+
+// Adds symbol to a set of names, kept as a frame.
+void addName(Value *symbol, Frame *names) {
+    if (lookupBindingInFrame(symbol, names) == NULL) {
+        addBinding(symbol, makeVoid(), names);
+    }
+}
+
+/* Records that the program might redefine symbol.
+ *
+ * isSet: whether it is a set! rather than a define. A name stops being a
+ *        constant at its first set! or its second define.
+ */
+void addRedefinedName(Value *symbol, bool isSet) {
+    if (isSet || lookupBindingInFrame(symbol, redefinedNames) != NULL) {
+        addName(symbol, changedNames);
+    }
+    addName(symbol, redefinedNames);
+}
+
+bool isConstantGlobal(Value *symbol) {
+    return changedNames != NULL
+        && lookupBindingInFrame(symbol, changedNames) == NULL;
+}
+
+void forgetConstantGlobal(Value *symbol) {
+    if (changedNames != NULL) {
+        addName(symbol, changedNames);
+    }
+}
+
+void analyzeExpr(Value *expr);
+
+// Reads the file a load expression names, if it is a literal file name, and
+// analyzes it as part of the program.
+void analyzeLoad(Value *args) {
+    if (!isCons(args) || !isString(car(args))) {
+        unknownLoad = true;
+        return;
+    }
+
+    char *path = car(args)->s;
+    for (Value *file = analyzedFiles; !isNull(file); file = cdr(file)) {
+        if (!strcmp(car(file)->s, path)) {
+            return;
+        }
+    }
+    analyzedFiles = cons(car(args), analyzedFiles);
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        // Loading it will fail, but only if that code runs
+        unknownLoad = true;
+        return;
+    }
+    Value *tree = tokenize(fp);
+    fclose(fp);
+    bool wasInLoadedFile = inLoadedFile;
+    inLoadedFile = true;
+    analyzeExpr(parse(tree));
+    inLoadedFile = wasInLoadedFile;
+}
+
+// Finds the define, set! and load expressions in expr, which hasn't been
+// expanded, so it is looked at as plain data.
+void analyzeExpr(Value *expr) {
+    if (!isCons(expr)) {
+        return;
+    }
+
+    Value *first = car(expr);
+    if (isSymbol(first) && isCons(cdr(expr))) {
+        Value *target = car(cdr(expr));
+        if (!strcmp(first->s, "quote")) {
+            return;
+        } else if (!strcmp(first->s, "define") || !strcmp(first->s, "set!")) {
+            // (define name ...), (define (name ...) ...), (set! name ...)
+            if (isCons(target)) {
+                target = car(target);
+            }
+            if (isSymbol(target)) {
+                addRedefinedName(target, !strcmp(first->s, "set!"));
+                if (inLoadedFile) {
+                    addName(target, loadedNames);
+                }
+            }
+        } else if (!strcmp(first->s, "load")) {
+            analyzeLoad(cdr(expr));
+        }
+    }
+
+    for (; isCons(expr); expr = cdr(expr)) {
+        analyzeExpr(car(expr));
+    }
+}
+
+void analyzeProgram(Value *tree) {
+    redefinedNames = makeFrame(NULL);
+    changedNames = makeFrame(NULL);
+    loadedNames = makeFrame(NULL);
+    inlinableProcedures = makeFrame(NULL);
+    unknownLoad = false;
+    inLoadedFile = false;
+    analyzedFiles = makeNull();
+    analyzeExpr(tree);
+}
+
+//==================
+// Inlining
+//==================
+
+// The most atoms a procedure body can have and still be inlined
+#define INLINE_SIZE_LIMIT 24
+
+// How many inlined calls can be nested inside each other's bodies, which
+// also stops procedures that call each other from being inlined forever
+#define INLINE_DEPTH_LIMIT 3
+
+// How many inlined calls are being folded right now, one inside another
+static int inlineDepth = 0;
+
+// Counts the fresh names made, to keep them unique
+static int freshNameCount = 0;
+
+bool isConstant(Value *expr);
+
+// Returns a name for a copy of the variable symbol that can't clash with any
+// other name. A name that is already a copy keeps its original part.
+Value *makeFreshName(Value *symbol) {
+    char *name = talloc(strlen(symbol->s) + 16);
+    strcpy(name, symbol->s);
+    char *suffix = strchr(name, '#');
+    if (suffix == NULL) {
+        suffix = name + strlen(name);
+    }
+    sprintf(suffix, "#%i", ++freshNameCount);
+    return makeSymbol(name);
+}
+
+// Checks whether an expanded expression is a special form with the given
+// keyword. Its cells may hold values put there by inlineGlobalValue, so they
+// are read through sourceExpr.
+bool isForm(Value *expr, char *keyword) {
+    return isCons(expr) && isSymbol(sourceExpr(expr))
+        && !strcmp(sourceExpr(expr)->s, keyword);
+}
+
+/* Checks whether a procedure body can be inlined, and counts its size.
+ *
+ * Bodies that define, set! or load anything are left alone, and so are
+ * bodies that call the procedure itself, named name.
+ * size: incremented for each atom in expr.
+ */
+bool isInlinableExpr(Value *expr, Value *name, int *size) {
+    if (!isCons(expr)) {
+        (*size)++;
+        return !isSymbol(expr) || strcmp(expr->s, name->s);
+    }
+    if (isForm(expr, "quote")) {
+        (*size)++;
+        return true;
+    }
+    if (isForm(expr, "define") || isForm(expr, "set!")
+        || isForm(expr, "load")) {
+        return false;
+    }
+    for (Value *cell = expr; isCons(cell); cell = cdr(cell)) {
+        if (!isInlinableExpr(sourceExpr(cell), name, size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Adds the lambda parameters params to a new frame whose parent is scope,
+// each bound to value, or to a fresh name if value is NULL.
+Frame *bindParams(Value *params, Value *value, Frame *scope) {
+    Frame *lambdaScope = makeFrame(scope);
+    if (isSymbol(params)) {
+        addBinding(params, value ? value : makeFreshName(params), lambdaScope);
+        return lambdaScope;
+    }
+    for (; isCons(params); params = cdr(params)) {
+        Value *param = car(params);
+        addBinding(param, value ? value : makeFreshName(param), lambdaScope);
+    }
+    return lambdaScope;
+}
+
+// Adds the symbols used in expr that aren't bound in scope, or by a lambda
+// inside expr, to the list *globals.
+void collectGlobals(Value *expr, Frame *scope, Value **globals) {
+    if (isSymbol(expr)) {
+        if (!isBoundInScope(expr, scope)) {
+            *globals = cons(expr, *globals);
+        }
+        return;
+    }
+    if (!isCons(expr) || isForm(expr, "quote")) {
+        return;
+    }
+    if (isForm(expr, "lambda")) {
+        Frame *lambdaScope = bindParams(car(cdr(expr)), makeVoid(), scope);
+        for (Value *cell = cdr(cdr(expr)); isCons(cell); cell = cdr(cell)) {
+            collectGlobals(sourceExpr(cell), lambdaScope, globals);
+        }
+        return;
+    }
+    for (Value *cell = expr; isCons(cell); cell = cdr(cell)) {
+        collectGlobals(sourceExpr(cell), scope, globals);
+    }
+}
+
+// Records a top-level form that defines a small procedure, so calls to it
+// folded from now on can be inlined.
+void recordInlinable(Value *form) {
+    if (!isForm(form, "define") || unknownLoad) {
+        return;
+    }
+    Value *name = car(cdr(form));
+    Value *lambda = car(cdr(cdr(form)));
+    if (!isForm(lambda, "lambda") || !isConstantGlobal(name)
+        || lookupBindingInFrame(name, loadedNames) != NULL) {
+        return;
+    }
+
+    int size = 0;
+    for (Value *cell = cdr(cdr(lambda)); isCons(cell); cell = cdr(cell)) {
+        if (!isInlinableExpr(sourceExpr(cell), name, &size)) {
+            return;
+        }
+    }
+    if (size > INLINE_SIZE_LIMIT) {
+        return;
+    }
+
+    Value *globals = makeNull();
+    collectGlobals(lambda, NULL, &globals);
+    addBinding(name, cons(lambda, globals), inlinableProcedures);
+}
+
+// Returns the binding symbol has in the renames made for an inlined body, or
+// symbol itself if it has none.
+Value *renameSymbol(Value *symbol, Frame *renames) {
+    for (; renames != NULL; renames = renames->parent) {
+        Value *binding = lookupBindingInFrame(symbol, renames);
+        if (binding != NULL) {
+            return car(binding);
+        }
+    }
+    return symbol;
+}
+
+Value *renameExpr(Value *expr, Frame *renames);
+
+// Returns a copy of the list exprs with each expression renamed.
+Value *renameEach(Value *exprs, Frame *renames) {
+    Value *result = makeNull();
+    for (; isCons(exprs); exprs = cdr(exprs)) {
+        result = cons(renameExpr(sourceExpr(exprs), renames), result);
+    }
+    return reverse(result);
+}
+
+/* Returns a copy of a procedure body for inlining.
+ *
+ * renames: what each variable becomes: the parameters of the procedure are
+ *          bound to the arguments of the call, and the parameters of the
+ *          lambdas inside it to fresh names as they are reached.
+ */
+Value *renameExpr(Value *expr, Frame *renames) {
+    if (isSymbol(expr)) {
+        return renameSymbol(expr, renames);
+    }
+    if (!isCons(expr) || isForm(expr, "quote")) {
+        return expr;
+    }
+    if (isForm(expr, "lambda")) {
+        Value *params = car(cdr(expr));
+        Frame *lambdaRenames = bindParams(params, NULL, renames);
+        Value *newParams;
+        if (isSymbol(params)) {
+            newParams = renameSymbol(params, lambdaRenames);
+        } else {
+            newParams = renameEach(params, lambdaRenames);
+        }
+        return cons(makeSymbol("lambda"),
+                    cons(newParams, renameEach(cdr(cdr(expr)), lambdaRenames)));
+    }
+    return renameEach(expr, renames);
+}
+
+/* Checks whether an argument can be put in place of a parameter, which may
+ * evaluate it any number of times, later than the call would have: it has
+ * to be a constant, or a local variable that is never set!.
+ */
+bool isSubstitutable(Value *arg, Frame *scope) {
+    if (isSymbol(arg)) {
+        return isBoundInScope(arg, scope)
+            && lookupBindingInFrame(arg, redefinedNames) == NULL;
+    }
+    return isConstant(arg);
+}
+
+// Returns the inlined body of a call whose arguments have been folded, or
+// NULL if it can't be inlined.
+Value *inlineCall(Value *call, Frame *scope) {
+    Value *operator = car(call);
+    if (!isSymbol(operator) || inlineDepth >= INLINE_DEPTH_LIMIT
+        || isBoundInScope(operator, scope) || !isConstantGlobal(operator)) {
+        return NULL;
+    }
+    Value *procedure = lookupBindingInFrame(operator, inlinableProcedures);
+    if (procedure == NULL) {
+        return NULL;
+    }
+    Value *lambda = car(car(procedure));
+    Value *params = car(cdr(lambda));
+    if (isSymbol(params) || length(params) != length(cdr(call))) {
+        return NULL;
+    }
+    for (Value *global = cdr(car(procedure)); !isNull(global);
+         global = cdr(global)) {
+        if (isBoundInScope(car(global), scope)) {
+            return NULL;
+        }
+    }
+
+    Frame *renames = makeFrame(NULL);
+    Value *arg = cdr(call);
+    for (; !isNull(params); params = cdr(params), arg = cdr(arg)) {
+        if (!isSubstitutable(car(arg), scope)) {
+            return NULL;
+        }
+        addBinding(car(params), car(arg), renames);
+    }
+
+    Value *body = renameEach(cdr(cdr(lambda)), renames);
+    if (isNull(cdr(body))) {
+        return car(body);
+    }
+    return cons(makeSymbol("begin"), body);
+}
+
+//==================
+// Lambda lifting
+//==================
+
+// The most variables a local procedure can capture and still be lifted
+#define LIFT_CAPTURE_LIMIT 4
+
+// Checks whether symbol is in the list symbols.
+bool isInList(Value *symbol, Value *symbols) {
+    for (; !isNull(symbols); symbols = cdr(symbols)) {
+        if (!strcmp(car(symbols)->s, symbol->s)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Checks whether a lambda parameter list binds any of the names in symbols.
+bool bindsAnyOf(Value *params, Value *symbols) {
+    if (isSymbol(params)) {
+        return isInList(params, symbols);
+    }
+    for (; isCons(params); params = cdr(params)) {
+        if (isInList(car(params), symbols)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Checks that a folded expression only uses the local procedure name as the
+ * operator of calls with numArgs arguments, and adds those calls to *calls.
+ *
+ * hidden: name and the variables it captures. A lambda inside that binds one
+ *         of them would change what a call means there, so that fails too.
+ */
+bool findLocalCalls(Value *expr, Value *name, int numArgs, Value *hidden,
+                    Value **calls) {
+    if (isSymbol(expr)) {
+        return strcmp(expr->s, name->s);
+    }
+    if (!isCons(expr) || isForm(expr, "quote")) {
+        return true;
+    }
+    if (isForm(expr, "lambda")) {
+        if (bindsAnyOf(car(cdr(expr)), hidden)) {
+            return false;
+        }
+        expr = cdr(cdr(expr));
+    } else if (isSymbol(car(expr)) && !strcmp(car(expr)->s, name->s)) {
+        if (length(cdr(expr)) != numArgs) {
+            return false;
+        }
+        *calls = cons(expr, *calls);
+        expr = cdr(expr);
+    }
+    for (; isCons(expr); expr = cdr(expr)) {
+        if (!findLocalCalls(car(expr), name, numArgs, hidden, calls)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Lifts one procedure bound by a folded let, if it can be.
+ *
+ * let: the let's (lambda names body...) expression.
+ * name: the name the procedure is bound to.
+ * argCell: the cell of the let whose car is the procedure's lambda expression;
+ *          it is replaced by a lambda that takes the captured variables as
+ *          extra parameters, and every call in the body is given them.
+ * scope: the variables bound around the let.
+ *
+ * The captured variables must never be set!, since the procedure now gets
+ * their values when it is called rather than sharing them.
+ */
+void liftLocalProcedure(Value *let, Value *name, Value *argCell,
+                        Frame *scope) {
+    Value *lambda = car(argCell);
+    if (!isForm(lambda, "lambda") || isSymbol(car(cdr(lambda)))
+        || lookupBindingInFrame(name, redefinedNames) != NULL) {
+        return;
+    }
+
+    Value *freeSymbols = makeNull();
+    collectGlobals(lambda, NULL, &freeSymbols);
+    Value *captured = makeNull();
+    int numCaptured = 0;
+    for (; !isNull(freeSymbols); freeSymbols = cdr(freeSymbols)) {
+        Value *symbol = car(freeSymbols);
+        if (!isBoundInScope(symbol, scope) || isInList(symbol, captured)) {
+            continue;
+        }
+        if (lookupBindingInFrame(symbol, redefinedNames) != NULL
+            || bindsAnyOf(car(cdr(let)), cons(symbol, makeNull()))
+            || ++numCaptured > LIFT_CAPTURE_LIMIT) {
+            return;
+        }
+        captured = cons(symbol, captured);
+    }
+    if (isNull(captured)) {
+        return;
+    }
+
+    Value *params = car(cdr(lambda));
+    Value *calls = makeNull();
+    Value *hidden = cons(name, captured);
+    for (Value *body = cdr(cdr(let)); !isNull(body); body = cdr(body)) {
+        if (!findLocalCalls(car(body), name, length(params), hidden, &calls)) {
+            return;
+        }
+    }
+
+    for (; !isNull(calls); calls = cdr(calls)) {
+        Value *call = car(calls);
+        call->c.cdr = append(cdr(call), captured);
+    }
+    argCell->c.car = cons(car(lambda),
+                          cons(append(params, captured), cdr(cdr(lambda))));
+}
+
+// Lifts the procedures bound by a folded let, ((lambda names body...)
+// exprs...), that can be lifted.
+void liftLocalProcedures(Value *call, Frame *scope) {
+    Value *let = car(call);
+    if (!isForm(let, "lambda")) {
+        return;
+    }
+    Value *names = car(cdr(let));
+    Value *argCell = cdr(call);
+    for (; isCons(names) && isCons(argCell);
+         names = cdr(names), argCell = cdr(argCell)) {
+        liftLocalProcedure(let, car(names), argCell, scope);
+    }
+}
+
+//==================
+// Folding
+//==================
+
+// Checks whether an expanded expression always evaluates to the same value:
+// a literal, or a quote.
+bool isConstant(Value *expr) {
+    if (isCons(expr)) {
+        return isSymbol(car(expr)) && !strcmp(car(expr)->s, "quote");
+    }
+    return isNumber(expr) || isString(expr)
+        || isBoolean(expr) || isNull(expr) || isVector(expr);
+}
+
+// Returns the value of a constant expression.
+Value *constantValue(Value *expr) {
+    if (isCons(expr)) {
+        return car(cdr(expr));
+    }
+    return expr;
+}
+
+// Returns an expression that evaluates to value.
+Value *makeLiteral(Value *value) {
+    if (isNumber(value) || isString(value)
+            || isBoolean(value) || isNull(value) || isVector(value)) {
+        return value;
+    }
+    return cons(makeSymbol("quote"), cons(value, makeNull()));
+}
+
+// Checks whether a call to the primitive can be made ahead of time without
+// failing. Integer division by zero and an index out of range stop with an
+// error rather than reporting it when the call runs, so they are left to
+// happen at run time.
+bool canFold(const PrimitiveDescriptor *descriptor, int argc, Value **argv) {
+    if (!descriptor->pure || !acceptsArguments(descriptor, argc, argv)) {
+        return false;
+    }
+    if (!strcmp(descriptor->name, "/") || !strcmp(descriptor->name, "modulo")) {
+        for (int i = 1; i < argc; i++) {
+            if (isInteger(argv[i]) && argv[i]->i == 0) {
+                return false;
+            }
+        }
+    }
+    if (!strcmp(descriptor->name, "vector-ref")) {
+        return argv[1]->i >= 0 && argv[1]->i < argv[0]->vector.length;
+    }
+    return true;
+}
+
+Value *foldExpr(Value *expr, Frame *scope);
+
+// Returns a copy of the list exprs with each expression folded.
+Value *foldEach(Value *exprs, Frame *scope) {
+    Value *result = makeNull();
+    while (isCons(exprs)) {
+        result = cons(foldExpr(car(exprs), scope), result);
+        exprs = cdr(exprs);
+    }
+    return reverse(result);
+}
+
+/* Folds a call whose arguments have been folded, if it is a call to a pure
+ * primitive with constant arguments. Returns the call otherwise.
+ *
+ * A call to a primitive that isn't folded, but has the right number of
+ * arguments, gets the primitive itself as its operator, so eval can call it
+ * without looking it up or checking the arity. That doesn't depend on the
+ * whole program being known, since deoptimizeGlobal undoes it.
+ */
+Value *foldCall(Value *call, Frame *scope) {
+    Value *operator = car(call);
+    if (!isSymbol(operator) || isBoundInScope(operator, scope)
+            || lookupBindingInFrame(operator, redefinedNames) != NULL
+            || !isConstantGlobal(operator)) {
+        return call;
+    }
+    const PrimitiveDescriptor *descriptor = lookUpPrimitive(operator->s);
+    if (descriptor == NULL) {
+        return call;
+    }
+
+    int argc = length(cdr(call));
+    if (!acceptsArity(descriptor, argc)) {
+        return call;
+    }
+    if (unknownLoad) {
+        inlineGlobalValue(call, makePrimitive(descriptor));
+        return call;
+    }
+    Value *argv[argc + 1];
+    int i = 0;
+    for (Value *arg = cdr(call); !isNull(arg); arg = cdr(arg)) {
+        if (!isConstant(car(arg))) {
+            inlineGlobalValue(call, makePrimitive(descriptor));
+            return call;
+        }
+        argv[i++] = constantValue(car(arg));
+    }
+    if (!canFold(descriptor, argc, argv)) {
+        inlineGlobalValue(call, makePrimitive(descriptor));
+        return call;
+    }
+    return makeLiteral(descriptor->function(argc, argv));
+}
+
+/* Folds an expanded expression.
+ *
+ * scope: the variables bound by the lambdas around expr, which may shadow
+ *        the primitives.
+ */
+Value *foldExpr(Value *expr, Frame *scope) {
+    if (!isCons(expr)) {
+        return expr;
+    }
+
+    Value *first = car(expr);
+    if (isSymbol(first)) {
+        if (!strcmp(first->s, "quote")) {
+            return expr;
+        } else if (!strcmp(first->s, "if")) {
+            Value *args = foldEach(cdr(expr), scope);
+            Value *condExpr = car(args);
+            if (isConstant(condExpr)) {
+                if (isTrue(constantValue(condExpr))) {
+                    return car(cdr(args));
+                }
+                return car(cdr(cdr(args)));
+            }
+            return cons(first, args);
+        } else if (!strcmp(first->s, "lambda")) {
+            Value *params = car(cdr(expr));
+            Frame *lambdaScope = makeFrame(scope);
+            if (isSymbol(params)) {
+                addBinding(params, makeVoid(), lambdaScope);
+            } else {
+                for (; !isNull(params); params = cdr(params)) {
+                    addBinding(car(params), makeVoid(), lambdaScope);
+                }
+            }
+            Value *body = foldEach(cdr(cdr(expr)), lambdaScope);
+            return cons(first, cons(car(cdr(expr)), body));
+        } else if (!strcmp(first->s, "define")
+                   || !strcmp(first->s, "set!")) {
+            Value *name = car(cdr(expr));
+            return cons(first, cons(name, foldEach(cdr(cdr(expr)), scope)));
+        } else if (!strcmp(first->s, "begin")
+                   || !strcmp(first->s, "display")
+                   || !strcmp(first->s, "load")) {
+            return cons(first, foldEach(cdr(expr), scope));
+        }
+    }
+
+    // An application
+    Value *call = foldEach(expr, scope);
+    liftLocalProcedures(call, scope);
+    Value *inlined = inlineCall(call, scope);
+    if (inlined != NULL) {
+        // The body may have calls to inline or fold in turn
+        inlineDepth++;
+        Value *result = foldExpr(inlined, scope);
+        inlineDepth--;
+        return result;
+    }
+    return foldCall(call, scope);
+}
+
+Value *foldConstants(Value *expr) {
+    Value *result = foldExpr(expr, NULL);
+    recordInlinable(result);
+    return result;
+}
@@ -0,0 +1,31 @@
+#ifndef _OPTIMIZER
+#define _OPTIMIZER
+
+#include <stdbool.h>
+#include "value.h"
+
+// Looks through a whole program, before any of it runs, for the globals it
+// might change with define or set!, including in files it loads by name. Must
+// be called before foldConstants.
+void analyzeProgram(Value *tree);
+
+// Returns an expanded expression (see expand()) with calls to pure primitives
+// on constant arguments replaced by their results, and ifs on a constant test
+// replaced by the branch that would run. A call is only folded if the
+// operator can only be the primitive: it isn't a local variable there and
+// the program never redefines it.
+//
+// Calls to small procedures defined at top level by earlier expressions are
+// inlined first, so their bodies are folded too.
+Value *foldConstants(Value *expr);
+
+// Checks whether a global is defined at most once and never set!, as far as
+// analyzeProgram and the program so far can tell, so its value can be put
+// straight into the code that uses it.
+bool isConstantGlobal(Value *symbol);
+
+// Records that a global turned out to change after all, so it is no longer
+// treated as a constant.
+void forgetConstantGlobal(Value *symbol);
+
+#endif
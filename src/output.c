@@ -0,0 +1,64 @@
+// Buffered output, for printing values.
+//
+// Printing a value used to take a printf for every parenthesis, space and
+// atom. These write straight into a large stdout buffer instead, with no
+// format string to parse. They still write through stdio rather than a
+// buffer of their own: error messages are printed with printf all over the
+// interpreter, and sharing stdout's buffer keeps them in order with the
+// output before them, with no flush needed before each one.
+
+#include "output.h"
+#include "dtoa.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// How much output is kept before it is written
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+static char outputBuffer[OUTPUT_BUFFER_SIZE];
+
+void initOutput() {
+    // A terminal is still written to a line at a time, like stdio does
+    int mode = isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF;
+    setvbuf(stdout, outputBuffer, mode, OUTPUT_BUFFER_SIZE);
+}
+
+void flushOutput() {
+    fflush(stdout);
+}
+
+void writeChar(char c) {
+    putchar_unlocked(c);
+}
+
+void writeString(const char *s) {
+    fwrite(s, 1, strlen(s), stdout);
+}
+
+void writeText(const char *s, long length) {
+    fwrite(s, 1, length, stdout);
+}
+
+void writeInteger(long value) {
+    // Digits are made from the end backwards; the most negative long can't
+    // be negated, so the digits of a negative number are made from negative
+    // remainders
+    char digits[24];
+    int start = sizeof(digits);
+    bool negative = value < 0;
+    do {
+        long digit = value % 10;
+        digits[--start] = '0' + (negative ? -digit : digit);
+        value /= 10;
+    } while (value != 0);
+    if (negative) {
+        digits[--start] = '-';
+    }
+    fwrite(digits + start, 1, sizeof(digits) - start, stdout);
+}
+
+void writeDouble(double value) {
+    char text[FORMAT_DOUBLE_MAX + 1];
+    fwrite(text, 1, formatDouble(value, text), stdout);
+}
@@ -0,0 +1,24 @@
+#ifndef _OUTPUT
+#define _OUTPUT
+
+#include <stdbool.h>
+
+// Standard output goes through a 64 KB buffer. It is written out when it
+// fills, when flushOutput is called, and at exit. If standard output is a
+// terminal, it is also written out at every newline.
+
+// Sets up the buffer. Must be called before anything is printed.
+void initOutput();
+
+// Writes out everything in the buffer.
+void flushOutput();
+
+// Print into the buffer: one character, a string, length characters of a
+// string, an integer, or a double as formatDouble writes it.
+void writeChar(char c);
+void writeString(const char *s);
+void writeText(const char *s, long length);
+void writeInteger(long value);
+void writeDouble(double value);
+
+#endif
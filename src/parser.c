@@ -2,9 +2,13 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "parser.h"
 #include "linkedlist.h"
 #include "tokenizer.h"
+#include "output.h"
+#include "talloc.h"
+#include "bignum.h"
 
 bool tokenInExpression(Value *currentToken, valueType closeType) {
     if (isNull(currentToken)) {
@@ -50,6 +54,17 @@ Value *parseExpression(Value **currentToken) {
         }
 
         return reverse(subtree);
+    } else if (currentType == OPEN_VECTOR_TYPE) {
+        // A vector literal: its elements are data, like a quoted list's
+        *currentToken = cdr(*currentToken);
+
+        Value *elements = makeNull();
+        while (tokenInExpression(*currentToken, CLOSE_TYPE)) {
+            elements = cons(parseExpression(currentToken), elements);
+            *currentToken = cdr(*currentToken);
+        }
+
+        return listToVector(reverse(elements));
     } else if (currentType == QUOTE_TYPE) {
         // Special case: quote syntax
         // Iterate the current token to whatever it's quoting
@@ -99,58 +114,224 @@ Value *parse(Value *tokens) {
     return reverse(stack);
 }
 
-void printValue(Value *val) {
-    if (isCons(val)) {
-        // This is a subtree expression.
-        printf("(");
-        printTree(val);
-        printf(")");
+//==================
+// Printing
+//==================
+
+// Whether printValue and printTree label shared structure
+static bool printGraph = false;
+
+// A list or vector being printed, innermost last on the stack
+typedef struct PrintFrame {
+    // The cell whose car was printed last, or the vector
+    Value *cell;
+    // For a vector, the index of the element printed last
+    long index;
+    // What to print after the list's last element: ')', or nothing for the
+    // top-level list of printTree
+    char close;
+    // Whether " . " has been printed, so the list ends after the next value
+    bool dotted;
+} PrintFrame;
+
+static PrintFrame *printStack = NULL;
+static int printStackCapacity = 0;
+
+// Returns the frame at depth, making the stack bigger if it isn't there yet.
+PrintFrame *printFrameAt(int depth) {
+    if (depth >= printStackCapacity) {
+        int capacity = printStackCapacity == 0 ? 64 : 2 * printStackCapacity;
+        PrintFrame *frames = talloc(sizeof(PrintFrame) * capacity);
+        for (int i = 0; i < printStackCapacity; i++) {
+            frames[i] = printStack[i];
+        }
+        printStack = frames;
+        printStackCapacity = capacity;
+    }
+    return &printStack[depth];
+}
+
+// A cons cell or vector found by findSharedCells, and its label
+typedef struct CellLabel {
+    Value *cell;
+    int label;
+} CellLabel;
+
+// Labels for cells that don't have a number yet
+#define SEEN_ONCE -2
+#define SHARED -1
+
+// Every cell and vector reachable from the value being printed, by address. The
+// capacity is a power of two, and at most half of it is used.
+static CellLabel *labelTable = NULL;
+static int labelCapacity = 0;
+static int labelCount = 0;
+static int nextLabel = 0;
+
+CellLabel *findCellLabel(Value *cell) {
+    unsigned long hash = ((unsigned long) cell >> 4) * 0x9E3779B97F4A7C15ul;
+    int index = (hash >> 32) & (labelCapacity - 1);
+    while (labelTable[index].cell != NULL && labelTable[index].cell != cell) {
+        index = (index + 1) & (labelCapacity - 1);
+    }
+    return &labelTable[index];
+}
+
+void growLabelTable() {
+    CellLabel *old = labelTable;
+    int oldCapacity = labelCapacity;
+    labelCapacity = oldCapacity == 0 ? 256 : 2 * oldCapacity;
+    labelTable = talloc(sizeof(CellLabel) * labelCapacity);
+    memset(labelTable, 0, sizeof(CellLabel) * labelCapacity);
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i].cell != NULL) {
+            *findCellLabel(old[i].cell) = old[i];
+        }
+    }
+}
+
+// Records a visit to cell. Returns true if it's the first.
+bool visitCell(Value *cell) {
+    if (2 * (labelCount + 1) > labelCapacity) {
+        growLabelTable();
+    }
+    CellLabel *entry = findCellLabel(cell);
+    if (entry->cell != NULL) {
+        entry->label = SHARED;
+        return false;
+    }
+    entry->cell = cell;
+    entry->label = SEEN_ONCE;
+    labelCount++;
+    return true;
+}
+
+/* Visits every cons cell and vector reachable from value, marking the ones
+ * reached more than once as SHARED: those in a cycle, and those in two
+ * places. It doesn't go past one it has seen, so it stops on cycles, and it
+ * keeps the cars and elements still to visit on the print stack rather than
+ * recursing.
+ */
+void findSharedCells(Value *value) {
+    if (labelCapacity > 0) {
+        memset(labelTable, 0, sizeof(CellLabel) * labelCapacity);
+    }
+    labelCount = 0;
+    nextLabel = 0;
+
+    int depth = 0;
+    printFrameAt(depth++)->cell = value;
+    while (depth > 0) {
+        Value *current = printStack[--depth].cell;
+        while (isCons(current) && visitCell(current)) {
+            if (isCons(car(current)) || isVector(car(current))) {
+                printFrameAt(depth++)->cell = car(current);
+            }
+            current = cdr(current);
+        }
+        if (isVector(current) && visitCell(current)) {
+            for (long i = 0; i < current->vector.length; i++) {
+                Value *item = current->vector.items[i];
+                if (isCons(item) || isVector(item)) {
+                    printFrameAt(depth++)->cell = item;
+                }
+            }
+        }
+    }
+}
+
+// Prints #n# and returns false if cell has been printed already. Otherwise
+// returns true, after printing #n= if cell is shared.
+bool openLabel(Value *cell) {
+    CellLabel *entry = findCellLabel(cell);
+    if (entry->label == SEEN_ONCE) {
+        return true;
+    }
+    writeChar('#');
+    if (entry->label >= 0) {
+        writeInteger(entry->label);
+        writeChar('#');
+        return false;
     }
+    entry->label = nextLabel++;
+    writeInteger(entry->label);
+    writeChar('=');
+    return true;
+}
+
+// Prints a value that isn't a cons cell.
+void printAtom(Value *val) {
     if (isInteger(val)) {
-        printf("%i", val->i);
+        writeInteger(val->i);
     }
     else if (isDouble(val)) {
-        printf("%f", val->d);
+        writeDouble(val->d);
+    }
+    else if (isBignum(val)) {
+        writeString(integerToString(val));
     }
     else if (isString(val)) {
-        printf("\"%s\"", val->s);
+        writeChar('"');
+        writeText(val->s, val->length);
+        writeChar('"');
     }
     else if (isSymbol(val)) {
-        printf("%s", val->s);
+        writeString(val->s);
     }
     else if (isType(val, OPEN_TYPE)) {
-        printf("THIS IS A MAJOR ERROR THERE SHOULD BE NO OPEN_TYPE\n");
+        writeString("THIS IS A MAJOR ERROR THERE SHOULD BE NO OPEN_TYPE\n");
     }
     else if (isType(val, CLOSE_TYPE)) {
-        printf("THIS IS A MAJOR ERROR THERE SHOULD BE NO CLOSE_TYPE\n");
+        writeString("THIS IS A MAJOR ERROR THERE SHOULD BE NO CLOSE_TYPE\n");
     }
     else if (isBoolean(val)) {
         if (val->i > 0) {
-            printf("#t");
+            writeString("#t");
         } else {
-            printf("#f");
+            writeString("#f");
         }
     }
     else if (isType(val, QUOTE_TYPE)) {
-        printf("%s", val->s);
+        writeString(val->s);
     }
     else if (isType(val, OPEN_BRACKET_TYPE)) {
-        printf("THIS IS A MAJOR ERROR THERE SHOULD BE NO OPEN_BRACKET_TYPE\n");
+        writeString("THIS IS A MAJOR ERROR THERE SHOULD BE NO OPEN_BRACKET_TYPE\n");
     }
     else if (isType(val, CLOSE_BRACKET_TYPE)) {
-        printf("THIS IS A MAJOR ERROR THERE SHOULD BE NO CLOSE_BRACKET_TYPE\n");
+        writeString("THIS IS A MAJOR ERROR THERE SHOULD BE NO CLOSE_BRACKET_TYPE\n");
     }
     else if (isType(val, DOT_TYPE)) {
-        printf("%s", val->s);
+        writeString(val->s);
     }
     else if (isNull(val)) {
-        printf("()");
+        writeString("()");
     }
     else if (isType(val, PRIMITIVE_TYPE)) {
-        printf("#<primitive>");
+        writeString("#<primitive>");
+    }
+    else if (isType(val, HASH_TABLE_TYPE)) {
+        writeString("#<hash-table>");
+    }
+    else if (isType(val, OUTPUT_STRING_TYPE)) {
+        writeString("#<output-string>");
+    }
+    else if (isType(val, F64VECTOR_TYPE) || isType(val, S64VECTOR_TYPE)) {
+        bool doubles = isType(val, F64VECTOR_TYPE);
+        writeString(doubles ? "#f64(" : "#s64(");
+        for (long i = 0; i < val->packed.length; i++) {
+            if (i > 0) {
+                writeChar(' ');
+            }
+            if (doubles) {
+                writeDouble(val->packed.doubles[i]);
+            } else {
+                writeInteger(val->packed.longs[i]);
+            }
+        }
+        writeChar(')');
     }
-    else if (isType(val, CLOSURE_TYPE)) {
-        printf("#<procedure>");
+    else if (isType(val, CLOSURE_TYPE) || isType(val, COMPILED_CLOSURE_TYPE)) {
+        writeString("#<procedure>");
 
         // Debugging:
         // printf("Param names: ");
@@ -163,30 +344,116 @@ void printValue(Value *val) {
     }
 }
 
-// Prints the tree to the screen in a readable fashion. It should look just like
-// Racket code; use parentheses to indicate subtrees.
-void printTree(Value *tree) {
-    assert(tree != NULL);
-
-    Value *current = tree;
-    while (!isNull(current)) {
-        printValue(car(current));
+/* Prints value; or, if inList, the elements of the list value without the
+ * parentheses around them.
+ *
+ * The lists and vectors still open are kept on printStack instead of the C
+ * stack, so data nested as deeply as memory allows can be printed. With
+ * labels, cells and vectors findSharedCells marked SHARED print as #n=(...)
+ * or #n=#(...) the first time and #n# after that; a shared cell in the
+ * middle of a list is printed after a dot, as the list's tail, so it can be
+ * labelled.
+ */
+void printData(Value *value, bool inList, bool labels) {
+    int depth = 0;
+    if (inList) {
+        if (isNull(value)) {
+            return;
+        }
+        PrintFrame *frame = printFrameAt(depth++);
+        frame->cell = value;
+        frame->close = '\0';
+        frame->dotted = false;
+        value = car(value);
+    }
 
-        // If the next element is null (the current subtree is done),
-        // don't print a space.
-        // Otherwise, the next element requires a space.
-        if (!isNull(cdr(current))) {
-            printf(" ");
+    while (true) {
+        // Print value, or open it and go on with its first element
+        if (isCons(value) && (!labels || openLabel(value))) {
+            writeChar('(');
+            PrintFrame *frame = printFrameAt(depth++);
+            frame->cell = value;
+            frame->close = ')';
+            frame->dotted = false;
+            value = car(value);
+            continue;
+        } else if (isVector(value) && (!labels || openLabel(value))) {
+            writeString("#(");
+            if (value->vector.length > 0) {
+                PrintFrame *frame = printFrameAt(depth++);
+                frame->cell = value;
+                frame->index = 0;
+                frame->close = ')';
+                frame->dotted = false;
+                value = value->vector.items[0];
+                continue;
+            }
+            writeChar(')');
+        } else if (!isCons(value) && !isVector(value)) {
+            printAtom(value);
         }
 
-        if (!isNull(cdr(current)) && !isCons(cdr(current))) {
-            printf(". ");
-            printValue(cdr(current));
-            break;
+        // Close the lists value ended, and find the next value to print
+        while (true) {
+            if (depth == 0) {
+                return;
+            }
+            PrintFrame *frame = &printStack[depth - 1];
+            if (isVector(frame->cell)) {
+                if (++frame->index < frame->cell->vector.length) {
+                    writeChar(' ');
+                    value = frame->cell->vector.items[frame->index];
+                    break;
+                }
+                writeChar(frame->close);
+                depth--;
+                continue;
+            }
+            Value *rest = cdr(frame->cell);
+            if (frame->dotted || isNull(rest)) {
+                if (frame->close != '\0') {
+                    writeChar(frame->close);
+                }
+                depth--;
+            } else if (isCons(rest)
+                       && (!labels || findCellLabel(rest)->label == SEEN_ONCE)) {
+                writeChar(' ');
+                frame->cell = rest;
+                value = car(rest);
+                break;
+            } else {
+                writeString(" . ");
+                frame->dotted = true;
+                value = rest;
+                break;
+            }
         }
+    }
+}
 
-        current = cdr(current);
+void setPrintGraph(bool enabled) {
+    printGraph = enabled;
+}
+
+bool isPrintGraphEnabled() {
+    return printGraph;
+}
+
+void printValue(Value *val) {
+    if (printGraph) {
+        findSharedCells(val);
+    }
+    printData(val, false, printGraph);
+}
+
+// Prints the tree to the screen in a readable fashion. It should look just like
+// Racket code; use parentheses to indicate subtrees.
+void printTree(Value *tree) {
+    assert(tree != NULL);
+    if (printGraph) {
+        findSharedCells(tree);
     }
+    printData(tree, true, printGraph);
 }
 
 void printTreeTest(Value *tree, int indent) {
@@ -208,7 +475,7 @@ void printTreeTest(Value *tree, int indent) {
             // printf(")\n");
         }
         if (isInteger(car(current))) {
-            printf("%i\n", car(current)->i);
+            printf("%li\n", car(current)->i);
         }
         else if (isDouble(car(current))) {
             printf("%f\n", car(current)->d);
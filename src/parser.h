@@ -16,5 +16,12 @@ void printTree(Value *tree);
 // Designed as a helper function to printTree, but can have uses on its own.
 void printValue(Value *val);
 
+// Turns datum labels on or off for printValue and printTree; they start
+// off. With labels, cons cells that appear more than once in what is
+// printed, including in a cycle, are printed as #0=(...) the first time and
+// #0# after that. Without, a cyclic list prints forever.
+void setPrintGraph(bool enabled);
+bool isPrintGraphEnabled();
+
 
 #endif
@@ -0,0 +1,155 @@
+// Strings and output strings.
+//
+// A string's text is never changed after it is made, which is what lets
+// substrings, symbol->string and the contents of an output string share
+// text instead of copying it. Joining strings measures them all first and
+// copies each once into text of the right size. An output string keeps its
+// text in an array that doubles when it fills, so writing n characters to
+// it a piece at a time copies O(n) characters in all; a grown array is a
+// new one, and the old one is left as it was for any string still sharing
+// it.
+
+#include "text.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "talloc.h"
+#include "bignum.h"
+#include "dtoa.h"
+
+// The room a new output string starts with
+#define MIN_OUTPUT_CAPACITY 64
+
+//==================
+// Strings
+//==================
+
+char *cString(Value *string) {
+    // The character after the text is the NUL unless the text is shared
+    // with a longer string, which has it somewhere further on
+    if (string->s[string->length] == '\0') {
+        return string->s;
+    }
+    char *text = talloc(string->length + 1);
+    memcpy(text, string->s, string->length);
+    text[string->length] = '\0';
+    return text;
+}
+
+Value *substring(Value *string, long start, long end) {
+    return makeSizedString(string->s + start, end - start);
+}
+
+Value *appendStrings(int count, Value **strings) {
+    long length = 0;
+    for (int i = 0; i < count; i++) {
+        length += strings[i]->length;
+    }
+    char *text = talloc(length + 1);
+    long position = 0;
+    for (int i = 0; i < count; i++) {
+        memcpy(text + position, strings[i]->s, strings[i]->length);
+        position += strings[i]->length;
+    }
+    text[length] = '\0';
+    return makeSizedString(text, length);
+}
+
+int compareStrings(Value *a, Value *b) {
+    long shorter = a->length < b->length ? a->length : b->length;
+    int order = memcmp(a->s, b->s, shorter);
+    if (order != 0) {
+        return order;
+    }
+    return a->length < b->length ? -1 : a->length > b->length;
+}
+
+//==================
+// Numbers
+//==================
+
+Value *numberToString(Value *number) {
+    if (isBignum(number)) {
+        return makeString(integerToString(number));
+    }
+    char *text = talloc(FORMAT_DOUBLE_MAX + 1);
+    if (isDouble(number)) {
+        formatDouble(number->d, text);
+    } else {
+        snprintf(text, FORMAT_DOUBLE_MAX + 1, "%li", number->i);
+    }
+    return makeString(text);
+}
+
+/* Reads a number the way the tokenizer does: an optional sign, then digits
+ * with at most one decimal point among them. With a point it's a double;
+ * without one it's an integer, which becomes a bignum if it doesn't fit in
+ * a long.
+ */
+Value *stringToNumber(Value *string) {
+    char *text = cString(string);
+    char *c = text;
+    if (*c == '+' || *c == '-') {
+        c++;
+    }
+    bool digits = false;
+    bool point = false;
+    for (; *c != '\0'; c++) {
+        if (isdigit(*c)) {
+            digits = true;
+        } else if (*c == '.' && !point) {
+            point = true;
+        } else {
+            return NULL;
+        }
+    }
+    if (!digits) {
+        return NULL;
+    } else if (point) {
+        return makeDouble(atof(text));
+    }
+    errno = 0;
+    long value = strtol(text, NULL, 10);
+    if (errno == ERANGE) {
+        // Too big for a long
+        return parseInteger(text);
+    }
+    return makeInt(value);
+}
+
+//==================
+// Output strings
+//==================
+
+Value *makeOutputString() {
+    Value *output = makeValue(OUTPUT_STRING_TYPE);
+    output->builder.text = talloc(MIN_OUTPUT_CAPACITY + 1);
+    output->builder.text[0] = '\0';
+    output->builder.length = 0;
+    output->builder.capacity = MIN_OUTPUT_CAPACITY;
+    return output;
+}
+
+void writeToOutputString(Value *output, Value *string) {
+    struct StringBuilder *builder = &output->builder;
+    long length = builder->length + string->length;
+    if (length > builder->capacity) {
+        long capacity = builder->capacity * 2;
+        if (capacity < length) {
+            capacity = length;
+        }
+        char *text = talloc(capacity + 1);
+        memcpy(text, builder->text, builder->length);
+        builder->text = text;
+        builder->capacity = capacity;
+    }
+    memcpy(builder->text + builder->length, string->s, string->length);
+    builder->text[length] = '\0';
+    builder->length = length;
+}
+
+Value *outputStringContents(Value *output) {
+    return makeSizedString(output->builder.text, output->builder.length);
+}
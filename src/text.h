@@ -0,0 +1,48 @@
+#ifndef _TEXT
+#define _TEXT
+
+#include <stdbool.h>
+#include "value.h"
+
+// Strings are STR_TYPE Values holding their text and its length. Nothing
+// changes a string's text once it is made, so strings share text rather
+// than copy it: a substring points into the text of the string it was taken
+// from, and symbol->string at the symbol's name. Text shared like that
+// doesn't always end in a NUL, so code that reads a string goes by its
+// length, or asks cString for a NUL-terminated copy.
+
+// Returns a string's text followed by a NUL, copying it only if it has to.
+char *cString(Value *string);
+
+// Create a new STR_TYPE Value of the characters of string from index start
+// up to end, sharing its text.
+Value *substring(Value *string, long start, long end);
+
+// Create a new STR_TYPE Value of count strings joined together.
+Value *appendStrings(int count, Value **strings);
+
+// Returns a negative number, zero, or a positive number as a's text comes
+// before, is the same as, or comes after b's, byte by byte.
+int compareStrings(Value *a, Value *b);
+
+// Create a new STR_TYPE Value of a number, written as it would be printed.
+Value *numberToString(Value *number);
+
+// Reads a number written the way the reader takes them. Returns NULL if the
+// string isn't one.
+Value *stringToNumber(Value *string);
+
+// Output strings are OUTPUT_STRING_TYPE Values that text is written to, a
+// piece at a time, in an array that doubles as it fills.
+
+// Create a new, empty OUTPUT_STRING_TYPE Value.
+Value *makeOutputString();
+
+// Adds a string's text to the end of an output string.
+void writeToOutputString(Value *output, Value *string);
+
+// Create a new STR_TYPE Value of everything written to an output string so
+// far. It shares the output string's text, which later writes only add to.
+Value *outputStringContents(Value *output);
+
+#endif
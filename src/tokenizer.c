@@ -1,16 +1,35 @@
 #include "tokenizer.h"
+#include "bignum.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <assert.h>
 #include <stdbool.h>
 
-void catLetter(char *str, char letter) {
-    int strLength = strlen(str);
-    str[strLength] = letter;
-    str[strLength +1] = '\0';
-    assert(strLength+1 ==  strlen(str) && "catLetter produces wrong length string");
+// The token being read: the length of its text, and the room for it. Tokens
+// can be as long as memory allows.
+static int tokenLength = 0;
+static int tokenCapacity = 0;
+
+// Starts the text of a token that will have letters added to it.
+void startToken(Value *token, char *text) {
+    tokenLength = strlen(text);
+    tokenCapacity = tokenLength + 1 > 255 ? tokenLength + 1 : 255;
+    token->s = talloc(tokenCapacity * sizeof(char));
+    strcpy(token->s, text);
+}
+
+void catLetter(Value *token, char letter) {
+    if (tokenLength + 2 > tokenCapacity) {
+        tokenCapacity *= 2;
+        char *text = talloc(tokenCapacity * sizeof(char));
+        memcpy(text, token->s, tokenLength);
+        token->s = text;
+    }
+    token->s[tokenLength++] = letter;
+    token->s[tokenLength] = '\0';
 }
 
 bool isSymbolInitial(char c) {
@@ -68,11 +87,23 @@ bool isSymbolSubsequent(char c) {
 Value *endToken(Value *tokens) {
     char *tokenString = car(tokens)->s;
     if (isInteger(car(tokens))) {
-        car(tokens)->i = atoi(tokenString);
+        errno = 0;
+        car(tokens)->i = strtol(tokenString, NULL, 10);
+        if (errno == ERANGE) {
+            // Too big for a long
+            car(tokens)->type = BIGNUM_TYPE;
+            car(tokens)->big = parseInteger(tokenString)->big;
+        }
     }
     else if (isDouble(car(tokens))) {
         car(tokens)->d = atof(tokenString);
     }
+    else if (isString(car(tokens))) {
+        car(tokens)->length = tokenLength;
+    }
+    else if (isSymbol(car(tokens))) {
+        car(tokens)->s = internSymbolName(tokenString);
+    }
     else if (isBoolean(car(tokens))) {
         if (!strcmp(tokenString, "#t")) {
             car(tokens)->i = true;
@@ -94,7 +125,16 @@ Value *endToken(Value *tokens) {
 }
 
 Value *parseParens(char charRead, Value *tokens) {
-    if (charRead == '(') {
+    if (charRead == '(' && isBoolean(car(tokens))
+        && !strcmp(car(tokens)->s, "#")) {
+        // #( opens a vector literal
+        car(tokens)->type = OPEN_VECTOR_TYPE;
+        car(tokens)->s = talloc(3 * sizeof(char));
+        strcpy(car(tokens)->s, "#(");
+
+        // End the current token
+        tokens = endToken(tokens);
+    } else if (charRead == '(') {
         if (!isNull(car(tokens))) {
             tokens = endToken(tokens);
         }
@@ -143,23 +183,23 @@ Value *parseNumber(char charRead, Value *tokens) {
     if (tokenType == INT_TYPE) {
         if (charRead == '.') {
             car(tokens)->type = DOUBLE_TYPE;
-            catLetter(car(tokens)->s, charRead);
+            catLetter(car(tokens), charRead);
         } else if (isdigit(charRead)) {
-            catLetter(car(tokens)->s, charRead);
+            catLetter(car(tokens), charRead);
         } else {
             printf("Syntax error.\n");
-            catLetter(car(tokens)->s, charRead);
+            catLetter(car(tokens), charRead);
             printf("Unparseable number: %s\n", car(tokens)->s);
             texit(1);
         }
     }
     else if (tokenType == DOUBLE_TYPE) {
         if (isdigit(charRead)) {
-            catLetter(car(tokens)->s, charRead);
+            catLetter(car(tokens), charRead);
         }
         else {
             printf("Syntax error.\n");
-            catLetter(car(tokens)->s, charRead);
+            catLetter(car(tokens), charRead);
             printf("Unparseable number: %s\n", car(tokens)->s);
             texit(1);
         }
@@ -173,21 +213,21 @@ Value *parseSymbol(char charRead, Value *tokens) {
         // These cases create numbers, not symbols
         if (isdigit(charRead)) {
             car(tokens)->type = INT_TYPE;
-            catLetter(car(tokens)->s, charRead);
+            catLetter(car(tokens), charRead);
         } else if (charRead == '.') {
             car(tokens)->type = DOUBLE_TYPE;
-            catLetter(car(tokens)->s, charRead);
+            catLetter(car(tokens), charRead);
         } else {
             printf("Syntax error: invalid symbol.\n");
-            catLetter(car(tokens)->s, charRead);
+            catLetter(car(tokens), charRead);
             printf("Entered: %s\n", car(tokens)->s);
             texit(1);
         }
     } else if (isSymbolSubsequent(charRead)) {
-        catLetter(car(tokens)->s, charRead);
+        catLetter(car(tokens), charRead);
     } else {
         printf("Syntax error: invalid symbol.\n");
-        catLetter(car(tokens)->s, charRead);
+        catLetter(car(tokens), charRead);
         printf("Entered: %s\n", car(tokens)->s);
         texit(1);
     }
@@ -200,14 +240,14 @@ Value *parseBool(char charRead, Value *tokens) {
     // start with '#'), and can't handle a first character.
     if (!strcmp(car(tokens)->s, "#")) {
         if (charRead == 't' || charRead == 'f') {
-            catLetter(car(tokens)->s, charRead);
+            catLetter(car(tokens), charRead);
         } else {
             printf("Syntax error. Invalid character in Boolean declaration at char:\n");
             printf("%c\n", charRead);
             texit(1);
         }
     } else {
-        catLetter(car(tokens)->s, charRead);
+        catLetter(car(tokens), charRead);
         printf("Syntax error. Invalid Boolean declaration: %s at char: ", car(tokens)->s);
         printf("%c\n", charRead);
         texit(1);
@@ -218,10 +258,10 @@ Value *parseBool(char charRead, Value *tokens) {
 Value *parseDot(char charRead, Value *tokens) {
     if (isdigit(charRead)) {
         car(tokens)->type = DOUBLE_TYPE;
-        catLetter(car(tokens)->s, charRead);
+        catLetter(car(tokens), charRead);
     } else {
         printf("Syntax error: dot must be on its own or in number.\n");
-        catLetter(car(tokens)->s, charRead);
+        catLetter(car(tokens), charRead);
         printf("At token: %s\n", car(tokens)->s);
         texit(1);
     }
@@ -231,26 +271,22 @@ Value *parseDot(char charRead, Value *tokens) {
 Value *parseFirstChar(char charRead, Value *tokens) {
     if (isdigit(charRead)) {
         car(tokens)->type = INT_TYPE;
-        car(tokens)->s = talloc(255*sizeof(char));
-        strcpy(car(tokens)->s, "");
-        catLetter(car(tokens)->s, charRead);
+        startToken(car(tokens), "");
+        catLetter(car(tokens), charRead);
     }
     // Change for Bonus?
     else if (charRead == '.') {
         car(tokens)->type = DOT_TYPE;
-        car(tokens)->s = talloc(255*sizeof(char));
-        strcpy(car(tokens)->s, ".");
+        startToken(car(tokens), ".");
     }
     else if (charRead == '#') {
         car(tokens)->type = BOOL_TYPE;
-        car(tokens)->s = talloc(255*sizeof(char));
-        strcpy(car(tokens)->s, "#");
+        startToken(car(tokens), "#");
     }
     else if (isSymbolInitial(charRead) || charRead == '+' || charRead == '-') {
         car(tokens)->type = SYMBOL_TYPE;
-        car(tokens)->s = talloc(255*sizeof(char));
-        strcpy(car(tokens)->s, "");
-        catLetter(car(tokens)->s, charRead);
+        startToken(car(tokens), "");
+        catLetter(car(tokens), charRead);
     } else if (!isspace(charRead)) {
         printf("Syntax error: invalid character %c\n", charRead);
         texit(1);
@@ -290,7 +326,7 @@ Value *tokenize(FILE *fp) {
                 tokens = endToken(tokens);
             }
             else {
-                catLetter(car(tokens)->s, charRead);
+                catLetter(car(tokens), charRead);
             }
         }
 
@@ -306,8 +342,7 @@ Value *tokenize(FILE *fp) {
                 tokens = endToken(tokens);
             }
             car(tokens)->type = STR_TYPE;
-            car(tokens)->s = talloc(255*sizeof(char));
-            strcpy(car(tokens)->s, "");
+            startToken(car(tokens), "");
         }
 
         // Beginning of token
@@ -373,7 +408,7 @@ void displayTokens(Value *list) {
     Value *current = list;
     while (!isNull(current)) {
         if (isInteger(car(current))) {
-            printf("%i:integer\n", car(current)->i);
+            printf("%li:integer\n", car(current)->i);
         }
         else if (isDouble(car(current))) {
             printf("%f:decimal\n", car(current)->d);
@@ -390,6 +425,9 @@ void displayTokens(Value *list) {
         else if (isType(car(current), CLOSE_TYPE)) {
             printf("%s:close\n", car(current)->s);
         }
+        else if (isType(car(current), OPEN_VECTOR_TYPE)) {
+            printf("%s:openvector\n", car(current)->s);
+        }
         else if (isBoolean(car(current))) {
             if (car(current)->i > 0) {
                 printf("#t:bool\n");
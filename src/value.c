@@ -1,9 +1,12 @@
 #include "value.h"
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <limits.h>
 #include "linkedlist.h"
 #include "talloc.h"
+#include "hashtable.h"
 
 // Allocates a Value struct, sets its type, and initializes it as unmarked.
 Value *makeValue(valueType type) {
@@ -32,7 +35,7 @@ Value *makeBool(bool val) {
     return result;
 }
 
-Value *makeInt(int val) {
+Value *makeInt(long val) {
     Value *result = makeValue(INT_TYPE);
     (*result).i = val;
     return result;
@@ -45,14 +48,55 @@ Value *makeDouble(double val) {
 }
 
 Value *makeString(char *val) {
+    return makeSizedString(val, strlen(val));
+}
+
+Value *makeSizedString(char *text, long length) {
     Value *result = makeValue(STR_TYPE);
-    (*result).s = val;
+    result->s = text;
+    result->length = length;
     return result;
 }
 
+// Every symbol name seen so far, each a symbol mapped to itself
+static Value *symbolNames = NULL;
+
+char *internSymbolName(char *name) {
+    if (symbolNames == NULL) {
+        symbolNames = makeHashTable(true);
+    }
+    Value key;
+    key.type = SYMBOL_TYPE;
+    key.s = name;
+    Value *interned = hashTableRef(symbolNames, &key);
+    if (interned == NULL) {
+        interned = makeValue(SYMBOL_TYPE);
+        interned->s = name;
+        hashTableSet(symbolNames, interned, interned);
+    }
+    return interned->s;
+}
+
 Value *makeSymbol(char *val) {
     Value *result = makeValue(SYMBOL_TYPE);
-    (*result).s = val;
+    (*result).s = internSymbolName(val);
+    return result;
+}
+
+Value *makeVector(long length, Value *fill) {
+    if (length > LONG_MAX / (long) sizeof(Value *)) {
+        return NULL;
+    }
+    Value **items = talloc(sizeof(Value *) * (length > 0 ? length : 1));
+    if (items == NULL) {
+        return NULL;
+    }
+    Value *result = makeValue(VECTOR_TYPE);
+    result->vector.items = items;
+    result->vector.length = length;
+    for (long i = 0; i < length; i++) {
+        result->vector.items[i] = fill;
+    }
     return result;
 }
 
@@ -83,10 +127,10 @@ bool isProperList(Value *value) {
 }
 
 // Check that the value is a numeric type.
-// Currently implemented are integer and float types.
+// Currently implemented are integer, bignum and float types.
 bool isNumber(Value *value) {
     assert(value != NULL);
-    return (isInteger(value) || isDouble(value));
+    return (isInteger(value) || isDouble(value) || isBignum(value));
 }
 
 // Check that the value is an integer.
@@ -95,12 +139,23 @@ bool isInteger(Value *value) {
     return value->type == INT_TYPE;
 }
 
+// Check that the value is an integer that doesn't fit in a long.
+bool isBignum(Value *value) {
+    assert(value != NULL);
+    return value->type == BIGNUM_TYPE;
+}
+
 // Check that the value is a double (float).
 bool isDouble(Value *value) {
     assert(value != NULL);
     return value->type == DOUBLE_TYPE;
 }
 
+bool isVector(Value *value) {
+    assert(value != NULL);
+    return value->type == VECTOR_TYPE;
+}
+
 // Check that the value is a boolean.
 bool isBoolean(Value *value) {
     assert(value != NULL);
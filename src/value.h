@@ -2,35 +2,94 @@
 #define _VALUE
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {INT_TYPE,DOUBLE_TYPE,STR_TYPE,CONS_TYPE,NULL_TYPE,PTR_TYPE,
               OPEN_TYPE,CLOSE_TYPE,BOOL_TYPE,SYMBOL_TYPE,
               DOT_TYPE, OPEN_BRACKET_TYPE, CLOSE_BRACKET_TYPE, QUOTE_TYPE,
-              VOID_TYPE, CLOSURE_TYPE, PRIMITIVE_TYPE, UNINITIALIZED} valueType;
+              VOID_TYPE, CLOSURE_TYPE, PRIMITIVE_TYPE, UNINITIALIZED,
+              COMPILED_CLOSURE_TYPE, BIGNUM_TYPE, VECTOR_TYPE,
+              OPEN_VECTOR_TYPE, HASH_TABLE_TYPE, F64VECTOR_TYPE,
+              S64VECTOR_TYPE, OUTPUT_STRING_TYPE} valueType;
 
 struct Value {
     valueType type;
     bool marked;
     union {
-        int i;
+        long i;
         double d;
-        char *s;
+        // An integer too big for i: its magnitude, in 64-bit limbs, least
+        // significant first and with no leading zero limbs, and its sign
+        struct Bignum {
+            uint64_t *limbs;
+            int length;
+            bool negative;
+        } big;
+        // A vector's elements, in one array
+        struct Vector {
+            struct Value **items;
+            long length;
+        } vector;
+        // An f64vector's or s64vector's elements, unboxed, in one array
+        struct PackedVector {
+            union {
+                double *doubles;
+                long *longs;
+            };
+            long length;
+        } packed;
+        // A hash table; only hashtable.c knows what's in it
+        struct HashTable *table;
+        // The text of a string, symbol or token. A string also has its
+        // length, and its text may be shared with another string and not
+        // end in a NUL (see text.h).
+        struct {
+            char *s;
+            long length;
+        };
+        // An output string: the text written to it so far, in an array
+        // with room for capacity characters and a NUL
+        struct StringBuilder {
+            char *text;
+            long length;
+            long capacity;
+        } builder;
         void *p;
         struct ConsCell {
             struct Value *car;
             struct Value *cdr;
+            // What the evaluator has worked out about this cell as code, so
+            // it doesn't have to again. NULL until then.
+            void *cache;
         } c;
         struct Closure {
             struct Value *paramNames;
             struct Value *functionCode;
             struct Frame *frame;
+            // Call count and machine code, for the JIT. NULL until the
+            // closure is first called.
+            struct JitState *jit;
         } cl;
-		struct Value *(*pf)(struct Value *);
+        // A closure made by one of the compiling engines. Only the engine
+        // that made it knows what its code and environment are.
+        struct CompiledClosure {
+            void *code;
+            void *env;
+        } cc;
+		// A primitive: its C function, which takes argc evaluated arguments
+		// in the array argv, and its entry in the table of primitives
+		struct {
+			struct Value *(*pf)(int argc, struct Value **argv);
+			const struct PrimitiveDescriptor *descriptor;
+		};
     };
 };
 
 typedef struct Value Value;
 
+// The C function behind a primitive.
+typedef Value *(*PrimitiveFunction)(int argc, Value **argv);
+
 // Allocates a Value struct, sets its type, and initializes it as unmarked.
 Value *makeValue(valueType type);
 
@@ -41,7 +100,7 @@ Value *makeNull();
 Value *makeVoid();
 
 // Create a new INT_TYPE Value.
-Value *makeInt(int val);
+Value *makeInt(long val);
 
 // Create a new DOUBLE_TYPE Value.
 Value *makeDouble(double val);
@@ -49,12 +108,23 @@ Value *makeDouble(double val);
 // Create a new BOOL_TYPE Value.
 Value *makeBool(bool val);
 
-// Create a new STR_TYPE Value.
+// Create a new STR_TYPE Value from NUL-terminated text.
 Value *makeString(char * val);
 
+// Create a new STR_TYPE Value of the length characters at text.
+Value *makeSizedString(char *text, long length);
+
 // Create a new SYMBOL_TYPE Value.
 Value *makeSymbol(char *val);
 
+// Returns the one copy of a symbol's name that every symbol with that name
+// shares, so that symbols can be told apart by comparing name pointers.
+char *internSymbolName(char *name);
+
+// Create a new VECTOR_TYPE Value of length elements, each of them fill.
+// Returns NULL if there isn't memory for that many.
+Value *makeVector(long length, Value *fill);
+
 // Note that there is not a makeCons() function. This is intentional, since the
 // cons() function should be used instead. It is both easier and ensures that
 // cons cells are Scheme-valid, with values in both car and cdr.
@@ -67,15 +137,21 @@ bool isCons(Value *value);
 bool isProperList(Value *value);
 
 // Check that the value is a numeric type.
-// Currently implemented are integer and float types.
+// Currently implemented are integer, bignum and float types.
 bool isNumber(Value *value);
 
-// Check that the value is an integer.
+// Check that the value is an integer that fits in a long.
 bool isInteger(Value *value);
 
+// Check that the value is an integer that doesn't fit in a long.
+bool isBignum(Value *value);
+
 // Check that the value is a double (float).
 bool isDouble(Value *value);
 
+// Check that the value is a vector.
+bool isVector(Value *value);
+
 // Check that the value is a boolean.
 bool isBoolean(Value *value);
 
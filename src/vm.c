@@ -0,0 +1,303 @@
+// Bytecode virtual machine.
+//
+// Runs the CodeObjects made by the compiler in bytecode.c. Instructions are
+// dispatched with computed goto: each handler jumps straight to the next
+// one's label through a table, instead of going back around a switch.
+//
+// Calls don't recurse in C. The caller's position is saved in a CallRecord on
+// a stack in the heap, like the continuation stack of the CEK machine, so
+// recursion depth is only limited by memory.
+
+#include "bytecode.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <assert.h>
+#include "linkedlist.h"
+#include "parser.h"
+#include "talloc.h"
+
+#define INITIAL_STACK_CAPACITY 256
+#define INITIAL_CALL_CAPACITY 64
+
+// The frame of one call: the parameters and let-bound variables of a lambda.
+typedef struct VMEnv {
+    struct VMEnv *parent;
+    Value *slots[];
+} VMEnv;
+
+// Where to continue after a call returns.
+typedef struct {
+    CodeObject *codeObject;
+    int pc;
+    VMEnv *env;
+} CallRecord;
+
+VMEnv *makeVMEnv(int numSlots, VMEnv *parent) {
+    VMEnv *env = talloc(sizeof(VMEnv) + numSlots * sizeof(Value *));
+    env->parent = parent;
+    return env;
+}
+
+/* Makes the frame for a call to a compiled closure.
+ *
+ * args: the evaluated arguments, in order.
+ * Stops with the same error as apply() if the arity is wrong.
+ */
+VMEnv *bindVMArguments(Value *function, Value **args, int numArgs) {
+    CodeObject *callee = function->cc.code;
+    VMEnv *env = makeVMEnv(callee->numSlots, function->cc.env);
+
+    if (callee->numParams < 0) {
+        // (lambda x ...) gets all of its arguments in one list
+        env->slots[0] = makeArgumentList(args, numArgs);
+    } else {
+        checkApplyArity(callee->numParams, numArgs);
+        for (int i = 0; i < numArgs; i++) {
+            env->slots[i] = args[i];
+        }
+    }
+    return env;
+}
+
+Value *runBytecode(CodeObject *codeObject, Frame *global) {
+    // Must be in the same order as the opcode enum
+    static void *dispatchTable[] = {
+        &&CONST_LABEL, &&VOID_LABEL, &&TRUE_LABEL, &&FALSE_LABEL,
+        &&LOCAL_REF_LABEL, &&LOCAL_SET_LABEL, &&GLOBAL_REF_LABEL,
+        &&GLOBAL_SET_LABEL, &&GLOBAL_DEFINE_LABEL, &&EVAL_ATOM_LABEL,
+        &&POP_LABEL, &&JUMP_LABEL, &&JUMP_IF_FALSE_LABEL,
+        &&MAKE_CLOSURE_LABEL, &&CALL_LABEL, &&TAIL_CALL_LABEL,
+        &&RETURN_LABEL, &&DISPLAY_LABEL, &&LOAD_LABEL, &&CHECK_BOUND_LABEL
+    };
+
+    int stackCapacity = INITIAL_STACK_CAPACITY + codeObject->maxStack;
+    Value **stack = talloc(stackCapacity * sizeof(Value *));
+    int sp = 0;
+
+    int callCapacity = INITIAL_CALL_CAPACITY;
+    CallRecord *calls = talloc(callCapacity * sizeof(CallRecord));
+    int callDepth = 0;
+
+    VMEnv *env = makeVMEnv(codeObject->numSlots, NULL);
+    int *code = codeObject->code;
+    Value **constants = codeObject->constants;
+    int pc = 0;
+
+    // Registers used by the call instructions
+    Value *function;
+    Value *result;
+    int numArgs;
+
+#define DISPATCH() goto *dispatchTable[code[pc++]]
+
+    DISPATCH();
+
+CONST_LABEL:
+    stack[sp++] = constants[code[pc++]];
+    DISPATCH();
+
+VOID_LABEL:
+    stack[sp++] = makeVoid();
+    DISPATCH();
+
+TRUE_LABEL:
+    stack[sp++] = makeBool(true);
+    DISPATCH();
+
+FALSE_LABEL:
+    stack[sp++] = makeBool(false);
+    DISPATCH();
+
+LOCAL_REF_LABEL: {
+    VMEnv *frame = env;
+    for (int depth = code[pc++]; depth > 0; depth--) {
+        frame = frame->parent;
+    }
+    stack[sp++] = frame->slots[code[pc++]];
+    DISPATCH();
+}
+
+LOCAL_SET_LABEL: {
+    VMEnv *frame = env;
+    for (int depth = code[pc++]; depth > 0; depth--) {
+        frame = frame->parent;
+    }
+    frame->slots[code[pc++]] = stack[--sp];
+    DISPATCH();
+}
+
+GLOBAL_REF_LABEL: {
+    int index = code[pc++];
+    Value *cell = codeObject->globalCells[index];
+    if (cell == NULL) {
+        // Stops with an error if it isn't defined yet
+        cell = lookUpSymbol(constants[index], global);
+        codeObject->globalCells[index] = cell;
+    }
+    stack[sp++] = car(cell);
+    DISPATCH();
+}
+
+GLOBAL_SET_LABEL: {
+    int index = code[pc++];
+    Value *cell = codeObject->globalCells[index];
+    if (cell == NULL) {
+        cell = lookUpSymbol(constants[index], global);
+        codeObject->globalCells[index] = cell;
+    }
+    cell->c.car = stack[--sp];
+    DISPATCH();
+}
+
+GLOBAL_DEFINE_LABEL:
+    // An existing binding keeps its cell, so cached cells stay valid
+    defineGlobal(constants[code[pc++]], stack[--sp], global);
+    DISPATCH();
+
+EVAL_ATOM_LABEL:
+    stack[sp++] = evalAtom(constants[code[pc++]], global);
+    DISPATCH();
+
+POP_LABEL:
+    sp--;
+    DISPATCH();
+
+JUMP_LABEL:
+    pc = code[pc];
+    DISPATCH();
+
+JUMP_IF_FALSE_LABEL:
+    if (isTrue(stack[--sp])) {
+        pc++;
+    } else {
+        pc = code[pc];
+    }
+    DISPATCH();
+
+MAKE_CLOSURE_LABEL: {
+    Value *closure = makeValue(COMPILED_CLOSURE_TYPE);
+    closure->cc.code = constants[code[pc++]]->p;
+    closure->cc.env = env;
+    stack[sp++] = closure;
+    DISPATCH();
+}
+
+CALL_LABEL:
+    numArgs = code[pc++];
+    function = stack[sp - numArgs - 1];
+    if (isType(function, PRIMITIVE_TYPE)) {
+        result = callPrimitive(function, numArgs, &stack[sp - numArgs]);
+        sp -= numArgs + 1;
+        stack[sp++] = result;
+        DISPATCH();
+    }
+    if (!isType(function, COMPILED_CLOSURE_TYPE)) {
+        // Fails the same way apply() does
+        makeApplyFrame(function, &stack[sp - numArgs], numArgs);
+    }
+
+    // Save where to come back to
+    if (callDepth == callCapacity) {
+        CallRecord *newCalls = talloc(2 * callCapacity * sizeof(CallRecord));
+        memcpy(newCalls, calls, callDepth * sizeof(CallRecord));
+        calls = newCalls;
+        callCapacity *= 2;
+    }
+    calls[callDepth].codeObject = codeObject;
+    calls[callDepth].pc = pc;
+    calls[callDepth].env = env;
+    callDepth++;
+    goto enterFunction;
+
+TAIL_CALL_LABEL:
+    numArgs = code[pc++];
+    function = stack[sp - numArgs - 1];
+    if (isType(function, PRIMITIVE_TYPE)) {
+        result = callPrimitive(function, numArgs, &stack[sp - numArgs]);
+        sp -= numArgs + 1;
+        goto returnResult;
+    }
+    if (!isType(function, COMPILED_CLOSURE_TYPE)) {
+        makeApplyFrame(function, &stack[sp - numArgs], numArgs);
+    }
+    // Nothing to save: the callee returns straight to our caller
+
+enterFunction:
+    env = bindVMArguments(function, &stack[sp - numArgs], numArgs);
+    sp -= numArgs + 1;
+    codeObject = function->cc.code;
+    code = codeObject->code;
+    constants = codeObject->constants;
+    pc = 0;
+
+    if (sp + codeObject->maxStack > stackCapacity) {
+        int newCapacity = 2 * stackCapacity + codeObject->maxStack;
+        Value **newStack = talloc(newCapacity * sizeof(Value *));
+        memcpy(newStack, stack, sp * sizeof(Value *));
+        stack = newStack;
+        stackCapacity = newCapacity;
+    }
+    DISPATCH();
+
+RETURN_LABEL:
+    result = stack[--sp];
+
+returnResult:
+    if (callDepth == 0) {
+        return result;
+    }
+    callDepth--;
+    codeObject = calls[callDepth].codeObject;
+    code = codeObject->code;
+    constants = codeObject->constants;
+    pc = calls[callDepth].pc;
+    env = calls[callDepth].env;
+    stack[sp++] = result;
+    DISPATCH();
+
+DISPLAY_LABEL:
+    printValue(stack[sp - 1]);
+    stack[sp - 1] = makeValue(VOID_TYPE);
+    DISPATCH();
+
+LOAD_LABEL: {
+    Value *args = constants[code[pc++]];
+    Value *tree = loadFile(args, stack[sp - 1]);
+
+    // Run each expression in the file as if it were top-level
+    result = makeVoid();
+    Value *current = tree;
+    while (!isNull(current)) {
+        result = runBytecode(compileTopLevel(current), global);
+        current = cdr(current);
+    }
+    stack[sp - 1] = result;
+    DISPATCH();
+}
+
+CHECK_BOUND_LABEL:
+    if (stack[sp - 1]->type == UNINITIALIZED) {
+        uninitializedVariable(constants[code[pc]]);
+    }
+    pc++;
+    DISPATCH();
+
+#undef DISPATCH
+}
+
+void interpretBytecode(Value *tree) {
+    Frame *global = makeGlobalFrame();
+
+    Value *current = tree;
+    while (!isNull(current)) {
+        // Compile each expression just before running it, so that syntax
+        // errors come after the output of the expressions before them
+        CodeObject *codeObject = compileTopLevel(current);
+        Value *result = runBytecode(codeObject, global);
+        printResult(result);
+        current = cdr(current);
+    }
+    printf("\n");
+}
@@ -2,6 +2,7 @@
 import os
 import re
 import subprocess
+import sys
 import filecmp
 import pprint
 
@@ -15,6 +16,13 @@ if "No bugs found." not in clangresult.stdout.decode():
     print("Clang static analyzer thinks it found a bug.")
     print(clangresult.stdout.decode())
 
+# Any arguments are passed on to the interpreter, to select an engine.
+# For example: ./runtests.py --cek
+# With --emit-c, each test is instead compiled to a standalone executable
+# (make test-in-NN.bin), and that is run and checked against the same output.
+interpreterFlags = sys.argv[1:]
+emitC = '--emit-c' in interpreterFlags
+
 allTestsPass = True
 for filename in sorted(os.listdir()):
     if filename.endswith('.rkt') and filename.startswith('test-in-'):
@@ -23,9 +31,28 @@ for filename in sorted(os.listdir()):
         expectedOutput = 'test-out-'+m.group(1)+'.txt'
         sourcefile = open(filename)
 
+        # A test whose first line is like ";; engines: --cek --bytecode" needs
+        # an engine that keeps its stack in the heap, so it only runs with one
+        # of those flags.
+        engines = re.match(';; engines:(.*)', sourcefile.readline())
+        if engines and not set(engines.group(1).split()) & set(interpreterFlags):
+            print("Input:",filename,"Skipped for this engine")
+            sourcefile.close()
+            continue
+
         # Check for correct output
-        result = subprocess.run('./valgrind.sh',stdin=open(filename),
-                                stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        if emitC:
+            binary = 'test-in-'+m.group(1)+'.bin'
+            subprocess.run(['make', '-C', '..', 'tests/'+binary])
+            result = subprocess.run(['valgrind', '--leak-check=full',
+                                     '--show-leak-kinds=all', './'+binary],
+                                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+            for generated in [binary, 'test-in-'+m.group(1)+'.c']:
+                if os.path.exists(generated):
+                    os.remove(generated)
+        else:
+            result = subprocess.run(['./valgrind.sh'] + interpreterFlags,stdin=open(filename),
+                                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
         output = result.stdout
         valgrind_output = result.stderr.decode('utf-8')
 
@@ -1,3 +1,3 @@
 #!/bin/bash
 
-exec valgrind --leak-check=full --show-leak-kinds=all ../interpreter
+exec valgrind --leak-check=full --show-leak-kinds=all ../interpreter "$@"